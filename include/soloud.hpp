@@ -41,20 +41,34 @@ namespace SoLoud
 // Maximum number of filters per stream
 static constexpr size_t FILTERS_PER_STREAM = 8;
 
+// Maximum number of aux sends per stream
+static constexpr size_t SENDS_PER_STREAM = 4;
+
 // Number of samples to process on one go
 static constexpr size_t SAMPLE_GRANULARITY = 512;
 
-// Maximum number of concurrent voices (hard limit is 4095)
+// Level below which a block of samples counts as silent (-100 dB)
+static constexpr float SILENCE_THRESHOLD = 1.0e-5f;
+
+// Maximum number of concurrent voices (handles allow up to 2^32 - 1). Virtual voices count too,
+// since they keep their slot. Per-voice state is in fixed arrays of this size, and the active
+// voice selection and 3d update walk them, so raising it makes every engine pay.
 static constexpr size_t VOICE_COUNT = 1024;
 
 // 1)mono, 2)stereo 4)quad 6)5.1 8)7.1
 static constexpr size_t MAX_CHANNELS = 8;
 
+// Channels of an ambisonic bus of the highest supported (third) order
+static constexpr size_t AMBISONIC_CHANNELS = 16;
+
+// Maximum number of listeners mixed at once, see Engine::setListenerCount
+static constexpr size_t MAX_LISTENERS = 8;
+
 class Engine;
 typedef void (*mutexCallFunction)(void* aMutexPtr);
 typedef void (*soloudCallFunction)(Engine* engine);
 typedef bool (*soloudResultFunction)(Engine* engine);
-typedef size_t handle;
+typedef uint64_t handle;
 typedef double time_t;
 
 enum class Waveform
@@ -89,6 +103,19 @@ enum class AttenuationModel
     ExponentialDistance = 3
 };
 
+// Which voice to stop when a sound starts and all voices, or all of its category's voices, are
+// busy. Among the voices it may stop, the lowest priority ones always go first. Oldest is a
+// lookup; Quietest and Farthest score every voice of the lowest priority.
+enum class VoiceStealPolicy
+{
+    // Stop the voice that started first
+    Oldest,
+    // Stop the voice with the lowest overall volume
+    Quietest,
+    // Stop the voice farthest from the listener; non-3d voices count as at the listener
+    Farthest
+};
+
 // Default resampler for both main and bus mixers
 static constexpr auto default_resampler = Resampler::Linear;
 }; // namespace SoLoud
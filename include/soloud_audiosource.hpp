@@ -28,7 +28,11 @@ freely, subject to the following restrictions:
 #include "soloud_filter.hpp"
 #include "soloud_vec3.hpp"
 #include <array>
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
+#include <vector>
 
 namespace SoLoud
 {
@@ -47,6 +51,41 @@ class AudioCollider
                           int                        aUserData) = 0;
 };
 
+// 3d voice whose occlusion is asked from an AudioOccluder
+struct OcclusionQuery
+{
+    // Voice to pass back in the OcclusionResult
+    handle mHandle = 0;
+
+    // World space position
+    vec3 mPosition;
+
+    // User data related to audio collider
+    int mUserData = 0;
+};
+
+// Occlusion of a 3d voice, see Engine::set3dOcclusion
+struct OcclusionResult
+{
+    handle mHandle = 0;
+
+    // 0 for a clear path to the listener, 1 for a fully occluded one
+    float mOcclusion = 0.0f;
+};
+
+class AudioOccluder
+{
+  public:
+    virtual ~AudioOccluder() noexcept = default;
+
+    // Called by Engine::update3dAudio with the 3d voices in range that aren't listener-relative.
+    // The results may be passed to Engine::set3dOcclusion right away, or later from any thread;
+    // voices keep their last result until then.
+    virtual void occlude(Engine*                         aEngine,
+                         const vec3&                     aListener,
+                         std::span<const OcclusionQuery> aQueries) = 0;
+};
+
 class AudioAttenuator
 {
   public:
@@ -77,8 +116,124 @@ struct AudioSourceInstanceFlagsData
     bool InaudibleKill : 1 = false;
     // If inaudible, should still be ticked (default = pause)
     bool InaudibleTick : 1 = false;
+    // If inaudible or out of active voices, only advance the play position (ticking wins)
+    bool InaudibleVirtual : 1 = false;
+    // Currently virtual; seeks to its play position when it becomes audible again
+    bool Virtual : 1 = false;
     // Don't auto-stop sound
     bool DisableAutostop : 1 = false;
+    // Bus that receives sends from other voices; mixed after the other voices of its bus
+    bool SendReturn : 1 = false;
+    // Rendered through the HRTF instead of panned, see EngineFlags::Hrtf
+    bool Binaural : 1 = false;
+    // Encoded into the ambisonic bus instead of panned, see Engine::setAmbisonicOrder
+    bool Ambisonic : 1 = false;
+    // Low-pass filtered by its occlusion, see Engine::set3dOcclusionResponse
+    bool OcclusionFilter : 1 = false;
+};
+
+// Aux send from a voice to a return bus
+struct AudioSend
+{
+    // Handle of the bus the send feeds. 0 if the send is unused.
+    handle mBusHandle = 0;
+
+    // Send level
+    float mLevel = 1.0f;
+
+    // Tap the signal before the voice volume is applied, so the send ignores volume changes and
+    // fades. Panning still applies.
+    bool mPreFader = false;
+};
+
+// Mixer state of an aux send
+struct AudioSendState
+{
+    // Current channel volumes, used to ramp the send level changes
+    std::array<float, MAX_CHANNELS> mCurrentVolume{};
+
+    // Write position in the return bus' send buffer
+    size_t mCursor = 0;
+
+    // Whether mCursor is placed in the return bus' send buffer yet
+    bool mSynced = false;
+};
+
+// Directions of the HRTF grid a binaural voice is rendered through, with their weights
+struct HrtfPosition
+{
+    std::array<uint32_t, 4> mEntry{};
+    std::array<float, 4>    mWeight{};
+};
+
+// Mixer state of a binaural voice
+struct HrtfVoiceState
+{
+    // Position set by the 3d update
+    HrtfPosition mTarget;
+
+    // Convolve with a kernel interpolated for this voice, instead of sharing the nearest grid
+    // direction with other voices. Set for the loudest voices, see Engine::setHrtfVoiceBudget.
+    bool mDirect = false;
+
+    // Whether the fields below hold anything yet
+    bool mSynced = false;
+
+    // How the last block was rendered
+    bool     mWasDirect = false;
+    uint32_t mEntry     = 0;
+
+    // Kernels and delays of the last direct block, left then right, and the input history
+    std::vector<float>   mKernel;
+    std::array<float, 2> mDelay{};
+    std::vector<float>   mHistory;
+};
+
+// Mixer state of a voice encoded into the ambisonic bus
+struct AmbisonicVoiceState
+{
+    // Encoding gains set by the 3d update
+    std::array<float, AMBISONIC_CHANNELS> mTarget{};
+
+    // Gains the last block was encoded with, volume included
+    std::array<float, AMBISONIC_CHANNELS> mGain{};
+
+    // Whether mGain holds anything yet
+    bool mSynced = false;
+};
+
+// Mixer state of the occlusion low-pass
+struct OcclusionVoiceState
+{
+    // Filter coefficient set by the 3d update; 1 lets everything through
+    float mTarget = 1.0f;
+
+    // Coefficient of the last block
+    float mCoefficient = 1.0f;
+
+    // Last output sample per channel
+    std::array<float, MAX_CHANNELS> mState{};
+};
+
+// Mixer state of the propagation delay line
+struct PropagationVoiceState
+{
+    // Recent samples of the voice, mLength per channel; empty without propagation delay
+    std::vector<float> mRing;
+    size_t             mLength = 0;
+    size_t             mWrite  = 0;
+
+    // Delay set by the 3d update, and the delay the last block ended with, in samples
+    float mTarget = 0.0f;
+    float mDelay  = 0.0f;
+    bool  mSynced = false;
+
+    // Delay the voice started with; the doppler factor scales the change of the delay from it
+    float mOrigin        = 0.0f;
+    float mDopplerFactor = 1.0f;
+
+    // Silent samples written since the last audible block, up to mLength
+    size_t mSilence = 0;
 };
 
 class AudioSourceInstance3dData
@@ -118,6 +273,9 @@ class AudioSourceInstance3dData
     // User data related to audio collider
     int mColliderData = 0;
 
+    // Collider volume at the last 3d update; every listener hears the voice through it
+    float mColliderVolume = 1.0f;
+
     // Doppler sample rate multiplier
     float mDopplerValue = 0.0f;
 
@@ -127,11 +285,35 @@ class AudioSourceInstance3dData
     // Channel volume
     std::array<float, MAX_CHANNELS> mChannelVolume{};
 
+    // Direction of the sound in listener space (x left, y up, z forward)
+    vec3 mDirection;
+
+    // Direction of the sound relative to the listener, in world space
+    vec3 mWorldDirection;
+
+    // Ambisonic encoding gains of the world space direction (ACN order, SN3D normalization)
+    std::array<float, AMBISONIC_CHANNELS> mAmbisonicGain{};
+
     // Copy of flags
     AudioSourceInstanceFlagsData mFlags;
 
     // Latest handle for this voice
     handle mHandle = 0;
+
+    // Beyond the culling distance at the last 3d update
+    bool mCulled = false;
+
+    // Latest occlusion passed to Engine::set3dOcclusion
+    float mOcclusionTarget = 0.0f;
+
+    // Occlusion smoothed towards mOcclusionTarget
+    float mOcclusion = 0.0f;
+
+    // Whether an occlusion result has been passed yet
+    bool mOcclusionSynced = false;
+
+    // Travel time of the sound to the listener, in seconds
+    float mPropagationDelay = 0.0f;
 };
 
 // Base class for audio instances
@@ -142,12 +324,16 @@ class AudioSourceInstance
 
     virtual ~AudioSourceInstance() noexcept = default;
 
-    // Play index; used to identify instances from handles
+    // Play index; orders the instances by age
     size_t mPlayIndex = 0;
 
     // Loop count
     size_t mLoopCount = 0;
 
+    // Priority and category, see AudioSource::priority and AudioSource::category
+    int    mPriority = 0;
+    size_t mCategory = 0;
+
     AudioSourceInstanceFlagsData mFlags;
 
     // Pan value, for getPan()
@@ -208,17 +394,41 @@ class AudioSourceInstance
     size_t mAudioSourceID = 0;
 
     // Handle of the bus this audio instance is playing on. 0 for root.
-    size_t mBusHandle = ~0u;
+    handle mBusHandle = ~0u;
 
     // Filter pointer
     std::array<std::shared_ptr<FilterInstance>, FILTERS_PER_STREAM> mFilter{};
 
+    // Aux sends
+    std::array<AudioSend, SENDS_PER_STREAM> mSend{};
+
+    // Mixer state of the aux sends
+    std::array<AudioSendState, SENDS_PER_STREAM> mSendState{};
+
+    // Mixer state of binaural rendering
+    HrtfVoiceState mHrtf;
+
+    // Mixer state of ambisonic encoding
+    AmbisonicVoiceState mAmbisonic;
+
+    // Mixer state of the occlusion low-pass
+    OcclusionVoiceState mOcclusion;
+
+    // Mixer state of the propagation delay line
+    PropagationVoiceState mPropagation;
+
     // Initialize instance. Mostly internal use.
-    void init(AudioSource& aSource, int aPlayIndex);
+    void init(AudioSource& aSource, size_t aPlayIndex);
 
     // Pointers to buffers for the resampler
     std::array<float*, 2> mResampleData{};
 
+    // Whether the resampler buffers hold silence
+    std::array<bool, 2> mResampleSilent{};
+
+    // Number of source samples the input to the filters has been silent for
+    size_t mSilentSamples = 0;
+
     // Sub-sample playhead; 16.16 fixed point
     size_t mSrcOffset = 0;
 
@@ -243,6 +453,9 @@ class AudioSourceInstance
     // Rewind stream. Base implementation returns NOT_IMPLEMENTED, meaning it can't rewind.
     virtual bool rewind();
 
+    // Length of the stream in seconds, if known. Lets virtual voices loop and end on time.
+    virtual std::optional<time_t> getLength();
+
     // Get information. Returns 0 by default.
     virtual float getInfo(size_t aInfoKey);
 };
@@ -263,6 +476,9 @@ class AudioSource
     // Set filter. Set to nullptr to clear the filter.
     virtual void setFilter(size_t aFilterId, Filter* aFilter);
 
+    // Set default aux send for new instances. Pass 0 as the bus handle to clear the send.
+    void setSend(size_t aSendId, handle aBusHandle, float aLevel = 1.0f, bool aPreFader = false);
+
     // Stop all instances of this audio source
     void stop();
 
@@ -284,12 +500,24 @@ class AudioSource
     // Delay start of sound by the distance from listener
     bool distance_delay : 1 = false;
 
+    // Delay 3d instances by their travel time to the listener through a delay line, which also
+    // gives them their doppler shift instead of a changing sample rate. Includes distance_delay.
+    // The doppler factor scales how far the delay moves from the one the voice started with, so
+    // a factor of 0 keeps the starting delay. See Engine::set3dMaxPropagationDelay.
+    bool propagation_delay : 1 = false;
+
     // If inaudible, should be killed (default)
     bool inaudible_kill : 1 = false;
 
     // If inaudible, should still be ticked (default = pause)
     bool inaudible_tick : 1 = false;
 
+    // If inaudible, only track the play position, and resume there when audible again
+    bool inaudible_virtual : 1 = false;
+
+    // Low-pass filter instances by their occlusion, see Engine::set3dOcclusionResponse
+    bool occlusion_filter : 1 = false;
+
     // Disable auto-stop
     bool disable_autostop : 1 = false;
 
@@ -299,6 +527,13 @@ class AudioSource
     // Default volume for created instances
     float volume = 1.0f;
 
+    // Priority of created instances. When voices run out, instances never stop ones of higher
+    // priority to start, and higher priority instances are mixed first.
+    int priority = 0;
+
+    // Category of created instances, see Engine::setCategoryVoiceLimit
+    size_t category = 0;
+
     // Number of channels this audio source produces
     size_t channel_count = 1;
 
@@ -323,6 +558,9 @@ class AudioSource
     // Filter pointer
     std::array<Filter*, FILTERS_PER_STREAM> filter{};
 
+    // Default aux sends
+    std::array<AudioSend, SENDS_PER_STREAM> sends{};
+
     // Pointer to the Soloud object. Needed to stop all instances in dtor.
     Engine* engine = nullptr;
 
@@ -31,12 +31,17 @@ freely, subject to the following restrictions:
 namespace SoLoud
 {
 class Bus;
-class DuckFilterInstance;
+
+// Level of the last mixed block of a bus, published for sidechain filters
+struct SidechainLevel
+{
+    float mPeak = 0.0f;
+    float mRms  = 0.0f;
+};
 
 class BusInstance final : public AudioSourceInstance
 {
     friend Bus;
-    friend DuckFilterInstance;
 
   public:
     explicit BusInstance(Bus* aParent);
@@ -47,11 +52,36 @@ class BusInstance final : public AudioSourceInstance
 
     ~BusInstance() noexcept override;
 
+    // Allocate the send buffer so voices can send to this bus. Mostly internal use.
+    void enableSendReturn_internal(size_t aMaxSamples);
+
+    // Accumulate a planar block of send signal into the send buffer. Mostly internal use.
+    void addSend_internal(const float*    aSource,
+                          size_t          aStride,
+                          size_t          aSamples,
+                          AudioSendState& aState);
+
+    // Level of the last mixed block. Mostly internal use.
+    const SidechainLevel& getSidechainLevel_internal() const
+    {
+        return mSidechainLevel;
+    }
+
   private:
     Bus*               mParent;
     size_t             mScratchSize;
     AlignedFloatBuffer mScratch;
 
+    // Ring buffer for incoming sends, mSendCapacity samples per channel
+    AlignedFloatBuffer mSendBuffer;
+    size_t             mSendCapacity = 0;
+
+    // Total number of send samples read so far
+    size_t mSendReadPos = 0;
+
+    // Measured on every block, whether visualization is enabled or not
+    SidechainLevel mSidechainLevel;
+
     // Approximate volume for channels.
     std::array<float, MAX_CHANNELS> mVisualizationChannelVolume{};
 
@@ -109,6 +139,10 @@ class Bus final : public AudioSource
     // before use.
     float getApproximateVolume(size_t aChannel);
 
+    // Get the peak and RMS level of the last block mixed by the bus, over all its channels. The
+    // level is measured on every block; visualization doesn't need to be enabled.
+    SidechainLevel getSidechainLevel();
+
     // Get number of immediate child voices to this bus
     size_t getActiveVoiceCount();
 
@@ -123,7 +157,7 @@ class Bus final : public AudioSource
     void findBusHandle();
 
     std::shared_ptr<BusInstance> mInstance;
-    size_t                       mChannelHandle = 0;
+    handle                       mChannelHandle = 0;
     Resampler                    mResampler     = default_resampler;
 
     // FFT output data
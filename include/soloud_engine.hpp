@@ -4,6 +4,8 @@
 #include "soloud_audiosource.hpp"
 #include "soloud_misc.hpp"
 #include "soloud_vec3.hpp"
+#include <atomic>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <span>
@@ -13,13 +15,93 @@ namespace SoLoud
 {
 class AudioSource;
 class AudioSourceInstance;
+class Ambisonics;
 class Filter;
+class Hrtf;
+class Limiter;
+class SpatialGrid;
+class StealCandidates;
+class VoiceGroup;
+class VoiceGroups;
+class VoiceSnapshots;
+struct SpatialListenerMix;
 
 struct EngineFlags
 {
     bool ClipRoundoff : 1        = true;
     bool EnableVisualization : 1 = false;
     bool NoFpuRegisterChange : 1 = false;
+    // Run a lookahead limiter on the master bus instead of the soft clipper
+    bool Limiter : 1 = false;
+    // Render 3d voices on the master bus through an HRTF, for headphones. Stereo output only.
+    bool Hrtf : 1 = false;
+};
+
+// Master bus limiter settings, see EngineFlags::Limiter.
+struct LimiterSettings
+{
+    // Level above which gain is reduced, as linear amplitude.
+    float mThreshold = 1.0f;
+    // Compression ratio above the threshold; infinite for a brickwall limiter.
+    float mRatio = std::numeric_limits<float>::infinity();
+    // Attack time in seconds, clamped to [0, 1]. This is also the lookahead, and thus the added
+    // output latency.
+    float mAttack = 0.005f;
+    // Release time in seconds.
+    float mRelease = 0.1f;
+    // Also catch peaks between samples, estimated by cubic interpolation.
+    bool mTruePeak = false;
+};
+
+// Sample formats the output stage can write to directly
+enum class SampleFormat
+{
+    Float32,
+    Signed16,
+    // Packed 3-byte little-endian samples
+    Signed24,
+    Signed32,
+};
+
+// Destination of a single output channel. Consecutive frames are mStep bytes apart.
+struct ChannelArea
+{
+    void*  mAddress = nullptr;
+    size_t mStep    = 0;
+};
+
+// One voice to start with Engine::playBatch
+struct PlayRequest
+{
+    AudioSource* mSound = nullptr;
+
+    // Negative volume means to use default
+    float  mVolume = -1.0f;
+    float  mPan    = 0.0f;
+    bool   mPaused = false;
+    handle mBus    = 0;
+
+    // Start as a 3d voice at mPosition, like play3d. mPan is ignored.
+    bool m3d = false;
+    vec3 mPosition;
+    vec3 mVelocity;
+};
+
+// State of a voice, as of the last mixed block or the last change made through the engine
+struct VoiceInfo
+{
+    // 0 if the voice has stopped
+    handle mHandle = 0;
+
+    time_t mStreamTime        = 0;
+    time_t mStreamPosition    = 0;
+    float  mVolume            = 0.0f;
+    float  mOverallVolume     = 0.0f;
+    float  mPan               = 0.0f;
+    float  mRelativePlaySpeed = 1.0f;
+    size_t mLoopCount         = 0;
+    bool   mPaused            = false;
+    bool   mVirtual           = false;
 };
 
 // Soloud core class.
@@ -66,26 +148,27 @@ class Engine
     vec3 getSpeakerPosition(size_t aChannel) const;
 
     // Start playing a sound. Returns voice handle, which can be ignored or used to alter the
-    // playing sound's parameters. Negative volume means to use default.
+    // playing sound's parameters, or 0 if no voice could be freed for it. Negative volume means
+    // to use default.
     handle play(AudioSource& aSound,
                 float        aVolume = -1.0f,
                 float        aPan    = 0.0f,
                 bool         aPaused = 0,
-                size_t       aBus    = 0);
+                handle       aBus    = 0);
     // Start playing a sound delayed in relation to other sounds called via this function. Negative
     // volume means to use default.
     handle playClocked(time_t       aSoundTime,
                        AudioSource& aSound,
                        float        aVolume = -1.0f,
                        float        aPan    = 0.0f,
-                       size_t       aBus    = 0);
+                       handle       aBus    = 0);
     // Start playing a 3d audio source
     handle play3d(AudioSource& aSound,
                   vec3         aPos,
                   vec3         aVel    = {},
                   float        aVolume = 1.0f,
                   bool         aPaused = 0,
-                  size_t       aBus    = 0);
+                  handle       aBus    = 0);
     // Start playing a 3d audio source, delayed in relation to other sounds called via this
     // function.
     handle play3dClocked(time_t       aSoundTime,
@@ -93,12 +176,15 @@ class Engine
                          vec3         aPos,
                          vec3         aVel    = {},
                          float        aVolume = 1.0f,
-                         size_t       aBus    = 0);
+                         handle       aBus    = 0);
     // Start playing a sound without any panning. It will be played at full volume.
     handle playBackground(AudioSource& aSound,
                           float        aVolume = -1.0f,
                           bool         aPaused = 0,
-                          size_t       aBus    = 0);
+                          handle       aBus    = 0);
+    // Start playing many sounds at once, writing a handle per request to aHandles (0 if no voice
+    // could be found). The instances are created before the audio mutex is locked, once.
+    void playBatch(std::span<const PlayRequest> aRequests, std::span<handle> aHandles);
 
     // Seek the audio stream to certain point in time. Some streams can't seek backwards. Relative
     // play speed affects time.
@@ -132,6 +218,22 @@ class Engine
                                   float  aTo,
                                   time_t aTime);
 
+    // Send a voice to a return bus, so effects on that bus run once for all voices sending to it.
+    // Pass 0 as the bus handle to clear the send.
+    void setSend(handle aVoiceHandle,
+                 size_t aSendId,
+                 handle aBusHandle,
+                 float  aLevel    = 1.0f,
+                 bool   aPreFader = false);
+    // Set the level of a send.
+    void setSendLevel(handle aVoiceHandle, size_t aSendId, float aLevel);
+    // Get the level of a send. Returns 0 if the send is unused.
+    float getSendLevel(handle aVoiceHandle, size_t aSendId);
+
+    // The voice getters from here to isVoiceVirtual and getLoopCount don't lock the audio mutex;
+    // they read the state published at the end of each mixed block and by every change made
+    // through the engine.
+
     // Get current play time, in seconds.
     time_t getStreamTime(handle aVoiceHandle);
     // Get current sample position, in seconds.
@@ -148,16 +250,24 @@ class Engine
     float getSamplerate(handle aVoiceHandle);
     // Get current voice protection state.
     bool getProtectVoice(handle aVoiceHandle);
-    // Get the current number of busy voices.
+    // Get the number of busy voices at the last mixed block.
     size_t getActiveVoiceCount();
     // Get the current number of voices in SoLoud
     size_t getVoiceCount();
     // Check if the handle is still valid, or if the sound has stopped.
     bool isValidVoiceHandle(handle aVoiceHandle);
+    // Query whether a voice is virtual: not mixed, only tracking its play position
+    bool isVoiceVirtual(handle aVoiceHandle);
+    // Get the state of many voices at once. Stopped voices get an info with a 0 handle.
+    void queryVoices(std::span<const handle> aVoiceHandles, std::span<VoiceInfo> aInfo);
     // Get current relative play speed.
     float getRelativePlaySpeed(handle aVoiceHandle);
     // Get current post-clip scaler value.
     float getPostClipScaler() const;
+    // Get current master bus limiter settings.
+    LimiterSettings getLimiterSettings() const;
+    // Get the highest gain reduction the limiter applied in the last mixed block, in decibels.
+    float getLimiterGainReduction();
     // Get the current main resampler
     Resampler getMainResampler() const;
     // Get current global volume
@@ -170,6 +280,12 @@ class Engine
     bool getAutoStop(handle aVoiceHandle);
     // Get voice loop point value
     time_t getLoopPoint(handle aVoiceHandle);
+    // Get voice priority
+    int getPriority(handle aVoiceHandle);
+    // Get the voice stealing policy
+    VoiceStealPolicy getVoiceStealPolicy() const;
+    // Get the voice limit of a category; 0 if unlimited
+    size_t getCategoryVoiceLimit(size_t aCategory) const;
 
     // Set voice loop point value
     void setLoopPoint(handle aVoiceHandle, time_t aLoopPoint);
@@ -181,10 +297,16 @@ class Engine
     void setMaxActiveVoiceCount(size_t aVoiceCount);
     // Set behavior for inaudible sounds
     void setInaudibleBehavior(handle aVoiceHandle, bool aMustTick, bool aKill);
+    // Make a voice virtual while it is inaudible or out of active voices: it is neither decoded
+    // nor resampled, and seeks to its play position with a short fade-in when mixed again.
+    // Virtual voices still hold a voice slot, so at most VOICE_COUNT voices exist at once.
+    void setInaudibleVirtual(handle aVoiceHandle, bool aVirtual);
     // Set the global volume
     void setGlobalVolume(float aVolume);
     // Set the post clip scaler value
     void setPostClipScaler(float aScaler);
+    // Set master bus limiter settings. Only used if the engine was created with the limiter flag.
+    void setLimiterSettings(const LimiterSettings& aSettings);
     // Set the main resampler
     void setMainResampler(Resampler aResampler);
     // Set the pause state
@@ -195,6 +317,14 @@ class Engine
     void setRelativePlaySpeed(handle aVoiceHandle, float aSpeed);
     // Set the voice protection state
     void setProtectVoice(handle aVoiceHandle, bool aProtect);
+    // Set voice priority, see AudioSource::priority
+    void setPriority(handle aVoiceHandle, int aPriority);
+    // Set the voice stealing policy
+    void setVoiceStealPolicy(VoiceStealPolicy aPolicy);
+    // Limit how many voices of a category play at once; 0 for no limit (default). A sound that
+    // starts in a full category stops one of its category's voices, picked like any stolen voice,
+    // or doesn't start if all of them have a higher priority or are protected.
+    void setCategoryVoiceLimit(size_t aCategory, size_t aMaxVoices);
     // Set the sample rate
     void setSamplerate(handle aVoiceHandle, float aSamplerate);
     // Set panning value; -1 is left, 0 is center, 1 is right
@@ -205,6 +335,10 @@ class Engine
     void setChannelVolume(handle aVoiceHandle, size_t aChannel, float aVolume);
     // Set overall volume
     void setVolume(handle aVoiceHandle, float aVolume);
+    // Set the volumes of many voices, locking the audio mutex once
+    void setVolumes(std::span<const handle> aVoiceHandles, std::span<const float> aVolumes);
+    // Set the panning of many voices, locking the audio mutex once
+    void setPans(std::span<const handle> aVoiceHandles, std::span<const float> aPans);
     // Set delay, in samples, before starting to play samples. Calling this on a live sound will
     // cause glitches.
     void setDelaySamples(handle aVoiceHandle, size_t aSamples);
@@ -255,12 +389,14 @@ class Engine
     // Get audiosource-specific information from a voice.
     float getInfo(handle aVoiceHandle, size_t aInfoKey);
 
-    // Create a voice group. Returns 0 if unable (out of voice groups / out of memory)
+    // Create a voice group.
     handle createVoiceGroup();
     // Destroy a voice group.
     void destroyVoiceGroup(handle aVoiceGroupHandle);
     // Add a voice handle to a voice group
     void addVoiceToGroup(handle aVoiceGroupHandle, handle aVoiceHandle);
+    // Remove a voice handle from a voice group. Stopped voices leave their groups by themselves.
+    void removeVoiceFromGroup(handle aVoiceGroupHandle, handle aVoiceHandle);
     // Is this handle a valid voice group?
     bool isVoiceGroup(handle aVoiceGroupHandle);
     // Is this voice group empty?
@@ -273,6 +409,45 @@ class Engine
     void set3dSoundSpeed(float aSpeed);
     // Get the current speed of sound constant for doppler
     float get3dSoundSpeed() const;
+    // Set the longest travel time the delay lines of voices started from now on can hold, see
+    // AudioSource::propagation_delay. Longer delays are cut to it. Default = 1 second.
+    void set3dMaxPropagationDelay(time_t aSeconds);
+    // Get the longest travel time of propagation delay lines
+    time_t get3dMaxPropagationDelay() const;
+    // Cull 3d voices farther than aDistance from the listener: the 3d update skips them, and they
+    // go virtual until they are back in range. 0 turns culling off (the default).
+    void set3dCullingDistance(float aDistance);
+    // Get the 3d culling distance
+    float get3dCullingDistance() const;
+    // Set the object asked for the occlusion of the 3d voices at each 3d update. nullptr (the
+    // default) leaves the voices unoccluded.
+    void set3dOccluder(AudioOccluder* aOccluder);
+    // Pass occlusion results, usually in response to AudioOccluder::occlude. Can be called from any
+    // thread; results of stopped voices are ignored.
+    void set3dOcclusion(std::span<const OcclusionResult> aResults);
+    // Set how occlusion sounds: the volume of a fully occluded voice, the low-pass cutoff for it
+    // (voices from sources with occlusion_filter; 0 disables the filter), and the time occlusion
+    // changes are smoothed over.
+    void set3dOcclusionResponse(float aVolume, float aCutoff, time_t aSmoothing);
+    // Replace the built-in HRTF. Only used if the engine was created with the HRTF flag.
+    //
+    // The table is little endian: "SLHR", version (u32, 1), sample rate (u32), taps (u32) and
+    // ring count (u32), then per ring its elevation in degrees (f32, ascending) and azimuth count
+    // (u32). Then per direction, ring by ring and azimuth by azimuth (evenly spaced, starting
+    // straight ahead and turning left): left and right onset delays in samples (f32), and left and
+    // right impulse responses (taps f32 each). Throws std::runtime_error if the data is malformed.
+    void setHrtfTable(std::span<const std::byte> aData);
+    // Set how many of the loudest binaural voices get their own interpolated HRTF; the rest
+    // share the nearest directions of the table. Default 32.
+    void setHrtfVoiceBudget(size_t aVoices);
+    // Get the number of binaural voices with their own interpolated HRTF
+    size_t getHrtfVoiceBudget() const;
+    // Encode 3d voices on the master bus into an ambisonic bus of the given order (1 to 3) instead
+    // of panning them. The bus is decoded once per block to the speaker positions, or binaurally
+    // if the engine was created with the HRTF flag. 0 turns it off.
+    void setAmbisonicOrder(size_t aOrder);
+    // Get the order of the ambisonic bus; 0 if it is off
+    size_t getAmbisonicOrder() const;
     // Set 3d listener parameters
     void set3dListenerParameters(vec3 pos, vec3 at, vec3 up, vec3 velocity = {});
     // Set 3d listener position
@@ -283,6 +458,15 @@ class Engine
     void set3dListenerUp(vec3 value);
     // Set 3d listener velocity
     void set3dListenerVelocity(vec3 value);
+    // Set the number of listeners (1 to MAX_LISTENERS). The functions above set listener 0. Every
+    // listener hears all voices, but each voice is decoded, resampled and filtered only once;
+    // only its volumes and panning differ per listener. Doppler, occlusion, ambisonics and the
+    // HRTF follow listener 0; the others are panned. See mixListeners.
+    void setListenerCount(size_t aCount);
+    // Get the number of listeners
+    size_t getListenerCount() const;
+    // Set the 3d parameters of a listener
+    void set3dListenerParameters(size_t aListener, vec3 pos, vec3 at, vec3 up, vec3 velocity = {});
 
     // Set 3d audio source parameters
     void set3dSourceParameters(handle aVoiceHandle, vec3 aPos, vec3 aVelocity = {});
@@ -291,6 +475,11 @@ class Engine
     void set3dSourcePosition(handle aVoiceHandle, vec3 pos);
     // Set 3d audio source velocity
     void set3dSourceVelocity(handle aVoiceHandle, vec3 velocity);
+    // Set the 3d positions of many audio sources
+    void set3dSourcePositions(std::span<const handle> aVoiceHandles, std::span<const vec3> aPos);
+    // Set the 3d velocities of many audio sources
+    void set3dSourceVelocities(std::span<const handle> aVoiceHandles,
+                               std::span<const vec3>   aVelocities);
     // Set 3d audio source min/max distance (distance < min means max volume)
     void set3dSourceMinMaxDistance(handle aVoiceHandle, float aMinDistance, float aMaxDistance);
     // Set 3d audio source attenuation parameters
@@ -307,10 +496,22 @@ class Engine
     // Returns mixed 16-bit signed integer samples in buffer. Called by the back-end, or user with
     // null driver.
     void mixSigned16(short* aBuffer, size_t aSamples);
+    // Returns mixed interleaved samples of the given format in buffer.
+    void mixInterleaved(void* aBuffer, size_t aSamples, SampleFormat aFormat);
+    // Mixes straight into per-channel destinations, such as a device's mmap areas. One area is
+    // needed per backend channel.
+    void mixChannelAreas(std::span<const ChannelArea> aAreas, size_t aSamples, SampleFormat aFormat);
+    // Mixes interleaved float samples for each listener; one buffer is needed per listener.
+    // Listener 0 gets what mix would return. The others skip the global filters and the limiter.
+    void mixListeners(std::span<float* const> aBuffers, size_t aSamples);
 
   public:
-    // Mix N samples * M channels. Called by other mix_ functions.
-    void mix_internal(size_t aSamples, size_t aStride);
+    // Mix N samples * M channels and write them to the output areas.
+    void mix_internal(size_t                       aSamples,
+                      size_t                       aStride,
+                      std::span<const ChannelArea> aAreas,
+                      SampleFormat                 aFormat,
+                      std::span<float* const>      aListenerBuffers = {});
 
     // Handle rest of initialization (called from backend)
     void postinit_internal(size_t      aSamplerate,
@@ -322,21 +523,68 @@ class Engine
     void calcActiveVoices_internal();
     // Map resample buffers to active voices
     void mapResampleBuffers_internal();
+    // Make the virtual candidates left out of the active voices virtual, and resume the virtual
+    // voices that made it in
+    void updateVirtualVoices_internal(size_t aCandidates);
+    // Seek a virtual voice (not handle) to its play position, fading in over the next block
+    void resumeVirtualVoice_internal(size_t aVoice);
     // Perform mixing for a specific bus
     void mixBus_internal(float*    aBuffer,
                          size_t    aSamplesToRead,
                          size_t    aBufferSize,
                          float*    aScratch,
-                         size_t    aBus,
+                         handle    aBus,
                          float     aSamplerate,
                          size_t    aChannels,
                          Resampler aResampler);
-    // Find a free voice, stopping the oldest if no free voice is found.
-    int findFreeVoice_internal();
+    // Mix the resampled voice (not handle) in the scratch to the listeners besides listener 0
+    void mixListenerVoice_internal(size_t aVoice,
+                                   float* aScratch,
+                                   size_t aSamplesToRead,
+                                   size_t aBufferSize,
+                                   size_t aChannels,
+                                   bool   aSilent);
+    // Mix the resampled voice (not handle) in the scratch to the return busses it sends to.
+    // aChannels is the channel count of the bus the voice plays on.
+    void mixSends_internal(size_t aVoice,
+                           float* aScratch,
+                           size_t aSamplesToRead,
+                           size_t aBufferSize,
+                           size_t aChannels,
+                           bool   aSilent);
+    // Set voice (not handle) send, preparing the target bus to receive it.
+    void setVoiceSend_internal(size_t aVoice, size_t aSendId, const AudioSend& aSend);
+    // Find a free voice for a sound, stopping one if all voices or the sound's category are
+    // busy. Returns -1 if every voice it may stop is protected or of higher priority.
+    int findFreeVoice_internal(const AudioSource& aSound);
+    // Pick a voice for a sound of aPriority to stop, per the steal policy, optionally only
+    // among a category. Returns -1 if there's none.
+    int findVoiceToSteal_internal(int aPriority, std::optional<size_t> aCategory) const;
+    // Add a voice (not handle) to the steal candidates, or remove it
+    void setStealCandidate_internal(size_t aVoice, bool aCandidate);
+    // Create an instance of a sound to play, with its filters. Doesn't need the audio mutex.
+    // a3d also prepares it for 3d processing if the sound doesn't ask for it.
+    std::shared_ptr<AudioSourceInstance> createVoiceInstance_internal(AudioSource& aSound,
+                                                                      bool a3d = false);
+    // Start an instance in a free voice. Returns the voice, or -1 if none could be found.
+    int playInstance_internal(AudioSource&                         aSound,
+                              std::shared_ptr<AudioSourceInstance> aInstance,
+                              float                                aVolume,
+                              float                                aPan,
+                              bool                                 aPaused,
+                              handle                               aBus);
+    // Make a voice (not handle) that just started 3d, placing it
+    void init3dVoice_internal(size_t aVoice, handle aVoiceHandle, vec3 aPos, vec3 aVel);
+    // Apply the first 3d update of a voice (not handle) that just started, culling it if needed
+    void start3dVoice_internal(size_t aVoice);
     // Converts handle to voice, if the handle is valid. Returns -1 if not.
     int getVoiceFromHandle_internal(handle aVoiceHandle) const;
     // Converts voice + playindex into handle
     handle getHandleFromVoice_internal(size_t aVoice) const;
+    // Publish the state of a voice (not handle) for the getters
+    void publishVoice_internal(size_t aVoice);
+    // Read the published state of a voice; the first voice of a group for group handles
+    VoiceInfo readVoice_internal(handle aVoiceHandle);
     // Stop voice (not handle).
     void stopVoice_internal(size_t aVoice);
     // Set voice (not handle) pan.
@@ -353,18 +601,34 @@ class Engine
     void updateVoiceRelativePlaySpeed_internal(size_t aVoice);
     // Perform 3d audio calculation for array of voices
     void update3dVoices_internal(std::span<const size_t> voiceList);
-    // Clip the samples in the buffer
-
-    void clip_internal(const AlignedFloatBuffer& aBuffer,
-                       const AlignedFloatBuffer& aDestBuffer,
-                       size_t                    aSamples,
-                       float                     aVolume0,
-                       float                     aVolume1);
-    // Remove all non-active voices from group
-    void trimVoiceGroup_internal(handle aVoiceGroupHandle);
-
-    // Get pointer to the zero-terminated array of voice handles in a voice group
-    handle* voiceGroupHandleToArray_internal(handle aVoiceGroupHandle) const;
+    // Copy the 3d panning, binaural position or ambisonic gains of a voice (not handle), and its
+    // volumes for the other listeners, to the mixer
+    void apply3dVoice_internal(size_t aVoice);
+    // Overall volume of a 3d voice (not handle) for the listener that hears it best
+    float loudest3dVolume_internal(size_t aVoice) const;
+    // Whether a 3d position is within the culling distance of any listener
+    bool in3dCullingRange_internal(vec3 aPos, bool aListenerRelative) const;
+    // Take a voice (not handle) beyond the culling distance out of the mix
+    void cull3dVoice_internal(size_t aVoice);
+    // Ask the occluder about the voices (not handles), and smooth their occlusion towards the
+    // latest results
+    void occlude3dVoices_internal(std::span<const size_t> aVoices);
+    // Apply global volume and clipping to a mix in place, then convert and write the result to
+    // the output areas.
+    void output_internal(float*                       aSource,
+                         std::span<const ChannelArea> aAreas,
+                         size_t                       aSamples,
+                         size_t                       aStride,
+                         SampleFormat                 aFormat,
+                         float                        aVolume0,
+                         float                        aVolume1);
+    // Gather visualization data from the output scratch
+    void updateVisualization_internal(size_t aSamples, size_t aStride);
+    // Get a voice group, or nullptr if the handle isn't a live voice group
+    const VoiceGroup* findVoiceGroup_internal(handle aVoiceGroupHandle) const;
+    // Voices of a handle for the 3d setters, which don't hold the audio mutex: the members of a
+    // voice group copied under the mutex, or else the handle itself. Valid until the next call.
+    std::span<const handle> get3dVoiceHandles_internal(const handle& aVoiceHandle);
 
     // Lock audio thread mutex.
     void lockAudioMutex_internal();
@@ -378,6 +642,13 @@ class Engine
     // Highest voice in use so far
     size_t mHighestVoice = 0;
 
+    // Voice stealing policy, the voices it may pick from, and the voice limits and playing voices
+    // of each category
+    VoiceStealPolicy                 mStealPolicy = VoiceStealPolicy::Oldest;
+    std::unique_ptr<StealCandidates> mStealCandidates;
+    std::vector<size_t>              mCategoryLimit;
+    std::vector<size_t>              mCategoryVoices;
+
     // Scratch buffer, used for resampling.
     AlignedFloatBuffer mScratch;
 
@@ -387,6 +658,9 @@ class Engine
     // Output scratch buffer, used in mix_().
     AlignedFloatBuffer mOutputScratch;
 
+    // Scratch buffer for panning voices to their aux sends.
+    AlignedFloatBuffer mSendScratch;
+
     // Pointers to resampler buffers, two per active voice.
     std::vector<float*> mResampleData;
 
@@ -419,9 +693,28 @@ class Engine
     // Post-clip scaler. Applied after clipping.
     float mPostClipScaler = 0.0f;
 
-    // Current play index. Used to create audio handles.
+    // Master bus limiter settings
+    LimiterSettings mLimiterSettings;
+
+    // Master bus limiter, if enabled in the flags
+    std::unique_ptr<Limiter> mLimiter;
+
+    // Binaural renderer for 3d voices, if enabled in the flags
+    std::unique_ptr<Hrtf> mHrtf;
+
+    // Number of binaural voices with their own interpolated HRTF
+    size_t mHrtfVoiceBudget = 32;
+
+    // Ambisonic bus for 3d voices, if enabled
+    std::unique_ptr<Ambisonics> mAmbisonics;
+    size_t                      mAmbisonicOrder = 0;
+
+    // Current play index. Orders the voices by age, to steal the oldest one.
     size_t mPlayIndex = 0;
 
+    // Generation of each voice slot, bumped on every play. Part of the voice handles.
+    std::array<uint32_t, VOICE_COUNT> mVoiceGeneration{};
+
     // Current sound source index. Used to create sound source IDs.
     size_t mAudioSourceID = 1;
 
@@ -440,6 +733,9 @@ class Engine
     // Global filter instance
     std::array<std::shared_ptr<FilterInstance>, FILTERS_PER_STREAM> mFilterInstance{};
 
+    // Number of samples the input to the global filters has been silent for
+    size_t mSilentSamples = 0;
+
     // Approximate volume for channels.
     std::array<float, MAX_CHANNELS> mVisualizationChannelVolume{};
 
@@ -460,6 +756,9 @@ class Engine
     // 3d speed of sound (for doppler)
     float m3dSoundSpeed = 343.3f;
 
+    // Longest travel time of propagation delay lines
+    time_t m3dMaxPropagationDelay = 1.0;
+
     // 3d position of speakers
     std::array<vec3, MAX_CHANNELS> m3dSpeakerPosition;
 
@@ -467,9 +766,31 @@ class Engine
     // audio mutex.
     AudioSourceInstance3dData m3dData[VOICE_COUNT];
 
-    // For each voice group, first int is number of ints alocated.
-    size_t** mVoiceGroup;
-    size_t   mVoiceGroupCount;
+    // Positions of 3d voices, for culling
+    std::unique_ptr<SpatialGrid> m3dGrid;
+    float                        m3dCullingDistance = 0.0f;
+
+    // Voices within the culling distance at the last 3d update, and the query for the next one
+    std::vector<size_t> m3dInRange;
+    std::vector<size_t> m3dQuery;
+
+    // Voice group members copied for the 3d setters
+    std::vector<handle> m3dGroupMembers;
+
+    // Occlusion of 3d voices
+    AudioOccluder*              m3dOccluder = nullptr;
+    std::vector<OcclusionQuery> m3dOcclusionQuery;
+    float                       m3dOcclusionVolume    = 0.3f;
+    float                       m3dOcclusionCutoff    = 1000.0f;
+    time_t                      m3dOcclusionSmoothing = 0.1;
+    time_t                      m3dOcclusionTime      = 0;
+
+    // Listeners besides listener 0, and how many of them the current mix renders
+    std::vector<std::unique_ptr<SpatialListenerMix>> mListener;
+    size_t                                           mListenerMixCount = 0;
+
+    // Voice groups and the groups each voice is in
+    std::unique_ptr<VoiceGroups> mVoiceGroups;
 
     // List of currently active voices
     std::array<size_t, VOICE_COUNT> mActiveVoice{};
@@ -479,5 +800,10 @@ class Engine
 
     // Active voices list needs to be recalculated
     bool mActiveVoiceDirty = true;
+
+    // Voice state, and active and playing voice counts for the getters
+    std::unique_ptr<VoiceSnapshots> mSnapshots;
+    std::atomic<size_t>             mPublishedActiveVoiceCount = 0;
+    std::atomic<size_t>             mPublishedVoiceCount       = 0;
 };
 }; // namespace SoLoud
@@ -27,10 +27,25 @@ freely, subject to the following restrictions:
 #include "soloud_fader.hpp"
 #include <array>
 #include <memory>
+#include <vector>
 
 namespace SoLoud
 {
 class Engine;
+class Wav;
+
+namespace FFT
+{
+class Plan;
+};
+
+namespace Biquad
+{
+class Cascade;
+};
+
+class DelayLine;
+class Lfo;
 
 class FilterInstance
 {
@@ -69,6 +84,10 @@ class FilterInstance
     virtual void oscillateFilterParameter(
         size_t aAttributeId, float aFrom, float aTo, time_t aTime, time_t aStartTime);
 
+    // Time it takes the output to fall below SILENCE_THRESHOLD once the input has gone silent.
+    // The mixer stops calling the filter on silent input after this. Infinite by default.
+    virtual time_t getTailLength(float aSamplerate);
+
   protected:
     size_t                   mNumParams    = 0;
     size_t                   mParamChanged = 0;
@@ -100,12 +119,18 @@ class FlangerFilterInstance final : public FilterInstance
 
     explicit FlangerFilterInstance(FlangerFilter* aParent);
 
+    ~FlangerFilterInstance() override;
+
+    time_t getTailLength(float aSamplerate) override;
+
   private:
-    std::unique_ptr<float[]> mBuffer;
-    size_t                   mBufferLength;
-    FlangerFilter*           mParent;
-    size_t                   mOffset;
-    double                   mIndex;
+    std::unique_ptr<DelayLine> mLine;
+    std::unique_ptr<Lfo>       mLfo;
+    FlangerFilter*             mParent;
+
+    // Per sample delay and delayed signal of the current block
+    std::vector<float> mDelay;
+    std::vector<float> mDelayed;
 };
 
 class FlangerFilter final : public Filter
@@ -155,6 +180,8 @@ class FreeverbFilterInstance final : public FilterInstance
                 time_t aTime) override;
 
     explicit FreeverbFilterInstance(FreeverbFilter* aParent);
+
+    time_t getTailLength(float aSamplerate) override;
 };
 
 class FreeverbFilter final : public Filter
@@ -179,6 +206,7 @@ class FreeverbFilter final : public Filter
 
 class DuckFilter;
 
+// Lowers the volume while a bus plays, going by the sidechain level the bus publishes.
 class DuckFilterInstance final : public FilterInstance
 {
   public:
@@ -191,6 +219,8 @@ class DuckFilterInstance final : public FilterInstance
 
     explicit DuckFilterInstance(DuckFilter* aParent);
 
+    time_t getTailLength(float aSamplerate) override;
+
   private:
     handle  mListenTo;
     Engine* mEngine;
@@ -217,14 +247,77 @@ class DuckFilter final : public Filter
     handle  mListenTo = 0;
 };
 
+class CompressorFilter;
+
+// Feed-forward compressor. The level is detected once per block, either from the filtered sound
+// or from the sidechain level published by a bus, and the gain glides across the block.
+class CompressorFilterInstance final : public FilterInstance
+{
+  public:
+    void filter(float* aBuffer,
+                size_t aSamples,
+                size_t aBufferSize,
+                size_t aChannels,
+                float  aSamplerate,
+                time_t aTime) override;
+
+    explicit CompressorFilterInstance(CompressorFilter* aParent);
+
+    time_t getTailLength(float aSamplerate) override;
+
+  private:
+    handle  mListenTo;
+    Engine* mEngine;
+
+    // Smoothed gain reduction in decibels, and the gain applied at the end of the last block
+    float mReduction = 0.0f;
+    float mGain      = 1.0f;
+};
+
+class CompressorFilter final : public Filter
+{
+  public:
+    enum FILTERATTRIBUTE
+    {
+        WET = 0,
+        THRESHOLD,
+        RATIO,
+        ATTACK,
+        RELEASE,
+        MAKEUP,
+        DETECTOR
+    };
+
+    enum DETECTORTYPE
+    {
+        PEAK = 0,
+        RMS
+    };
+
+    std::shared_ptr<FilterInstance> createInstance() override;
+
+    // Bus to use as sidechain, with the engine it plays on. Without one, the compressor reacts
+    // to the filtered sound itself.
+    Engine* mEngine   = nullptr;
+    handle  mListenTo = 0;
+
+    // Threshold and makeup gain in decibels, attack and release in seconds
+    float mThreshold = -20.0f;
+    float mRatio     = 4.0f;
+    float mAttack    = 0.01f;
+    float mRelease   = 0.2f;
+    float mMakeup    = 0.0f;
+    int   mDetector  = RMS;
+};
+
 class EchoFilter;
 
 class EchoFilterInstance final : public FilterInstance
 {
-    std::unique_ptr<float[]> mBuffer;
-    int                      mBufferLength;
-    int                      mBufferMaxLength;
-    int                      mOffset;
+    std::unique_ptr<DelayLine> mLine;
+
+    // Delayed signal, then new line input, of the current run
+    std::vector<float> mRun;
 
   public:
     void filter(float* aBuffer,
@@ -235,6 +328,10 @@ class EchoFilterInstance final : public FilterInstance
                 time_t aTime) override;
 
     explicit EchoFilterInstance(EchoFilter* aParent);
+
+    ~EchoFilterInstance() override;
+
+    time_t getTailLength(float aSamplerate) override;
 };
 
 class EchoFilter final : public Filter
@@ -285,6 +382,8 @@ class LofiFilterInstance final : public FilterInstance
                        size_t aChannels) override;
 
     explicit LofiFilterInstance(LofiFilter* aParent);
+
+    time_t getTailLength(float aSamplerate) override;
 };
 
 class LofiFilter final : public Filter
@@ -318,6 +417,8 @@ class WaveShaperFilterInstance final : public FilterInstance
                        size_t aChannels) override;
 
     explicit WaveShaperFilterInstance(WaveShaperFilter* aParent);
+
+    time_t getTailLength(float aSamplerate) override;
 };
 
 class WaveShaperFilter final : public Filter
@@ -355,6 +456,8 @@ class RobotizeFilterInstance final : public FilterInstance
                        size_t aChannel,
                        size_t aChannels) override;
     explicit RobotizeFilterInstance(RobotizeFilter* aParent);
+
+    time_t getTailLength(float aSamplerate) override;
 };
 
 class RobotizeFilter final : public Filter
@@ -375,39 +478,57 @@ class RobotizeFilter final : public Filter
 
 class FFTFilter;
 
+// Short-time Fourier transform filter. Each hop, the last window of input of all channels is
+// transformed at once and handed to fftFilter(); the results are overlap-added back together.
 class FFTFilterInstance : public FilterInstance
 {
   public:
-    virtual void fftFilterChannel(float* aFFTBuffer,
-                                  size_t aSamples,
-                                  float  aSamplerate,
-                                  time_t aTime,
-                                  size_t aChannel,
-                                  size_t aChannels);
-    void         filterChannel(float* aBuffer,
-                               size_t aSamples,
-                               float  aSamplerate,
-                               time_t aTime,
-                               size_t aChannel,
-                               size_t aChannels) override;
+    // Process the spectra of one frame, in place. Channel c has aBins bins at aReal + c * aStride
+    // and aImag + c * aStride, laid out as described in FFT::Plan (aImag[0] is the Nyquist bin).
+    // The default shifts the lower bins up an octave through the magnitude / frequency domain.
+    virtual void fftFilter(float* aReal,
+                           float* aImag,
+                           size_t aBins,
+                           size_t aStride,
+                           size_t aChannels,
+                           float  aSamplerate,
+                           time_t aTime);
+
+    void filter(float* aBuffer,
+                size_t aSamples,
+                size_t aBufferSize,
+                size_t aChannels,
+                float  aSamplerate,
+                time_t aTime) override;
 
     explicit FFTFilterInstance(FFTFilter* aParent);
-    FFTFilterInstance();
 
-    void comp2MagPhase(float* aFFTBuffer, size_t aSamples);
-    void magPhase2MagFreq(float* aFFTBuffer, size_t aSamples, float aSamplerate, size_t aChannel);
-    void magFreq2MagPhase(float* aFFTBuffer, size_t aSamples, float aSamplerate, size_t aChannel);
-    void magPhase2Comp(float* aFFTBuffer, size_t aSamples);
+    time_t getTailLength(float aSamplerate) override;
+
+    // Conversions between complex bins and magnitude / phase, in place
+    void comp2MagPhase(float* aReal, float* aImag, size_t aBins);
+    void magPhase2Comp(float* aMagnitude, float* aPhase, size_t aBins);
+
+    // Conversions between phase and true bin frequency, tracking the phase across frames
+    void magPhase2MagFreq(float* aPhase, size_t aBins, float aSamplerate, size_t aChannel);
+    void magFreq2MagPhase(float* aFrequency, size_t aBins, float aSamplerate, size_t aChannel);
+
+  protected:
+    size_t mWindowSize;
+    size_t mHopSize;
 
   private:
-    std::unique_ptr<float[]> mTemp;
+    void initBuffers(size_t aChannels);
+
+    const FFT::Plan*         mPlan     = nullptr;
+    size_t                   mChannels = 0;
+    size_t                   mFill     = 0;
+    std::unique_ptr<float[]> mWindow;
     std::unique_ptr<float[]> mInputBuffer;
     std::unique_ptr<float[]> mMixBuffer;
+    std::unique_ptr<float[]> mSpectrum;
     std::unique_ptr<float[]> mLastPhase;
     std::unique_ptr<float[]> mSumPhase;
-    size_t                   mInputOffset[MAX_CHANNELS];
-    size_t                   mMixOffset[MAX_CHANNELS];
-    size_t                   mReadOffset[MAX_CHANNELS];
     FFTFilter*               mParent;
 };
 
@@ -415,6 +536,16 @@ class FFTFilter : public Filter
 {
   public:
     std::shared_ptr<FilterInstance> createInstance() override;
+
+    // Set the window and hop sizes, clamping them to the valid range and rounding them down to
+    // powers of two.
+    void setParams(size_t aWindowSize, size_t aHopSize);
+
+    // Transform size, a power of two between 64 and 65536, and the hop between transforms, a
+    // power of two no larger than half the window. Latency is one window. Other values are
+    // clamped as setParams does.
+    size_t mWindowSize = 256;
+    size_t mHopSize    = 128;
 };
 
 class EqFilter;
@@ -436,13 +567,17 @@ class EqFilterInstance final : public FFTFilterInstance
 
     EqFilter* mParent;
 
+    // Gain of each bin, rebuilt when the bands change
+    std::unique_ptr<float[]> mGain;
+
   public:
-    void fftFilterChannel(float* aFFTBuffer,
-                          size_t aSamples,
-                          float  aSamplerate,
-                          time_t aTime,
-                          size_t aChannel,
-                          size_t aChannels) override;
+    void fftFilter(float* aReal,
+                   float* aImag,
+                   size_t aBins,
+                   size_t aStride,
+                   size_t aChannels,
+                   float  aSamplerate,
+                   time_t aTime) override;
     explicit EqFilterInstance(EqFilter* aParent);
 };
 
@@ -469,24 +604,199 @@ class EqFilter final : public FFTFilter
     std::array<float, 8> mVolume{};
 };
 
-class BiquadResonantFilter;
+class ParametricEqFilter;
+
+// Equalizer made of a cascade of biquad bands. It adds no latency, and all channels are filtered
+// at once.
+class ParametricEqFilterInstance final : public FilterInstance
+{
+  public:
+    explicit ParametricEqFilterInstance(ParametricEqFilter* aParent);
+
+    ~ParametricEqFilterInstance() override;
+
+    void filter(float* aBuffer,
+                size_t aSamples,
+                size_t aBufferSize,
+                size_t aChannels,
+                float  aSamplerate,
+                time_t aTime) override;
+
+    time_t getTailLength(float aSamplerate) override;
+
+  private:
+    void calcBands();
+
+    ParametricEqFilter*              mParent;
+    size_t                           mBandCount;
+    std::unique_ptr<Biquad::Cascade> mCascade;
+    float                            mSamplerate = 0.0f;
+};
+
+class ParametricEqFilter final : public Filter
+{
+  public:
+    static constexpr size_t MAX_BANDS = 8;
+
+    enum BANDTYPE
+    {
+        LOWSHELF = 0,
+        PEAK,
+        HIGHSHELF,
+        LOWPASS,
+        HIGHPASS,
+        BANDPASS,
+        NOTCH
+    };
+
+    // Attributes of a band; see bandAttribute(). The gain is in decibels and only applies to
+    // shelves and peaks.
+    enum BANDATTRIBUTE
+    {
+        TYPE = 0,
+        FREQUENCY,
+        GAIN,
+        Q
+    };
+
+    enum FILTERATTRIBUTE
+    {
+        WET = 0
+    };
+
+    // Filter attribute id of an attribute of a band, to use with the engine's filter parameter
+    // functions.
+    static constexpr size_t bandAttribute(size_t aBand, size_t aAttribute)
+    {
+        return 1 + aBand * 4 + aAttribute;
+    }
+
+    struct Band
+    {
+        int   mType      = PEAK;
+        float mFrequency = 1000.0f;
+        float mGain      = 0.0f;
+        float mQ         = 1.0f;
+    };
+
+    // aBands bands, at most MAX_BANDS. The first and the last one are shelves and the ones in
+    // between peaks, spread evenly in octaves from 100 Hz to 8 kHz, all at unity gain.
+    explicit ParametricEqFilter(size_t aBands = 4);
+
+    std::shared_ptr<FilterInstance> createInstance() override;
+
+    size_t                      mBandCount;
+    std::array<Band, MAX_BANDS> mBand{};
+};
+
+class ConvolutionFilter;
+
+// Impulse response prepared for partitioned convolution, shared by all instances of a filter
+struct ConvolutionResponse
+{
+    size_t mPartitionSize = 0;
+    size_t mPartitions    = 0;
+    size_t mChannels      = 0;
+    size_t mLength        = 0;
+    float  mSamplerate    = 0.0f;
+
+    // First partition of each channel, time reversed, for direct convolution
+    std::vector<float> mHead;
+
+    // Spectra of the remaining partitions, per channel; see FFT::Plan for the layout
+    std::vector<float> mSpectra;
+};
 
-struct BQRStateData
+// Uniformly partitioned convolution. The first partition of the impulse response is applied
+// directly so the filter adds no latency; the rest goes through a frequency domain delay line.
+class ConvolutionFilterInstance final : public FilterInstance
 {
-    float mY1, mY2, mX1, mX2;
+  public:
+    void filter(float* aBuffer,
+                size_t aSamples,
+                size_t aBufferSize,
+                size_t aChannels,
+                float  aSamplerate,
+                time_t aTime) override;
+
+    explicit ConvolutionFilterInstance(ConvolutionFilter* aParent);
+
+    time_t getTailLength(float aSamplerate) override;
+
+  private:
+    void initBuffers(size_t aChannels);
+
+    // Responses prepared when the instance was created, and the one in use
+    std::shared_ptr<const std::vector<std::shared_ptr<const ConvolutionResponse>>> mResponses;
+    std::shared_ptr<const ConvolutionResponse>                                     mResponse;
+
+    size_t mChannels = 0;
+    size_t                                     mFill     = 0;
+    size_t                                     mSlot     = 0;
+
+    // Per channel: the previous and the current partition of input
+    std::vector<float> mHistory;
+    // Per channel: output of the delayed partitions for the current partition
+    std::vector<float> mTail;
+    // Per channel: spectra of the last mPartitions partitions of input
+    std::vector<float> mDelayLine;
+    // Accumulated spectrum and its inverse
+    std::vector<float> mScratch;
+};
+
+class ConvolutionFilter final : public Filter
+{
+  public:
+    enum FILTERATTRIBUTE
+    {
+        WET = 0
+    };
+
+    // Use the sound as impulse response. Channels of the filtered stream past the impulse
+    // response's use its last channel. The partition size, a power of two between 32 and 32768,
+    // trades the cost of the direct head against the cost of the delay line.
+    //
+    // The response is prepared for aSamplerate, or for the sound's base sample rate if 0. A
+    // response at another rate is resampled from the sound, scaled to keep its gain.
+    explicit ConvolutionFilter(const Wav& aImpulse,
+                               size_t     aPartitionSize = 512,
+                               float      aSamplerate    = 0.0f);
+
+    // Also prepare the response for instances running at aSamplerate, which costs about as much
+    // as loading the filter. Only instances created afterwards can use it. Instances running at
+    // a rate that was not prepared use the response of the closest rate.
+    void prepare(float aSamplerate);
+
+    std::shared_ptr<FilterInstance> createInstance() override;
+
+    // Prepared responses, replaced as a whole so that instances can keep the one they started with
+    std::shared_ptr<const std::vector<std::shared_ptr<const ConvolutionResponse>>> mResponses;
+
+  private:
+    // Planar impulse the responses are made from, at its own rate
+    std::vector<float> mImpulse;
+    size_t             mChannels          = 0;
+    float              mImpulseSamplerate = 0.0f;
+    size_t             mPartitionSize     = 0;
 };
 
+class BiquadResonantFilter;
+
 class BiquadResonantFilterInstance final : public FilterInstance
 {
   public:
     explicit BiquadResonantFilterInstance(BiquadResonantFilter* aParent);
 
-    void filterChannel(float* aBuffer,
-                       size_t aSamples,
-                       float  aSamplerate,
-                       time_t aTime,
-                       size_t aChannel,
-                       size_t aChannels) override;
+    ~BiquadResonantFilterInstance() override;
+
+    time_t getTailLength(float aSamplerate) override;
+
+    void filter(float* aBuffer,
+                size_t aSamples,
+                size_t aBufferSize,
+                size_t aChannels,
+                float  aSamplerate,
+                time_t aTime) override;
 
   protected:
     enum FilterAttribute
@@ -494,17 +804,12 @@ class BiquadResonantFilterInstance final : public FilterInstance
         Wet = 0,
         Type,
         Frequency,
-        Resonance
+        Resonance,
+        Gain
     };
 
-    std::array<BQRStateData, 8> mState{};
-    float                       mA0 = 0.0f;
-    float                       mA1 = 0.0f;
-    float                       mA2 = 0.0f;
-    float                       mB1 = 0.0f;
-    float                       mB2 = 0.0f;
-    int                         mDirty{};
-    float                       mSamplerate;
+    std::unique_ptr<Biquad::Cascade> mCascade;
+    float                            mSamplerate;
 
     BiquadResonantFilter* mParent;
     void                  calcBQRParams();
@@ -513,11 +818,19 @@ class BiquadResonantFilterInstance final : public FilterInstance
 class BiquadResonantFilter final : public Filter
 {
   public:
+    // The Linkwitz-Riley types are 24 dB / octave crossover halves and ignore the resonance. The
+    // gain, in decibels, only applies to the peak and shelf types.
     enum FILTERTYPE
     {
         LOWPASS  = 0,
         HIGHPASS = 1,
-        BANDPASS = 2
+        BANDPASS = 2,
+        NOTCH,
+        PEAK,
+        LOWSHELF,
+        HIGHSHELF,
+        LINKWITZ_RILEY_LOWPASS,
+        LINKWITZ_RILEY_HIGHPASS
     };
 
     enum FILTERATTRIBUTE
@@ -525,7 +838,8 @@ class BiquadResonantFilter final : public Filter
         WET = 0,
         TYPE,
         FREQUENCY,
-        RESONANCE
+        RESONANCE,
+        GAIN
     };
 
     std::shared_ptr<FilterInstance> createInstance() override;
@@ -533,5 +847,6 @@ class BiquadResonantFilter final : public Filter
     int   mFilterType = LOWPASS;
     float mFrequency  = 1000.0f;
     float mResonance  = 2.0f;
+    float mGain       = 0.0f;
 };
 }; // namespace SoLoud
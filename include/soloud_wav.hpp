@@ -41,10 +41,14 @@ class WavInstance final : public AudioSourceInstance
 
     size_t getAudio(float* aBuffer, size_t aSamplesToRead, size_t aBufferSize) override;
 
+    bool seek(time_t aSeconds, float* aScratch, size_t aScratchSize) override;
+
     bool rewind() override;
 
     bool hasEnded() override;
 
+    std::optional<time_t> getLength() override;
+
   private:
     Wav*   mParent = nullptr;
     size_t mOffset = 0;
@@ -63,6 +67,12 @@ class Wav final : public AudioSource
 
     time_t getLength() const;
 
+    // Number of samples per channel
+    size_t getSampleCount() const;
+
+    // Planar sample data, getSampleCount() samples per channel
+    const float* getData() const;
+
   private:
     void loadwav(const MemoryFile& aReader);
     void loadogg(const MemoryFile& aReader);
@@ -63,6 +63,8 @@ class WavStreamInstance final : public AudioSourceInstance
     bool   rewind() override;
     bool   hasEnded() override;
     ~WavStreamInstance() override;
+
+    std::optional<time_t> getLength() override;
 };
 
 enum WAVSTREAM_FILETYPE
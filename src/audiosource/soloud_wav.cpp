@@ -28,11 +28,16 @@ freely, subject to the following restrictions:
 #include "dr_wav.h"
 #include "soloud.hpp"
 #include "soloud_file.hpp"
+#include "soloud_interleave.hpp"
 #include "stb_vorbis.h"
+#include <algorithm>
 #include <cstring>
 
 #define MAKEDWORD(a, b, c, d) (((d) << 24) | ((c) << 16) | ((b) << 8) | (a))
 
+// Frames decoded per call while loading
+static constexpr size_t DECODE_BLOCK_FRAMES = 4096;
+
 namespace SoLoud
 {
 WavInstance::WavInstance(Wav* aParent)
@@ -70,11 +75,25 @@ bool WavInstance::rewind()
     return true;
 }
 
+bool WavInstance::seek(time_t aSeconds, float* /*aScratch*/, size_t /*aScratchSize*/)
+{
+    // The whole sample is in memory, so seeking is just moving the offset
+    const double frame = std::max(aSeconds, 0.0) * mBaseSamplerate;
+    mOffset            = std::min(size_t(frame), mParent->mSampleCount);
+    mStreamPosition    = aSeconds;
+    return true;
+}
+
 bool WavInstance::hasEnded()
 {
     return !mFlags.Looping && mOffset >= mParent->mSampleCount;
 }
 
+std::optional<time_t> WavInstance::getLength()
+{
+    return mParent->getLength();
+}
+
 Wav::Wav(std::span<const std::byte> data)
 {
     assert(data.data() != nullptr);
@@ -115,24 +134,43 @@ void Wav::loadwav(const MemoryFile& aReader)
         throw std::runtime_error{"Failed to load WAV"};
     }
 
-    mData            = std::make_unique<float[]>(samples * decoder.channels);
+    channel_count    = std::min<size_t>(decoder.channels, MAX_CHANNELS);
+    mData            = std::make_unique<float[]>(samples * channel_count);
     base_sample_rate = float(decoder.sampleRate);
     mSampleCount     = samples;
-    channel_count    = decoder.channels;
 
-    for (size_t i = 0; i < mSampleCount; i += 512)
+    // 16 and 24-bit PCM is converted by our own kernels; everything else through dr_wav
+    const bool pcm   = decoder.translatedFormatTag == DR_WAVE_FORMAT_PCM;
+    auto       block = std::vector<float>(DECODE_BLOCK_FRAMES * decoder.channels);
+
+    for (size_t i = 0; i < mSampleCount;)
     {
-        float      tmp[512 * MAX_CHANNELS];
-        const auto blockSize = (mSampleCount - i) > 512 ? 512 : mSampleCount - i;
-        drwav_read_pcm_frames_f32(&decoder, blockSize, tmp);
+        const auto count = std::min<size_t>(DECODE_BLOCK_FRAMES, mSampleCount - i);
+        float*     dest  = mData.get() + i;
+        size_t     read  = 0;
 
-        for (size_t j = 0; j < blockSize; ++j)
+        if (pcm && decoder.bitsPerSample == 16)
         {
-            for (size_t k = 0; k < decoder.channels; k++)
-            {
-                mData[k * mSampleCount + i + j] = tmp[j * decoder.channels + k];
-            }
+            auto* tmp = reinterpret_cast<int16_t*>(block.data());
+            read      = drwav_read_pcm_frames_s16(&decoder, count, tmp);
+            deinterleaveSigned16(tmp, decoder.channels, dest, channel_count, mSampleCount, read);
         }
+        else if (pcm && decoder.bitsPerSample == 24)
+        {
+            auto* tmp = reinterpret_cast<unsigned char*>(block.data());
+            read      = drwav_read_pcm_frames(&decoder, count, tmp);
+            deinterleaveSigned24(tmp, decoder.channels, dest, channel_count, mSampleCount, read);
+        }
+        else
+        {
+            read = drwav_read_pcm_frames_f32(&decoder, count, block.data());
+            deinterleaveFloat(block.data(), decoder.channels, dest, channel_count, mSampleCount, read);
+        }
+
+        if (read == 0)
+            break;
+
+        i += read;
     }
 
     drwav_uninit(&decoder);
@@ -203,25 +241,25 @@ void Wav::loadmp3(const MemoryFile& aReader)
         throw std::runtime_error{"Failed to load MP3"};
     }
 
-    mData            = std::make_unique<float[]>(samples * decoder.channels);
+    channel_count    = std::min<size_t>(decoder.channels, MAX_CHANNELS);
+    mData            = std::make_unique<float[]>(samples * channel_count);
     base_sample_rate = float(decoder.sampleRate);
     mSampleCount     = samples;
-    channel_count    = decoder.channels;
     drmp3_seek_to_pcm_frame(&decoder, 0);
 
-    for (size_t i = 0; i < mSampleCount; i += 512)
+    auto block = std::vector<float>(DECODE_BLOCK_FRAMES * decoder.channels);
+
+    for (size_t i = 0; i < mSampleCount;)
     {
-        auto         tmp       = std::array<float, 512 * MAX_CHANNELS>{};
-        const size_t blockSize = (mSampleCount - i) > 512 ? 512 : mSampleCount - i;
-        drmp3_read_pcm_frames_f32(&decoder, blockSize, tmp.data());
+        const auto count = std::min<size_t>(DECODE_BLOCK_FRAMES, mSampleCount - i);
+        const auto read  = size_t(drmp3_read_pcm_frames_f32(&decoder, count, block.data()));
 
-        for (size_t j = 0; j < blockSize; ++j)
-        {
-            for (size_t k = 0; k < decoder.channels; k++)
-            {
-                mData[k * mSampleCount + i + j] = tmp[j * decoder.channels + k];
-            }
-        }
+        if (read == 0)
+            break;
+
+        deinterleaveFloat(
+            block.data(), decoder.channels, mData.get() + i, channel_count, mSampleCount, read);
+        i += read;
     }
 
     drmp3_uninit(&decoder);
@@ -244,24 +282,36 @@ void Wav::loadflac(const MemoryFile& aReader)
         throw std::runtime_error{"Failed to load FLAC"};
     }
 
-    mData            = std::make_unique<float[]>(samples * decoder->channels);
+    channel_count    = std::min<size_t>(decoder->channels, MAX_CHANNELS);
+    mData            = std::make_unique<float[]>(samples * channel_count);
     base_sample_rate = float(decoder->sampleRate);
     mSampleCount     = samples;
-    channel_count    = decoder->channels;
     drflac_seek_to_pcm_frame(decoder, 0);
 
-    for (size_t i = 0; i < mSampleCount; i += 512)
+    auto block = std::vector<float>(DECODE_BLOCK_FRAMES * decoder->channels);
+
+    for (size_t i = 0; i < mSampleCount;)
     {
-        auto         tmp       = std::array<float, 512 * MAX_CHANNELS>{};
-        const size_t blockSize = (mSampleCount - i) > 512 ? 512 : mSampleCount - i;
-        drflac_read_pcm_frames_f32(decoder, blockSize, tmp.data());
-        for (size_t j = 0; j < blockSize; ++j)
+        const auto count = std::min<size_t>(DECODE_BLOCK_FRAMES, mSampleCount - i);
+        float*     dest  = mData.get() + i;
+        size_t     read  = 0;
+
+        if (decoder->bitsPerSample <= 16)
+        {
+            auto* tmp = reinterpret_cast<int16_t*>(block.data());
+            read      = drflac_read_pcm_frames_s16(decoder, count, tmp);
+            deinterleaveSigned16(tmp, decoder->channels, dest, channel_count, mSampleCount, read);
+        }
+        else
         {
-            for (size_t k = 0; k < decoder->channels; k++)
-            {
-                mData[k * mSampleCount + i + j] = tmp[j * decoder->channels + k];
-            }
+            read = drflac_read_pcm_frames_f32(decoder, count, block.data());
+            deinterleaveFloat(block.data(), decoder->channels, dest, channel_count, mSampleCount, read);
         }
+
+        if (read == 0)
+            break;
+
+        i += read;
     }
 
     drflac_close(decoder);
@@ -276,4 +326,14 @@ double Wav::getLength() const
 {
     return base_sample_rate == 0 ? 0 : mSampleCount / base_sample_rate;
 }
+
+size_t Wav::getSampleCount() const
+{
+    return mSampleCount;
+}
+
+const float* Wav::getData() const
+{
+    return mData.get();
+}
 }; // namespace SoLoud
@@ -28,8 +28,11 @@ freely, subject to the following restrictions:
 
 #include "soloud.hpp"
 #include "soloud_file.hpp"
+#include "soloud_interleave.hpp"
 #include "soloud_wavstream.hpp"
 #include "stb_vorbis.h"
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 
 #define MAKEDWORD(a, b, c, d) (((d) << 24) | ((c) << 16) | ((b) << 8) | (a))
@@ -86,16 +89,14 @@ WavStreamInstance::WavStreamInstance(WavStream* aParent)
 {
     mFile = mParent->mFile;
 
-    if (mParent->mIsStream)
-    {
-        mFile.seek(0); // stb_vorbis assumes file offset to be at start of ogg
-    }
+    // Decoders assume the file offset to be at the start of the stream
+    mFile.seek(0);
 
     // if (mFile)
     {
         if (mParent->mFiletype == WAVSTREAM_WAV)
         {
-            auto& wav = std::get<drwav*>(mCodec);
+            auto& wav = mCodec.emplace<drwav*>();
             wav       = new drwav();
             if (!drwav_init(wav, drwav_read_func, drwav_seek_func, &mFile, nullptr))
             {
@@ -105,7 +106,7 @@ WavStreamInstance::WavStreamInstance(WavStream* aParent)
         }
         else if (mParent->mFiletype == WAVSTREAM_OGG)
         {
-            auto& ogg = std::get<stb_vorbis*>(mCodec);
+            auto& ogg = mCodec.emplace<stb_vorbis*>();
 
             int e = 0;
             ogg   = stb_vorbis_open_memory(mFile.data_uc(), int(mFile.size()), &e, nullptr);
@@ -121,7 +122,7 @@ WavStreamInstance::WavStreamInstance(WavStream* aParent)
         }
         else if (mParent->mFiletype == WAVSTREAM_FLAC)
         {
-            auto& flac = std::get<drflac*>(mCodec);
+            auto& flac = mCodec.emplace<drflac*>();
             flac       = drflac_open(drflac_read_func, drflac_seek_func, &mFile, nullptr);
 
             if (!flac)
@@ -131,7 +132,7 @@ WavStreamInstance::WavStreamInstance(WavStream* aParent)
         }
         else if (mParent->mFiletype == WAVSTREAM_MP3)
         {
-            auto& mp3 = std::get<drmp3*>(mCodec);
+            auto& mp3 = mCodec.emplace<drmp3*>();
 
             mp3 = new drmp3();
 
@@ -220,8 +221,12 @@ static int getOggData(float** aOggOutputs,
 
 size_t WavStreamInstance::getAudio(float* aBuffer, size_t aSamplesToRead, size_t aBufferSize)
 {
-    size_t                                offset = 0;
-    std::array<float, 512 * MAX_CHANNELS> tmp{};
+    size_t offset = 0;
+
+    // Interleaved frames from the decoder; deliberately not zero-initialized
+    alignas(16) unsigned char tmp[512 * MAX_CHANNELS * sizeof(float)];
+    auto* const               tmpFloat = reinterpret_cast<float*>(tmp);
+    auto* const               tmpS16   = reinterpret_cast<int16_t*>(tmp);
 
 #if 0
     if (mFile == nullptr)
@@ -231,20 +236,30 @@ size_t WavStreamInstance::getAudio(float* aBuffer, size_t aSamplesToRead, size_t
     switch (mParent->mFiletype)
     {
         case WAVSTREAM_FLAC: {
-            auto* flac = std::get<drflac*>(mCodec);
+            auto*        flac        = std::get<drflac*>(mCodec);
+            const size_t blockFrames = sizeof(tmp) / sizeof(float) / flac->channels;
 
-            for (size_t i = 0; i < aSamplesToRead; i += 512)
+            while (offset < aSamplesToRead)
             {
-                size_t blockSize = (aSamplesToRead - i) > 512 ? 512 : aSamplesToRead - i;
-                offset += drflac_read_pcm_frames_f32(flac, blockSize, tmp.data());
+                const size_t count = std::min(blockFrames, aSamplesToRead - offset);
+                float*       dest  = aBuffer + offset;
+                size_t       read  = 0;
 
-                for (size_t j = 0; j < blockSize; ++j)
+                if (flac->bitsPerSample <= 16)
                 {
-                    for (size_t k = 0; k < mChannels; k++)
-                    {
-                        aBuffer[k * aSamplesToRead + i + j] = tmp[j * flac->channels + k];
-                    }
+                    read = drflac_read_pcm_frames_s16(flac, count, tmpS16);
+                    deinterleaveSigned16(tmpS16, flac->channels, dest, mChannels, aBufferSize, read);
                 }
+                else
+                {
+                    read = drflac_read_pcm_frames_f32(flac, count, tmpFloat);
+                    deinterleaveFloat(tmpFloat, flac->channels, dest, mChannels, aBufferSize, read);
+                }
+
+                if (read == 0)
+                    break;
+
+                offset += read;
             }
 
             mOffset += offset;
@@ -252,20 +267,20 @@ size_t WavStreamInstance::getAudio(float* aBuffer, size_t aSamplesToRead, size_t
             return offset;
         }
         case WAVSTREAM_MP3: {
-            auto* mp3 = std::get<drmp3*>(mCodec);
+            auto*        mp3         = std::get<drmp3*>(mCodec);
+            const size_t blockFrames = sizeof(tmp) / sizeof(float) / mp3->channels;
 
-            for (size_t i = 0; i < aSamplesToRead; i += 512)
+            while (offset < aSamplesToRead)
             {
-                size_t blockSize = (aSamplesToRead - i) > 512 ? 512 : aSamplesToRead - i;
-                offset += (size_t)drmp3_read_pcm_frames_f32(mp3, blockSize, tmp.data());
+                const size_t count = std::min(blockFrames, aSamplesToRead - offset);
+                const auto   read  = size_t(drmp3_read_pcm_frames_f32(mp3, count, tmpFloat));
 
-                for (size_t j = 0; j < blockSize; ++j)
-                {
-                    for (size_t k = 0; k < mChannels; k++)
-                    {
-                        aBuffer[k * aSamplesToRead + i + j] = tmp[j * mp3->channels + k];
-                    }
-                }
+                if (read == 0)
+                    break;
+
+                deinterleaveFloat(
+                    tmpFloat, mp3->channels, aBuffer + offset, mChannels, aBufferSize, read);
+                offset += read;
             }
             mOffset += offset;
             return offset;
@@ -313,20 +328,36 @@ size_t WavStreamInstance::getAudio(float* aBuffer, size_t aSamplesToRead, size_t
         }
         break;
         case WAVSTREAM_WAV: {
-            auto* wav = std::get<drwav*>(mCodec);
+            auto*        wav         = std::get<drwav*>(mCodec);
+            const size_t blockFrames = sizeof(tmp) / sizeof(float) / wav->channels;
+            const bool   pcm         = wav->translatedFormatTag == DR_WAVE_FORMAT_PCM;
 
-            for (size_t i = 0; i < aSamplesToRead; i += 512)
+            while (offset < aSamplesToRead)
             {
-                size_t blockSize = (aSamplesToRead - i) > 512 ? 512 : aSamplesToRead - i;
-                offset += drwav_read_pcm_frames_f32(wav, blockSize, tmp.data());
+                const size_t count = std::min(blockFrames, aSamplesToRead - offset);
+                float*       dest  = aBuffer + offset;
+                size_t       read  = 0;
 
-                for (size_t j = 0; j < blockSize; ++j)
+                if (pcm && wav->bitsPerSample == 16)
                 {
-                    for (size_t k = 0; k < mChannels; k++)
-                    {
-                        aBuffer[k * aSamplesToRead + i + j] = tmp[j * wav->channels + k];
-                    }
+                    read = drwav_read_pcm_frames_s16(wav, count, tmpS16);
+                    deinterleaveSigned16(tmpS16, wav->channels, dest, mChannels, aBufferSize, read);
                 }
+                else if (pcm && wav->bitsPerSample == 24)
+                {
+                    read = drwav_read_pcm_frames(wav, count, tmp);
+                    deinterleaveSigned24(tmp, wav->channels, dest, mChannels, aBufferSize, read);
+                }
+                else
+                {
+                    read = drwav_read_pcm_frames_f32(wav, count, tmpFloat);
+                    deinterleaveFloat(tmpFloat, wav->channels, dest, mChannels, aBufferSize, read);
+                }
+
+                if (read == 0)
+                    break;
+
+                offset += read;
             }
             mOffset += offset;
             return offset;
@@ -337,10 +368,12 @@ size_t WavStreamInstance::getAudio(float* aBuffer, size_t aSamplesToRead, size_t
 
 bool WavStreamInstance::seek(double aSeconds, float* mScratch, size_t mScratchSize)
 {
+    const auto frame =
+        std::min(size_t(std::max(floor(mBaseSamplerate * aSeconds), 0.0)), mParent->mSampleCount);
+
     if (auto** ogg = std::get_if<stb_vorbis*>(&mCodec))
     {
-        const auto pos = int(floor(mBaseSamplerate * aSeconds));
-        stb_vorbis_seek(*ogg, pos);
+        stb_vorbis_seek(*ogg, unsigned(frame));
         // Since the position that we just sought to might not be *exactly*
         // the position we asked for, we're re-calculating the position just
         // for the sake of correctness.
@@ -348,7 +381,33 @@ bool WavStreamInstance::seek(double aSeconds, float* mScratch, size_t mScratchSi
         double newPosition = float(mOffset / mBaseSamplerate);
         mStreamPosition    = newPosition;
 
-        return false;
+        // Whatever was left of the last decoded frame is from before the seek
+        mOggFrameSize   = 0;
+        mOggFrameOffset = 0;
+
+        return true;
+    }
+
+    // The other decoders seek to the exact frame, without decoding the audio up to it
+    bool sought = false;
+    if (auto** flac = std::get_if<drflac*>(&mCodec))
+    {
+        sought = drflac_seek_to_pcm_frame(*flac, frame);
+    }
+    else if (auto** mp3 = std::get_if<drmp3*>(&mCodec))
+    {
+        sought = drmp3_seek_to_pcm_frame(*mp3, frame);
+    }
+    else if (auto** wav = std::get_if<drwav*>(&mCodec))
+    {
+        sought = drwav_seek_to_pcm_frame(*wav, frame);
+    }
+
+    if (sought)
+    {
+        mOffset         = frame;
+        mStreamPosition = double(frame) / mBaseSamplerate;
+        return true;
     }
 
     return AudioSourceInstance::seek(aSeconds, mScratch, mScratchSize);
@@ -398,6 +457,13 @@ bool WavStreamInstance::hasEnded()
     return mOffset >= mParent->mSampleCount;
 }
 
+std::optional<time_t> WavStreamInstance::getLength()
+{
+    assert(mParent != nullptr);
+
+    return mParent->getLength();
+}
+
 WavStream::WavStream(std::span<const std::byte> data)
     : mFile(data)
 {
@@ -37,16 +37,72 @@ namespace SoLoud
 {
 struct ALSAData
 {
-    float*               buffer;
-    short*               sampleBuffer;
+    unsigned char*       sampleBuffer;
     snd_pcm_t*           alsaDeviceHandle;
     Engine*              soloud;
     int                  samples;
     int                  channels;
+    SampleFormat         format;
+    size_t               sampleSize;
+    bool                 mmapAccess;
     bool                 audioProcessingDone;
     Thread::ThreadHandle threadHandle;
 };
 
+// Mix straight into the device's ring buffer. Returns false on an unrecoverable error.
+static bool alsaMixMmap(ALSAData* data)
+{
+    snd_pcm_t* handle = data->alsaDeviceHandle;
+
+    const snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+    if (avail < 0)
+    {
+        return snd_pcm_recover(handle, int(avail), 1) >= 0;
+    }
+
+    if (avail < data->samples)
+    {
+        if (snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+        {
+            snd_pcm_start(handle);
+        }
+        snd_pcm_wait(handle, 1000);
+        return true;
+    }
+
+    const snd_pcm_channel_area_t* areas  = nullptr;
+    snd_pcm_uframes_t             offset = 0;
+    snd_pcm_uframes_t             frames = data->samples;
+
+    int rc = snd_pcm_mmap_begin(handle, &areas, &offset, &frames);
+    if (rc < 0)
+    {
+        return snd_pcm_recover(handle, rc, 1) >= 0;
+    }
+
+    ChannelArea target[MAX_CHANNELS];
+    for (int i = 0; i < data->channels; ++i)
+    {
+        target[i].mAddress = static_cast<unsigned char*>(areas[i].addr) +
+                             (areas[i].first + offset * areas[i].step) / 8;
+        target[i].mStep = areas[i].step / 8;
+    }
+
+    data->soloud->mixChannelAreas({target, size_t(data->channels)}, frames, data->format);
+
+    const snd_pcm_sframes_t committed = snd_pcm_mmap_commit(handle, offset, frames);
+    if (committed < 0 || snd_pcm_uframes_t(committed) != frames)
+    {
+        return snd_pcm_recover(handle, committed >= 0 ? -EPIPE : int(committed), 1) >= 0;
+    }
+
+    if (snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+    {
+        snd_pcm_start(handle);
+    }
+
+    return true;
+}
 
 static void alsaThread(void* aParam)
 {
@@ -54,12 +110,14 @@ static void alsaThread(void* aParam)
     ALSAData* data = static_cast<ALSAData*>(aParam);
     while (!data->audioProcessingDone)
     {
-        data->soloud->mix(data->buffer, data->samples);
-        for (int i = 0; i < data->samples * data->channels; ++i)
+        if (data->mmapAccess)
         {
-            data->sampleBuffer[i] =
-                static_cast<short>(floor(data->buffer[i] * static_cast<float>(0x7fff)));
+            if (!alsaMixMmap(data))
+                break;
+            continue;
         }
+
+        data->soloud->mixInterleaved(data->sampleBuffer, data->samples, data->format);
         if (snd_pcm_writei(data->alsaDeviceHandle, data->sampleBuffer, data->samples) == -EPIPE)
             snd_pcm_prepare(data->alsaDeviceHandle);
     }
@@ -84,14 +142,41 @@ static void alsaCleanup(Engine* engine)
     {
         delete[] data->sampleBuffer;
     }
-    if (0 != data->buffer)
-    {
-        delete[] data->buffer;
-    }
     delete data;
     engine->mBackendData = 0;
 }
 
+// Picks a sample format the device accepts, preferring 16-bit like before.
+static bool alsaSetFormat(snd_pcm_t* handle, snd_pcm_hw_params_t* params, ALSAData* data)
+{
+    struct Candidate
+    {
+        snd_pcm_format_t alsaFormat;
+        SampleFormat     format;
+        size_t           size;
+    };
+
+    static constexpr Candidate candidates[] = {
+        {SND_PCM_FORMAT_S16_LE, SampleFormat::Signed16, 2},
+        {SND_PCM_FORMAT_FLOAT_LE, SampleFormat::Float32, 4},
+        {SND_PCM_FORMAT_S32_LE, SampleFormat::Signed32, 4},
+        {SND_PCM_FORMAT_S24_3LE, SampleFormat::Signed24, 3},
+    };
+
+    for (const auto& candidate : candidates)
+    {
+        if (snd_pcm_hw_params_test_format(handle, params, candidate.alsaFormat) == 0 &&
+            snd_pcm_hw_params_set_format(handle, params, candidate.alsaFormat) == 0)
+        {
+            data->format    = candidate.format;
+            data->sampleSize = candidate.size;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void alsa_init(Engine* engine, EngineFlags aFlags, size_t aSamplerate, size_t aBuffer, size_t aChannels)
 {
     ALSAData* data = new ALSAData;
@@ -116,8 +201,19 @@ void alsa_init(Engine* engine, EngineFlags aFlags, size_t aSamplerate, size_t aB
     snd_pcm_hw_params_alloca(&params);
     snd_pcm_hw_params_any(handle, params);
 
-    snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(handle, params, SND_PCM_FORMAT_S16_LE);
+    // Mixing straight into the device buffer avoids an extra copy; not all devices support it.
+    data->mmapAccess =
+        snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+    if (!data->mmapAccess)
+    {
+        snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
+    }
+
+    if (!alsaSetFormat(handle, params, data))
+    {
+        throw std::runtime_error{"Failed to initialize the audio device"};
+    }
+
     snd_pcm_hw_params_set_channels(handle, params, 2);
     snd_pcm_hw_params_set_buffer_size(handle, params, aBuffer);
 
@@ -140,8 +236,10 @@ void alsa_init(Engine* engine, EngineFlags aFlags, size_t aSamplerate, size_t aB
     snd_pcm_hw_params_get_channels(params, &val);
     data->channels = val;
 
-    data->buffer       = new float[data->samples * data->channels];
-    data->sampleBuffer = new short[data->samples * data->channels];
+    if (!data->mmapAccess)
+    {
+        data->sampleBuffer = new unsigned char[data->samples * data->channels * data->sampleSize];
+    }
     engine->postinit_internal(aSamplerate, data->samples * data->channels, aFlags, 2);
     data->threadHandle = Thread::createThread(alsaThread, data);
 
@@ -150,4 +248,4 @@ void alsa_init(Engine* engine, EngineFlags aFlags, size_t aSamplerate, size_t aB
         throw std::runtime_error{"Failed to initialize the audio device"};
     }
 }
-}; // namespace SoLoud
\ No newline at end of file
+}; // namespace SoLoud
@@ -22,19 +22,26 @@ freely, subject to the following restrictions:
    distribution.
 */
 
+#include "soloud_ambisonics.hpp"
+#include "soloud_bus.hpp"
 #include "soloud_fft.hpp"
+#include "soloud_hrtf.hpp"
+#include "soloud_interleave.hpp"
+#include "soloud_limiter.hpp"
 #include "soloud_internal.hpp"
+#include "soloud_snapshot.hpp"
+#include "soloud_spatial.hpp"
+#include "soloud_steal.hpp"
 #include "soloud_thread.hpp"
+#include <algorithm>
 #include <cfloat> // _controlfp
 #include <cmath> // sin
 #include <cstring>
 
 
 #ifdef SOLOUD_SSE_INTRINSICS
-#include <xmmintrin.h>
-#ifdef _M_IX86
 #include <emmintrin.h>
-#endif
+#include <xmmintrin.h>
 #endif
 
 namespace SoLoud
@@ -73,6 +80,15 @@ Engine::Engine(EngineFlags           flags,
 
     mAudioThreadMutex = Thread::createMutex();
 
+    // Culling is off, so the cell size is only a guess until it is turned on
+    m3dGrid = std::make_unique<SpatialGrid>(100.0f);
+
+    mSnapshots = std::make_unique<VoiceSnapshots>();
+
+    mVoiceGroups = std::make_unique<VoiceGroups>();
+
+    mStealCandidates = std::make_unique<StealCandidates>();
+
     int samplerate = aSamplerate.value_or(44100);
     int buffersize = aBufferSize.value_or(2048);
 
@@ -198,6 +214,7 @@ void Engine::postinit_internal(size_t      aSamplerate,
 
     mScratch       = AlignedFloatBuffer{mScratchSize * MAX_CHANNELS};
     mOutputScratch = AlignedFloatBuffer{mScratchSize * MAX_CHANNELS};
+    mSendScratch   = AlignedFloatBuffer{mScratchSize * MAX_CHANNELS};
 
     mResampleData.resize(mMaxActiveVoices * 2);
     mResampleDataOwner.resize(mMaxActiveVoices);
@@ -211,6 +228,19 @@ void Engine::postinit_internal(size_t      aSamplerate,
     mFlags          = flags;
     mPostClipScaler = 0.95f;
 
+    if (mFlags.Limiter)
+    {
+        mLimiter = std::make_unique<Limiter>(float(mSamplerate), mChannels, mScratchSize);
+        mLimiter->setSettings(mLimiterSettings);
+    }
+
+    if (mFlags.Hrtf && mChannels == 2)
+    {
+        mHrtf = std::make_unique<Hrtf>(createDefaultHrirTable(float(mSamplerate)),
+                                       float(mSamplerate),
+                                       mScratchSize);
+    }
+
     switch (mChannels)
     {
         case 1: {
@@ -308,263 +338,334 @@ float Engine::getApproximateVolume(size_t aChannel)
 float* Engine::calcFFT()
 {
     lockAudioMutex_internal();
-    float temp[1024];
+    float temp[512];
     for (int i = 0; i < 256; ++i)
     {
-        temp[i * 2]     = mVisualizationWaveData[i];
-        temp[i * 2 + 1] = 0;
-        temp[i + 512]   = 0;
-        temp[i + 768]   = 0;
+        temp[i]       = mVisualizationWaveData[i];
+        temp[i + 256] = 0;
     }
     unlockAudioMutex_internal();
 
-    FFT::fft1024(temp);
+    float real[256];
+    float imag[256];
+    FFT::getPlan(512).forward(temp, real, imag);
 
-    for (int i = 0; i < 256; ++i)
+    // imag[0] holds the Nyquist bin, which isn't shown
+    mFFTData[0] = fabsf(real[0]);
+    for (int i = 1; i < 256; ++i)
     {
-        const float real = temp[i * 2];
-        const float imag = temp[i * 2 + 1];
-
-        mFFTData[i] = std::sqrt(real * real + imag * imag);
+        mFFTData[i] = std::sqrt(real[i] * real[i] + imag[i] * imag[i]);
     }
 
     return mFFTData.data();
 }
 
-#if defined(SOLOUD_SSE_INTRINSICS)
-void Engine::clip_internal(const AlignedFloatBuffer& aBuffer,
-                           const AlignedFloatBuffer& aDestBuffer,
-                           size_t                    aSamples,
-                           float                     aVolume0,
-                           float                     aVolume1)
+namespace
 {
-    float  vd = (aVolume1 - aVolume0) / aSamples;
-    float  v  = aVolume0;
-    size_t i, j, c, d;
-    size_t samplequads = (aSamples + 3) / 4; // rounded up
-
-    // Clip
-    if (mFlags.ClipRoundoff)
-    {
-        float                  nb          = -1.65f;
-        __m128                 negbound    = _mm_load_ps1(&nb);
-        float                  pb          = 1.65f;
-        __m128                 posbound    = _mm_load_ps1(&pb);
-        float                  ls          = 0.87f;
-        __m128                 linearscale = _mm_load_ps1(&ls);
-        float                  cs          = -0.1f;
-        __m128                 cubicscale  = _mm_load_ps1(&cs);
-        float                  nw          = -0.9862875f;
-        __m128                 negwall     = _mm_load_ps1(&nw);
-        float                  pw          = 0.9862875f;
-        __m128                 poswall     = _mm_load_ps1(&pw);
-        __m128                 postscale   = _mm_load_ps1(&mPostClipScaler);
-        TinyAlignedFloatBuffer volumes;
-        volumes.mData[0] = v;
-        volumes.mData[1] = v + vd;
-        volumes.mData[2] = v + vd + vd;
-        volumes.mData[3] = v + vd + vd + vd;
-        vd *= 4;
-        __m128 vdelta = _mm_load_ps1(&vd);
-        c             = 0;
-        d             = 0;
-        for (size_t j = 0; j < mChannels; ++j)
+#ifdef SOLOUD_SSE_INTRINSICS
+template <bool Roundoff>
+inline __m128 clipQuad(__m128 f)
+{
+    if constexpr (Roundoff)
+    {
+        const __m128 u = _mm_cmpgt_ps(f, _mm_set1_ps(-1.65f));
+        const __m128 o = _mm_cmplt_ps(f, _mm_set1_ps(1.65f));
+
+        // f = 0.87f * f - 0.1f * f * f * f;
+        const __m128 lin   = _mm_mul_ps(f, _mm_set1_ps(0.87f));
+        const __m128 cubic = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(f, f), f), _mm_set1_ps(-0.1f));
+        f                  = _mm_add_ps(cubic, lin);
+
+        // Walls outside of the soft knee
+        f = _mm_or_ps(_mm_andnot_ps(u, _mm_set1_ps(-0.9862875f)), _mm_and_ps(u, f));
+        return _mm_or_ps(_mm_andnot_ps(o, _mm_set1_ps(0.9862875f)), _mm_and_ps(o, f));
+    }
+    else
+    {
+        return _mm_min_ps(_mm_max_ps(f, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+    }
+}
+
+// Volume ramp, clipper and post-clip scaler, in place on planar channels. The stride is a
+// multiple of 16 and the buffer 16-byte aligned, so the last quad may run past aSamples.
+template <bool Roundoff>
+void clipChannels(float* aBuffer,
+                  size_t aStride,
+                  size_t aChannels,
+                  size_t aSamples,
+                  float  aVolume,
+                  float  aVolumeDelta,
+                  float  aPostClipScaler)
+{
+    const __m128 postscale = _mm_set1_ps(aPostClipScaler);
+    const __m128 vdelta    = _mm_set1_ps(aVolumeDelta * 4);
+    const float  vd        = aVolumeDelta;
+
+    for (size_t c = 0; c < aChannels; ++c)
+    {
+        float* data = aBuffer + c * aStride;
+        __m128 vol  = _mm_setr_ps(aVolume, aVolume + vd, aVolume + vd * 2, aVolume + vd * 3);
+
+        for (size_t i = 0; i < aSamples; i += 4)
         {
-            __m128 vol = _mm_load_ps(volumes.mData);
+            const __m128 f = clipQuad<Roundoff>(_mm_mul_ps(_mm_load_ps(data + i), vol));
+            _mm_store_ps(data + i, _mm_mul_ps(f, postscale));
+            vol = _mm_add_ps(vol, vdelta);
+        }
+    }
+}
+#else // fallback code
+// Scalar version of the clipper
+template <bool Roundoff>
+inline float clipSample(float aSample)
+{
+    if constexpr (Roundoff)
+    {
+        return aSample <= -1.65f  ? -0.9862875f
+               : aSample >= 1.65f ? 0.9862875f
+                                  : 0.87f * aSample - 0.1f * aSample * aSample * aSample;
+    }
+    else
+    {
+        return aSample <= -1 ? -1 : aSample >= 1 ? 1 : aSample;
+    }
+}
 
-            for (i = 0; i < samplequads; ++i)
-            {
-                // float f1 = origdata[c] * v;	++c; v += vd;
-                __m128 f = _mm_load_ps(&aBuffer.mData[c]);
-                c += 4;
-                f   = _mm_mul_ps(f, vol);
-                vol = _mm_add_ps(vol, vdelta);
-
-                // float u1 = (f1 > -1.65f);
-                __m128 u = _mm_cmpgt_ps(f, negbound);
-
-                // float o1 = (f1 < 1.65f);
-                __m128 o = _mm_cmplt_ps(f, posbound);
-
-                // f1 = (0.87f * f1 - 0.1f * f1 * f1 * f1) * u1 * o1;
-                __m128 lin   = _mm_mul_ps(f, linearscale);
-                __m128 cubic = _mm_mul_ps(f, f);
-                cubic        = _mm_mul_ps(cubic, f);
-                cubic        = _mm_mul_ps(cubic, cubicscale);
-                f            = _mm_add_ps(cubic, lin);
-
-                // f1 = f1 * u1 + !u1 * -0.9862875f;
-                __m128 lowmask  = _mm_andnot_ps(u, negwall);
-                __m128 ilowmask = _mm_and_ps(u, f);
-                f               = _mm_add_ps(lowmask, ilowmask);
-
-                // f1 = f1 * o1 + !o1 * 0.9862875f;
-                __m128 himask  = _mm_andnot_ps(o, poswall);
-                __m128 ihimask = _mm_and_ps(o, f);
-                f              = _mm_add_ps(himask, ihimask);
-
-                // outdata[d] = f1 * postclip; d++;
-                f = _mm_mul_ps(f, postscale);
-                _mm_store_ps(&aDestBuffer.mData[d], f);
-                d += 4;
-            }
+template <bool Roundoff>
+void clipChannels(float* aBuffer,
+                  size_t aStride,
+                  size_t aChannels,
+                  size_t aSamples,
+                  float  aVolume,
+                  float  aVolumeDelta,
+                  float  aPostClipScaler)
+{
+    for (size_t c = 0; c < aChannels; ++c)
+    {
+        float* data = aBuffer + c * aStride;
+        float  v    = aVolume;
+
+        for (size_t i = 0; i < aSamples; ++i)
+        {
+            data[i] = clipSample<Roundoff>(data[i] * v) * aPostClipScaler;
+            v += aVolumeDelta;
         }
     }
+}
+#endif
+} // namespace
+
+void Engine::output_internal(float*                       aSource,
+                             std::span<const ChannelArea> aAreas,
+                             size_t                       aSamples,
+                             size_t                       aStride,
+                             SampleFormat                 aFormat,
+                             float                        aVolume0,
+                             float                        aVolume1)
+{
+    assert(aAreas.size() >= mChannels);
+
+    const float volumeDelta = aSamples > 0 ? (aVolume1 - aVolume0) / aSamples : 0.0f;
+
+    // The limiter already keeps the signal in range; only clip hard to catch the leftovers
+    if (mFlags.ClipRoundoff && !mLimiter)
+    {
+        clipChannels<true>(
+            aSource, aStride, mChannels, aSamples, aVolume0, volumeDelta, mPostClipScaler);
+    }
     else
     {
-        float                  nb        = -1.0f;
-        __m128                 negbound  = _mm_load_ps1(&nb);
-        float                  pb        = 1.0f;
-        __m128                 posbound  = _mm_load_ps1(&pb);
-        __m128                 postscale = _mm_load_ps1(&mPostClipScaler);
-        TinyAlignedFloatBuffer volumes;
-        volumes.mData[0] = v;
-        volumes.mData[1] = v + vd;
-        volumes.mData[2] = v + vd + vd;
-        volumes.mData[3] = v + vd + vd + vd;
-        vd *= 4;
-        __m128 vdelta = _mm_load_ps1(&vd);
-        c             = 0;
-        d             = 0;
-        for (size_t j = 0; j < mChannels; ++j)
+        clipChannels<false>(
+            aSource, aStride, mChannels, aSamples, aVolume0, volumeDelta, mPostClipScaler);
+    }
+
+    // Interleaved if every channel directly follows the previous one in a shared frame
+    const size_t size        = sampleSize(aFormat);
+    auto* const  first       = static_cast<unsigned char*>(aAreas[0].mAddress);
+    bool         interleaved = true;
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        if (aAreas[c].mStep != size * mChannels || aAreas[c].mAddress != first + c * size)
         {
-            __m128 vol = _mm_load_ps(volumes.mData);
-            for (i = 0; i < samplequads; ++i)
-            {
-                // float f1 = aBuffer.mData[c] * v; ++c; v += vd;
-                __m128 f = _mm_load_ps(&aBuffer.mData[c]);
-                c += 4;
-                f   = _mm_mul_ps(f, vol);
-                vol = _mm_add_ps(vol, vdelta);
-
-                // f1 = (f1 <= -1) ? -1 : (f1 >= 1) ? 1 : f1;
-                f = _mm_max_ps(f, negbound);
-                f = _mm_min_ps(f, posbound);
-
-                // aDestBuffer.mData[d] = f1 * mPostClipScaler; d++;
-                f = _mm_mul_ps(f, postscale);
-                _mm_store_ps(&aDestBuffer.mData[d], f);
-                d += 4;
-            }
+            interleaved = false;
         }
     }
+
+    if (interleaved)
+    {
+        interleaveSamples(aSource, aStride, mChannels, first, aFormat, aSamples);
+        return;
+    }
+
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        storeSamples(aSource + c * aStride, aAreas[c].mAddress, aAreas[c].mStep, aFormat, aSamples);
+    }
 }
-#else // fallback code
-void Engine::clip_internal(const AlignedFloatBuffer& aBuffer,
-                           const AlignedFloatBuffer& aDestBuffer,
-                           size_t                    aSamples,
-                           float                     aVolume0,
-                           float                     aVolume1)
+
+void Engine::updateVisualization_internal(size_t aSamples, size_t aStride)
 {
-    const float vd          = (aVolume1 - aVolume0) / aSamples;
-    const auto  samplequads = (aSamples + 3) / 4; // rounded up
+    for (size_t i = 0; i < MAX_CHANNELS; ++i)
+    {
+        mVisualizationChannelVolume[i] = 0;
+    }
+
+    if (aSamples == 0)
+    {
+        mVisualizationWaveData.fill(0);
+        return;
+    }
 
-    // Clip
-    if (mFlags.ClipRoundoff)
+    // The output stage left the clipped samples in the scratch buffer. "i % aSamples" is a very
+    // unlikely failsafe for tiny buffers.
+    for (size_t i = 0; i < 256; ++i)
     {
-        auto c = size_t(0);
-        auto d = size_t(0);
+        const size_t s = i % aSamples;
 
+        mVisualizationWaveData[i] = 0;
         for (size_t j = 0; j < mChannels; ++j)
         {
-            auto v = aVolume0;
-            for (size_t i = 0; i < samplequads; ++i)
+            const auto sample = mOutputScratch.mData[s + j * aStride];
+            const auto absvol = fabs(sample);
+
+            if (mVisualizationChannelVolume[j] < absvol)
             {
-                float f1 = aBuffer.mData[c] * v;
-                ++c;
-                v += vd;
-
-                float f2 = aBuffer.mData[c] * v;
-                ++c;
-                v += vd;
-
-                float f3 = aBuffer.mData[c] * v;
-                ++c;
-                v += vd;
-
-                float f4 = aBuffer.mData[c] * v;
-                ++c;
-                v += vd;
-
-                f1 = f1 <= -1.65f  ? -0.9862875f
-                     : f1 >= 1.65f ? 0.9862875f
-                                   : 0.87f * f1 - 0.1f * f1 * f1 * f1;
-                f2 = f2 <= -1.65f  ? -0.9862875f
-                     : f2 >= 1.65f ? 0.9862875f
-                                   : 0.87f * f2 - 0.1f * f2 * f2 * f2;
-                f3 = f3 <= -1.65f  ? -0.9862875f
-                     : f3 >= 1.65f ? 0.9862875f
-                                   : 0.87f * f3 - 0.1f * f3 * f3 * f3;
-                f4 = f4 <= -1.65f  ? -0.9862875f
-                     : f4 >= 1.65f ? 0.9862875f
-                                   : 0.87f * f4 - 0.1f * f4 * f4 * f4;
-
-                aDestBuffer.mData[d] = f1 * mPostClipScaler;
-                d++;
-
-                aDestBuffer.mData[d] = f2 * mPostClipScaler;
-                d++;
-
-                aDestBuffer.mData[d] = f3 * mPostClipScaler;
-                d++;
-
-                aDestBuffer.mData[d] = f4 * mPostClipScaler;
-                d++;
+                mVisualizationChannelVolume[j] = absvol;
             }
+
+            mVisualizationWaveData[i] += sample;
         }
     }
-    else
+}
+
+static constexpr auto FIXPOINT_FRAC_BITS = 20;
+static constexpr auto FIXPOINT_FRAC_MUL  = 1 << FIXPOINT_FRAC_BITS;
+static constexpr auto FIXPOINT_FRAC_MASK = (1 << FIXPOINT_FRAC_BITS) - 1;
+
+// Check whether every channel of a planar block stays below the silence threshold
+static bool isSilent(const float* aBuffer, size_t aSamples, size_t aChannels, size_t aStride)
+{
+    for (size_t j = 0; j < aChannels; ++j)
     {
-        auto c = size_t(0);
-        auto d = size_t(0);
+        const float* src = aBuffer + j * aStride;
+        size_t       i   = 0;
 
-        for (size_t j = 0; j < mChannels; ++j)
+#ifdef SOLOUD_SSE_INTRINSICS
+        const __m128 signmask  = _mm_set1_ps(-0.0f);
+        const __m128 threshold = _mm_set1_ps(SILENCE_THRESHOLD);
+        for (; i + 16 <= aSamples; i += 16)
         {
-            auto v = aVolume0;
+            // Audible blocks usually bail out on the first few samples
+            __m128 loud = _mm_cmpgt_ps(_mm_andnot_ps(signmask, _mm_loadu_ps(src + i)), threshold);
+            loud        = _mm_or_ps(
+                loud, _mm_cmpgt_ps(_mm_andnot_ps(signmask, _mm_loadu_ps(src + i + 4)), threshold));
+            loud = _mm_or_ps(
+                loud, _mm_cmpgt_ps(_mm_andnot_ps(signmask, _mm_loadu_ps(src + i + 8)), threshold));
+            loud = _mm_or_ps(
+                loud, _mm_cmpgt_ps(_mm_andnot_ps(signmask, _mm_loadu_ps(src + i + 12)), threshold));
+            if (_mm_movemask_ps(loud))
+            {
+                return false;
+            }
+        }
+#endif
 
-            for (size_t i = 0; i < samplequads; ++i)
+        for (; i < aSamples; ++i)
+        {
+            if (fabsf(src[i]) > SILENCE_THRESHOLD)
             {
-                float f1 = aBuffer.mData[c] * v;
-                ++c;
-                v += vd;
+                return false;
+            }
+        }
+    }
 
-                float f2 = aBuffer.mData[c] * v;
-                ++c;
-                v += vd;
+    return true;
+}
 
-                float f3 = aBuffer.mData[c] * v;
-                ++c;
-                v += vd;
+// Run a filter chain on a planar block. Once the input has been silent for longer than the longest
+// filter tail the filters have nothing left to say and are skipped. Returns whether the block is
+// silent afterwards.
+static bool runFilters(std::array<std::shared_ptr<FilterInstance>, FILTERS_PER_STREAM>& aFilters,
+                       float*                                                           aBuffer,
+                       size_t                                                           aSamples,
+                       size_t  aBufferSize,
+                       size_t  aChannels,
+                       float   aSamplerate,
+                       time_t  aTime,
+                       size_t& aSilentSamples)
+{
+    const bool silent = isSilent(aBuffer, aSamples, aChannels, aBufferSize);
+    aSilentSamples    = silent ? aSilentSamples + aSamples : 0;
 
-                float f4 = aBuffer.mData[c] * v;
-                ++c;
-                v += vd;
+    auto hasFilters = false;
+    auto tail       = time_t(0);
+    for (const auto& filter : aFilters)
+    {
+        if (filter)
+        {
+            hasFilters = true;
+            tail       = std::max(tail, filter->getTailLength(aSamplerate));
+        }
+    }
 
-                f1 = f1 <= -1 ? -1 : f1 >= 1 ? 1 : f1;
-                f2 = f2 <= -1 ? -1 : f2 >= 1 ? 1 : f2;
-                f3 = f3 <= -1 ? -1 : f3 >= 1 ? 1 : f3;
-                f4 = f4 <= -1 ? -1 : f4 >= 1 ? 1 : f4;
+    if (!hasFilters)
+    {
+        return silent;
+    }
 
-                aDestBuffer.mData[d] = f1 * mPostClipScaler;
-                d++;
+    if (silent && double(aSilentSamples - aSamples) >= tail * aSamplerate)
+    {
+        return true;
+    }
 
-                aDestBuffer.mData[d] = f2 * mPostClipScaler;
-                d++;
+    for (const auto& filter : aFilters)
+    {
+        if (filter)
+        {
+            filter->filter(aBuffer, aSamples, aBufferSize, aChannels, aSamplerate, aTime);
+        }
+    }
 
-                aDestBuffer.mData[d] = f3 * mPostClipScaler;
-                d++;
+    return isSilent(aBuffer, aSamples, aChannels, aBufferSize);
+}
+
+// Check whether a voice can't be heard in this block, neither dry nor through its sends
+static bool isMuted(const AudioSourceInstance& aVoice, size_t aChannels)
+{
+    for (size_t k = 0; k < aChannels; ++k)
+    {
+        if (aVoice.mCurrentChannelVolume[k] != 0 ||
+            aVoice.mChannelVolume[k] * aVoice.mOverallVolume != 0)
+        {
+            return false;
+        }
+    }
 
-                aDestBuffer.mData[d] = f4 * mPostClipScaler;
-                d++;
+    for (size_t i = 0; i < SENDS_PER_STREAM; ++i)
+    {
+        const auto& send  = aVoice.mSend[i];
+        const auto& state = aVoice.mSendState[i];
+        if (send.mBusHandle == 0)
+        {
+            continue;
+        }
+
+        if (send.mLevel != 0 && (send.mPreFader || aVoice.mOverallVolume != 0))
+        {
+            return false;
+        }
+
+        for (const auto volume : state.mCurrentVolume)
+        {
+            if (volume != 0)
+            {
+                return false;
             }
         }
     }
-}
-#endif
 
-static constexpr auto FIXPOINT_FRAC_BITS = 20;
-static constexpr auto FIXPOINT_FRAC_MUL  = 1 << FIXPOINT_FRAC_BITS;
-static constexpr auto FIXPOINT_FRAC_MASK = (1 << FIXPOINT_FRAC_BITS) - 1;
+    return true;
+}
 
 static float catmullrom(float t, float p0, float p1, float p2, float p3)
 {
@@ -665,13 +766,131 @@ static void resample_point(const float* aSrc,
     }
 }
 
+// Occlusion low-pass of a voice's resampled block, ramping the coefficient over the block
+static void occlusionLowpass(OcclusionVoiceState& aState,
+                             float*               aScratch,
+                             size_t               aChannels,
+                             size_t               aSamplesToRead,
+                             size_t               aBufferSize)
+{
+    if (aSamplesToRead == 0)
+    {
+        return;
+    }
 
-void panAndExpand(std::shared_ptr<AudioSourceInstance>& aVoice,
-                  float*                                aBuffer,
-                  size_t                                aSamplesToRead,
-                  size_t                                aBufferSize,
-                  float*                                aScratch,
-                  size_t                                aChannels)
+    if (aState.mCoefficient == 1.0f && aState.mTarget == 1.0f)
+    {
+        // Open; keep the state so the filter starts from the signal when it closes
+        for (size_t j = 0; j < aChannels; ++j)
+        {
+            aState.mState[j] = aScratch[j * aBufferSize + aSamplesToRead - 1];
+        }
+        return;
+    }
+
+    const float step = (aState.mTarget - aState.mCoefficient) / float(aSamplesToRead);
+
+    for (size_t j = 0; j < aChannels; ++j)
+    {
+        float* const data = aScratch + j * aBufferSize;
+        float        a    = aState.mCoefficient;
+        float        y    = aState.mState[j];
+
+        for (size_t i = 0; i < aSamplesToRead; ++i)
+        {
+            a       += step;
+            y       += a * (data[i] - y);
+            data[i]  = y;
+        }
+
+        aState.mState[j] = y;
+    }
+
+    aState.mCoefficient = aState.mTarget;
+}
+
+// Propagation delay line of a voice's resampled block: the block goes into the ring, and comes
+// back delayed by the travel time, which ramps over the block. A changing delay squeezes or
+// stretches the signal, which is its doppler shift. Returns whether the delayed block is audible.
+static bool propagationDelay(PropagationVoiceState& aState,
+                             float*                 aScratch,
+                             size_t                 aChannels,
+                             size_t                 aSamplesToRead,
+                             size_t                 aBufferSize,
+                             bool                   aAudible)
+{
+    const size_t mask = aState.mLength - 1;
+
+    if (!aState.mSynced)
+    {
+        aState.mOrigin = aState.mTarget;
+    }
+
+    // At least a sample, so that the interpolation never reads past the block written; and
+    // changing by at most half a sample per sample, so the doppler shift stays within an octave
+    const float moving = aState.mOrigin + aState.mDopplerFactor * (aState.mTarget - aState.mOrigin);
+    const float target = std::clamp(moving, 1.0f, float(aState.mLength - SAMPLE_GRANULARITY - 2));
+    const float from = aState.mSynced ? aState.mDelay : target;
+    const float half = 0.5f * float(aSamplesToRead);
+    const float to   = std::clamp(target, from - half, from + half);
+    const float step = (to - from) / float(aSamplesToRead);
+
+    aState.mDelay  = to;
+    aState.mSynced = true;
+
+    // Silence into a ring of silence needs no writes, and a block of it no reads
+    const bool cleared = !aAudible && aState.mSilence >= aState.mLength;
+    aState.mSilence    = aAudible ? 0 : std::min(aState.mSilence + aSamplesToRead, aState.mLength);
+
+    const bool audible = aState.mSilence <= size_t(std::max(from, to)) + 2;
+
+    for (size_t start = 0; start < aSamplesToRead; start += SAMPLE_GRANULARITY)
+    {
+        const size_t count = std::min(SAMPLE_GRANULARITY, aSamplesToRead - start);
+
+        for (size_t j = 0; j < aChannels; ++j)
+        {
+            float* const ring = aState.mRing.data() + j * aState.mLength;
+            float* const data = aScratch + j * aBufferSize + start;
+
+            if (!cleared)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    ring[(aState.mWrite + i) & mask] = aAudible ? data[i] : 0.0f;
+                }
+            }
+
+            if (!audible)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                const float  delay = from + step * float(start + i + 1);
+                const size_t whole = size_t(delay);
+                const float  frac  = delay - float(whole);
+                const size_t at    = (aState.mWrite + aState.mLength + i - whole) & mask;
+
+                data[i] = ring[at] + frac * (ring[(at - 1) & mask] - ring[at]);
+            }
+        }
+
+        aState.mWrite = (aState.mWrite + count) & mask;
+    }
+
+    return audible;
+}
+
+void panAndExpand(size_t                                 aVoiceChannels,
+                  float*                                 aBuffer,
+                  size_t                                 aSamplesToRead,
+                  size_t                                 aBufferSize,
+                  float*                                 aScratch,
+                  size_t                                 aChannels,
+                  const std::array<float, MAX_CHANNELS>& aFrom,
+                  const std::array<float, MAX_CHANNELS>& aTo)
 {
 #ifdef SOLOUD_SSE_INTRINSICS
     assert(((size_t)aBuffer & 0xf) == 0);
@@ -680,24 +899,21 @@ void panAndExpand(std::shared_ptr<AudioSourceInstance>& aVoice,
 #endif
 
     float                           pan[MAX_CHANNELS]; // current speaker volume
-    std::array<float, MAX_CHANNELS> pand{}; // destination speaker volume
     std::array<float, MAX_CHANNELS> pani{}; // speaker volume increment per sample
 
     for (size_t k = 0; k < aChannels; k++)
     {
-        pan[k]  = aVoice->mCurrentChannelVolume[k];
-        pand[k] = aVoice->mChannelVolume[k] * aVoice->mOverallVolume;
-        pani[k] =
-            (pand[k] - pan[k]) /
-            aSamplesToRead; // TODO: this is a bit inconsistent.. but it's a hack to begin with
+        pan[k]  = aFrom[k];
+        pani[k] = (aTo[k] - pan[k]) /
+                  aSamplesToRead; // TODO: this is a bit inconsistent.. but it's a hack to begin with
     }
 
     switch (aChannels)
     {
         case 1: // Target is mono. Sum everything. (1->1, 2->1, 4->1, 6->1, 8->1)
-            for (size_t j = 0, ofs = 0; j < aVoice->mChannels; ++j, ofs += aBufferSize)
+            for (size_t j = 0, ofs = 0; j < aVoiceChannels; ++j, ofs += aBufferSize)
             {
-                pan[0] = aVoice->mCurrentChannelVolume[0];
+                pan[0] = aFrom[0];
                 for (size_t k = 0; k < aSamplesToRead; k++)
                 {
                     pan[0] += pani[0];
@@ -706,7 +922,7 @@ void panAndExpand(std::shared_ptr<AudioSourceInstance>& aVoice,
             }
             break;
         case 2:
-            switch (aVoice->mChannels)
+            switch (aVoiceChannels)
             {
                 case 8: // 8->2, just sum lefties and righties, add a bit of center and sub?
                     for (size_t j = 0; j < aSamplesToRead; ++j)
@@ -882,7 +1098,7 @@ void panAndExpand(std::shared_ptr<AudioSourceInstance>& aVoice,
             }
             break;
         case 4:
-            switch (aVoice->mChannels)
+            switch (aVoiceChannels)
             {
                 case 8: // 8->4, add a bit of center, sub?
                     for (size_t j = 0; j < aSamplesToRead; ++j)
@@ -975,7 +1191,7 @@ void panAndExpand(std::shared_ptr<AudioSourceInstance>& aVoice,
             }
             break;
         case 6:
-            switch (aVoice->mChannels)
+            switch (aVoiceChannels)
             {
                 case 8: // 8->6
                     for (size_t j = 0; j < aSamplesToRead; ++j)
@@ -1086,7 +1302,7 @@ void panAndExpand(std::shared_ptr<AudioSourceInstance>& aVoice,
             }
             break;
         case 8:
-            switch (aVoice->mChannels)
+            switch (aVoiceChannels)
             {
                 case 8: // 8->8
                     for (size_t j = 0; j < aSamplesToRead; ++j)
@@ -1217,10 +1433,147 @@ void panAndExpand(std::shared_ptr<AudioSourceInstance>& aVoice,
             }
             break;
     }
+}
 
-    for (size_t k = 0; k < aChannels; k++)
+void Engine::mixListenerVoice_internal(size_t aVoice,
+                                       float* aScratch,
+                                       size_t aSamplesToRead,
+                                       size_t aBufferSize,
+                                       size_t aChannels,
+                                       bool   aSilent)
+{
+    const auto& voice = *mVoice[aVoice];
+
+    for (size_t l = 0; l < mListenerMixCount; ++l)
+    {
+        auto& mix = *mListener[l];
+
+        // 3d voices have their own volumes per listener; the rest sound the same to everyone
+        auto volume = std::array<float, MAX_CHANNELS>{};
+        for (size_t k = 0; k < aChannels; ++k)
+        {
+            if (voice.mFlags.Process3D)
+            {
+                volume[k] = mix.mChannelVolume[aVoice][k] * voice.mSetVolume * mix.m3dVolume[aVoice];
+            }
+            else
+            {
+                volume[k] = voice.mChannelVolume[k] * voice.mOverallVolume;
+            }
+        }
+
+        auto& current = mix.mCurrentVolume[aVoice];
+        if (!mix.mSynced[aVoice])
+        {
+            current             = volume;
+            mix.mSynced[aVoice] = true;
+        }
+
+        if (!aSilent)
+        {
+            panAndExpand(voice.mChannels,
+                         mix.mOutput.mData,
+                         aSamplesToRead,
+                         aBufferSize,
+                         aScratch,
+                         aChannels,
+                         current,
+                         volume);
+        }
+
+        current = volume;
+    }
+}
+
+void Engine::mixSends_internal(size_t aVoice,
+                               float* aScratch,
+                               size_t aSamplesToRead,
+                               size_t aBufferSize,
+                               size_t aChannels,
+                               bool   aSilent)
+{
+    auto& voice = *mVoice[aVoice];
+
+    for (size_t i = 0; i < SENDS_PER_STREAM; ++i)
     {
-        aVoice->mCurrentChannelVolume[k] = pand[k];
+        const auto& send = voice.mSend[i];
+        if (send.mBusHandle == 0)
+        {
+            continue;
+        }
+
+        const int ch = getVoiceFromHandle_internal(send.mBusHandle);
+        if (ch == -1 || !mVoice[ch]->mFlags.SendReturn)
+        {
+            continue;
+        }
+
+        auto*        bus      = static_cast<BusInstance*>(mVoice[ch].get());
+        auto&        state    = voice.mSendState[i];
+        auto         volume   = std::array<float, MAX_CHANNELS>{};
+        auto         audible  = false;
+        const size_t channels = bus->mChannels;
+
+        // The channel volumes are laid out for the parent bus. A return bus with another layout
+        // pans the voice again: by its pan, or by the side a 3d voice is heard from.
+        auto pan = voice.mChannelVolume;
+        if (channels != aChannels)
+        {
+            pan.fill(1.0f);
+
+            if (voice.mFlags.Process3D)
+            {
+                const auto& v = m3dData[aVoice];
+                panChannelVolumes(std::clamp(-v.mDirection.mX, -1.0f, 1.0f), channels, pan);
+                for (auto& p : pan)
+                {
+                    p *= v.m3dVolume;
+                }
+            }
+            else
+            {
+                panChannelVolumes(voice.mPan, channels, pan);
+            }
+
+            // A mono bus takes the voice at full volume wherever it is panned
+            if (channels == 1)
+            {
+                pan[0] = voice.mFlags.Process3D ? m3dData[aVoice].m3dVolume : 1.0f;
+            }
+        }
+
+        const float level = send.mPreFader ? send.mLevel : send.mLevel * voice.mOverallVolume;
+        for (size_t k = 0; k < channels; ++k)
+        {
+            volume[k] = pan[k] * level;
+            audible   = audible || volume[k] != 0 || state.mCurrentVolume[k] != 0;
+        }
+
+        if (aSilent || !audible)
+        {
+            // Keep the send's place in the return bus so it resumes in sync
+            state.mCurrentVolume  = volume;
+            state.mCursor        += aSamplesToRead;
+            continue;
+        }
+
+        for (size_t k = 0; k < channels; ++k)
+        {
+            memset(mSendScratch.mData + k * aBufferSize, 0, sizeof(float) * aSamplesToRead);
+        }
+
+        panAndExpand(voice.mChannels,
+                     mSendScratch.mData,
+                     aSamplesToRead,
+                     aBufferSize,
+                     aScratch,
+                     channels,
+                     state.mCurrentVolume,
+                     volume);
+
+        state.mCurrentVolume = volume;
+
+        bus->addSend_internal(mSendScratch.mData, aBufferSize, aSamplesToRead, state);
     }
 }
 
@@ -1228,7 +1581,7 @@ void Engine::mixBus_internal(float*    aBuffer,
                              size_t    aSamplesToRead,
                              size_t    aBufferSize,
                              float*    aScratch,
-                             size_t    aBus,
+                             handle    aBus,
                              float     aSamplerate,
                              size_t    aChannels,
                              Resampler aResampler)
@@ -1261,6 +1614,12 @@ void Engine::mixBus_internal(float*    aBuffer,
             size_t step_fixed = (int)floor(step * FIXPOINT_FRAC_MUL);
             size_t outofs     = 0;
 
+            // Silent or muted stretches skip the resampler, and whole silent blocks skip the panning.
+            // A voice muted in the master mix may still be heard by the other listeners.
+            const bool muted =
+                isMuted(*voice, aChannels) && (aBus != 0 || mListenerMixCount == 0);
+            bool audible = false;
+
             if (voice->mDelaySamples)
             {
                 if (voice->mDelaySamples > aSamplesToRead)
@@ -1289,6 +1648,7 @@ void Engine::mixBus_internal(float*    aBuffer,
                     float* t                = voice->mResampleData[0];
                     voice->mResampleData[0] = voice->mResampleData[1];
                     voice->mResampleData[1] = t;
+                    std::swap(voice->mResampleSilent[0], voice->mResampleSilent[1]);
 
                     // Get a block of source data
 
@@ -1345,18 +1705,14 @@ void Engine::mixBus_internal(float*    aBuffer,
 
                     // Run the per-stream filters to get our source data
 
-                    for (size_t j = 0; j < FILTERS_PER_STREAM; ++j)
-                    {
-                        if (voice->mFilter[j])
-                        {
-                            voice->mFilter[j]->filter(voice->mResampleData[0],
-                                                      SAMPLE_GRANULARITY,
-                                                      SAMPLE_GRANULARITY,
-                                                      voice->mChannels,
-                                                      voice->mSamplerate,
-                                                      mStreamTime);
-                        }
-                    }
+                    voice->mResampleSilent[0] = runFilters(voice->mFilter,
+                                                           voice->mResampleData[0],
+                                                           SAMPLE_GRANULARITY,
+                                                           SAMPLE_GRANULARITY,
+                                                           voice->mChannels,
+                                                           voice->mSamplerate,
+                                                           mStreamTime,
+                                                           voice->mSilentSamples);
                 }
                 else
                 {
@@ -1389,8 +1745,18 @@ void Engine::mixBus_internal(float*    aBuffer,
                 }
 
                 // Call resampler to generate the samples, once per channel
-                if (writesamples)
+                if (writesamples && (muted || (voice->mResampleSilent[0] &&
+                                               voice->mResampleSilent[1])))
+                {
+                    for (size_t j = 0; j < voice->mChannels; ++j)
+                    {
+                        memset(aScratch + aBufferSize * j + outofs, 0, sizeof(float) * writesamples);
+                    }
+                }
+                else if (writesamples)
                 {
+                    audible = true;
+
                     for (size_t j = 0; j < voice->mChannels; ++j)
                     {
                         switch (aResampler)
@@ -1438,12 +1804,95 @@ void Engine::mixBus_internal(float*    aBuffer,
                 voice->mSrcOffset += writesamples * step_fixed;
             }
 
+            if (!voice->mPropagation.mRing.empty())
+            {
+                audible = propagationDelay(voice->mPropagation,
+                                           aScratch,
+                                           voice->mChannels,
+                                           aSamplesToRead,
+                                           aBufferSize,
+                                           audible);
+            }
+
+            if (audible)
+            {
+                occlusionLowpass(voice->mOcclusion,
+                                 aScratch,
+                                 voice->mChannels,
+                                 aSamplesToRead,
+                                 aBufferSize);
+            }
+
             // Handle panning and channel expansion (and/or shrinking)
-            panAndExpand(voice, aBuffer, aSamplesToRead, aBufferSize, aScratch, aChannels);
+            auto volume = std::array<float, MAX_CHANNELS>{};
+            for (size_t k = 0; k < aChannels; ++k)
+            {
+                volume[k] = voice->mChannelVolume[k] * voice->mOverallVolume;
+            }
 
-            // clear voice if the sound is over
+            const bool ambisonic = voice->mFlags.Ambisonic && aBus == 0 && mAmbisonics;
+            const bool binaural =
+                voice->mFlags.Binaural && aBus == 0 && aChannels == 2 && mHrtf;
+
+            if (audible && ambisonic)
+            {
+                mAmbisonics->addVoice(aScratch,
+                                      voice->mChannels,
+                                      aBufferSize,
+                                      aSamplesToRead,
+                                      voice->mAmbisonic,
+                                      volume[0]);
+            }
+            else if (audible && binaural)
+            {
+                mHrtf->addVoice(aScratch,
+                                voice->mChannels,
+                                aBufferSize,
+                                aSamplesToRead,
+                                voice->mHrtf,
+                                voice->mCurrentChannelVolume[0],
+                                volume[0],
+                                aBuffer,
+                                aBufferSize);
+            }
+            else if (audible)
+            {
+                panAndExpand(voice->mChannels,
+                             aBuffer,
+                             aSamplesToRead,
+                             aBufferSize,
+                             aScratch,
+                             aChannels,
+                             voice->mCurrentChannelVolume,
+                             volume);
+            }
+            else
+            {
+                voice->mHrtf.mSynced      = false;
+                voice->mAmbisonic.mSynced = false;
+            }
+
+            for (size_t k = 0; k < aChannels; ++k)
+            {
+                voice->mCurrentChannelVolume[k] = volume[k];
+            }
+
+            if (aBus == 0 && mListenerMixCount > 0)
+            {
+                mixListenerVoice_internal(
+                    mActiveVoice[i], aScratch, aSamplesToRead, aBufferSize, aChannels, !audible);
+            }
+
+            mixSends_internal(
+                mActiveVoice[i], aScratch, aSamplesToRead, aBufferSize, aChannels, !audible);
+
+            // clear voice if the sound is over, and what's still travelling has arrived
             // TODO: check this condition some day
-            if (!voice->mFlags.Looping && !voice->mFlags.DisableAutostop && voice->hasEnded())
+            const auto& propagation = voice->mPropagation;
+            const bool  arrived =
+                propagation.mRing.empty() || propagation.mSilence > size_t(propagation.mDelay) + 2;
+            if (!voice->mFlags.Looping && !voice->mFlags.DisableAutostop && voice->hasEnded() &&
+                arrived)
             {
                 stopVoice_internal(mActiveVoice[i]);
             }
@@ -1564,6 +2013,26 @@ void Engine::mixBus_internal(float*    aBuffer,
             }
         }
     }
+
+    // The ambisonic bus is decoded once, through the HRTF grid if there is one
+    if (aBus == 0 && mAmbisonics)
+    {
+        if (aChannels == 2 && mHrtf)
+        {
+            mAmbisonics->decode(*mHrtf, aSamplesToRead);
+        }
+        else
+        {
+            mAmbisonics->decode(
+                aBuffer, aSamplesToRead, aBufferSize, aChannels, m3dSpeakerPosition);
+        }
+    }
+
+    // Binaural voices sharing grid directions are convolved once per direction
+    if (aBus == 0 && aChannels == 2 && mHrtf)
+    {
+        mHrtf->render(aBuffer, aSamplesToRead, aBufferSize);
+    }
 }
 
 void Engine::mapResampleBuffers_internal()
@@ -1660,13 +2129,27 @@ void Engine::calcActiveVoices_internal()
                 mustlive++;
             }
         }
+        else if (voice->mFlags.InaudibleVirtual && !voice->mFlags.Paused)
+        {
+            voice->mFlags.Virtual = true;
+        }
     }
 
+    // Return busses are mixed after the voices that send to them. Busses always tick, so they're
+    // among the must-live voices and survive the sort below.
+    const auto sendsLast = [this] {
+        std::partition(mActiveVoice.begin(),
+                       mActiveVoice.begin() + mActiveVoiceCount,
+                       [this](size_t aVoice) { return !mVoice[aVoice]->mFlags.SendReturn; });
+    };
+
     // Check for early out
     if (candidates <= mMaxActiveVoices)
     {
         // everything is audible, early out
         mActiveVoiceCount = candidates;
+        sendsLast();
+        updateVirtualVoices_internal(candidates);
         mapResampleBuffers_internal();
         return;
     }
@@ -1679,11 +2162,20 @@ void Engine::calcActiveVoices_internal()
         // ate all our active voice slots.
         // This is a potentially an error situation, but we have no way to report
         // error from here. And asserting could be bad, too.
+        sendsLast();
+        updateVirtualVoices_internal(candidates);
+        mapResampleBuffers_internal();
         return;
     }
 
     // If we get this far, there's nothing to it: we'll have to sort the voices to find the most
-    // audible.
+    // audible. Higher priority voices rank above all lower priority ones.
+    const auto ranksAbove = [this](size_t aVoice, size_t aOther) {
+        const auto& voice = *mVoice[aVoice];
+        const auto& other = *mVoice[aOther];
+        return voice.mPriority != other.mPriority ? voice.mPriority > other.mPriority
+                                                  : voice.mOverallVolume > other.mOverallVolume;
+    };
 
     // Iterative partial quicksort:
     int       left = 0, stack[24], pos = 0;
@@ -1699,28 +2191,27 @@ void Engine::calcActiveVoices_internal()
                 len = stack[pos = 0];
             }
 
-            const int   pivot    = data[left];
-            const float pivotvol = mVoice[pivot]->mOverallVolume;
-            stack[pos++]         = len;
+            const size_t pivot = data[left];
+            stack[pos++]       = len;
 
             for (int right = left - 1;;)
             {
                 do
                 {
                     ++right;
-                } while (mVoice[data[right]]->mOverallVolume > pivotvol);
+                } while (ranksAbove(data[right], pivot));
 
                 do
                 {
                     --len;
-                } while (pivotvol > mVoice[data[len]]->mOverallVolume);
+                } while (ranksAbove(pivot, data[len]));
 
                 if (right >= len)
                 {
                     break;
                 }
 
-                std::swap(data[left], data[right]);
+                std::swap(data[right], data[len]);
             }
         }
 
@@ -1739,10 +2230,78 @@ void Engine::calcActiveVoices_internal()
     }
 
     // TODO: should the rest of the voices be flagged INAUDIBLE?
+    sendsLast();
+    updateVirtualVoices_internal(candidates);
     mapResampleBuffers_internal();
 }
 
-void Engine::mix_internal(size_t aSamples, size_t aStride)
+// A virtual voice keeps its slot and handle, so going virtual and back costs no bookkeeping,
+// but virtual voices are bounded by VOICE_COUNT with the rest.
+void Engine::updateVirtualVoices_internal(size_t aCandidates)
+{
+    for (size_t i = 0; i < aCandidates; ++i)
+    {
+        auto& voice = *mVoice[mActiveVoice[i]];
+
+        if (i < mActiveVoiceCount && voice.mFlags.Virtual)
+        {
+            resumeVirtualVoice_internal(mActiveVoice[i]);
+        }
+        else if (i >= mActiveVoiceCount && voice.mFlags.InaudibleVirtual)
+        {
+            voice.mFlags.Virtual = true;
+        }
+    }
+}
+
+void Engine::resumeVirtualVoice_internal(size_t aVoice)
+{
+    auto& voice = *mVoice[aVoice];
+
+    voice.mFlags.Virtual = false;
+
+    // Wrap the play position into the loop
+    auto       position = voice.mStreamPosition;
+    const auto length   = voice.getLength();
+    if (voice.mFlags.Looping && length && *length > voice.mLoopPoint && position >= *length)
+    {
+        const time_t loop  = *length - voice.mLoopPoint;
+        const time_t loops = floor((position - voice.mLoopPoint) / loop);
+        voice.mLoopCount += size_t(loops);
+        position -= loops * loop;
+    }
+
+    voice.seek(position, mScratch.mData, mScratchSize);
+
+    // Start over with a new block of source data, and ramp the volume up from zero over it
+    voice.mSrcOffset       = 0;
+    voice.mLeftoverSamples = 0;
+    voice.mResampleSilent  = {};
+
+    voice.mCurrentChannelVolume = {};
+    voice.mAmbisonic.mGain      = {};
+    voice.mAmbisonic.mSynced    = true;
+    for (const auto& mix : mListener)
+    {
+        mix->mCurrentVolume[aVoice] = {};
+        mix->mSynced[aVoice]        = true;
+    }
+
+    // Binaural voices ramp up from the channel volume too, but start over with a clear history
+    voice.mHrtf.mSynced = false;
+
+    // Whatever was travelling when the voice went virtual is gone
+    auto& propagation = voice.mPropagation;
+    std::fill(propagation.mRing.begin(), propagation.mRing.end(), 0.0f);
+    propagation.mSilence = propagation.mLength;
+    propagation.mSynced  = false;
+}
+
+void Engine::mix_internal(size_t                       aSamples,
+                          size_t                       aStride,
+                          std::span<const ChannelArea> aAreas,
+                          SampleFormat                 aFormat,
+                          std::span<float* const>      aListenerBuffers)
 {
 #ifdef __arm__
     // flush to zero (FTZ) for ARM
@@ -1823,6 +2382,18 @@ void Engine::mix_internal(size_t aSamples, size_t aStride)
             mVoice[i]->mStreamPosition +=
                 double(buffertime) * double(mVoice[i]->mOverallRelativePlaySpeed);
 
+            // Virtual voices only track their play position, so they end when it passes the end
+            if (mVoice[i]->mFlags.Virtual && !mVoice[i]->mFlags.Looping &&
+                !mVoice[i]->mFlags.DisableAutostop)
+            {
+                const auto length = mVoice[i]->getLength();
+                if (length && mVoice[i]->mStreamPosition >= *length)
+                {
+                    stopVoice_internal(i);
+                    continue;
+                }
+            }
+
             // TODO: this is actually unstable, because mStreamTime depends on the relative play
             // speed.
             if (mVoice[i]->mRelativePlaySpeedFader.mActive > 0)
@@ -1877,6 +2448,18 @@ void Engine::mix_internal(size_t aSamples, size_t aStride)
         calcActiveVoices_internal();
     }
 
+    mPublishedActiveVoiceCount.store(mActiveVoiceCount, std::memory_order_relaxed);
+
+    // The other listeners are mixed alongside the master bus
+    mListenerMixCount = std::min(aListenerBuffers.size(), mListener.size());
+    for (size_t l = 0; l < mListenerMixCount; ++l)
+    {
+        for (size_t c = 0; c < mChannels; ++c)
+        {
+            memset(mListener[l]->mOutput.mData + c * aStride, 0, sizeof(float) * aSamples);
+        }
+    }
+
     mixBus_internal(mOutputScratch.mData,
                     aSamples,
                     aStride,
@@ -1886,125 +2469,110 @@ void Engine::mix_internal(size_t aSamples, size_t aStride)
                     mChannels,
                     mResampler);
 
-    for (size_t i = 0; i < FILTERS_PER_STREAM; ++i)
+    runFilters(mFilterInstance,
+               mOutputScratch.mData,
+               aSamples,
+               aStride,
+               mChannels,
+               float(mSamplerate),
+               mStreamTime,
+               mSilentSamples);
+
+    for (size_t l = 0; l < mListenerMixCount; ++l)
     {
-        if (mFilterInstance[i])
+        auto areas = std::array<ChannelArea, MAX_CHANNELS>{};
+        for (size_t c = 0; c < mChannels; ++c)
         {
-            mFilterInstance[i]->filter(mOutputScratch.mData,
-                                       aSamples,
-                                       aStride,
-                                       mChannels,
-                                       float(mSamplerate),
-                                       mStreamTime);
+            areas[c].mAddress = aListenerBuffers[l] + c;
+            areas[c].mStep    = sizeof(float) * mChannels;
         }
-    }
 
-    unlockAudioMutex_internal();
-
-    // Note: clipping channels*aStride, not channels*aSamples, so we're possibly clipping some
-    // unused data. The buffers should be large enough for it, we just may do a few bytes of
-    // unneccessary work.
-    clip_internal(mOutputScratch, mScratch, aStride, globalVolume[0], globalVolume[1]);
+        output_internal(mListener[l]->mOutput.mData,
+                        {areas.data(), mChannels},
+                        aSamples,
+                        aStride,
+                        SampleFormat::Float32,
+                        globalVolume[0],
+                        globalVolume[1]);
+    }
+    mListenerMixCount = 0;
 
-    if (mFlags.EnableVisualization)
+    // The limiter works on the signal after global volume, so it applies the volume itself
+    if (mLimiter)
     {
-        for (size_t i = 0; i < MAX_CHANNELS; ++i)
-        {
-            mVisualizationChannelVolume[i] = 0;
-        }
+        mLimiter->process(
+            mOutputScratch.mData, aSamples, aStride, globalVolume[0], globalVolume[1]);
+        globalVolume[0] = 1;
+        globalVolume[1] = 1;
+    }
 
-        if (aSamples > 255)
+    // Times, positions and loop counts moved on
+    for (size_t i = 0; i < mHighestVoice; ++i)
+    {
+        if (mVoice[i])
         {
-            for (size_t i = 0; i < 256; ++i)
-            {
-                mVisualizationWaveData[i] = 0;
-                for (size_t j = 0; j < mChannels; ++j)
-                {
-                    const auto sample = mScratch.mData[i + j * aStride];
-                    const auto absvol = fabs(sample);
-
-                    if (mVisualizationChannelVolume[j] < absvol)
-                    {
-                        mVisualizationChannelVolume[j] = absvol;
-                    }
-
-                    mVisualizationWaveData[i] += sample;
-                }
-            }
+            publishVoice_internal(i);
         }
-        else
-        {
-            // Very unlikely failsafe branch
-            for (size_t i = 0; i < 256; ++i)
-            {
-                mVisualizationWaveData[i] = 0;
+    }
 
-                for (size_t j = 0; j < mChannels; ++j)
-                {
-                    const auto sample = mScratch.mData[(i % aSamples) + j * aStride];
-                    const auto absvol = fabs(sample);
+    unlockAudioMutex_internal();
 
-                    if (mVisualizationChannelVolume[j] < absvol)
-                    {
-                        mVisualizationChannelVolume[j] = absvol;
-                    }
+    // Volume and clipping happen in place, then the samples are converted into the destination
+    output_internal(
+        mOutputScratch.mData, aAreas, aSamples, aStride, aFormat, globalVolume[0], globalVolume[1]);
 
-                    mVisualizationWaveData[i] += sample;
-                }
-            }
-        }
+    if (mFlags.EnableVisualization)
+    {
+        updateVisualization_internal(aSamples, aStride);
     }
 }
 
 void Engine::mix(float* aBuffer, size_t aSamples)
 {
-    size_t stride = (aSamples + 15) & ~0xf;
-    mix_internal(aSamples, stride);
-    interlace_samples_float(mScratch.mData, aBuffer, aSamples, mChannels, stride);
+    mixInterleaved(aBuffer, aSamples, SampleFormat::Float32);
 }
 
 void Engine::mixSigned16(short* aBuffer, size_t aSamples)
 {
-    size_t stride = (aSamples + 15) & ~0xf;
-    mix_internal(aSamples, stride);
-    interlace_samples_s16(mScratch.mData, aBuffer, aSamples, mChannels, stride);
+    mixInterleaved(aBuffer, aSamples, SampleFormat::Signed16);
 }
 
-void interlace_samples_float(const float* aSourceBuffer,
-                             float*       aDestBuffer,
-                             size_t       aSamples,
-                             size_t       aChannels,
-                             size_t       aStride)
+void Engine::mixInterleaved(void* aBuffer, size_t aSamples, SampleFormat aFormat)
 {
-    // 111222 -> 121212
-    for (size_t j = 0; j < aChannels; ++j)
+    const size_t size  = sampleSize(aFormat);
+    auto         areas = std::array<ChannelArea, MAX_CHANNELS>{};
+
+    for (size_t i = 0; i < mChannels; ++i)
     {
-        auto c = j * aStride;
-        for (auto i = j; i < aSamples * aChannels; i += aChannels)
-        {
-            aDestBuffer[i] = aSourceBuffer[c];
-            ++c;
-        }
+        areas[i].mAddress = static_cast<unsigned char*>(aBuffer) + i * size;
+        areas[i].mStep    = size * mChannels;
     }
+
+    mixChannelAreas({areas.data(), mChannels}, aSamples, aFormat);
 }
 
-void interlace_samples_s16(const float* aSourceBuffer,
-                           short*       aDestBuffer,
-                           size_t       aSamples,
-                           size_t       aChannels,
-                           size_t       aStride)
+void Engine::mixChannelAreas(std::span<const ChannelArea> aAreas,
+                             size_t                       aSamples,
+                             SampleFormat                 aFormat)
 {
-    // 111222 -> 121212
-    for (size_t j = 0; j < aChannels; ++j)
-    {
-        size_t c = j * aStride;
+    size_t stride = (aSamples + 15) & ~0xf;
+    mix_internal(aSamples, stride, aAreas, aFormat);
+}
 
-        for (size_t i = j; i < aSamples * aChannels; i += aChannels)
-        {
-            aDestBuffer[i] = short(aSourceBuffer[c] * 0x7fff);
-            ++c;
-        }
+void Engine::mixListeners(std::span<float* const> aBuffers, size_t aSamples)
+{
+    assert(aBuffers.size() >= getListenerCount());
+
+    auto areas = std::array<ChannelArea, MAX_CHANNELS>{};
+    for (size_t i = 0; i < mChannels; ++i)
+    {
+        areas[i].mAddress = aBuffers[0] + i;
+        areas[i].mStep    = sizeof(float) * mChannels;
     }
+
+    size_t stride = (aSamples + 15) & ~0xf;
+    mix_internal(
+        aSamples, stride, {areas.data(), mChannels}, SampleFormat::Float32, aBuffers.subspan(1));
 }
 
 void Engine::lockAudioMutex_internal()
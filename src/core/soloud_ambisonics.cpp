@@ -0,0 +1,445 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_ambisonics.hpp"
+#include "soloud_hrtf.hpp"
+#include "soloud_ramp.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+namespace
+{
+#ifdef SOLOUD_SSE_INTRINSICS
+// Four lanes, so that the harmonics below can be evaluated for four directions at once
+struct Quad
+{
+    __m128 mValue;
+
+    Quad(__m128 aValue)
+        : mValue(aValue)
+    {
+    }
+
+    Quad(float aValue)
+        : mValue(_mm_set1_ps(aValue))
+    {
+    }
+};
+
+inline Quad operator+(Quad a, Quad b)
+{
+    return _mm_add_ps(a.mValue, b.mValue);
+}
+
+inline Quad operator-(Quad a, Quad b)
+{
+    return _mm_sub_ps(a.mValue, b.mValue);
+}
+
+inline Quad operator*(Quad a, Quad b)
+{
+    return _mm_mul_ps(a.mValue, b.mValue);
+}
+#endif
+
+// Real spherical harmonics up to third order, ACN order and SN3D normalization, of a unit vector
+// with x to the front, y to the left and z up
+template <typename T>
+void sphericalHarmonics(T x, T y, T z, T* aOut)
+{
+    const T x2 = x * x;
+    const T y2 = y * y;
+    const T z2 = z * z;
+
+    aOut[0] = T(1.0f);
+
+    aOut[1] = y;
+    aOut[2] = z;
+    aOut[3] = x;
+
+    aOut[4] = T(1.7320508f) * x * y;
+    aOut[5] = T(1.7320508f) * y * z;
+    aOut[6] = T(1.5f) * z2 - T(0.5f);
+    aOut[7] = T(1.7320508f) * x * z;
+    aOut[8] = T(0.8660254f) * (x2 - y2);
+
+    aOut[9]  = T(0.7905694f) * y * (T(3.0f) * x2 - y2);
+    aOut[10] = T(3.8729833f) * x * y * z;
+    aOut[11] = T(0.6123724f) * y * (T(5.0f) * z2 - T(1.0f));
+    aOut[12] = T(0.5f) * z * (T(5.0f) * z2 - T(3.0f));
+    aOut[13] = T(0.6123724f) * x * (T(5.0f) * z2 - T(1.0f));
+    aOut[14] = T(1.9364917f) * z * (x2 - y2);
+    aOut[15] = T(0.7905694f) * x * (x2 - T(3.0f) * y2);
+}
+
+// Harmonics of a direction in engine axes (x left, y up, z forward)
+void sphericalHarmonics(const vec3& aDirection, float* aOut)
+{
+    sphericalHarmonics(aDirection.mZ, aDirection.mX, aDirection.mY, aOut);
+}
+
+size_t orderOf(size_t aChannel)
+{
+    return aChannel < 1 ? 0 : aChannel < 4 ? 1 : aChannel < 9 ? 2 : 3;
+}
+
+// Gauss-Legendre nodes and weights on [-1, 1] for 2 to 4 points
+constexpr float GAUSS_NODE[3][4] = {
+    {-0.5773503f, 0.5773503f},
+    {-0.7745967f, 0.0f, 0.7745967f},
+    {-0.8611363f, -0.3399810f, 0.3399810f, 0.8611363f},
+};
+
+constexpr float GAUSS_WEIGHT[3][4] = {
+    {1.0f, 1.0f},
+    {0.5555556f, 0.8888889f, 0.5555556f},
+    {0.3478548f, 0.6521452f, 0.6521452f, 0.3478548f},
+};
+} // namespace
+
+Ambisonics::Ambisonics(size_t aOrder, size_t aMaxSamples)
+    : mOrder(aOrder)
+    , mChannels((aOrder + 1) * (aOrder + 1))
+    , mMaxSamples(aMaxSamples)
+    , mBus(mChannels * aMaxSamples)
+    , mRotation(mChannels * mChannels)
+    , mMono(aMaxSamples)
+{
+    assert(aOrder >= 1 && aOrder <= 3);
+
+    // Max-rE weights: Legendre polynomials at the cosine of the spread of the order
+    const float re = cosf(2.4068f / (float(aOrder) + 1.51f));
+    mOrderWeight   = {1.0f, re, 1.5f * re * re - 0.5f, (2.5f * re * re - 1.5f) * re};
+
+    // Gauss-Legendre rings of elevation with evenly spaced azimuths, order + 1 rings of
+    // 2 * (order + 1) points
+    const size_t rings    = aOrder + 1;
+    const size_t azimuths = 2 * rings;
+    for (size_t r = 0; r < rings; ++r)
+    {
+        const float height = GAUSS_NODE[aOrder - 1][r];
+        const float weight = GAUSS_WEIGHT[aOrder - 1][r];
+        const float radius = sqrtf(1 - height * height);
+
+        for (size_t a = 0; a < azimuths; ++a)
+        {
+            const float azimuth = 2 * std::numbers::pi_v<float> * (a + 0.5f) / azimuths;
+            mPoint.push_back({radius * sinf(azimuth), height, radius * cosf(azimuth)});
+            mPointWeight.push_back(weight * 2 * std::numbers::pi_v<float> / azimuths);
+        }
+    }
+}
+
+size_t Ambisonics::getOrder() const
+{
+    return mOrder;
+}
+
+void Ambisonics::encode(std::span<const vec3>                            aDirections,
+                        std::span<std::array<float, AMBISONIC_CHANNELS>> aGains)
+{
+    assert(aGains.size() >= aDirections.size());
+
+    size_t i = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    for (; i + 4 <= aDirections.size(); i += 4)
+    {
+        const auto& d = aDirections;
+
+        const Quad x = _mm_setr_ps(d[i].mZ, d[i + 1].mZ, d[i + 2].mZ, d[i + 3].mZ);
+        const Quad y = _mm_setr_ps(d[i].mX, d[i + 1].mX, d[i + 2].mX, d[i + 3].mX);
+        const Quad z = _mm_setr_ps(d[i].mY, d[i + 1].mY, d[i + 2].mY, d[i + 3].mY);
+
+        Quad harmonics[AMBISONIC_CHANNELS] = {
+            0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        };
+        sphericalHarmonics(x, y, z, harmonics);
+
+        for (size_t c = 0; c < AMBISONIC_CHANNELS; ++c)
+        {
+            float lanes[4];
+            _mm_storeu_ps(lanes, harmonics[c].mValue);
+            for (size_t k = 0; k < 4; ++k)
+            {
+                aGains[i + k][c] = lanes[k];
+            }
+        }
+    }
+#endif
+
+    for (; i < aDirections.size(); ++i)
+    {
+        sphericalHarmonics(aDirections[i], aGains[i].data());
+    }
+}
+
+void Ambisonics::setOrientation(const std::array<vec3, 3>& aAxes)
+{
+    for (size_t i = 0; i < 3; ++i)
+    {
+        if (aAxes[i].mX != mAxes[i].mX || aAxes[i].mY != mAxes[i].mY ||
+            aAxes[i].mZ != mAxes[i].mZ)
+        {
+            mAxes          = aAxes;
+            mRotationDirty = true;
+            return;
+        }
+    }
+}
+
+void Ambisonics::addVoice(const float*         aBuffer,
+                          size_t               aChannels,
+                          size_t               aStride,
+                          size_t               aSamples,
+                          AmbisonicVoiceState& aState,
+                          float                aVolume)
+{
+    auto gain = std::array<float, AMBISONIC_CHANNELS>{};
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        gain[c] = aState.mTarget[c] * aVolume;
+    }
+
+    if (!aState.mSynced)
+    {
+        aState.mGain   = gain;
+        aState.mSynced = true;
+    }
+
+    const float* mono = aBuffer;
+    if (aChannels > 1)
+    {
+        const float scale = 1.0f / aChannels;
+        for (size_t i = 0; i < aSamples; ++i)
+        {
+            float sum = 0;
+            for (size_t ch = 0; ch < aChannels; ++ch)
+            {
+                sum += aBuffer[i + ch * aStride];
+            }
+            mMono[i] = sum * scale;
+        }
+        mono = mMono.data();
+    }
+
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        mixRamp(mono, &mBus[c * mMaxSamples], aSamples, aState.mGain[c], gain[c]);
+    }
+
+    aState.mGain = gain;
+    mBusUsed     = true;
+}
+
+bool Ambisonics::prepare()
+{
+    if (mRotationDirty)
+    {
+        // Project the harmonics of the rotated quadrature points back onto the harmonics
+        std::fill(mRotation.begin(), mRotation.end(), 0.0f);
+        for (size_t q = 0; q < mPoint.size(); ++q)
+        {
+            const auto& p       = mPoint[q];
+            const auto  rotated = vec3{mAxes[0].dot(p), mAxes[1].dot(p), mAxes[2].dot(p)};
+
+            float from[AMBISONIC_CHANNELS];
+            float to[AMBISONIC_CHANNELS];
+            sphericalHarmonics(p, from);
+            sphericalHarmonics(rotated, to);
+
+            for (size_t i = 0; i < mChannels; ++i)
+            {
+                for (size_t j = 0; j < mChannels; ++j)
+                {
+                    if (orderOf(i) == orderOf(j))
+                    {
+                        const float scale = (2 * orderOf(j) + 1) / (4 * std::numbers::pi_v<float>);
+                        mRotation[i * mChannels + j] += mPointWeight[q] * scale * to[i] * from[j];
+                    }
+                }
+            }
+        }
+        mRotationDirty = false;
+        mDecoderDirty  = true;
+    }
+
+    if (mDecoderDirty)
+    {
+        mMatrix.assign(mOutputs * mChannels, 0.0f);
+        for (size_t o = 0; o < mOutputs; ++o)
+        {
+            for (size_t j = 0; j < mChannels; ++j)
+            {
+                float sum = 0;
+                for (size_t i = 0; i < mChannels; ++i)
+                {
+                    sum += mDecoder[o * mChannels + i] * mRotation[i * mChannels + j];
+                }
+                mMatrix[o * mChannels + j] = sum;
+            }
+        }
+
+        if (mPreviousMatrix.size() != mMatrix.size())
+        {
+            mPreviousMatrix = mMatrix;
+        }
+        mDecoderDirty = false;
+    }
+
+    return mBusUsed;
+}
+
+void Ambisonics::clear(size_t aSamples)
+{
+    if (mBusUsed)
+    {
+        for (size_t c = 0; c < mChannels; ++c)
+        {
+            std::fill_n(&mBus[c * mMaxSamples], aSamples, 0.0f);
+        }
+        mBusUsed = false;
+    }
+    mPreviousMatrix = mMatrix;
+}
+
+void Ambisonics::decodeOutput(size_t aOutput, float* aBuffer, size_t aSamples) const
+{
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        const float g0 = mPreviousMatrix[aOutput * mChannels + c];
+        const float g1 = mMatrix[aOutput * mChannels + c];
+        if (g0 != 0 || g1 != 0)
+        {
+            mixRamp(&mBus[c * mMaxSamples], aBuffer, aSamples, g0, g1);
+        }
+    }
+}
+
+void Ambisonics::decode(float*                                aOutput,
+                        size_t                                aSamples,
+                        size_t                                aStride,
+                        size_t                                aChannels,
+                        const std::array<vec3, MAX_CHANNELS>& aSpeakers)
+{
+    bool changed = mBinaural || mOutputs != aChannels;
+    for (size_t s = 0; s < aChannels && !changed; ++s)
+    {
+        changed = aSpeakers[s].mX != mSpeakers[s].mX || aSpeakers[s].mY != mSpeakers[s].mY ||
+                  aSpeakers[s].mZ != mSpeakers[s].mZ;
+    }
+
+    if (changed)
+    {
+        // Sampling decoder with max-rE weighting, normalized so the feeds of a regular layout
+        // sum to the omni channel. Null speakers (subwoofers) get the omni channel.
+        mBinaural = false;
+        mOutputs  = aChannels;
+        mSpeakers = aSpeakers;
+        mDecoder.assign(mOutputs * mChannels, 0.0f);
+
+        size_t placed = 0;
+        for (size_t s = 0; s < aChannels; ++s)
+        {
+            placed += aSpeakers[s].isNull() ? 0 : 1;
+        }
+
+        for (size_t s = 0; s < aChannels; ++s)
+        {
+            if (aSpeakers[s].isNull() || placed < 2)
+            {
+                mDecoder[s * mChannels] = 1.0f;
+                continue;
+            }
+
+            float harmonics[AMBISONIC_CHANNELS];
+            sphericalHarmonics(normalize(aSpeakers[s]), harmonics);
+            for (size_t c = 0; c < mChannels; ++c)
+            {
+                const size_t order = orderOf(c);
+                mDecoder[s * mChannels + c] =
+                    (2 * order + 1) * mOrderWeight[order] * harmonics[c] / placed;
+            }
+        }
+        mDecoderDirty = true;
+        mPreviousMatrix.clear();
+    }
+
+    if (prepare())
+    {
+        for (size_t s = 0; s < aChannels; ++s)
+        {
+            decodeOutput(s, aOutput + s * aStride, aSamples);
+        }
+    }
+
+    clear(aSamples);
+}
+
+void Ambisonics::decode(Hrtf& aHrtf, size_t aSamples)
+{
+    if (!mBinaural)
+    {
+        // Projection onto the quadrature points, with max-rE weighting
+        mBinaural = true;
+        mOutputs  = mPoint.size();
+        mDecoder.assign(mOutputs * mChannels, 0.0f);
+
+        for (size_t q = 0; q < mPoint.size(); ++q)
+        {
+            float harmonics[AMBISONIC_CHANNELS];
+            sphericalHarmonics(mPoint[q], harmonics);
+            for (size_t c = 0; c < mChannels; ++c)
+            {
+                const size_t order = orderOf(c);
+                mDecoder[q * mChannels + c] = mPointWeight[q] * (2 * order + 1) *
+                                              mOrderWeight[order] * harmonics[c] /
+                                              (4 * std::numbers::pi_v<float>);
+            }
+        }
+        mDecoderDirty = true;
+        mPreviousMatrix.clear();
+    }
+
+    if (prepare())
+    {
+        for (size_t q = 0; q < mPoint.size(); ++q)
+        {
+            decodeOutput(q, aHrtf.input(aHrtf.nearest(mPoint[q]), aSamples), aSamples);
+        }
+    }
+
+    clear(aSamples);
+}
+}; // namespace SoLoud
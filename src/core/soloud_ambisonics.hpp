@@ -0,0 +1,119 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include "soloud_engine.hpp"
+#include <array>
+#include <span>
+#include <vector>
+
+namespace SoLoud
+{
+class Hrtf;
+
+// Ambisonic bus for 3d voices on the master bus, of first to third order. Channels are in ACN
+// order with SN3D normalization.
+//
+// Voices are encoded with the direction they have relative to the listener in world space, so
+// that turning the listener only changes a rotation matrix on the bus. The rotation is folded into
+// the decoder, which runs once per block however many voices were encoded.
+class Ambisonics
+{
+  public:
+    Ambisonics(size_t aOrder, size_t aMaxSamples);
+
+    size_t getOrder() const;
+
+    // Encoding gains of unit directions, four at a time
+    static void encode(std::span<const vec3>                                  aDirections,
+                       std::span<std::array<float, AMBISONIC_CHANNELS>> aGains);
+
+    // Set the listener orientation: its left, up and forward axes in world space
+    void setOrientation(const std::array<vec3, 3>& aAxes);
+
+    // Encode a block of a voice into the bus, ramping from the gains of the last block
+    void addVoice(const float*         aBuffer,
+                  size_t               aChannels,
+                  size_t               aStride,
+                  size_t               aSamples,
+                  AmbisonicVoiceState& aState,
+                  float                aVolume);
+
+    // Decode the bus to speakers at the given listener space positions, adding to aOutput
+    void decode(float*                                 aOutput,
+                size_t                                 aSamples,
+                size_t                                 aStride,
+                size_t                                 aChannels,
+                const std::array<vec3, MAX_CHANNELS>& aSpeakers);
+
+    // Decode the bus to virtual speakers, added to the inputs of their nearest HRTF directions
+    void decode(Hrtf& aHrtf, size_t aSamples);
+
+  private:
+    // Decoder for the current outputs, rotation included; returns false if the bus is empty
+    bool prepare();
+
+    // Add the decoded output aOutput of the bus to aBuffer
+    void decodeOutput(size_t aOutput, float* aBuffer, size_t aSamples) const;
+
+    // Clear the bus after decoding a block
+    void clear(size_t aSamples);
+
+    size_t mOrder;
+    size_t mChannels;
+    size_t mMaxSamples;
+
+    // Planar bus, mMaxSamples per channel
+    std::vector<float> mBus;
+    bool               mBusUsed = false;
+
+    // Max-rE weight of each order
+    std::array<float, 4> mOrderWeight{};
+
+    // Product quadrature on the sphere, exact for the products of two harmonics of the order.
+    // The points double as the virtual speakers of the binaural decoder.
+    std::vector<vec3>  mPoint;
+    std::vector<float> mPointWeight;
+
+    std::array<vec3, 3> mAxes{};
+    bool                mRotationDirty = true;
+    std::vector<float>  mRotation;
+
+    // Outputs the decoder was made for
+    std::array<vec3, MAX_CHANNELS> mSpeakers{};
+    size_t                         mOutputs  = 0;
+    bool                           mBinaural = false;
+    bool                           mDecoderDirty = true;
+
+    // Decoder without the rotation, and with it for this block and the last one
+    std::vector<float> mDecoder;
+    std::vector<float> mMatrix;
+    std::vector<float> mPreviousMatrix;
+
+    // Downmix of the voice being encoded
+    std::vector<float> mMono;
+};
+}; // namespace SoLoud
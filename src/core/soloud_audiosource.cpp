@@ -49,9 +49,11 @@ AudioSourceInstance::AudioSourceInstance()
     std::ranges::fill(mChannelVolume, 1.0f);
 }
 
-void AudioSourceInstance::init(AudioSource& aSource, int aPlayIndex)
+void AudioSourceInstance::init(AudioSource& aSource, size_t aPlayIndex)
 {
     mPlayIndex      = aPlayIndex;
+    mPriority       = aSource.priority;
+    mCategory       = aSource.category;
     mBaseSamplerate = aSource.base_sample_rate;
     mSamplerate     = mBaseSamplerate;
     mChannels       = aSource.channel_count;
@@ -79,10 +81,18 @@ void AudioSourceInstance::init(AudioSource& aSource, int aPlayIndex)
     {
         mFlags.InaudibleTick = true;
     }
+    if (aSource.inaudible_virtual)
+    {
+        mFlags.InaudibleVirtual = true;
+    }
     if (aSource.disable_autostop)
     {
         mFlags.DisableAutostop = true;
     }
+    if (aSource.occlusion_filter)
+    {
+        mFlags.OcclusionFilter = true;
+    }
 }
 
 bool AudioSourceInstance::rewind()
@@ -90,6 +100,11 @@ bool AudioSourceInstance::rewind()
     return false;
 }
 
+std::optional<time_t> AudioSourceInstance::getLength()
+{
+    return {};
+}
+
 bool AudioSourceInstance::seek(double aSeconds, float* mScratch, size_t mScratchSize)
 {
     double offset = aSeconds - mStreamPosition;
@@ -131,6 +146,14 @@ void AudioSource::setFilter(size_t aFilterId, Filter* aFilter)
     filter[aFilterId] = aFilter;
 }
 
+void AudioSource::setSend(size_t aSendId, handle aBusHandle, float aLevel, bool aPreFader)
+{
+    if (aSendId >= SENDS_PER_STREAM)
+        return;
+
+    sends[aSendId] = AudioSend{aBusHandle, aLevel, aPreFader};
+}
+
 void AudioSource::stop()
 {
     if (engine)
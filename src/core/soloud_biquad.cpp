@@ -0,0 +1,484 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_biquad.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+namespace Biquad
+{
+namespace
+{
+enum History
+{
+    X1 = 0,
+    X2,
+    Y1,
+    Y2
+};
+
+// Per sample change moving aFrom to aTo over 1 / aScale samples
+Coefficients rampStep(const Coefficients& aFrom, const Coefficients& aTo, float aScale)
+{
+    return {
+        .mB0 = (aTo.mB0 - aFrom.mB0) * aScale,
+        .mB1 = (aTo.mB1 - aFrom.mB1) * aScale,
+        .mB2 = (aTo.mB2 - aFrom.mB2) * aScale,
+        .mA1 = (aTo.mA1 - aFrom.mA1) * aScale,
+        .mA2 = (aTo.mA2 - aFrom.mA2) * aScale,
+    };
+}
+
+#ifdef SOLOUD_SSE_INTRINSICS
+struct QuadCoefficients
+{
+    __m128 mB0, mB1, mB2, mA1, mA2;
+
+    explicit QuadCoefficients(const Coefficients& aCoefficients = {})
+        : mB0(_mm_set1_ps(aCoefficients.mB0))
+        , mB1(_mm_set1_ps(aCoefficients.mB1))
+        , mB2(_mm_set1_ps(aCoefficients.mB2))
+        , mA1(_mm_set1_ps(aCoefficients.mA1))
+        , mA2(_mm_set1_ps(aCoefficients.mA2))
+    {
+    }
+
+    void add(const QuadCoefficients& aDelta)
+    {
+        mB0 = _mm_add_ps(mB0, aDelta.mB0);
+        mB1 = _mm_add_ps(mB1, aDelta.mB1);
+        mB2 = _mm_add_ps(mB2, aDelta.mB2);
+        mA1 = _mm_add_ps(mA1, aDelta.mA1);
+        mA2 = _mm_add_ps(mA2, aDelta.mA2);
+    }
+};
+
+struct QuadHistory
+{
+    __m128 mX1, mX2, mY1, mY2;
+};
+
+// Run one sample of four channels through all stages.
+template <bool RAMP>
+inline __m128 tickQuad(__m128                  aInput,
+                       QuadCoefficients*       aCoefficients,
+                       const QuadCoefficients* aDelta,
+                       QuadHistory*            aHistory,
+                       size_t                  aStages)
+{
+    for (size_t s = 0; s < aStages; ++s)
+    {
+        auto& c = aCoefficients[s];
+        auto& h = aHistory[s];
+
+        if constexpr (RAMP)
+        {
+            c.add(aDelta[s]);
+        }
+
+        __m128 y = _mm_mul_ps(c.mB0, aInput);
+        y        = _mm_add_ps(y, _mm_mul_ps(c.mB1, h.mX1));
+        y        = _mm_add_ps(y, _mm_mul_ps(c.mB2, h.mX2));
+        y        = _mm_sub_ps(y, _mm_mul_ps(c.mA1, h.mY1));
+        y        = _mm_sub_ps(y, _mm_mul_ps(c.mA2, h.mY2));
+
+        h.mX2  = h.mX1;
+        h.mX1  = aInput;
+        h.mY2  = h.mY1;
+        h.mY1  = y;
+        aInput = y;
+    }
+
+    return aInput;
+}
+
+// Filter up to four channels. Unused lanes repeat the first channel and aren't written back.
+template <bool RAMP>
+void processQuad(float* const*           aChannel,
+                 size_t                  aLanes,
+                 size_t                  aSamples,
+                 QuadCoefficients*       aCoefficients,
+                 const QuadCoefficients* aDelta,
+                 QuadHistory*            aHistory,
+                 size_t                  aStages)
+{
+    size_t i = 0;
+
+    // Transpose blocks of four samples so each vector holds one sample of every channel
+    for (; i + 4 <= aSamples; i += 4)
+    {
+        __m128 r0 = _mm_loadu_ps(aChannel[0] + i);
+        __m128 r1 = _mm_loadu_ps(aChannel[1] + i);
+        __m128 r2 = _mm_loadu_ps(aChannel[2] + i);
+        __m128 r3 = _mm_loadu_ps(aChannel[3] + i);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        r0 = tickQuad<RAMP>(r0, aCoefficients, aDelta, aHistory, aStages);
+        r1 = tickQuad<RAMP>(r1, aCoefficients, aDelta, aHistory, aStages);
+        r2 = tickQuad<RAMP>(r2, aCoefficients, aDelta, aHistory, aStages);
+        r3 = tickQuad<RAMP>(r3, aCoefficients, aDelta, aHistory, aStages);
+
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        const __m128 rows[4] = {r0, r1, r2, r3};
+        for (size_t k = 0; k < aLanes; ++k)
+        {
+            _mm_storeu_ps(aChannel[k] + i, rows[k]);
+        }
+    }
+
+    for (; i < aSamples; ++i)
+    {
+        const __m128 x =
+            _mm_setr_ps(aChannel[0][i], aChannel[1][i], aChannel[2][i], aChannel[3][i]);
+
+        alignas(16) float y[4];
+        _mm_store_ps(y, tickQuad<RAMP>(x, aCoefficients, aDelta, aHistory, aStages));
+        for (size_t k = 0; k < aLanes; ++k)
+        {
+            aChannel[k][i] = y[k];
+        }
+    }
+}
+#else
+template <bool RAMP>
+void processChannel(float*              aBuffer,
+                    size_t              aSamples,
+                    Coefficients*       aCoefficients,
+                    const Coefficients* aDelta,
+                    float (*aHistory)[4],
+                    size_t aStages)
+{
+    for (size_t i = 0; i < aSamples; ++i)
+    {
+        float x = aBuffer[i];
+        for (size_t s = 0; s < aStages; ++s)
+        {
+            auto& c = aCoefficients[s];
+            auto& h = aHistory[s];
+
+            if constexpr (RAMP)
+            {
+                c.mB0 += aDelta[s].mB0;
+                c.mB1 += aDelta[s].mB1;
+                c.mB2 += aDelta[s].mB2;
+                c.mA1 += aDelta[s].mA1;
+                c.mA2 += aDelta[s].mA2;
+            }
+
+            const float y =
+                c.mB0 * x + c.mB1 * h[X1] + c.mB2 * h[X2] - c.mA1 * h[Y1] - c.mA2 * h[Y2];
+
+            h[X2] = h[X1];
+            h[X1] = x;
+            h[Y2] = h[Y1];
+            h[Y1] = y;
+            x     = y;
+        }
+        aBuffer[i] = x;
+    }
+}
+#endif
+} // namespace
+
+Coefficients design(Shape aShape, float aFrequency, float aQ, float aGain, float aSamplerate)
+{
+    // Keep the frequency inside the audible band and the resonance finite
+    const double frequency = std::clamp(double(aFrequency), 1.0, 0.49 * aSamplerate);
+    const double q         = std::max(double(aQ), 0.01);
+
+    const double omega = 2.0 * M_PI * frequency / aSamplerate;
+    const double cs    = cos(omega);
+    const double alpha = sin(omega) / (2.0 * q);
+    const double a     = pow(10.0, aGain / 40.0);
+    const double beta  = 2.0 * sqrt(a) * alpha;
+
+    double b0 = 1, b1 = 0, b2 = 0, a0 = 1, a1 = 0, a2 = 0;
+
+    switch (aShape)
+    {
+        case Shape::Lowpass:
+            b0 = 0.5 * (1.0 - cs);
+            b1 = 1.0 - cs;
+            b2 = b0;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cs;
+            a2 = 1.0 - alpha;
+            break;
+        case Shape::Highpass:
+            b0 = 0.5 * (1.0 + cs);
+            b1 = -(1.0 + cs);
+            b2 = b0;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cs;
+            a2 = 1.0 - alpha;
+            break;
+        case Shape::Bandpass:
+            b0 = alpha;
+            b1 = 0.0;
+            b2 = -alpha;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cs;
+            a2 = 1.0 - alpha;
+            break;
+        case Shape::Notch:
+            b0 = 1.0;
+            b1 = -2.0 * cs;
+            b2 = 1.0;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cs;
+            a2 = 1.0 - alpha;
+            break;
+        case Shape::Peak:
+            b0 = 1.0 + alpha * a;
+            b1 = -2.0 * cs;
+            b2 = 1.0 - alpha * a;
+            a0 = 1.0 + alpha / a;
+            a1 = -2.0 * cs;
+            a2 = 1.0 - alpha / a;
+            break;
+        case Shape::LowShelf:
+            b0 = a * ((a + 1.0) - (a - 1.0) * cs + beta);
+            b1 = 2.0 * a * ((a - 1.0) - (a + 1.0) * cs);
+            b2 = a * ((a + 1.0) - (a - 1.0) * cs - beta);
+            a0 = (a + 1.0) + (a - 1.0) * cs + beta;
+            a1 = -2.0 * ((a - 1.0) + (a + 1.0) * cs);
+            a2 = (a + 1.0) + (a - 1.0) * cs - beta;
+            break;
+        case Shape::HighShelf:
+            b0 = a * ((a + 1.0) + (a - 1.0) * cs + beta);
+            b1 = -2.0 * a * ((a - 1.0) + (a + 1.0) * cs);
+            b2 = a * ((a + 1.0) + (a - 1.0) * cs - beta);
+            a0 = (a + 1.0) - (a - 1.0) * cs + beta;
+            a1 = 2.0 * ((a - 1.0) - (a + 1.0) * cs);
+            a2 = (a + 1.0) - (a - 1.0) * cs - beta;
+            break;
+        case Shape::Allpass:
+            b0 = 1.0 - alpha;
+            b1 = -2.0 * cs;
+            b2 = 1.0 + alpha;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cs;
+            a2 = 1.0 - alpha;
+            break;
+    }
+
+    return {
+        .mB0 = float(b0 / a0),
+        .mB1 = float(b1 / a0),
+        .mB2 = float(b2 / a0),
+        .mA1 = float(a1 / a0),
+        .mA2 = float(a2 / a0),
+    };
+}
+
+Cascade::Cascade(size_t aStages)
+{
+    setStageCount(aStages);
+}
+
+void Cascade::setStageCount(size_t aStages)
+{
+    assert(aStages <= MAX_STAGES);
+
+    for (size_t s = mStageCount; s < aStages; ++s)
+    {
+        mCurrent[s] = {};
+        mTarget[s]  = {};
+        mHistory[s] = {};
+    }
+
+    mStageCount = aStages;
+}
+
+void Cascade::setStage(size_t aStage, const Coefficients& aCoefficients)
+{
+    assert(aStage < mStageCount);
+
+    mTarget[aStage] = aCoefficients;
+    mChanged        = true;
+}
+
+void Cascade::reset()
+{
+    mCurrent = mTarget;
+    mHistory = {};
+    mChanged = false;
+}
+
+void Cascade::process(float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels)
+{
+    assert(aChannels <= MAX_CHANNELS);
+
+    if (mStageCount == 0 || aSamples == 0)
+    {
+        return;
+    }
+
+    const bool   ramp  = mChanged;
+    const float  scale = 1.0f / float(aSamples);
+    const size_t n     = mStageCount;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    QuadCoefficients delta[MAX_STAGES];
+    for (size_t s = 0; s < n && ramp; ++s)
+    {
+        delta[s] = QuadCoefficients{rampStep(mCurrent[s], mTarget[s], scale)};
+    }
+
+    for (size_t c = 0; c < aChannels; c += 4)
+    {
+        const size_t lanes = std::min<size_t>(aChannels - c, 4);
+
+        float* channel[4];
+        for (size_t k = 0; k < 4; ++k)
+        {
+            channel[k] = aBuffer + (c + (k < lanes ? k : 0)) * aStride;
+        }
+
+        QuadCoefficients coefficients[MAX_STAGES];
+        QuadHistory      history[MAX_STAGES];
+        for (size_t s = 0; s < n; ++s)
+        {
+            coefficients[s] = QuadCoefficients{mCurrent[s]};
+            history[s]      = {
+                _mm_loadu_ps(mHistory[s][X1].data() + c),
+                _mm_loadu_ps(mHistory[s][X2].data() + c),
+                _mm_loadu_ps(mHistory[s][Y1].data() + c),
+                _mm_loadu_ps(mHistory[s][Y2].data() + c),
+            };
+        }
+
+        if (ramp)
+        {
+            processQuad<true>(channel, lanes, aSamples, coefficients, delta, history, n);
+        }
+        else
+        {
+            processQuad<false>(channel, lanes, aSamples, coefficients, delta, history, n);
+        }
+
+        for (size_t s = 0; s < n; ++s)
+        {
+            _mm_storeu_ps(mHistory[s][X1].data() + c, history[s].mX1);
+            _mm_storeu_ps(mHistory[s][X2].data() + c, history[s].mX2);
+            _mm_storeu_ps(mHistory[s][Y1].data() + c, history[s].mY1);
+            _mm_storeu_ps(mHistory[s][Y2].data() + c, history[s].mY2);
+        }
+    }
+#else
+    Coefficients delta[MAX_STAGES];
+    for (size_t s = 0; s < n && ramp; ++s)
+    {
+        delta[s] = rampStep(mCurrent[s], mTarget[s], scale);
+    }
+
+    for (size_t c = 0; c < aChannels; ++c)
+    {
+        Coefficients coefficients[MAX_STAGES];
+        float        history[MAX_STAGES][4];
+        for (size_t s = 0; s < n; ++s)
+        {
+            coefficients[s] = mCurrent[s];
+            for (size_t k = 0; k < 4; ++k)
+            {
+                history[s][k] = mHistory[s][k][c];
+            }
+        }
+
+        if (ramp)
+        {
+            processChannel<true>(aBuffer + c * aStride, aSamples, coefficients, delta, history, n);
+        }
+        else
+        {
+            processChannel<false>(aBuffer + c * aStride, aSamples, coefficients, delta, history, n);
+        }
+
+        for (size_t s = 0; s < n; ++s)
+        {
+            for (size_t k = 0; k < 4; ++k)
+            {
+                mHistory[s][k][c] = history[s][k];
+            }
+        }
+    }
+#endif
+
+    // Land exactly on the targets rather than on the accumulated steps
+    mCurrent = mTarget;
+    mChanged = false;
+}
+
+void Cascade::process(
+    float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels, float aWet)
+{
+    mDry.save(aBuffer, aSamples, aStride, aChannels, aWet);
+    process(aBuffer, aSamples, aStride, aChannels);
+    mDry.mix(aBuffer, aSamples, aStride, aChannels);
+}
+
+double Cascade::getPoleRadius() const
+{
+    double radius = 0;
+
+    for (size_t s = 0; s < mStageCount; ++s)
+    {
+        // Poles are the roots of z^2 + a1 z + a2
+        const double a1   = mTarget[s].mA1;
+        const double a2   = mTarget[s].mA2;
+        const double disc = a1 * a1 - 4.0 * a2;
+
+        radius = std::max(radius,
+                          disc < 0 ? sqrt(fabs(a2))
+                                   : std::max(fabs((-a1 + sqrt(disc)) * 0.5),
+                                              fabs((-a1 - sqrt(disc)) * 0.5)));
+    }
+
+    return radius;
+}
+
+time_t Cascade::getTailLength(float aSamplerate) const
+{
+    // The impulse response decays with the largest pole radius per sample
+    const double radius = getPoleRadius();
+
+    if (radius >= 1)
+    {
+        return std::numeric_limits<time_t>::infinity();
+    }
+
+    const double samples = radius > 0 ? ceil(log(SILENCE_THRESHOLD) / log(radius)) : 2;
+    return std::max(samples, 2.0 * double(mStageCount)) / aSamplerate;
+}
+}; // namespace Biquad
+}; // namespace SoLoud
@@ -0,0 +1,116 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include "soloud.hpp"
+#include "soloud_ramp.hpp"
+#include <array>
+#include <cstddef>
+
+namespace SoLoud
+{
+namespace Biquad
+{
+enum class Shape
+{
+    Lowpass,
+    Highpass,
+    Bandpass,
+    Notch,
+    Peak,
+    LowShelf,
+    HighShelf,
+    Allpass
+};
+
+// Normalized coefficients of H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+struct Coefficients
+{
+    float mB0 = 1.0f;
+    float mB1 = 0.0f;
+    float mB2 = 0.0f;
+    float mA1 = 0.0f;
+    float mA2 = 0.0f;
+};
+
+// Coefficients from the Audio EQ Cookbook. aGain is in decibels and only used by the peak and
+// shelf shapes. A Linkwitz-Riley crossover is two stages of the Butterworth (Q = 1 / sqrt(2))
+// lowpass or highpass.
+Coefficients design(Shape aShape, float aFrequency, float aQ, float aGain, float aSamplerate);
+
+// Chain of biquads run on every channel of a planar buffer. Channels are processed four at a
+// time in SIMD lanes, running all stages on a sample before moving to the next.
+//
+// New coefficients are reached by interpolating them linearly over the next processed block, so
+// parameters can move every block without zipper noise and without evaluating the design per
+// sample. The stable region of (a1, a2) is a triangle, so the interpolated filters stay stable.
+class Cascade
+{
+  public:
+    static constexpr size_t MAX_STAGES = 16;
+
+    explicit Cascade(size_t aStages = 1);
+
+    size_t getStageCount() const
+    {
+        return mStageCount;
+    }
+
+    // Added stages start as a pass-through and move to their coefficients like any other change.
+    void setStageCount(size_t aStages);
+
+    void setStage(size_t aStage, const Coefficients& aCoefficients);
+
+    // Clear the history and jump to the current coefficients.
+    void reset();
+
+    // Filter aChannels channels of aSamples samples, aStride floats apart, in place.
+    void process(float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels);
+
+    // As above, mixed with the input at the wet level aWet, ramping to it from the last one.
+    void process(float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels, float aWet);
+
+    // Largest pole radius over the stages, which sets how fast the output decays.
+    double getPoleRadius() const;
+
+    // Time it takes the output to fall below SILENCE_THRESHOLD once the input has gone silent.
+    time_t getTailLength(float aSamplerate) const;
+
+  private:
+    // Coefficients per stage: the ones in use and the ones to reach over the next block
+    std::array<Coefficients, MAX_STAGES> mCurrent{};
+    std::array<Coefficients, MAX_STAGES> mTarget{};
+    size_t                               mStageCount = 0;
+    bool                                 mChanged    = false;
+
+    // Input of the block, kept while not fully wet
+    DryMix mDry;
+
+    // x[n-1], x[n-2], y[n-1], y[n-2] per stage, each holding one value per channel
+    std::array<std::array<std::array<float, MAX_CHANNELS>, 4>, MAX_STAGES> mHistory{};
+};
+}; // namespace Biquad
+}; // namespace SoLoud
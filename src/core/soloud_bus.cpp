@@ -25,6 +25,7 @@ freely, subject to the following restrictions:
 #include "soloud_bus.hpp"
 #include "soloud_fft.hpp"
 #include "soloud_internal.hpp"
+#include "soloud_sidechain.hpp"
 #include <algorithm>
 #include <cassert>
 
@@ -51,19 +52,52 @@ size_t BusInstance::getAudio(float* aBuffer, size_t aSamplesToRead, size_t aBuff
             aBuffer[i] = 0;
         }
 
-        return aSamplesToRead;
+        // A return bus may still receive sends without playing anything itself
+        if (mSendCapacity == 0)
+        {
+            return aSamplesToRead;
+        }
+    }
+    else
+    {
+        mParent->engine->mixBus_internal(aBuffer,
+                                         aSamplesToRead,
+                                         aBufferSize,
+                                         mScratch.mData,
+                                         handle,
+                                         mSamplerate,
+                                         mChannels,
+                                         mParent->mResampler);
     }
 
-    auto* s = mParent->engine;
+    if (mSendCapacity)
+    {
+        // Take the sends out of the ring, leaving it cleared for the next writes
+        const size_t pos   = mSendReadPos & (mSendCapacity - 1);
+        const size_t first = std::min(aSamplesToRead, mSendCapacity - pos);
+
+        for (size_t j = 0; j < mChannels; ++j)
+        {
+            float* ring = mSendBuffer.mData + j * mSendCapacity;
+            float* dst  = aBuffer + j * aBufferSize;
+
+            for (size_t i = 0; i < first; ++i)
+            {
+                dst[i] += ring[pos + i];
+            }
+            for (size_t i = first; i < aSamplesToRead; ++i)
+            {
+                dst[i] += ring[i - first];
+            }
 
-    s->mixBus_internal(aBuffer,
-                       aSamplesToRead,
-                       aBufferSize,
-                       mScratch.mData,
-                       handle,
-                       mSamplerate,
-                       mChannels,
-                       mParent->mResampler);
+            std::fill_n(ring + pos, first, 0.0f);
+            std::fill_n(ring, aSamplesToRead - first, 0.0f);
+        }
+
+        mSendReadPos += aSamplesToRead;
+    }
+
+    mSidechainLevel = measureLevel(aBuffer, aSamplesToRead, aBufferSize, mChannels);
 
     if (mParent->visualization_data)
     {
@@ -111,6 +145,62 @@ size_t BusInstance::getAudio(float* aBuffer, size_t aSamplesToRead, size_t aBuff
     return aSamplesToRead;
 }
 
+void BusInstance::enableSendReturn_internal(size_t aMaxSamples)
+{
+    if (mSendCapacity)
+    {
+        return;
+    }
+
+    // Writers stay a granule ahead of the reader, since the resampler pulls a whole granule before
+    // it's needed. Leave room for the largest write on top of that.
+    mSendCapacity = SAMPLE_GRANULARITY;
+    while (mSendCapacity < aMaxSamples + SAMPLE_GRANULARITY * 2)
+    {
+        mSendCapacity *= 2;
+    }
+
+    mSendBuffer = AlignedFloatBuffer{mSendCapacity * MAX_CHANNELS};
+    mSendBuffer.clear();
+    mSendReadPos      = 0;
+    mFlags.SendReturn = true;
+}
+
+void BusInstance::addSend_internal(const float*    aSource,
+                                   size_t          aStride,
+                                   size_t          aSamples,
+                                   AudioSendState& aState)
+{
+    // (Re)place writers that fell behind the reader or ran too far ahead of it, e.g. after
+    // a pause.
+    if (!aState.mSynced || aState.mCursor < mSendReadPos ||
+        aState.mCursor + aSamples > mSendReadPos + mSendCapacity)
+    {
+        aState.mCursor = mSendReadPos + SAMPLE_GRANULARITY;
+        aState.mSynced = true;
+    }
+
+    const size_t pos   = aState.mCursor & (mSendCapacity - 1);
+    const size_t first = std::min(aSamples, mSendCapacity - pos);
+
+    for (size_t j = 0; j < mChannels; ++j)
+    {
+        const float* src  = aSource + j * aStride;
+        float*       ring = mSendBuffer.mData + j * mSendCapacity;
+
+        for (size_t i = 0; i < first; ++i)
+        {
+            ring[pos + i] += src[i];
+        }
+        for (size_t i = first; i < aSamples; ++i)
+        {
+            ring[i - first] += src[i];
+        }
+    }
+
+    aState.mCursor += aSamples;
+}
+
 bool BusInstance::hasEnded()
 {
     return false;
@@ -270,23 +360,22 @@ float* Bus::calcFFT()
     if (mInstance && engine)
     {
         engine->lockAudioMutex_internal();
-        auto temp = std::array<float, 1024>{};
+        auto temp = std::array<float, 512>{};
         for (int i = 0; i < 256; ++i)
         {
-            temp[i * 2]     = mInstance->mVisualizationWaveData[i];
-            temp[i * 2 + 1] = 0;
-            temp[i + 512]   = 0;
-            temp[i + 768]   = 0;
+            temp[i] = mInstance->mVisualizationWaveData[i];
         }
         engine->unlockAudioMutex_internal();
 
-        FFT::fft1024(temp.data());
+        auto real = std::array<float, 256>{};
+        auto imag = std::array<float, 256>{};
+        FFT::getPlan(512).forward(temp.data(), real.data(), imag.data());
 
-        for (int i = 0; i < 256; ++i)
+        // imag[0] holds the Nyquist bin, which isn't shown
+        mFFTData[0] = fabsf(real[0]);
+        for (int i = 1; i < 256; ++i)
         {
-            const float real = temp[i * 2];
-            const float imag = temp[i * 2 + 1];
-            mFFTData[i]      = sqrt(real * real + imag * imag);
+            mFFTData[i] = sqrt(real[i] * real[i] + imag[i] * imag[i]);
         }
     }
 
@@ -321,6 +410,18 @@ float Bus::getApproximateVolume(size_t aChannel)
     return vol;
 }
 
+SidechainLevel Bus::getSidechainLevel()
+{
+    auto level = SidechainLevel{};
+    if (mInstance && engine)
+    {
+        engine->lockAudioMutex_internal();
+        level = mInstance->mSidechainLevel;
+        engine->unlockAudioMutex_internal();
+    }
+    return level;
+}
+
 size_t Bus::getActiveVoiceCount()
 {
     size_t count = 0;
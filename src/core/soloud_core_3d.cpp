@@ -22,10 +22,15 @@ freely, subject to the following restrictions:
    distribution.
 */
 
+#include "soloud_ambisonics.hpp"
+#include "soloud_hrtf.hpp"
 #include "soloud_internal.hpp"
+#include "soloud_spatial.hpp"
 #include "soloud_vec3.hpp"
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <vector>
 
 // 3d audio operations
 
@@ -35,15 +40,6 @@ struct mat3 : std::array<vec3, 3>
 {
 };
 
-static vec3 operator*(const mat3& m, const vec3& a)
-{
-    return {
-        m[0].mX * a.mX + m[0].mY * a.mY + m[0].mZ * a.mZ,
-        m[1].mX * a.mX + m[1].mY * a.mY + m[1].mZ * a.mZ,
-        m[2].mX * a.mX + m[2].mY * a.mY + m[2].mZ * a.mZ,
-    };
-}
-
 static mat3 lookatRH(const vec3& at, vec3 up)
 {
     const auto z = normalize(at);
@@ -53,149 +49,277 @@ static mat3 lookatRH(const vec3& at, vec3 up)
     return {x, y, z};
 }
 
-#ifndef MIN
-#define MIN(a, b) ((a) < (b)) ? (a) : (b)
-#endif
+void Engine::update3dVoices_internal(std::span<const size_t> voiceList)
+{
+    const auto makeListener = [&](vec3 aPosition, vec3 aVelocity, vec3 aAt, vec3 aUp) {
+        auto listener = SpatialListener{
+            .mPosition   = aPosition,
+            .mVelocity   = aVelocity,
+            .mAxes       = lookatRH(aAt, aUp),
+            .mSpeakers   = {},
+            .mChannels   = mChannels,
+            .mSoundSpeed = m3dSoundSpeed,
+        };
+
+        for (size_t i = 0; i < mChannels; ++i)
+            listener.mSpeakers[i] = normalize(m3dSpeakerPosition[i]);
+
+        return listener;
+    };
 
-#ifndef MAX
-#define MAX(a, b) ((a) > (b)) ? (a) : (b)
-#endif
+    auto listener = makeListener(m3dPosition, m3dVelocity, m3dAt, m3dUp);
 
-float doppler(
-    vec3 aDeltaPos, const vec3& aSrcVel, const vec3& aDstVel, float aFactor, float aSoundSpeed)
-{
-    float deltamag = aDeltaPos.mag();
-    if (deltamag == 0)
-        return 1.0f;
-    float vls      = aDeltaPos.dot(aDstVel) / deltamag;
-    float vss      = aDeltaPos.dot(aSrcVel) / deltamag;
-    float maxspeed = aSoundSpeed / aFactor;
-    vss            = MIN(vss, maxspeed);
-    vls            = MIN(vls, maxspeed);
-    return (aSoundSpeed - aFactor * vls) / (aSoundSpeed - aFactor * vss);
-}
+    SpatialBatch batch;
 
-float attenuateInvDistance(float aDistance,
-                           float aMinDistance,
-                           float aMaxDistance,
-                           float aRolloffFactor)
-{
-    float distance = MAX(aDistance, aMinDistance);
-    distance       = MIN(distance, aMaxDistance);
-    return aMinDistance / (aMinDistance + aRolloffFactor * (distance - aMinDistance));
+    for (size_t first = 0; first < voiceList.size(); first += SpatialBatch::CAPACITY)
+    {
+        const size_t count = std::min(SpatialBatch::CAPACITY, voiceList.size() - first);
+
+        batch.gather(voiceList.subspan(first, count), m3dData, listener);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto& v = m3dData[batch.mVoice[i]];
+
+            v.mColliderVolume = 1.0f;
+            if (v.mCollider != nullptr)
+            {
+                v.mColliderVolume = v.mCollider->collide(this, v, v.mColliderData);
+            }
+
+            batch.mVolume[i] = v.mColliderVolume;
+            batch.mVolume[i] *= 1.0f - v.mOcclusion * (1.0f - m3dOcclusionVolume);
+        }
+
+        batch.update(listener);
+
+        // cone
+        // (todo) vol *= conev;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto& v   = m3dData[batch.mVoice[i]];
+            float vol = batch.mVolume[i];
+
+            if (v.mAttenuator != nullptr)
+            {
+                vol *= v.mAttenuator->attenuate(batch.mDistance[i],
+                                                v.m3dMinDistance,
+                                                v.m3dMaxDistance,
+                                                v.m3dAttenuationRolloff);
+            }
+
+            v.mDopplerValue     = batch.mDoppler[i];
+            v.mPropagationDelay = batch.mDelay[i];
+
+            v.mWorldDirection = {
+                batch.mWorldDirectionX[i],
+                batch.mWorldDirectionY[i],
+                batch.mWorldDirectionZ[i],
+            };
+
+            v.mDirection = {batch.mDirectionX[i], batch.mDirectionY[i], batch.mDirectionZ[i]};
+
+            v.mChannelVolume = {};
+            for (size_t j = 0; j < mChannels; ++j)
+            {
+                v.mChannelVolume[j] = vol * batch.mPan[j][i];
+            }
+
+            v.m3dVolume = vol;
+        }
+
+        // Ambisonic gains of the batch
+        if (mAmbisonicOrder > 0)
+        {
+            using Gains = std::array<float, AMBISONIC_CHANNELS>;
+
+            auto directions = std::array<vec3, SpatialBatch::CAPACITY>{};
+            auto gains      = std::array<Gains, SpatialBatch::CAPACITY>{};
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                directions[i] = m3dData[batch.mVoice[i]].mWorldDirection;
+            }
+
+            Ambisonics::encode({directions.data(), count}, gains);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                m3dData[batch.mVoice[i]].mAmbisonicGain = gains[i];
+            }
+        }
+    }
+
+    // The other listeners only need volumes and panning. The collider ran once above.
+    for (const auto& mix : mListener)
+    {
+        listener = makeListener(mix->mPosition, mix->mVelocity, mix->mAt, mix->mUp);
+
+        for (size_t first = 0; first < voiceList.size(); first += SpatialBatch::CAPACITY)
+        {
+            const size_t count = std::min(SpatialBatch::CAPACITY, voiceList.size() - first);
+
+            batch.gather(voiceList.subspan(first, count), m3dData, listener);
+            batch.update(listener);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                const size_t voice = batch.mVoice[i];
+                const auto&  v     = m3dData[voice];
+                float        vol   = batch.mVolume[i] * v.mColliderVolume;
+
+                vol *= 1.0f - v.mOcclusion * (1.0f - m3dOcclusionVolume);
+
+                if (v.mAttenuator != nullptr)
+                {
+                    vol *= v.mAttenuator->attenuate(batch.mDistance[i],
+                                                    v.m3dMinDistance,
+                                                    v.m3dMaxDistance,
+                                                    v.m3dAttenuationRolloff);
+                }
+
+                mix->mTargetChannelVolume[voice] = {};
+                for (size_t j = 0; j < mChannels; ++j)
+                {
+                    mix->mTargetChannelVolume[voice][j] = vol * batch.mPan[j][i];
+                }
+
+                mix->mTarget3dVolume[voice] = vol;
+            }
+        }
+    }
 }
 
-float attenuateLinearDistance(float aDistance,
-                              float aMinDistance,
-                              float aMaxDistance,
-                              float aRolloffFactor)
+float Engine::loudest3dVolume_internal(size_t aVoice) const
 {
-    float distance = MAX(aDistance, aMinDistance);
-    distance       = MIN(distance, aMaxDistance);
-    return 1 - aRolloffFactor * (distance - aMinDistance) / (aMaxDistance - aMinDistance);
+    const auto& voice = *mVoice[aVoice];
+
+    float volume = voice.mOverallVolume;
+    for (const auto& mix : mListener)
+    {
+        volume = std::max(volume, voice.mSetVolume * mix->m3dVolume[aVoice]);
+    }
+
+    return volume;
 }
 
-float attenuateExponentialDistance(float aDistance,
-                                   float aMinDistance,
-                                   float aMaxDistance,
-                                   float aRolloffFactor)
+bool Engine::in3dCullingRange_internal(vec3 aPos, bool aListenerRelative) const
 {
-    float distance = MAX(aDistance, aMinDistance);
-    distance       = MIN(distance, aMaxDistance);
-    return pow(distance / aMinDistance, -aRolloffFactor);
+    const auto inRange = [&](vec3 aListener) {
+        const auto pos = aListenerRelative ? aPos : aPos - aListener;
+        return pos.mag() <= m3dCullingDistance;
+    };
+
+    return inRange(m3dPosition) || std::ranges::any_of(mListener, [&](const auto& aMix) {
+               return inRange(aMix->mPosition);
+           });
 }
 
-void Engine::update3dVoices_internal(std::span<const size_t> voiceList)
+void Engine::apply3dVoice_internal(size_t aVoice)
 {
-    auto speaker = std::array<vec3, MAX_CHANNELS>{};
+    const auto& v  = m3dData[aVoice];
+    const auto& vi = mVoice[aVoice];
 
-    for (size_t i = 0; i < mChannels; ++i)
-        speaker[i] = normalize(m3dSpeakerPosition[i]);
+    // Voices on other busses are mixed before the master bus, so they can only be panned
+    vi->mFlags.Ambisonic = mAmbisonics && vi->mBusHandle == 0;
+    vi->mFlags.Binaural  = !vi->mFlags.Ambisonic && mHrtf && vi->mBusHandle == 0;
 
-    const auto lpos = m3dPosition;
-    const auto lvel = m3dVelocity;
-    const auto at   = m3dAt;
-    const auto up   = m3dUp;
-    const auto m    = lookatRH(at, up);
+    if (vi->mFlags.Ambisonic)
+    {
+        // The decoder does the panning
+        vi->mChannelVolume = {};
+        for (size_t i = 0; i < mChannels; ++i)
+        {
+            vi->mChannelVolume[i] = v.m3dVolume;
+        }
+        vi->mAmbisonic.mTarget = v.mAmbisonicGain;
+    }
+    else if (vi->mFlags.Binaural)
+    {
+        // The HRTF does the panning; only the attenuation goes to both ears
+        vi->mChannelVolume    = {};
+        vi->mChannelVolume[0] = v.m3dVolume;
+        vi->mChannelVolume[1] = v.m3dVolume;
+        vi->mHrtf.mTarget     = mHrtf->locate(v.mDirection);
+    }
+    else
+    {
+        vi->mChannelVolume = v.mChannelVolume;
+    }
 
-    for (const size_t voice_id : voiceList)
+    // One-pole low-pass; the coefficient at full occlusion is scaled logarithmically
+    vi->mOcclusion.mTarget = 1.0f;
+    if (vi->mFlags.OcclusionFilter && m3dOcclusionCutoff > 0.0f && v.mOcclusion > 0.0f)
     {
-        auto& v = m3dData[voice_id];
+        const float full =
+            1.0f - std::exp(-2.0f * float(M_PI) * m3dOcclusionCutoff / float(mSamplerate));
 
-        auto vol = v.mCollider != nullptr ? v.mCollider->collide(this, v, v.mColliderData) : 1.0f;
+        vi->mOcclusion.mTarget = std::pow(full, v.mOcclusion);
+    }
 
-        auto       pos = v.m3dPosition;
-        const auto vel = v.m3dVelocity;
+    vi->mPropagation.mTarget        = v.mPropagationDelay * float(mSamplerate);
+    vi->mPropagation.mDopplerFactor = v.m3dDopplerFactor;
 
-        if (!v.mFlags.ListenerRelative)
-        {
-            pos = pos - lpos;
-        }
+    for (const auto& mix : mListener)
+    {
+        mix->m3dVolume[aVoice]      = mix->mTarget3dVolume[aVoice];
+        mix->mChannelVolume[aVoice] = mix->mTargetChannelVolume[aVoice];
+    }
+}
 
-        const float dist = pos.mag();
+void Engine::cull3dVoice_internal(size_t aVoice)
+{
+    auto& voice = *mVoice[aVoice];
 
-        // attenuation
+    m3dData[aVoice].mCulled = true;
+    voice.mFlags.Inaudible  = true;
+    mActiveVoiceDirty       = true;
 
-        if (v.mAttenuator != nullptr)
-        {
-            vol *= v.mAttenuator->attenuate(dist,
-                                            v.m3dMinDistance,
-                                            v.m3dMaxDistance,
-                                            v.m3dAttenuationRolloff);
-        }
-        else
+    if (voice.mFlags.InaudibleKill)
+    {
+        stopVoice_internal(aVoice);
+    }
+    else if (!voice.mFlags.InaudibleTick)
+    {
+        voice.mFlags.Virtual = true;
+    }
+}
+
+void Engine::occlude3dVoices_internal(std::span<const size_t> aVoices)
+{
+    if (m3dOccluder != nullptr)
+    {
+        m3dOcclusionQuery.clear();
+        for (const size_t i : aVoices)
         {
-            switch (v.m3dAttenuationModel)
+            const auto& v = m3dData[i];
+            if (!v.mFlags.ListenerRelative)
             {
-                case AttenuationModel::InverseDistance:
-                    vol *= attenuateInvDistance(dist,
-                                                v.m3dMinDistance,
-                                                v.m3dMaxDistance,
-                                                v.m3dAttenuationRolloff);
-                    break;
-                case AttenuationModel::LinearDistance:
-                    vol *= attenuateLinearDistance(dist,
-                                                   v.m3dMinDistance,
-                                                   v.m3dMaxDistance,
-                                                   v.m3dAttenuationRolloff);
-                    break;
-                case AttenuationModel::ExponentialDistance:
-                    vol *= attenuateExponentialDistance(dist,
-                                                        v.m3dMinDistance,
-                                                        v.m3dMaxDistance,
-                                                        v.m3dAttenuationRolloff);
-                    break;
-                default:
-                    // case AudioSource::NO_ATTENUATION:
-                    break;
+                m3dOcclusionQuery.push_back({
+                    .mHandle   = v.mHandle,
+                    .mPosition = v.m3dPosition,
+                    .mUserData = v.mColliderData,
+                });
             }
         }
 
-        // cone
-        // (todo) vol *= conev;
-
-        // doppler
-        v.mDopplerValue = doppler(pos, vel, lvel, v.m3dDopplerFactor, m3dSoundSpeed);
-
-        // panning
-        pos = normalize(m * pos);
+        m3dOccluder->occlude(this, m3dPosition, m3dOcclusionQuery);
+    }
 
-        v.mChannelVolume = {};
+    lockAudioMutex_internal();
+    const time_t elapsed = mStreamTime - m3dOcclusionTime;
+    m3dOcclusionTime     = mStreamTime;
 
-        // Apply volume to channels based on speaker vectors
-        for (size_t j = 0; j < mChannels; ++j)
-        {
-            float speakervol = (speaker[j].dot(pos) + 1) / 2;
-            if (speaker[j].isNull())
-                speakervol = 1;
-            // Different speaker "focus" calculations to try, if the default "bleeds" too much..
-            // speakervol = (speakervol * speakervol + speakervol) / 2;
-            // speakervol = speakervol * speakervol;
-            v.mChannelVolume[j] = vol * speakervol;
-        }
+    const float k =
+        m3dOcclusionSmoothing > 0 ? float(1.0 - exp(-elapsed / m3dOcclusionSmoothing)) : 1.0f;
 
-        v.m3dVolume = vol;
+    for (const size_t i : aVoices)
+    {
+        auto& v       = m3dData[i];
+        v.mOcclusion += (v.mOcclusionTarget - v.mOcclusion) * k;
     }
+    unlockAudioMutex_internal();
 }
 
 void Engine::update3dAudio()
@@ -205,38 +329,86 @@ void Engine::update3dAudio()
 
     // Step 1 - find voices that need 3d processing
     lockAudioMutex_internal();
-    for (size_t i = 0; i < mHighestVoice; ++i)
+    if (m3dCullingDistance > 0.0f)
     {
-        if (mVoice[i] && mVoice[i]->mFlags.Process3D)
+        // Only the voices in range; the ones that were in range at the last update but are not
+        // found now get culled
+        for (const size_t i : m3dInRange)
+        {
+            m3dData[i].mCulled = true;
+        }
+
+        m3dQuery.clear();
+        m3dGrid->query(m3dPosition, m3dCullingDistance, m3dQuery);
+        if (!mListener.empty())
+        {
+            for (const auto& mix : mListener)
+            {
+                m3dGrid->query(mix->mPosition, m3dCullingDistance, m3dQuery);
+            }
+
+            std::ranges::sort(m3dQuery);
+            m3dQuery.erase(std::unique(m3dQuery.begin(), m3dQuery.end()), m3dQuery.end());
+        }
+
+        for (const size_t i : m3dQuery)
         {
-            voices[voicecount] = i;
-            voicecount++;
-            m3dData[i].mFlags = mVoice[i]->mFlags;
+            if (mVoice[i] && mVoice[i]->mFlags.Process3D)
+            {
+                voices[voicecount] = i;
+                voicecount++;
+                m3dData[i].mFlags  = mVoice[i]->mFlags;
+                m3dData[i].mCulled = false;
+            }
+            else
+            {
+                // Stopped, or replaced by a voice that isn't 3d
+                m3dGrid->remove(i);
+            }
+        }
+
+        for (const size_t i : m3dInRange)
+        {
+            if (mVoice[i] && mVoice[i]->mFlags.Process3D && m3dData[i].mCulled)
+            {
+                cull3dVoice_internal(i);
+            }
+        }
+
+        m3dInRange.assign(voices, voices + voicecount);
+    }
+    else
+    {
+        for (size_t i = 0; i < mHighestVoice; ++i)
+        {
+            if (mVoice[i] && mVoice[i]->mFlags.Process3D)
+            {
+                voices[voicecount] = i;
+                voicecount++;
+                m3dData[i].mFlags = mVoice[i]->mFlags;
+            }
         }
     }
     unlockAudioMutex_internal();
 
     // Step 2 - do 3d processing
 
+    occlude3dVoices_internal({voices, voicecount});
     update3dVoices_internal({voices, voicecount});
 
     // Step 3 - update SoLoud voices
 
     lockAudioMutex_internal();
+    size_t binauralcount = 0;
     for (size_t i = 0; i < voicecount; ++i)
     {
-        auto& v = m3dData[voices[i]];
-
         if (const auto& vi = mVoice[voices[i]])
         {
             updateVoiceRelativePlaySpeed_internal(voices[i]);
             updateVoiceVolume_internal(voices[i]);
-            for (size_t j = 0; j < MAX_CHANNELS; ++j)
-            {
-                vi->mChannelVolume[j] = v.mChannelVolume[j];
-            }
+            apply3dVoice_internal(voices[i]);
 
-            if (vi->mOverallVolume < 0.001f)
+            if (loudest3dVolume_internal(voices[i]) < 0.001f)
             {
                 // Inaudible.
                 vi->mFlags.Inaudible = true;
@@ -250,74 +422,127 @@ void Engine::update3dAudio()
             {
                 vi->mFlags.Inaudible = false;
             }
+
+            if (vi && vi->mFlags.Binaural)
+            {
+                voices[binauralcount++] = voices[i];
+            }
         }
     }
 
-    mActiveVoiceDirty = true;
-    unlockAudioMutex_internal();
-}
+    if (mAmbisonics)
+    {
+        mAmbisonics->setOrientation(lookatRH(m3dAt, m3dUp));
+    }
 
+    // Step 4 - the loudest binaural voices get their own interpolated HRTF
 
-handle Engine::play3d(
-    AudioSource& aSound, vec3 aPos, vec3 aVel, float aVolume, bool aPaused, size_t aBus)
-{
-    const handle h = play(aSound, aVolume, 0, true, aBus);
-    lockAudioMutex_internal();
-    auto v = getVoiceFromHandle_internal(h);
+    const auto loudness = [this](size_t aVoice) {
+        return mVoice[aVoice]->mOverallVolume * mVoice[aVoice]->mChannelVolume[0];
+    };
 
-    if (v < 0)
+    const size_t direct = std::min(binauralcount, mHrtfVoiceBudget);
+    std::nth_element(voices,
+                     voices + direct,
+                     voices + binauralcount,
+                     [&](size_t a, size_t b) { return loudness(a) > loudness(b); });
+
+    for (size_t i = 0; i < binauralcount; ++i)
     {
-        unlockAudioMutex_internal();
-        return h;
+        mVoice[voices[i]]->mHrtf.mDirect = i < direct;
     }
 
-    m3dData[v].mHandle          = h;
-    mVoice[v]->mFlags.Process3D = true;
+    mActiveVoiceDirty = true;
+    unlockAudioMutex_internal();
+}
 
-    set3dSourceParameters(h, aPos, aVel);
 
-    int samples = 0;
-    if (aSound.distance_delay)
-    {
-        const auto pos = mVoice[v]->mFlags.ListenerRelative ? aPos : aPos - m3dPosition;
+void Engine::init3dVoice_internal(size_t aVoice, handle aVoiceHandle, vec3 aPos, vec3 aVel)
+{
+    auto& v = m3dData[aVoice];
 
-        const float dist = pos.mag();
-        samples += int(floor(dist / m3dSoundSpeed * float(mSamplerate)));
-    }
+    v.mHandle                        = aVoiceHandle;
+    v.m3dPosition                    = aPos;
+    v.m3dVelocity                    = aVel;
+    mVoice[aVoice]->mFlags.Process3D = true;
 
-    update3dVoices_internal({reinterpret_cast<size_t*>(&v), 1});
-    updateVoiceRelativePlaySpeed_internal(v);
+    m3dGrid->insert(aVoice, aPos, mVoice[aVoice]->mFlags.ListenerRelative);
+}
 
-    for (size_t j = 0; j < MAX_CHANNELS; ++j)
-    {
-        mVoice[v]->mChannelVolume[j] = m3dData[v].mChannelVolume[j];
-    }
+void Engine::start3dVoice_internal(size_t aVoice)
+{
+    const auto& vi = mVoice[aVoice];
+
+    updateVoiceRelativePlaySpeed_internal(aVoice);
 
-    updateVoiceVolume_internal(v);
+    apply3dVoice_internal(aVoice);
+    updateVoiceVolume_internal(aVoice);
 
     // Fix initial voice volume ramp up
     for (size_t i = 0; i < MAX_CHANNELS; ++i)
     {
-        mVoice[v]->mCurrentChannelVolume[i] =
-            mVoice[v]->mChannelVolume[i] * mVoice[v]->mOverallVolume;
+        vi->mCurrentChannelVolume[i] = vi->mChannelVolume[i] * vi->mOverallVolume;
     }
 
-    if (mVoice[v]->mOverallVolume < 0.01f)
+    if (loudest3dVolume_internal(aVoice) < 0.01f)
     {
         // Inaudible.
-        mVoice[v]->mFlags.Inaudible = true;
+        vi->mFlags.Inaudible = true;
 
-        if (mVoice[v]->mFlags.InaudibleKill)
+        if (vi->mFlags.InaudibleKill)
         {
-            stopVoice_internal(v);
+            stopVoice_internal(aVoice);
         }
     }
     else
     {
-        mVoice[v]->mFlags.Inaudible = false;
+        vi->mFlags.Inaudible = false;
+    }
+
+    if (vi && m3dCullingDistance > 0.0f)
+    {
+        if (!in3dCullingRange_internal(m3dData[aVoice].m3dPosition, vi->mFlags.ListenerRelative))
+        {
+            cull3dVoice_internal(aVoice);
+        }
+        else
+        {
+            m3dInRange.push_back(aVoice);
+        }
     }
 
     mActiveVoiceDirty = true;
+}
+
+handle Engine::play3d(
+    AudioSource& aSound, vec3 aPos, vec3 aVel, float aVolume, bool aPaused, handle aBus)
+{
+    auto instance = createVoiceInstance_internal(aSound, true);
+
+    lockAudioMutex_internal();
+    const int v = playInstance_internal(aSound, std::move(instance), aVolume, 0, true, aBus);
+    if (v < 0)
+    {
+        unlockAudioMutex_internal();
+        return 0;
+    }
+
+    const handle h = getHandleFromVoice_internal(v);
+
+    init3dVoice_internal(v, h, aPos, aVel);
+
+    int samples = 0;
+    if (aSound.distance_delay && !aSound.propagation_delay)
+    {
+        const auto pos = mVoice[v]->mFlags.ListenerRelative ? aPos : aPos - m3dPosition;
+
+        const float dist = pos.mag();
+        samples += int(floor(dist / m3dSoundSpeed * float(mSamplerate)));
+    }
+
+    const auto voice = size_t(v);
+    update3dVoices_internal({&voice, 1});
+    start3dVoice_internal(voice);
 
     unlockAudioMutex_internal();
     setDelaySamples(h, samples);
@@ -327,19 +552,20 @@ handle Engine::play3d(
 }
 
 handle Engine::play3dClocked(
-    time_t aSoundTime, AudioSource& aSound, vec3 aPos, vec3 aVel, float aVolume, size_t aBus)
+    time_t aSoundTime, AudioSource& aSound, vec3 aPos, vec3 aVel, float aVolume, handle aBus)
 {
-    const handle h = play(aSound, aVolume, 0, 1, aBus);
+    auto instance = createVoiceInstance_internal(aSound, true);
+
     lockAudioMutex_internal();
-    int v = getVoiceFromHandle_internal(h);
+    const int v = playInstance_internal(aSound, std::move(instance), aVolume, 0, true, aBus);
     if (v < 0)
     {
         unlockAudioMutex_internal();
-        return h;
+        return 0;
     }
-    m3dData[v].mHandle          = h;
-    mVoice[v]->mFlags.Process3D = true;
-    set3dSourceParameters(h, aPos, aVel);
+
+    const handle h = getHandleFromVoice_internal(v);
+    init3dVoice_internal(v, h, aPos, aVel);
     time_t lasttime = mLastClockedTime;
     if (lasttime == 0)
     {
@@ -356,65 +582,213 @@ handle Engine::play3dClocked(
         samples = 0;
     }
 
-    if (aSound.distance_delay)
+    if (aSound.distance_delay && !aSound.propagation_delay)
     {
         const float dist = aPos.mag();
         samples += int(floor((dist / m3dSoundSpeed) * mSamplerate));
     }
 
-    update3dVoices_internal({reinterpret_cast<size_t*>(&v), 1});
+    const auto voice = size_t(v);
+    update3dVoices_internal({&voice, 1});
     lockAudioMutex_internal();
-    updateVoiceRelativePlaySpeed_internal(v);
+    start3dVoice_internal(voice);
+    unlockAudioMutex_internal();
+
+    setDelaySamples(h, samples);
+    setPause(h, false);
 
-    for (size_t j = 0; j < MAX_CHANNELS; ++j)
+    return h;
+}
+
+
+void Engine::set3dSoundSpeed(float aSpeed)
+{
+    assert(aSpeed > 0.0f);
+    m3dSoundSpeed = aSpeed;
+}
+
+
+float Engine::get3dSoundSpeed() const
+{
+    return m3dSoundSpeed;
+}
+
+void Engine::set3dMaxPropagationDelay(time_t aSeconds)
+{
+    assert(aSeconds >= 0);
+    m3dMaxPropagationDelay = aSeconds;
+}
+
+time_t Engine::get3dMaxPropagationDelay() const
+{
+    return m3dMaxPropagationDelay;
+}
+
+void Engine::set3dCullingDistance(float aDistance)
+{
+    assert(aDistance >= 0.0f);
+
+    lockAudioMutex_internal();
+    m3dCullingDistance = aDistance;
+    if (aDistance > 0.0f)
     {
-        mVoice[v]->mChannelVolume[j] = m3dData[v].mChannelVolume[j];
+        m3dGrid->setCellSize(aDistance);
+
+        // All 3d voices count as in range, so that the next update culls the far ones
+        m3dInRange.clear();
+        for (size_t i = 0; i < mHighestVoice; ++i)
+        {
+            if (mVoice[i] && mVoice[i]->mFlags.Process3D)
+            {
+                m3dInRange.push_back(i);
+            }
+        }
     }
+    unlockAudioMutex_internal();
+}
 
-    updateVoiceVolume_internal(v);
+float Engine::get3dCullingDistance() const
+{
+    return m3dCullingDistance;
+}
 
-    // Fix initial voice volume ramp up
-    for (int i = 0; i < MAX_CHANNELS; ++i)
+void Engine::set3dOccluder(AudioOccluder* aOccluder)
+{
+    lockAudioMutex_internal();
+    m3dOccluder = aOccluder;
+    if (aOccluder == nullptr)
     {
-        mVoice[v]->mCurrentChannelVolume[i] =
-            mVoice[v]->mChannelVolume[i] * mVoice[v]->mOverallVolume;
+        for (auto& v : m3dData)
+        {
+            v.mOcclusionTarget = 0.0f;
+        }
     }
+    unlockAudioMutex_internal();
+}
 
-    if (mVoice[v]->mOverallVolume < 0.01f)
+void Engine::set3dOcclusion(std::span<const OcclusionResult> aResults)
+{
+    lockAudioMutex_internal();
+    for (const auto& result : aResults)
     {
-        // Inaudible.
-        mVoice[v]->mFlags.Inaudible = true;
+        const int ch = getVoiceFromHandle_internal(result.mHandle);
+        if (ch == -1)
+        {
+            continue;
+        }
+
+        auto& v            = m3dData[ch];
+        v.mOcclusionTarget = std::clamp(result.mOcclusion, 0.0f, 1.0f);
 
-        if (mVoice[v]->mFlags.InaudibleKill)
+        // The first result isn't faded in
+        if (!v.mOcclusionSynced)
         {
-            stopVoice_internal(v);
+            v.mOcclusion       = v.mOcclusionTarget;
+            v.mOcclusionSynced = true;
         }
     }
-    else
+    unlockAudioMutex_internal();
+}
+
+void Engine::set3dOcclusionResponse(float aVolume, float aCutoff, time_t aSmoothing)
+{
+    assert(aVolume >= 0.0f && aVolume <= 1.0f);
+    assert(aCutoff >= 0.0f);
+    assert(aSmoothing >= 0);
+
+    lockAudioMutex_internal();
+    m3dOcclusionVolume    = aVolume;
+    m3dOcclusionCutoff    = aCutoff;
+    m3dOcclusionSmoothing = aSmoothing;
+    unlockAudioMutex_internal();
+}
+
+void Engine::setHrtfTable(std::span<const std::byte> aData)
+{
+    const auto table = loadHrirTable(aData);
+    if (!mHrtf)
     {
-        mVoice[v]->mFlags.Inaudible = false;
+        return;
     }
 
-    mActiveVoiceDirty = true;
+    auto hrtf = std::make_unique<Hrtf>(table, float(mSamplerate), mScratchSize);
+
+    // The states of the playing 3d voices are sized for the new table outside the mutex, and
+    // swapped in along with it. Voices started in between share grid directions until they end.
+    auto voices = std::vector<std::shared_ptr<AudioSourceInstance>>{};
+    voices.reserve(VOICE_COUNT);
+
+    lockAudioMutex_internal();
+    for (const auto& voice : mVoice)
+    {
+        if (voice && voice->mFlags.Process3D)
+        {
+            voices.push_back(voice);
+        }
+    }
     unlockAudioMutex_internal();
 
-    setDelaySamples(h, samples);
-    setPause(h, false);
+    auto states = std::vector<HrtfVoiceState>(voices.size());
+    for (auto& state : states)
+    {
+        hrtf->initVoice(state);
+    }
 
-    return h;
+    lockAudioMutex_internal();
+    mHrtf.swap(hrtf);
+    for (size_t i = 0; i < voices.size(); ++i)
+    {
+        auto& state = voices[i]->mHrtf;
+        std::swap(state.mKernel, states[i].mKernel);
+        std::swap(state.mHistory, states[i].mHistory);
+    }
+    for (const auto& voice : mVoice)
+    {
+        if (voice && voice->mFlags.Binaural)
+        {
+            voice->mHrtf.mSynced = false;
+            voice->mHrtf.mTarget = mHrtf->locate(m3dData[&voice - mVoice.data()].mDirection);
+        }
+    }
+    unlockAudioMutex_internal();
 }
 
+void Engine::setHrtfVoiceBudget(size_t aVoices)
+{
+    mHrtfVoiceBudget = aVoices;
+}
 
-void Engine::set3dSoundSpeed(float aSpeed)
+size_t Engine::getHrtfVoiceBudget() const
 {
-    assert(aSpeed > 0.0f);
-    m3dSoundSpeed = aSpeed;
+    return mHrtfVoiceBudget;
 }
 
+void Engine::setAmbisonicOrder(size_t aOrder)
+{
+    assert(aOrder <= 3);
 
-float Engine::get3dSoundSpeed() const
+    auto ambisonics = aOrder > 0 ? std::make_unique<Ambisonics>(aOrder, mScratchSize) : nullptr;
+
+    lockAudioMutex_internal();
+    if (ambisonics)
+    {
+        ambisonics->setOrientation(lookatRH(m3dAt, m3dUp));
+    }
+    mAmbisonics.swap(ambisonics);
+    mAmbisonicOrder = aOrder;
+    for (const auto& voice : mVoice)
+    {
+        if (voice)
+        {
+            voice->mAmbisonic.mSynced = false;
+        }
+    }
+    unlockAudioMutex_internal();
+}
+
+size_t Engine::getAmbisonicOrder() const
 {
-    return m3dSoundSpeed;
+    return mAmbisonicOrder;
 }
 
 
@@ -426,6 +800,47 @@ void Engine::set3dListenerParameters(vec3 pos, vec3 at, vec3 up, vec3 velocity)
     m3dVelocity = velocity;
 }
 
+void Engine::setListenerCount(size_t aCount)
+{
+    assert(aCount >= 1 && aCount <= MAX_LISTENERS);
+
+    auto added = std::vector<std::unique_ptr<SpatialListenerMix>>{};
+    for (size_t i = mListener.size() + 1; i < aCount; ++i)
+    {
+        added.push_back(std::make_unique<SpatialListenerMix>(mScratchSize));
+    }
+
+    lockAudioMutex_internal();
+    mListener.resize(std::min(mListener.size(), aCount - 1));
+    for (auto& mix : added)
+    {
+        mListener.push_back(std::move(mix));
+    }
+    unlockAudioMutex_internal();
+}
+
+size_t Engine::getListenerCount() const
+{
+    return mListener.size() + 1;
+}
+
+void Engine::set3dListenerParameters(size_t aListener, vec3 pos, vec3 at, vec3 up, vec3 velocity)
+{
+    assert(aListener < getListenerCount());
+
+    if (aListener == 0)
+    {
+        set3dListenerParameters(pos, at, up, velocity);
+        return;
+    }
+
+    auto& mix     = *mListener[aListener - 1];
+    mix.mPosition = pos;
+    mix.mAt       = at;
+    mix.mUp       = up;
+    mix.mVelocity = velocity;
+}
+
 
 void Engine::set3dListenerPosition(vec3 value)
 {
@@ -456,6 +871,7 @@ void Engine::set3dSourceParameters(handle aVoiceHandle, vec3 aPos, vec3 aVelocit
     FOR_ALL_VOICES_PRE_3D
     m3dData[ch].m3dPosition = aPos;
     m3dData[ch].m3dVelocity = aVelocity;
+    m3dGrid->move(ch, aPos);
     FOR_ALL_VOICES_POST_3D
 }
 
@@ -464,6 +880,7 @@ void Engine::set3dSourcePosition(handle aVoiceHandle, vec3 value)
 {
     FOR_ALL_VOICES_PRE_3D
     m3dData[ch].m3dPosition = value;
+    m3dGrid->move(ch, value);
     FOR_ALL_VOICES_POST_3D
 }
 
@@ -476,6 +893,47 @@ void Engine::set3dSourceVelocity(handle aVoiceHandle, vec3 velocity)
 }
 
 
+void Engine::set3dSourcePositions(std::span<const handle> aVoiceHandles, std::span<const vec3> aPos)
+{
+    assert(aVoiceHandles.size() == aPos.size());
+
+    // The grid is moved in one go
+    auto voices    = std::vector<size_t>{};
+    auto positions = std::vector<vec3>{};
+    voices.reserve(aVoiceHandles.size());
+    positions.reserve(aVoiceHandles.size());
+
+    for (size_t i = 0; i < aVoiceHandles.size(); ++i)
+    {
+        const handle aVoiceHandle = aVoiceHandles[i];
+
+        FOR_ALL_VOICES_PRE_3D
+        m3dData[ch].m3dPosition = aPos[i];
+        voices.push_back(ch);
+        positions.push_back(aPos[i]);
+        FOR_ALL_VOICES_POST_3D
+    }
+
+    m3dGrid->move(voices, positions);
+}
+
+
+void Engine::set3dSourceVelocities(std::span<const handle> aVoiceHandles,
+                                   std::span<const vec3>   aVelocities)
+{
+    assert(aVoiceHandles.size() == aVelocities.size());
+
+    for (size_t i = 0; i < aVoiceHandles.size(); ++i)
+    {
+        const handle aVoiceHandle = aVoiceHandles[i];
+
+        FOR_ALL_VOICES_PRE_3D
+        m3dData[ch].m3dVelocity = aVelocities[i];
+        FOR_ALL_VOICES_POST_3D
+    }
+}
+
+
 void Engine::set3dSourceMinMaxDistance(handle aVoiceHandle, float aMinDistance, float aMaxDistance)
 {
     FOR_ALL_VOICES_PRE_3D
@@ -22,13 +22,19 @@ freely, subject to the following restrictions:
    distribution.
 */
 
+#include "soloud_hrtf.hpp"
 #include "soloud_internal.hpp"
+#include "soloud_spatial.hpp"
+#include <bit>
+#include <cmath>
+#include <vector>
 
 // Core "basic" operations - play, stop, etc
 
 namespace SoLoud
 {
-handle Engine::play(AudioSource& aSound, float aVolume, float aPan, bool aPaused, size_t aBus)
+std::shared_ptr<AudioSourceInstance> Engine::createVoiceInstance_internal(AudioSource& aSound,
+                                                                          bool         a3d)
 {
     if (aSound.single_instance)
     {
@@ -41,32 +47,75 @@ handle Engine::play(AudioSource& aSound, float aVolume, float aPan, bool aPaused
     aSound.engine = this;
     auto instance = aSound.createInstance();
 
-    lockAudioMutex_internal();
-    int ch = findFreeVoice_internal();
+    for (size_t i = 0; i < FILTERS_PER_STREAM; ++i)
+    {
+        if (aSound.filter[i])
+        {
+            instance->mFilter[i] = aSound.filter[i]->createInstance();
+        }
+    }
+
+    if (aSound.propagation_delay)
+    {
+        // Room for the longest delay and a block being read, as a power of two for wrapping
+        const auto delay = size_t(ceil(m3dMaxPropagationDelay * mSamplerate));
+        auto&      state = instance->mPropagation;
+
+        state.mLength  = std::bit_ceil(delay + SAMPLE_GRANULARITY + 2);
+        state.mSilence = state.mLength;
+        state.mRing.assign(state.mLength * aSound.channel_count, 0.0f);
+    }
+
+    // Binaural voices rendered directly keep a history of their own
+    if ((a3d || aSound.process_3d) && mHrtf)
+    {
+        mHrtf->initVoice(instance->mHrtf);
+    }
+
+    return instance;
+}
+
+int Engine::playInstance_internal(AudioSource&                         aSound,
+                                  std::shared_ptr<AudioSourceInstance> aInstance,
+                                  float                                aVolume,
+                                  float                                aPan,
+                                  bool                                 aPaused,
+                                  handle                               aBus)
+{
+    int ch = findFreeVoice_internal(aSound);
     if (ch < 0)
     {
-        unlockAudioMutex_internal();
-        return 7; // TODO: this was "UNKNOWN_ERROR"
+        return ch;
     }
     if (!aSound.audio_source_id)
     {
         aSound.audio_source_id = mAudioSourceID;
         mAudioSourceID++;
     }
-    mVoice[ch]                 = instance;
+    mVoice[ch]                 = std::move(aInstance);
+    mPublishedVoiceCount.fetch_add(1, std::memory_order_relaxed);
     mVoice[ch]->mAudioSourceID = aSound.audio_source_id;
     mVoice[ch]->mBusHandle     = aBus;
     mVoice[ch]->init(aSound, mPlayIndex);
+    mVoiceGeneration[ch] = (mVoiceGeneration[ch] + 1) & HANDLE_GENERATION_MASK;
+    if (aSound.category >= mCategoryVoices.size())
+    {
+        mCategoryLimit.resize(aSound.category + 1, 0);
+        mCategoryVoices.resize(aSound.category + 1, 0);
+    }
+    mCategoryVoices[aSound.category]++;
+    if (!mVoice[ch]->mFlags.Protected)
+    {
+        setStealCandidate_internal(ch, true);
+    }
     m3dData[ch] = AudioSourceInstance3dData{aSound};
-
-    mPlayIndex++;
-
-    // 20 bits, skip the last one (top bits full = voice group)
-    if (mPlayIndex == 0xfffff)
+    for (const auto& mix : mListener)
     {
-        mPlayIndex = 0;
+        mix->mSynced[ch] = false;
     }
 
+    mPlayIndex++;
+
     if (aPaused)
     {
         mVoice[ch]->mFlags.Paused = true;
@@ -91,23 +140,110 @@ handle Engine::play(AudioSource& aSound, float aVolume, float aPan, bool aPaused
 
     setVoiceRelativePlaySpeed_internal(ch, 1);
 
-    for (int i = 0; i < FILTERS_PER_STREAM; ++i)
+    for (size_t i = 0; i < SENDS_PER_STREAM; ++i)
     {
-        if (aSound.filter[i])
-        {
-            mVoice[ch]->mFilter[i] = aSound.filter[i]->createInstance();
-        }
+        setVoiceSend_internal(ch, i, aSound.sends[i]);
     }
 
     mActiveVoiceDirty = true;
 
+    return ch;
+}
+
+handle Engine::play(AudioSource& aSound, float aVolume, float aPan, bool aPaused, handle aBus)
+{
+    auto instance = createVoiceInstance_internal(aSound);
+
+    lockAudioMutex_internal();
+    const int ch = playInstance_internal(aSound, std::move(instance), aVolume, aPan, aPaused, aBus);
     unlockAudioMutex_internal();
 
+    if (ch < 0)
+    {
+        return 0;
+    }
+
     return getHandleFromVoice_internal(ch);
 }
 
+void Engine::playBatch(std::span<const PlayRequest> aRequests, std::span<handle> aHandles)
+{
+    assert(aHandles.size() >= aRequests.size());
+
+    auto instances = std::vector<std::shared_ptr<AudioSourceInstance>>{};
+    instances.reserve(aRequests.size());
+    for (const auto& request : aRequests)
+    {
+        instances.push_back(createVoiceInstance_internal(*request.mSound, request.m3d));
+    }
+
+    auto voices3d = std::vector<size_t>{};
+
+    lockAudioMutex_internal();
+    for (size_t i = 0; i < aRequests.size(); ++i)
+    {
+        const auto& request = aRequests[i];
+        auto&       sound   = *request.mSound;
+
+        // 3d voices start paused, until their first 3d update is applied
+        const int ch = playInstance_internal(sound,
+                                             std::move(instances[i]),
+                                             request.mVolume,
+                                             request.m3d ? 0.0f : request.mPan,
+                                             request.mPaused || request.m3d,
+                                             request.mBus);
+        if (ch < 0)
+        {
+            aHandles[i] = 0;
+            continue;
+        }
+
+        aHandles[i] = getHandleFromVoice_internal(ch);
+
+        if (request.m3d)
+        {
+            init3dVoice_internal(ch, aHandles[i], request.mPosition, request.mVelocity);
+            voices3d.push_back(ch);
+        }
+    }
+
+    // A later request may have taken the voice of an earlier one
+    std::erase_if(voices3d, [&](size_t aVoice) {
+        return getVoiceFromHandle_internal(m3dData[aVoice].mHandle) != int(aVoice);
+    });
+
+    update3dVoices_internal(voices3d);
+
+    for (size_t i = 0; i < aRequests.size(); ++i)
+    {
+        const auto& request = aRequests[i];
+        const int   ch      = getVoiceFromHandle_internal(aHandles[i]);
+        if (!request.m3d || ch < 0)
+        {
+            continue;
+        }
+
+        if (request.mSound->distance_delay && !request.mSound->propagation_delay)
+        {
+            const auto pos = mVoice[ch]->mFlags.ListenerRelative ? request.mPosition
+                                                                 : request.mPosition - m3dPosition;
+
+            mVoice[ch]->mDelaySamples =
+                size_t(floor(pos.mag() / m3dSoundSpeed * float(mSamplerate)));
+        }
+
+        start3dVoice_internal(ch);
+
+        if (mVoice[ch])
+        {
+            setVoicePause_internal(ch, request.mPaused);
+        }
+    }
+    unlockAudioMutex_internal();
+}
+
 handle Engine::playClocked(
-    time_t aSoundTime, AudioSource& aSound, float aVolume, float aPan, size_t aBus)
+    time_t aSoundTime, AudioSource& aSound, float aVolume, float aPan, handle aBus)
 {
     const handle h = play(aSound, aVolume, aPan, 1, aBus);
     lockAudioMutex_internal();
@@ -128,7 +264,7 @@ handle Engine::playClocked(
     return h;
 }
 
-handle Engine::playBackground(AudioSource& aSound, float aVolume, bool aPaused, size_t aBus)
+handle Engine::playBackground(AudioSource& aSound, float aVolume, bool aPaused, handle aBus)
 {
     const handle h = play(aSound, aVolume, 0.0f, aPaused, aBus);
     setPanAbsolute(h, 1.0f, 1.0f);
@@ -142,6 +278,7 @@ bool Engine::seek(handle aVoiceHandle, time_t aSeconds)
     const auto singleres = mVoice[ch]->seek(aSeconds, mScratch.mData, mScratchSize);
     if (!singleres)
         res = singleres;
+    publishVoice_internal(ch);
     FOR_ALL_VOICES_POST
     return res;
 }
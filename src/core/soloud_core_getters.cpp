@@ -23,6 +23,10 @@ freely, subject to the following restrictions:
 */
 
 #include "soloud_engine.hpp"
+#include "soloud_handles.hpp"
+#include "soloud_limiter.hpp"
+#include "soloud_snapshot.hpp"
+#include "soloud_steal.hpp"
 
 // Getters - return information about SoLoud state
 
@@ -33,6 +37,25 @@ float Engine::getPostClipScaler() const
     return mPostClipScaler;
 }
 
+LimiterSettings Engine::getLimiterSettings() const
+{
+    return mLimiterSettings;
+}
+
+float Engine::getLimiterGainReduction()
+{
+    auto ret = 0.0f;
+
+    lockAudioMutex_internal();
+    if (mLimiter)
+    {
+        ret = mLimiter->getGainReduction();
+    }
+    unlockAudioMutex_internal();
+
+    return ret;
+}
+
 Resampler Engine::getMainResampler() const
 {
     return mResampler;
@@ -50,86 +73,141 @@ handle Engine::getHandleFromVoice_internal(size_t aVoice) const
         return 0;
     }
 
-    return (aVoice + 1) | (mVoice[aVoice]->mPlayIndex << 12);
+    return makeHandle(aVoice, mVoiceGeneration[aVoice]);
 }
 
 int Engine::getVoiceFromHandle_internal(handle aVoiceHandle) const
 {
     // If this is a voice group handle, pick the first handle from the group
-    if (const auto* h = voiceGroupHandleToArray_internal(aVoiceHandle); h != nullptr)
+    if (isGroupHandle(aVoiceHandle))
     {
-        aVoiceHandle = *h;
+        const auto* group = findVoiceGroup_internal(aVoiceHandle);
+        if (group == nullptr || group->empty())
+        {
+            return -1;
+        }
+        aVoiceHandle = (*group)[0];
     }
 
-    if (aVoiceHandle == 0)
+    const size_t ch = handleSlot(aVoiceHandle);
+
+    if (ch < VOICE_COUNT && mVoice[ch] != nullptr &&
+        mVoiceGeneration[ch] == handleGeneration(aVoiceHandle))
     {
-        return -1;
+        return int(ch);
     }
 
-    const int    ch  = (aVoiceHandle & 0xfff) - 1;
-    const size_t idx = aVoiceHandle >> 12;
+    return -1;
+}
 
-    if (mVoice[ch] != nullptr && (mVoice[ch]->mPlayIndex & 0xfffff) == idx)
+void Engine::publishVoice_internal(size_t aVoice)
+{
+    assert(mInsideAudioThreadMutex);
+    if (mVoice[aVoice] == nullptr)
     {
-        return ch;
+        mSnapshots->publish(aVoice, {});
+        return;
     }
 
-    return -1;
+    const auto& voice = *mVoice[aVoice];
+
+    VoiceInfo info;
+    info.mHandle            = getHandleFromVoice_internal(aVoice);
+    info.mStreamTime        = voice.mStreamTime;
+    info.mStreamPosition    = voice.mStreamPosition;
+    info.mVolume            = voice.mSetVolume;
+    info.mOverallVolume     = voice.mOverallVolume;
+    info.mPan               = voice.mPan;
+    info.mRelativePlaySpeed = voice.mSetRelativePlaySpeed;
+    info.mLoopCount         = voice.mLoopCount;
+    info.mPaused            = voice.mFlags.Paused;
+    info.mVirtual           = voice.mFlags.Virtual;
+
+    mSnapshots->publish(aVoice, info);
 }
 
-size_t Engine::getMaxActiveVoiceCount() const
+VoiceInfo Engine::readVoice_internal(handle aVoiceHandle)
 {
-    return mMaxActiveVoices;
+    // Resolving a voice group needs the group list, which the mutex guards
+    if (isGroupHandle(aVoiceHandle))
+    {
+        lockAudioMutex_internal();
+        const auto* group = findVoiceGroup_internal(aVoiceHandle);
+        aVoiceHandle      = group != nullptr && !group->empty() ? (*group)[0] : 0;
+        unlockAudioMutex_internal();
+    }
+
+    const size_t ch = handleSlot(aVoiceHandle);
+    if (ch >= VOICE_COUNT)
+    {
+        return {};
+    }
+
+    auto info = mSnapshots->read(ch);
+    if (info.mHandle != aVoiceHandle)
+    {
+        return {};
+    }
+
+    return info;
 }
 
-size_t Engine::getActiveVoiceCount()
+void Engine::queryVoices(std::span<const handle> aVoiceHandles, std::span<VoiceInfo> aInfo)
 {
-    lockAudioMutex_internal();
-    if (mActiveVoiceDirty)
+    assert(aInfo.size() >= aVoiceHandles.size());
+    for (size_t i = 0; i < aVoiceHandles.size(); ++i)
     {
-        calcActiveVoices_internal();
+        aInfo[i] = readVoice_internal(aVoiceHandles[i]);
     }
-    const size_t c = mActiveVoiceCount;
-    unlockAudioMutex_internal();
+}
 
-    return c;
+size_t Engine::getMaxActiveVoiceCount() const
+{
+    return mMaxActiveVoices;
+}
+
+size_t Engine::getActiveVoiceCount()
+{
+    return mPublishedActiveVoiceCount.load(std::memory_order_relaxed);
 }
 
 size_t Engine::getVoiceCount()
 {
-    lockAudioMutex_internal();
-    int c = 0;
-    for (size_t i = 0; i < mHighestVoice; ++i)
-    {
-        if (mVoice[i])
-        {
-            ++c;
-        }
-    }
-    unlockAudioMutex_internal();
-    return c;
+    return mPublishedVoiceCount.load(std::memory_order_relaxed);
 }
 
 bool Engine::isValidVoiceHandle(handle aVoiceHandle)
 {
     // voice groups are not valid voice handles
-    if ((aVoiceHandle & 0xfffff000) == 0xfffff000)
+    if (isGroupHandle(aVoiceHandle))
     {
         return false;
     }
 
+    return readVoice_internal(aVoiceHandle).mHandle != 0;
+}
+
+bool Engine::isVoiceVirtual(handle aVoiceHandle)
+{
+    return readVoice_internal(aVoiceHandle).mVirtual;
+}
+
+
+time_t Engine::getLoopPoint(handle aVoiceHandle)
+{
     lockAudioMutex_internal();
-    if (getVoiceFromHandle_internal(aVoiceHandle) != -1)
+    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
+    if (ch == -1)
     {
         unlockAudioMutex_internal();
-        return true;
+        return 0;
     }
+    const time_t v = mVoice[ch]->mLoopPoint;
     unlockAudioMutex_internal();
-    return false;
+    return v;
 }
 
-
-time_t Engine::getLoopPoint(handle aVoiceHandle)
+int Engine::getPriority(handle aVoiceHandle)
 {
     lockAudioMutex_internal();
     const int ch = getVoiceFromHandle_internal(aVoiceHandle);
@@ -138,11 +216,21 @@ time_t Engine::getLoopPoint(handle aVoiceHandle)
         unlockAudioMutex_internal();
         return 0;
     }
-    const time_t v = mVoice[ch]->mLoopPoint;
+    const int v = mVoice[ch]->mPriority;
     unlockAudioMutex_internal();
     return v;
 }
 
+VoiceStealPolicy Engine::getVoiceStealPolicy() const
+{
+    return mStealPolicy;
+}
+
+size_t Engine::getCategoryVoiceLimit(size_t aCategory) const
+{
+    return aCategory < mCategoryLimit.size() ? mCategoryLimit[aCategory] : 0;
+}
+
 bool Engine::getLooping(handle aVoiceHandle)
 {
     lockAudioMutex_internal();
@@ -187,86 +275,32 @@ float Engine::getInfo(handle aVoiceHandle, size_t mInfoKey)
 
 float Engine::getVolume(handle aVoiceHandle)
 {
-    lockAudioMutex_internal();
-    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
-    if (ch == -1)
-    {
-        unlockAudioMutex_internal();
-        return 0;
-    }
-    const float v = mVoice[ch]->mSetVolume;
-    unlockAudioMutex_internal();
-    return v;
+    return readVoice_internal(aVoiceHandle).mVolume;
 }
 
 float Engine::getOverallVolume(handle aVoiceHandle)
 {
-    lockAudioMutex_internal();
-    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
-    if (ch == -1)
-    {
-        unlockAudioMutex_internal();
-        return 0;
-    }
-    const float v = mVoice[ch]->mOverallVolume;
-    unlockAudioMutex_internal();
-    return v;
+    return readVoice_internal(aVoiceHandle).mOverallVolume;
 }
 
 float Engine::getPan(handle aVoiceHandle)
 {
-    lockAudioMutex_internal();
-    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
-    if (ch == -1)
-    {
-        unlockAudioMutex_internal();
-        return 0;
-    }
-    const float v = mVoice[ch]->mPan;
-    unlockAudioMutex_internal();
-    return v;
+    return readVoice_internal(aVoiceHandle).mPan;
 }
 
 time_t Engine::getStreamTime(handle aVoiceHandle)
 {
-    lockAudioMutex_internal();
-    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
-    if (ch == -1)
-    {
-        unlockAudioMutex_internal();
-        return 0;
-    }
-    const double v = mVoice[ch]->mStreamTime;
-    unlockAudioMutex_internal();
-    return v;
+    return readVoice_internal(aVoiceHandle).mStreamTime;
 }
 
 time_t Engine::getStreamPosition(handle aVoiceHandle)
 {
-    lockAudioMutex_internal();
-    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
-    if (ch == -1)
-    {
-        unlockAudioMutex_internal();
-        return 0;
-    }
-    const double v = mVoice[ch]->mStreamPosition;
-    unlockAudioMutex_internal();
-    return v;
+    return readVoice_internal(aVoiceHandle).mStreamPosition;
 }
 
 float Engine::getRelativePlaySpeed(handle aVoiceHandle)
 {
-    lockAudioMutex_internal();
-    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
-    if (ch == -1)
-    {
-        unlockAudioMutex_internal();
-        return 1;
-    }
-    const float v = mVoice[ch]->mSetRelativePlaySpeed;
-    unlockAudioMutex_internal();
-    return v;
+    return readVoice_internal(aVoiceHandle).mRelativePlaySpeed;
 }
 
 float Engine::getSamplerate(handle aVoiceHandle)
@@ -285,16 +319,7 @@ float Engine::getSamplerate(handle aVoiceHandle)
 
 bool Engine::getPause(handle aVoiceHandle)
 {
-    lockAudioMutex_internal();
-    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
-    if (ch == -1)
-    {
-        unlockAudioMutex_internal();
-        return false;
-    }
-    const auto v = mVoice[ch]->mFlags.Paused;
-    unlockAudioMutex_internal();
-    return v;
+    return readVoice_internal(aVoiceHandle).mPaused;
 }
 
 bool Engine::getProtectVoice(handle aVoiceHandle)
@@ -311,10 +336,20 @@ bool Engine::getProtectVoice(handle aVoiceHandle)
     return v;
 }
 
-int Engine::findFreeVoice_internal()
+int Engine::findFreeVoice_internal(const AudioSource& aSound)
 {
-    size_t lowest_play_index_value = 0xffffffff;
-    int    lowest_play_index       = -1;
+    // A full category makes room among its own voices, even if other voices are free
+    const size_t category = aSound.category;
+    if (category < mCategoryLimit.size() && mCategoryLimit[category] != 0 &&
+        mCategoryVoices[category] >= mCategoryLimit[category])
+    {
+        const int victim = findVoiceToSteal_internal(aSound.priority, category);
+        if (victim != -1)
+        {
+            stopVoice_internal(victim);
+        }
+        return victim;
+    }
 
     // (slowly) drag the highest active voice index down
     if (mHighestVoice > 0 && mVoice[mHighestVoice - 1] == nullptr)
@@ -332,29 +367,79 @@ int Engine::findFreeVoice_internal()
             }
             return i;
         }
+    }
+
+    const int victim = findVoiceToSteal_internal(aSound.priority, std::nullopt);
+    if (victim != -1)
+    {
+        stopVoice_internal(victim);
+    }
+    return victim;
+}
+
+int Engine::findVoiceToSteal_internal(int aPriority, std::optional<size_t> aCategory) const
+{
+    // Lowest priority first, then the lowest score for the policy
+    const auto&  candidates = *mStealCandidates;
+    const size_t first      = candidates.first(aCategory);
+    if (first == StealCandidates::NONE || candidates.priority(first) > aPriority)
+    {
+        return -1;
+    }
+
+    // The candidates of a priority are in play order
+    if (mStealPolicy == VoiceStealPolicy::Oldest)
+    {
+        return int(first);
+    }
+
+    // Volumes and distances change all the time, so only the lowest priority voices get scored.
+    // This visits all of them, which is every unprotected voice while priorities are left alone.
+    const int  lowest      = candidates.priority(first);
+    const bool inCategory  = aCategory.has_value();
+    int        victim      = -1;
+    double     victimScore = 0;
 
-        if (!mVoice[i]->mFlags.Protected && mVoice[i]->mPlayIndex < lowest_play_index_value)
+    for (size_t i = first; i != StealCandidates::NONE && candidates.priority(i) == lowest;
+         i = candidates.next(i, inCategory))
+    {
+        const auto& voice = *mVoice[i];
+
+        double score = 0;
+        if (mStealPolicy == VoiceStealPolicy::Quietest)
+        {
+            score = voice.mOverallVolume;
+        }
+        else if (voice.mFlags.Process3D)
         {
-            lowest_play_index_value = mVoice[i]->mPlayIndex;
-            lowest_play_index       = i;
+            const auto& pos = m3dData[i].m3dPosition;
+            score = -(voice.mFlags.ListenerRelative ? pos : pos - m3dPosition).mag();
+        }
+
+        if (victim == -1 || score < victimScore)
+        {
+            victim      = int(i);
+            victimScore = score;
         }
     }
-    stopVoice_internal(lowest_play_index);
-    return lowest_play_index;
+
+    return victim;
 }
 
-size_t Engine::getLoopCount(handle aVoiceHandle)
+void Engine::setStealCandidate_internal(size_t aVoice, bool aCandidate)
 {
-    lockAudioMutex_internal();
-    const int ch = getVoiceFromHandle_internal(aVoiceHandle);
-    if (ch == -1)
+    mStealCandidates->erase(aVoice);
+
+    if (aCandidate)
     {
-        unlockAudioMutex_internal();
-        return 0;
+        const auto& voice = *mVoice[aVoice];
+        mStealCandidates->insert(aVoice, voice.mCategory, voice.mPriority, voice.mPlayIndex);
     }
-    const int v = mVoice[ch]->mLoopCount;
-    unlockAudioMutex_internal();
-    return v;
+}
+
+size_t Engine::getLoopCount(handle aVoiceHandle)
+{
+    return readVoice_internal(aVoiceHandle).mLoopCount;
 }
 
 // Returns current backend channel count (1 mono, 2 stereo, etc)
@@ -0,0 +1,109 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_bus.hpp"
+#include "soloud_internal.hpp"
+
+// Core operations related to aux sends
+
+namespace SoLoud
+{
+void Engine::setVoiceSend_internal(size_t aVoice, size_t aSendId, const AudioSend& aSend)
+{
+    auto& voice = mVoice[aVoice];
+    auto  send  = aSend;
+
+    if (send.mBusHandle != 0)
+    {
+        // Only busses can take sends
+        const int ch  = getVoiceFromHandle_internal(send.mBusHandle);
+        auto*     bus = ch != -1 ? dynamic_cast<BusInstance*>(mVoice[ch].get()) : nullptr;
+
+        if (bus == nullptr || ch == int(aVoice))
+        {
+            send.mBusHandle = 0;
+        }
+        else if (!bus->mFlags.SendReturn)
+        {
+            bus->enableSendReturn_internal(mScratchSize);
+            mActiveVoiceDirty = true;
+        }
+    }
+
+    if (send.mBusHandle != voice->mSend[aSendId].mBusHandle)
+    {
+        // New target; ramp in from silence
+        voice->mSendState[aSendId] = AudioSendState{};
+    }
+
+    voice->mSend[aSendId] = send;
+}
+
+void Engine::setSend(
+    handle aVoiceHandle, size_t aSendId, handle aBusHandle, float aLevel, bool aPreFader)
+{
+    if (aSendId >= SENDS_PER_STREAM)
+    {
+        return;
+    }
+
+    FOR_ALL_VOICES_PRE
+    setVoiceSend_internal(ch, aSendId, AudioSend{aBusHandle, aLevel, aPreFader});
+    FOR_ALL_VOICES_POST
+}
+
+void Engine::setSendLevel(handle aVoiceHandle, size_t aSendId, float aLevel)
+{
+    if (aSendId >= SENDS_PER_STREAM)
+    {
+        return;
+    }
+
+    FOR_ALL_VOICES_PRE
+    mVoice[ch]->mSend[aSendId].mLevel = aLevel;
+    FOR_ALL_VOICES_POST
+}
+
+float Engine::getSendLevel(handle aVoiceHandle, size_t aSendId)
+{
+    if (aSendId >= SENDS_PER_STREAM)
+    {
+        return 0;
+    }
+
+    lockAudioMutex_internal();
+
+    auto      ret = 0.0f;
+    const int ch  = getVoiceFromHandle_internal(aVoiceHandle);
+    if (ch != -1 && mVoice[ch]->mSend[aSendId].mBusHandle != 0)
+    {
+        ret = mVoice[ch]->mSend[aSendId].mLevel;
+    }
+
+    unlockAudioMutex_internal();
+
+    return ret;
+}
+}; // namespace SoLoud
@@ -23,6 +23,7 @@ freely, subject to the following restrictions:
 */
 
 #include "soloud_internal.hpp"
+#include "soloud_limiter.hpp"
 
 // Setters - set various bits of SoLoud state
 
@@ -33,6 +34,17 @@ void Engine::setPostClipScaler(float aScaler)
     mPostClipScaler = aScaler;
 }
 
+void Engine::setLimiterSettings(const LimiterSettings& aSettings)
+{
+    lockAudioMutex_internal();
+    mLimiterSettings = aSettings;
+    if (mLimiter)
+    {
+        mLimiter->setSettings(mLimiterSettings);
+    }
+    unlockAudioMutex_internal();
+}
+
 void Engine::setMainResampler(Resampler aResampler)
 {
     mResampler = aResampler;
@@ -104,9 +116,39 @@ void Engine::setProtectVoice(handle aVoiceHandle, bool aProtect)
 {
     FOR_ALL_VOICES_PRE
     mVoice[ch]->mFlags.Protected = aProtect;
+    setStealCandidate_internal(ch, !aProtect);
+    FOR_ALL_VOICES_POST
+}
+
+void Engine::setPriority(handle aVoiceHandle, int aPriority)
+{
+    FOR_ALL_VOICES_PRE
+    setStealCandidate_internal(ch, false);
+    mVoice[ch]->mPriority = aPriority;
+    mActiveVoiceDirty     = true;
+    setStealCandidate_internal(ch, !mVoice[ch]->mFlags.Protected);
     FOR_ALL_VOICES_POST
 }
 
+void Engine::setVoiceStealPolicy(VoiceStealPolicy aPolicy)
+{
+    lockAudioMutex_internal();
+    mStealPolicy = aPolicy;
+    unlockAudioMutex_internal();
+}
+
+void Engine::setCategoryVoiceLimit(size_t aCategory, size_t aMaxVoices)
+{
+    lockAudioMutex_internal();
+    if (aCategory >= mCategoryLimit.size())
+    {
+        mCategoryLimit.resize(aCategory + 1, 0);
+        mCategoryVoices.resize(aCategory + 1, 0);
+    }
+    mCategoryLimit[aCategory] = aMaxVoices;
+    unlockAudioMutex_internal();
+}
+
 void Engine::setPan(handle aVoiceHandle, float aPan)
 {
     FOR_ALL_VOICES_PRE
@@ -162,6 +204,14 @@ void Engine::setInaudibleBehavior(handle aVoiceHandle, bool aMustTick, bool aKil
     FOR_ALL_VOICES_POST
 }
 
+void Engine::setInaudibleVirtual(handle aVoiceHandle, bool aVirtual)
+{
+    FOR_ALL_VOICES_PRE
+    mVoice[ch]->mFlags.InaudibleVirtual = aVirtual;
+    mActiveVoiceDirty                   = true;
+    FOR_ALL_VOICES_POST
+}
+
 void Engine::setLoopPoint(handle aVoiceHandle, time_t aLoopPoint)
 {
     FOR_ALL_VOICES_PRE
@@ -191,6 +241,39 @@ void Engine::setVolume(handle aVoiceHandle, float aVolume)
     FOR_ALL_VOICES_POST
 }
 
+void Engine::setVolumes(std::span<const handle> aVoiceHandles, std::span<const float> aVolumes)
+{
+    assert(aVoiceHandles.size() == aVolumes.size());
+
+    lockAudioMutex_internal();
+    for (size_t i = 0; i < aVoiceHandles.size(); ++i)
+    {
+        const handle aVoiceHandle = aVoiceHandles[i];
+
+        FOR_ALL_VOICES_PRE_LOCKED
+        mVoice[ch]->mVolumeFader.mActive = 0;
+        setVoiceVolume_internal(ch, aVolumes[i]);
+        FOR_ALL_VOICES_POST_LOCKED
+    }
+    unlockAudioMutex_internal();
+}
+
+void Engine::setPans(std::span<const handle> aVoiceHandles, std::span<const float> aPans)
+{
+    assert(aVoiceHandles.size() == aPans.size());
+
+    lockAudioMutex_internal();
+    for (size_t i = 0; i < aVoiceHandles.size(); ++i)
+    {
+        const handle aVoiceHandle = aVoiceHandles[i];
+
+        FOR_ALL_VOICES_PRE_LOCKED
+        setVoicePan_internal(ch, aPans[i]);
+        FOR_ALL_VOICES_POST_LOCKED
+    }
+    unlockAudioMutex_internal();
+}
+
 void Engine::setDelaySamples(handle aVoiceHandle, size_t aSamples)
 {
     FOR_ALL_VOICES_PRE
@@ -23,11 +23,44 @@ freely, subject to the following restrictions:
 */
 
 #include "soloud_engine.hpp"
+#include "soloud_handles.hpp"
+#include "soloud_internal.hpp"
+#include "soloud_snapshot.hpp"
 
 // Direct voice operations (no mutexes - called from other functions)
 
 namespace SoLoud
 {
+void panChannelVolumes(float aPan, size_t aChannels, std::array<float, MAX_CHANNELS>& aVolume)
+{
+    const auto l = float(std::cos((aPan + 1) * M_PI / 4));
+    const auto r = float(std::sin((aPan + 1) * M_PI / 4));
+
+    aVolume[0] = l;
+    aVolume[1] = r;
+    if (aChannels == 4)
+    {
+        aVolume[2] = l;
+        aVolume[3] = r;
+    }
+    if (aChannels == 6)
+    {
+        aVolume[2] = 1.0f / std::sqrt(2.0f);
+        aVolume[3] = 1;
+        aVolume[4] = l;
+        aVolume[5] = r;
+    }
+    if (aChannels == 8)
+    {
+        aVolume[2] = 1.0f / std::sqrt(2.0f);
+        aVolume[3] = 1;
+        aVolume[4] = l;
+        aVolume[5] = r;
+        aVolume[6] = l;
+        aVolume[7] = r;
+    }
+}
+
 void Engine::setVoiceRelativePlaySpeed_internal(size_t aVoice, float aSpeed)
 {
     assert(aVoice < VOICE_COUNT);
@@ -38,6 +71,7 @@ void Engine::setVoiceRelativePlaySpeed_internal(size_t aVoice, float aSpeed)
     {
         mVoice[aVoice]->mSetRelativePlaySpeed = aSpeed;
         updateVoiceRelativePlaySpeed_internal(aVoice);
+        publishVoice_internal(aVoice);
     }
 }
 
@@ -51,6 +85,7 @@ void Engine::setVoicePause_internal(size_t aVoice, int aPause)
     {
         mVoice[aVoice]->mPauseScheduler.mActive = 0;
         mVoice[aVoice]->mFlags.Paused           = aPause;
+        publishVoice_internal(aVoice);
     }
 }
 
@@ -60,32 +95,9 @@ void Engine::setVoicePan_internal(size_t aVoice, float aPan)
     assert(mInsideAudioThreadMutex);
     if (mVoice[aVoice])
     {
-        mVoice[aVoice]->mPan              = aPan;
-        const auto l                      = float(std::cos((aPan + 1) * M_PI / 4));
-        const auto r                      = float(std::sin((aPan + 1) * M_PI / 4));
-        mVoice[aVoice]->mChannelVolume[0] = l;
-        mVoice[aVoice]->mChannelVolume[1] = r;
-        if (mVoice[aVoice]->mChannels == 4)
-        {
-            mVoice[aVoice]->mChannelVolume[2] = l;
-            mVoice[aVoice]->mChannelVolume[3] = r;
-        }
-        if (mVoice[aVoice]->mChannels == 6)
-        {
-            mVoice[aVoice]->mChannelVolume[2] = 1.0f / std::sqrt(2.0f);
-            mVoice[aVoice]->mChannelVolume[3] = 1;
-            mVoice[aVoice]->mChannelVolume[4] = l;
-            mVoice[aVoice]->mChannelVolume[5] = r;
-        }
-        if (mVoice[aVoice]->mChannels == 8)
-        {
-            mVoice[aVoice]->mChannelVolume[2] = 1.0f / std::sqrt(2.0f);
-            mVoice[aVoice]->mChannelVolume[3] = 1;
-            mVoice[aVoice]->mChannelVolume[4] = l;
-            mVoice[aVoice]->mChannelVolume[5] = r;
-            mVoice[aVoice]->mChannelVolume[6] = l;
-            mVoice[aVoice]->mChannelVolume[7] = r;
-        }
+        mVoice[aVoice]->mPan = aPan;
+        panChannelVolumes(aPan, mVoice[aVoice]->mChannels, mVoice[aVoice]->mChannelVolume);
+        publishVoice_internal(aVoice);
     }
 }
 
@@ -108,9 +120,15 @@ void Engine::stopVoice_internal(size_t aVoice)
     mActiveVoiceDirty = true;
     if (mVoice[aVoice])
     {
+        mCategoryVoices[mVoice[aVoice]->mCategory]--;
+        setStealCandidate_internal(aVoice, false);
+
         // Delete via temporary variable to avoid recursion
         auto v = mVoice[aVoice];
         mVoice[aVoice].reset();
+        mSnapshots->publish(aVoice, {});
+        mPublishedVoiceCount.fetch_sub(1, std::memory_order_relaxed);
+        mVoiceGroups->removeFromAll(aVoice);
 
         for (size_t i = 0; i < mMaxActiveVoices; ++i)
         {
@@ -126,8 +144,10 @@ void Engine::updateVoiceRelativePlaySpeed_internal(size_t aVoice)
 {
     assert(aVoice < VOICE_COUNT);
     assert(mInsideAudioThreadMutex);
-    mVoice[aVoice]->mOverallRelativePlaySpeed =
-        m3dData[aVoice].mDopplerValue * mVoice[aVoice]->mSetRelativePlaySpeed;
+    // The propagation delay line makes the doppler shift itself
+    const float doppler =
+        mVoice[aVoice]->mPropagation.mRing.empty() ? m3dData[aVoice].mDopplerValue : 1.0f;
+    mVoice[aVoice]->mOverallRelativePlaySpeed = doppler * mVoice[aVoice]->mSetRelativePlaySpeed;
     mVoice[aVoice]->mSamplerate =
         mVoice[aVoice]->mBaseSamplerate * mVoice[aVoice]->mOverallRelativePlaySpeed;
 }
@@ -145,5 +165,6 @@ void Engine::updateVoiceVolume_internal(size_t aVoice)
                 mVoice[aVoice]->mChannelVolume[i] * mVoice[aVoice]->mOverallVolume;
         }
     }
+    publishVoice_internal(aVoice);
 }
 } // namespace SoLoud
@@ -0,0 +1,258 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_delayline.hpp"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+namespace
+{
+// Catmull-Rom weights of the four samples around a position, from the one before its floor to
+// the second one after, for a fraction t past the floor
+inline void cubicWeights(float t, float* aWeight)
+{
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    aWeight[0]     = 0.5f * (-t3 + 2.0f * t2 - t);
+    aWeight[1]     = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+    aWeight[2]     = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+    aWeight[3]     = 0.5f * (t3 - t2);
+}
+} // namespace
+
+void DelayLine::reserve(size_t aChannels, size_t aMaxDelay)
+{
+    // Interpolated reads look two samples past the delayed position
+    const size_t capacity = std::bit_ceil(aMaxDelay + 2);
+
+    if (aChannels != mChannels)
+    {
+        mChannels = aChannels;
+        mMask     = capacity - 1;
+        mHead     = 0;
+        mBuffer.assign(mChannels * capacity, 0.0f);
+        return;
+    }
+
+    if (capacity <= getCapacity())
+    {
+        return;
+    }
+
+    // Unroll the history to the start of the larger buffer, oldest sample first
+    const size_t       previous = getCapacity();
+    std::vector<float> buffer(mChannels * capacity, 0.0f);
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        const float* src = mBuffer.data() + c * previous;
+        float*       dst = buffer.data() + c * capacity;
+        memcpy(dst, src + mHead, (previous - mHead) * sizeof(float));
+        memcpy(dst + previous - mHead, src, mHead * sizeof(float));
+    }
+
+    mBuffer = std::move(buffer);
+    mMask   = capacity - 1;
+    mHead   = previous;
+}
+
+void DelayLine::write(const float* aInput, size_t aSamples, size_t aStride)
+{
+    assert(aSamples <= getCapacity());
+
+    const size_t capacity = getCapacity();
+    const size_t first    = std::min(aSamples, capacity - mHead);
+
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        float*       dst = mBuffer.data() + c * capacity;
+        const float* src = aInput + c * aStride;
+        memcpy(dst + mHead, src, first * sizeof(float));
+        memcpy(dst, src + first, (aSamples - first) * sizeof(float));
+    }
+
+    mHead = (mHead + aSamples) & mMask;
+}
+
+void DelayLine::read(float* aOutput, size_t aSamples, size_t aStride, size_t aDelay) const
+{
+    assert(aDelay >= aSamples && aDelay <= getCapacity());
+
+    const size_t capacity = getCapacity();
+    const size_t start    = (mHead - aDelay) & mMask;
+    const size_t first    = std::min(aSamples, capacity - start);
+
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        const float* src = mBuffer.data() + c * capacity;
+        float*       dst = aOutput + c * aStride;
+        memcpy(dst, src + start, first * sizeof(float));
+        memcpy(dst + first, src, (aSamples - first) * sizeof(float));
+    }
+}
+
+void DelayLine::readInterpolated(float*       aOutput,
+                                 size_t       aSamples,
+                                 size_t       aStride,
+                                 const float* aDelay) const
+{
+    const size_t capacity = getCapacity();
+    size_t       i        = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    const __m128i head = _mm_set1_epi32(int32_t(mHead) - 1);
+    const __m128i mask = _mm_set1_epi32(int32_t(mMask));
+    const __m128  half = _mm_set1_ps(0.5f);
+
+    for (; i + 4 <= aSamples; i += 4)
+    {
+        // Position relative to the write position, split into whole samples and a fraction
+        const __m128 offset = _mm_add_ps(_mm_set1_ps(float(i)), _mm_setr_ps(0, 1, 2, 3));
+        const __m128 rel    = _mm_sub_ps(offset, _mm_loadu_ps(aDelay + i));
+        __m128i      whole  = _mm_cvttps_epi32(rel);
+        __m128       wholef = _mm_cvtepi32_ps(whole);
+
+        // Truncation rounds negative positions up; step those down to the floor
+        const __m128 above = _mm_cmpgt_ps(wholef, rel);
+        whole              = _mm_add_epi32(whole, _mm_castps_si128(above));
+        wholef             = _mm_sub_ps(wholef, _mm_and_ps(above, _mm_set1_ps(1.0f)));
+
+        const __m128 t  = _mm_sub_ps(rel, wholef);
+        const __m128 t2 = _mm_mul_ps(t, t);
+        const __m128 t3 = _mm_mul_ps(t2, t);
+
+        // Catmull-Rom weights, as in cubicWeights()
+        const __m128 w0 = _mm_mul_ps(
+            half, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), t3), _mm_add_ps(t2, t2)), t));
+        const __m128 w1 = _mm_mul_ps(
+            half,
+            _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), t3),
+                                  _mm_mul_ps(_mm_set1_ps(5.0f), t2)),
+                       _mm_set1_ps(2.0f)));
+        const __m128 w2 = _mm_mul_ps(
+            half,
+            _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(4.0f), t2),
+                                  _mm_mul_ps(_mm_set1_ps(3.0f), t3)),
+                       t));
+        const __m128 w3 = _mm_mul_ps(half, _mm_sub_ps(t3, t2));
+
+        alignas(16) int32_t index[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(index),
+                        _mm_and_si128(_mm_add_epi32(head, whole), mask));
+
+        for (size_t c = 0; c < mChannels; ++c)
+        {
+            const float* src = mBuffer.data() + c * capacity;
+
+            __m128 x[4];
+            for (size_t k = 0; k < 4; ++k)
+            {
+                x[k] = _mm_setr_ps(src[(index[0] + k) & mMask],
+                                   src[(index[1] + k) & mMask],
+                                   src[(index[2] + k) & mMask],
+                                   src[(index[3] + k) & mMask]);
+            }
+
+            __m128 y = _mm_mul_ps(w0, x[0]);
+            y        = _mm_add_ps(y, _mm_mul_ps(w1, x[1]));
+            y        = _mm_add_ps(y, _mm_mul_ps(w2, x[2]));
+            y        = _mm_add_ps(y, _mm_mul_ps(w3, x[3]));
+            _mm_storeu_ps(aOutput + c * aStride + i, y);
+        }
+    }
+#endif
+
+    for (; i < aSamples; ++i)
+    {
+        const float  rel   = float(i) - aDelay[i];
+        const float  whole = floorf(rel);
+        const size_t index = (mHead + ptrdiff_t(whole) - 1) & mMask;
+
+        float w[4];
+        cubicWeights(rel - whole, w);
+
+        for (size_t c = 0; c < mChannels; ++c)
+        {
+            const float* src = mBuffer.data() + c * capacity;
+            float        y   = 0.0f;
+            for (size_t k = 0; k < 4; ++k)
+            {
+                y += w[k] * src[(index + k) & mMask];
+            }
+            aOutput[c * aStride + i] = y;
+        }
+    }
+}
+
+void DelayLine::clear()
+{
+    std::ranges::fill(mBuffer, 0.0f);
+}
+
+void Lfo::setFrequency(double aFrequency, float aSamplerate)
+{
+    if (aFrequency == mFrequency && aSamplerate == mSamplerate)
+    {
+        return;
+    }
+
+    mFrequency  = aFrequency;
+    mSamplerate = aSamplerate;
+
+    const double omega = 2.0 * M_PI * aFrequency / aSamplerate;
+    mRotCos            = cos(omega);
+    mRotSin            = sin(omega);
+}
+
+void Lfo::generate(float* aOutput, size_t aSamples)
+{
+    double c = mCos;
+    double s = mSin;
+
+    for (size_t i = 0; i < aSamples; ++i)
+    {
+        aOutput[i] = float(c);
+
+        const double next = c * mRotCos - s * mRotSin;
+        s                 = s * mRotCos + c * mRotSin;
+        c                 = next;
+    }
+
+    // Keep rounding errors from growing or shrinking the phasor
+    const double scale = 1.0 / sqrt(c * c + s * s);
+    mCos               = c * scale;
+    mSin               = s * scale;
+}
+}; // namespace SoLoud
@@ -0,0 +1,100 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace SoLoud
+{
+// Planar multichannel circular buffer with a power of two capacity, for delay based filters.
+//
+// Positions are relative to the write position, the index of the next sample to be written: a
+// delay of d reads the sample written d samples before it. Reads and writes of a block are split
+// into at most two contiguous segments instead of wrapping each sample.
+class DelayLine
+{
+  public:
+    // Make room for delays up to aMaxDelay samples. Changing the channel count clears the line;
+    // otherwise growing keeps the history, and the line never shrinks.
+    void reserve(size_t aChannels, size_t aMaxDelay);
+
+    size_t getCapacity() const
+    {
+        return mMask + 1;
+    }
+
+    // Append aSamples samples of every channel, aStride floats apart.
+    void write(const float* aInput, size_t aSamples, size_t aStride);
+
+    // Read aSamples samples of every channel, sample i delayed by aDelay from position i. The
+    // delay must be at least aSamples, so only samples already written are read.
+    void read(float* aOutput, size_t aSamples, size_t aStride, size_t aDelay) const;
+
+    // Like read(), with a fractional delay per sample, shared by the channels, through cubic
+    // (Catmull-Rom) interpolation. The interpolator reads up to two samples past the delayed
+    // position, so the delay of sample i must be at least i + 3.
+    void readInterpolated(float*       aOutput,
+                          size_t       aSamples,
+                          size_t       aStride,
+                          const float* aDelay) const;
+
+    // Sample of a channel written aDelay samples before the write position, aDelay >= 1.
+    float at(size_t aChannel, size_t aDelay) const
+    {
+        return mBuffer[aChannel * getCapacity() + ((mHead - aDelay) & mMask)];
+    }
+
+    void clear();
+
+  private:
+    std::vector<float> mBuffer;
+    size_t             mChannels = 0;
+    size_t             mMask     = 0;
+    size_t             mHead     = 0;
+};
+
+// Low frequency sine oscillator. A rotating phasor is advanced by a complex multiplication per
+// sample and renormalized per block, so there is no trigonometry per sample.
+class Lfo
+{
+  public:
+    void setFrequency(double aFrequency, float aSamplerate);
+
+    // Cosine of the phase of the next aSamples samples. The phase starts at 0.
+    void generate(float* aOutput, size_t aSamples);
+
+  private:
+    double mFrequency  = -1;
+    float  mSamplerate = 0.0f;
+
+    // Phasor and its rotation per sample
+    double mCos    = 1;
+    double mSin    = 0;
+    double mRotCos = 1;
+    double mRotSin = 0;
+};
+}; // namespace SoLoud
@@ -25,6 +25,17 @@ freely, subject to the following restrictions:
 // FFT based on fftreal by Laurent de Soras, under WTFPL
 
 #include "soloud_fft.hpp"
+#include "soloud.hpp"
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <mutex>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
 
 namespace fftimpl
 {
@@ -2526,5 +2537,528 @@ void ifft(float* aBuffer, size_t aBufferLength)
         aBuffer[i] *= 1.0f / float(aBufferLength / 2);
     }
 }
+
+namespace
+{
+constexpr size_t MIN_PLAN_BITS = std::countr_zero(MIN_SIZE);
+constexpr size_t MAX_PLAN_BITS = std::countr_zero(MAX_SIZE);
+
+#ifdef SOLOUD_SSE_INTRINSICS
+// (aReal + i aImag) * (bReal + i bImag), four at a time
+inline void mulQuad(__m128 aReal, __m128 aImag, __m128 bReal, __m128 bImag, __m128& oReal, __m128& oImag)
+{
+    oReal = _mm_sub_ps(_mm_mul_ps(aReal, bReal), _mm_mul_ps(aImag, bImag));
+    oImag = _mm_add_ps(_mm_mul_ps(aReal, bImag), _mm_mul_ps(aImag, bReal));
+}
+
+inline __m128 reverseQuad(__m128 aValue)
+{
+    return _mm_shuffle_ps(aValue, aValue, _MM_SHUFFLE(0, 1, 2, 3));
+}
+#endif
+
+// First two radix-2 stages, fused into one radix-4 pass over groups of four points
+void radix4First(float* aReal, float* aImag, size_t aPoints)
+{
+    size_t g = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    for (; g + 16 <= aPoints; g += 16)
+    {
+        // Transpose so that each register holds the same point of four groups
+        __m128 r0 = _mm_loadu_ps(aReal + g);
+        __m128 r1 = _mm_loadu_ps(aReal + g + 4);
+        __m128 r2 = _mm_loadu_ps(aReal + g + 8);
+        __m128 r3 = _mm_loadu_ps(aReal + g + 12);
+        __m128 i0 = _mm_loadu_ps(aImag + g);
+        __m128 i1 = _mm_loadu_ps(aImag + g + 4);
+        __m128 i2 = _mm_loadu_ps(aImag + g + 8);
+        __m128 i3 = _mm_loadu_ps(aImag + g + 12);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _MM_TRANSPOSE4_PS(i0, i1, i2, i3);
+
+        const __m128 br0 = _mm_add_ps(r0, r1);
+        const __m128 bi0 = _mm_add_ps(i0, i1);
+        const __m128 br1 = _mm_sub_ps(r0, r1);
+        const __m128 bi1 = _mm_sub_ps(i0, i1);
+        const __m128 br2 = _mm_add_ps(r2, r3);
+        const __m128 bi2 = _mm_add_ps(i2, i3);
+        const __m128 br3 = _mm_sub_ps(r2, r3);
+        const __m128 bi3 = _mm_sub_ps(i2, i3);
+
+        r0 = _mm_add_ps(br0, br2);
+        i0 = _mm_add_ps(bi0, bi2);
+        r2 = _mm_sub_ps(br0, br2);
+        i2 = _mm_sub_ps(bi0, bi2);
+        r1 = _mm_add_ps(br1, bi3);
+        i1 = _mm_sub_ps(bi1, br3);
+        r3 = _mm_sub_ps(br1, bi3);
+        i3 = _mm_add_ps(bi1, br3);
+
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _MM_TRANSPOSE4_PS(i0, i1, i2, i3);
+        _mm_storeu_ps(aReal + g, r0);
+        _mm_storeu_ps(aReal + g + 4, r1);
+        _mm_storeu_ps(aReal + g + 8, r2);
+        _mm_storeu_ps(aReal + g + 12, r3);
+        _mm_storeu_ps(aImag + g, i0);
+        _mm_storeu_ps(aImag + g + 4, i1);
+        _mm_storeu_ps(aImag + g + 8, i2);
+        _mm_storeu_ps(aImag + g + 12, i3);
+    }
+#endif
+
+    for (; g < aPoints; g += 4)
+    {
+        float* re = aReal + g;
+        float* im = aImag + g;
+
+        const float br0 = re[0] + re[1];
+        const float bi0 = im[0] + im[1];
+        const float br1 = re[0] - re[1];
+        const float bi1 = im[0] - im[1];
+        const float br2 = re[2] + re[3];
+        const float bi2 = im[2] + im[3];
+        const float br3 = re[2] - re[3];
+        const float bi3 = im[2] - im[3];
+
+        re[0] = br0 + br2;
+        im[0] = bi0 + bi2;
+        re[2] = br0 - br2;
+        im[2] = bi0 - bi2;
+        re[1] = br1 + bi3;
+        im[1] = bi1 - br3;
+        re[3] = br1 - bi3;
+        im[3] = bi1 + br3;
+    }
+}
+
+// Two radix-2 stages with half lengths aHalf and 2 * aHalf, fused into one pass
+void radix4Pass(float*       aReal,
+                float*       aImag,
+                size_t       aPoints,
+                size_t       aHalf,
+                const float* aTwiddleReal,
+                const float* aTwiddleImag)
+{
+    const float* w1r = aTwiddleReal + aHalf;
+    const float* w1i = aTwiddleImag + aHalf;
+    const float* w2r = aTwiddleReal + aHalf * 2;
+    const float* w2i = aTwiddleImag + aHalf * 2;
+
+    for (size_t g = 0; g < aPoints; g += aHalf * 4)
+    {
+        float* r0 = aReal + g;
+        float* i0 = aImag + g;
+        float* r1 = r0 + aHalf;
+        float* i1 = i0 + aHalf;
+        float* r2 = r1 + aHalf;
+        float* i2 = i1 + aHalf;
+        float* r3 = r2 + aHalf;
+        float* i3 = i2 + aHalf;
+
+        size_t k = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+        for (; k + 4 <= aHalf; k += 4)
+        {
+            const __m128 ar1 = _mm_loadu_ps(w1r + k);
+            const __m128 ai1 = _mm_loadu_ps(w1i + k);
+            const __m128 ar2 = _mm_loadu_ps(w2r + k);
+            const __m128 ai2 = _mm_loadu_ps(w2i + k);
+            const __m128 xr0 = _mm_loadu_ps(r0 + k);
+            const __m128 xi0 = _mm_loadu_ps(i0 + k);
+            const __m128 xr2 = _mm_loadu_ps(r2 + k);
+            const __m128 xi2 = _mm_loadu_ps(i2 + k);
+
+            __m128 tr, ti;
+            mulQuad(_mm_loadu_ps(r1 + k), _mm_loadu_ps(i1 + k), ar1, ai1, tr, ti);
+            const __m128 yr0 = _mm_add_ps(xr0, tr);
+            const __m128 yi0 = _mm_add_ps(xi0, ti);
+            const __m128 yr1 = _mm_sub_ps(xr0, tr);
+            const __m128 yi1 = _mm_sub_ps(xi0, ti);
+
+            mulQuad(_mm_loadu_ps(r3 + k), _mm_loadu_ps(i3 + k), ar1, ai1, tr, ti);
+            const __m128 yr2 = _mm_add_ps(xr2, tr);
+            const __m128 yi2 = _mm_add_ps(xi2, ti);
+            const __m128 yr3 = _mm_sub_ps(xr2, tr);
+            const __m128 yi3 = _mm_sub_ps(xi2, ti);
+
+            mulQuad(yr2, yi2, ar2, ai2, tr, ti);
+            _mm_storeu_ps(r0 + k, _mm_add_ps(yr0, tr));
+            _mm_storeu_ps(i0 + k, _mm_add_ps(yi0, ti));
+            _mm_storeu_ps(r2 + k, _mm_sub_ps(yr0, tr));
+            _mm_storeu_ps(i2 + k, _mm_sub_ps(yi0, ti));
+
+            // The twiddle for the odd half is the even one times -i
+            mulQuad(yr3, yi3, ar2, ai2, tr, ti);
+            _mm_storeu_ps(r1 + k, _mm_add_ps(yr1, ti));
+            _mm_storeu_ps(i1 + k, _mm_sub_ps(yi1, tr));
+            _mm_storeu_ps(r3 + k, _mm_sub_ps(yr1, ti));
+            _mm_storeu_ps(i3 + k, _mm_add_ps(yi1, tr));
+        }
+#endif
+
+        for (; k < aHalf; ++k)
+        {
+            float tr = r1[k] * w1r[k] - i1[k] * w1i[k];
+            float ti = r1[k] * w1i[k] + i1[k] * w1r[k];
+
+            const float yr0 = r0[k] + tr;
+            const float yi0 = i0[k] + ti;
+            const float yr1 = r0[k] - tr;
+            const float yi1 = i0[k] - ti;
+
+            tr = r3[k] * w1r[k] - i3[k] * w1i[k];
+            ti = r3[k] * w1i[k] + i3[k] * w1r[k];
+
+            const float yr2 = r2[k] + tr;
+            const float yi2 = i2[k] + ti;
+            const float yr3 = r2[k] - tr;
+            const float yi3 = i2[k] - ti;
+
+            tr    = yr2 * w2r[k] - yi2 * w2i[k];
+            ti    = yr2 * w2i[k] + yi2 * w2r[k];
+            r0[k] = yr0 + tr;
+            i0[k] = yi0 + ti;
+            r2[k] = yr0 - tr;
+            i2[k] = yi0 - ti;
+
+            tr    = yr3 * w2r[k] - yi3 * w2i[k];
+            ti    = yr3 * w2i[k] + yi3 * w2r[k];
+            r1[k] = yr1 + ti;
+            i1[k] = yi1 - tr;
+            r3[k] = yr1 - ti;
+            i3[k] = yi1 + tr;
+        }
+    }
+}
+
+// Single radix-2 stage with half length aHalf
+void radix2Pass(float*       aReal,
+                float*       aImag,
+                size_t       aPoints,
+                size_t       aHalf,
+                const float* aTwiddleReal,
+                const float* aTwiddleImag)
+{
+    const float* wr = aTwiddleReal + aHalf;
+    const float* wi = aTwiddleImag + aHalf;
+
+    for (size_t g = 0; g < aPoints; g += aHalf * 2)
+    {
+        float* r0 = aReal + g;
+        float* i0 = aImag + g;
+        float* r1 = r0 + aHalf;
+        float* i1 = i0 + aHalf;
+
+        size_t k = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+        for (; k + 4 <= aHalf; k += 4)
+        {
+            __m128 tr, ti;
+            mulQuad(_mm_loadu_ps(r1 + k),
+                    _mm_loadu_ps(i1 + k),
+                    _mm_loadu_ps(wr + k),
+                    _mm_loadu_ps(wi + k),
+                    tr,
+                    ti);
+            const __m128 xr = _mm_loadu_ps(r0 + k);
+            const __m128 xi = _mm_loadu_ps(i0 + k);
+            _mm_storeu_ps(r0 + k, _mm_add_ps(xr, tr));
+            _mm_storeu_ps(i0 + k, _mm_add_ps(xi, ti));
+            _mm_storeu_ps(r1 + k, _mm_sub_ps(xr, tr));
+            _mm_storeu_ps(i1 + k, _mm_sub_ps(xi, ti));
+        }
+#endif
+
+        for (; k < aHalf; ++k)
+        {
+            const float tr = r1[k] * wr[k] - i1[k] * wi[k];
+            const float ti = r1[k] * wi[k] + i1[k] * wr[k];
+            r1[k]          = r0[k] - tr;
+            i1[k]          = i0[k] - ti;
+            r0[k] += tr;
+            i0[k] += ti;
+        }
+    }
+}
+} // namespace
+
+Plan::Plan(size_t aSize)
+    : mSize(aSize)
+{
+    assert(std::has_single_bit(aSize));
+    assert(aSize >= MIN_SIZE && aSize <= MAX_SIZE);
+
+    // The real transform runs on a complex one of half the size
+    const size_t points = aSize / 2;
+    const int    bits   = std::countr_zero(points);
+
+    mBitReverse.resize(points);
+    for (size_t i = 0; i < points; ++i)
+    {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b)
+        {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        mBitReverse[i] = r;
+    }
+
+    mTwiddleReal.resize(points);
+    mTwiddleImag.resize(points);
+    for (size_t h = 1; h < points; h *= 2)
+    {
+        for (size_t k = 0; k < h; ++k)
+        {
+            const double phase  = -M_PI * double(k) / double(h);
+            mTwiddleReal[h + k] = float(cos(phase));
+            mTwiddleImag[h + k] = float(sin(phase));
+        }
+    }
+
+    mSplitReal.resize(points / 2 + 1);
+    mSplitImag.resize(points / 2 + 1);
+    for (size_t k = 0; k <= points / 2; ++k)
+    {
+        const double phase = -2.0 * M_PI * double(k) / double(aSize);
+        mSplitReal[k]      = float(cos(phase));
+        mSplitImag[k]      = float(sin(phase));
+    }
+}
+
+void Plan::transform(float* aReal, float* aImag) const
+{
+    const size_t points = mSize / 2;
+    const float* wr     = mTwiddleReal.data();
+    const float* wi     = mTwiddleImag.data();
+
+    radix4First(aReal, aImag, points);
+
+    size_t h = 4;
+    for (; h * 2 < points; h *= 4)
+    {
+        radix4Pass(aReal, aImag, points, h, wr, wi);
+    }
+
+    if (h < points)
+    {
+        radix2Pass(aReal, aImag, points, h, wr, wi);
+    }
+}
+
+void Plan::forward(const float* aInput, float* aReal, float* aImag) const
+{
+    const size_t points = mSize / 2;
+
+    // Pack even samples into the real and odd samples into the imaginary part
+    for (size_t i = 0; i < points; ++i)
+    {
+        const size_t j = size_t(mBitReverse[i]) * 2;
+        aReal[i]       = aInput[j];
+        aImag[i]       = aInput[j + 1];
+    }
+
+    transform(aReal, aImag);
+
+    // Split into the spectra of the even and odd samples and recombine them. Bins k and
+    // points - k are computed together, in place.
+    const float dc = aReal[0];
+    aReal[0]       = dc + aImag[0];
+    aImag[0]       = dc - aImag[0];
+
+    const float* wr = mSplitReal.data();
+    const float* wi = mSplitImag.data();
+    size_t       k  = 1;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; k + 4 <= points / 2; k += 4)
+    {
+        const size_t m  = points - k - 3;
+        const __m128 ar = _mm_loadu_ps(aReal + k);
+        const __m128 ai = _mm_loadu_ps(aImag + k);
+        const __m128 br = reverseQuad(_mm_loadu_ps(aReal + m));
+        const __m128 bi = reverseQuad(_mm_loadu_ps(aImag + m));
+
+        // E = (A + conj(B)) / 2, O = -i (A - conj(B)) / 2
+        const __m128 er = _mm_mul_ps(_mm_add_ps(ar, br), half);
+        const __m128 ei = _mm_mul_ps(_mm_sub_ps(ai, bi), half);
+        const __m128 ori = _mm_mul_ps(_mm_add_ps(ai, bi), half);
+        const __m128 oii = _mm_mul_ps(_mm_sub_ps(br, ar), half);
+
+        __m128 pr, pi;
+        mulQuad(ori, oii, _mm_loadu_ps(wr + k), _mm_loadu_ps(wi + k), pr, pi);
+
+        _mm_storeu_ps(aReal + k, _mm_add_ps(er, pr));
+        _mm_storeu_ps(aImag + k, _mm_add_ps(ei, pi));
+        _mm_storeu_ps(aReal + m, reverseQuad(_mm_sub_ps(er, pr)));
+        _mm_storeu_ps(aImag + m, reverseQuad(_mm_sub_ps(pi, ei)));
+    }
+#endif
+
+    for (; k <= points / 2; ++k)
+    {
+        const size_t m  = points - k;
+        const float  er = (aReal[k] + aReal[m]) * 0.5f;
+        const float  ei = (aImag[k] - aImag[m]) * 0.5f;
+        const float  or_ = (aImag[k] + aImag[m]) * 0.5f;
+        const float  oi = (aReal[m] - aReal[k]) * 0.5f;
+        const float  pr = or_ * wr[k] - oi * wi[k];
+        const float  pi = or_ * wi[k] + oi * wr[k];
+
+        aReal[k] = er + pr;
+        aImag[k] = ei + pi;
+        aReal[m] = er - pr;
+        aImag[m] = pi - ei;
+    }
+}
+
+void Plan::inverse(float* aReal, float* aImag, float* aOutput) const
+{
+    const size_t points = mSize / 2;
+    const float  scale  = 0.5f / float(points);
+
+    // Undo the split, folding in the 1 / points scale of the inverse transform
+    const float dc = aReal[0];
+    aReal[0]       = (dc + aImag[0]) * scale;
+    aImag[0]       = (dc - aImag[0]) * scale;
+
+    const float* wr = mSplitReal.data();
+    const float* wi = mSplitImag.data();
+    size_t       k  = 1;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    const __m128 s = _mm_set1_ps(scale);
+    for (; k + 4 <= points / 2; k += 4)
+    {
+        const size_t m  = points - k - 3;
+        const __m128 ar = _mm_loadu_ps(aReal + k);
+        const __m128 ai = _mm_loadu_ps(aImag + k);
+        const __m128 br = reverseQuad(_mm_loadu_ps(aReal + m));
+        const __m128 bi = reverseQuad(_mm_loadu_ps(aImag + m));
+
+        // E = (A + conj(B)) / 2, O = (A - conj(B)) conj(W) / 2
+        const __m128 er = _mm_mul_ps(_mm_add_ps(ar, br), s);
+        const __m128 ei = _mm_mul_ps(_mm_sub_ps(ai, bi), s);
+        const __m128 dr = _mm_mul_ps(_mm_sub_ps(ar, br), s);
+        const __m128 di = _mm_mul_ps(_mm_add_ps(ai, bi), s);
+
+        __m128 orr, oi;
+        mulQuad(dr,
+                di,
+                _mm_loadu_ps(wr + k),
+                _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(wi + k)),
+                orr,
+                oi);
+
+        // Z[k] = E + iO, Z[points - k] = conj(E) + i conj(O)
+        _mm_storeu_ps(aReal + k, _mm_sub_ps(er, oi));
+        _mm_storeu_ps(aImag + k, _mm_add_ps(ei, orr));
+        _mm_storeu_ps(aReal + m, reverseQuad(_mm_add_ps(er, oi)));
+        _mm_storeu_ps(aImag + m, reverseQuad(_mm_sub_ps(orr, ei)));
+    }
+#endif
+
+    for (; k <= points / 2; ++k)
+    {
+        const size_t m   = points - k;
+        const float  er  = (aReal[k] + aReal[m]) * scale;
+        const float  ei  = (aImag[k] - aImag[m]) * scale;
+        const float  dr  = (aReal[k] - aReal[m]) * scale;
+        const float  di  = (aImag[k] + aImag[m]) * scale;
+        const float  or_ = dr * wr[k] + di * wi[k];
+        const float  oi  = di * wr[k] - dr * wi[k];
+
+        aReal[k] = er - oi;
+        aImag[k] = ei + or_;
+        aReal[m] = er + oi;
+        aImag[m] = or_ - ei;
+    }
+
+    for (size_t i = 0; i < points; ++i)
+    {
+        if (const size_t j = mBitReverse[i]; i < j)
+        {
+            std::swap(aReal[i], aReal[j]);
+            std::swap(aImag[i], aImag[j]);
+        }
+    }
+
+    // Swapping the real and imaginary parts turns the forward transform into the inverse
+    transform(aImag, aReal);
+
+    size_t i = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    for (; i + 4 <= points; i += 4)
+    {
+        const __m128 re = _mm_loadu_ps(aReal + i);
+        const __m128 im = _mm_loadu_ps(aImag + i);
+        _mm_storeu_ps(aOutput + i * 2, _mm_unpacklo_ps(re, im));
+        _mm_storeu_ps(aOutput + i * 2 + 4, _mm_unpackhi_ps(re, im));
+    }
+#endif
+
+    for (; i < points; ++i)
+    {
+        aOutput[i * 2]     = aReal[i];
+        aOutput[i * 2 + 1] = aImag[i];
+    }
+}
+
+void multiplyAccumulate(float*       aReal,
+                        float*       aImag,
+                        const float* aReal0,
+                        const float* aImag0,
+                        const float* aReal1,
+                        const float* aImag1,
+                        size_t       aBins)
+{
+    // DC and Nyquist are both real
+    const float dc      = aReal[0] + aReal0[0] * aReal1[0];
+    const float nyquist = aImag[0] + aImag0[0] * aImag1[0];
+
+    size_t i = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    for (; i + 4 <= aBins; i += 4)
+    {
+        __m128 re, im;
+        mulQuad(_mm_loadu_ps(aReal0 + i),
+                _mm_loadu_ps(aImag0 + i),
+                _mm_loadu_ps(aReal1 + i),
+                _mm_loadu_ps(aImag1 + i),
+                re,
+                im);
+        _mm_storeu_ps(aReal + i, _mm_add_ps(_mm_loadu_ps(aReal + i), re));
+        _mm_storeu_ps(aImag + i, _mm_add_ps(_mm_loadu_ps(aImag + i), im));
+    }
+#endif
+
+    for (; i < aBins; ++i)
+    {
+        aReal[i] += aReal0[i] * aReal1[i] - aImag0[i] * aImag1[i];
+        aImag[i] += aReal0[i] * aImag1[i] + aImag0[i] * aReal1[i];
+    }
+
+    aReal[0] = dc;
+    aImag[0] = nyquist;
+}
+
+const Plan& getPlan(size_t aSize)
+{
+    static std::array<std::unique_ptr<Plan>, MAX_PLAN_BITS + 1> plans;
+    static std::array<std::once_flag, MAX_PLAN_BITS + 1>        created;
+
+    const size_t bits = std::countr_zero(aSize);
+    assert(bits >= MIN_PLAN_BITS && bits <= MAX_PLAN_BITS);
+
+    std::call_once(created[bits], [&] { plans[bits] = std::make_unique<Plan>(aSize); });
+
+    return *plans[bits];
+}
 }; // namespace FFT
 }; // namespace SoLoud
@@ -24,10 +24,69 @@ freely, subject to the following restrictions:
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 namespace SoLoud
 {
 namespace FFT
 {
+// Range of transform sizes a Plan supports
+constexpr size_t MIN_SIZE = 64;
+constexpr size_t MAX_SIZE = 65536;
+
+// Real FFT of a fixed power of two size between 64 and 65536, with the twiddle factors and the
+// bit reversal permutation computed up front.
+//
+// Spectra are stored split: aReal[k] and aImag[k] hold bin k for k < size / 2. The imaginary part
+// of the DC bin is always zero, so aImag[0] holds the (real) Nyquist bin instead.
+class Plan
+{
+  public:
+    explicit Plan(size_t aSize);
+
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    // Transform aSize real samples into aSize / 2 bins. The input can't alias the outputs.
+    void forward(const float* aInput, float* aReal, float* aImag) const;
+
+    // Transform aSize / 2 bins back into aSize real samples, scaled so that the inverse of the
+    // forward transform is the identity. The bins are overwritten.
+    void inverse(float* aReal, float* aImag, float* aOutput) const;
+
+  private:
+    // In place complex FFT of size / 2 points, taking bit reversed input
+    void transform(float* aReal, float* aImag) const;
+
+    size_t mSize;
+
+    std::vector<uint32_t> mBitReverse;
+
+    // Butterfly twiddles; the ones for the stage with half length h start at index h
+    std::vector<float> mTwiddleReal;
+    std::vector<float> mTwiddleImag;
+
+    // Twiddles splitting the half size complex spectrum into the real one
+    std::vector<float> mSplitReal;
+    std::vector<float> mSplitImag;
+};
+
+// Plan for the given size, shared by all callers and created on first use.
+const Plan& getPlan(size_t aSize);
+
+// Multiply two spectra in the layout of Plan and add the product to a third one.
+void multiplyAccumulate(float*       aReal,
+                        float*       aImag,
+                        const float* aReal0,
+                        const float* aImag0,
+                        const float* aReal1,
+                        const float* aImag1,
+                        size_t       aBins);
+
 // Perform 1024 unit FFT. Buffer must have 1024 floats, and will be overwritten
 void fft1024(float* aBuffer);
 
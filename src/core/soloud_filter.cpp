@@ -24,6 +24,7 @@ freely, subject to the following restrictions:
 
 #include "soloud_filter.hpp"
 #include "soloud_fader.hpp"
+#include <limits>
 
 namespace SoLoud
 {
@@ -42,7 +43,7 @@ void FilterInstance::updateParams(double aTime)
     {
         if (mParamFader[i].mActive > 0)
         {
-            mParamChanged |= 1 << i;
+            mParamChanged |= size_t(1) << i;
             mParam[i] = mParamFader[i].get(aTime);
         }
     }
@@ -55,7 +56,7 @@ void FilterInstance::setFilterParameter(size_t aAttributeId, float aValue)
 
     mParamFader[aAttributeId].mActive = 0;
     mParam[aAttributeId]              = aValue;
-    mParamChanged |= 1 << aAttributeId;
+    mParamChanged |= size_t(1) << aAttributeId;
 }
 
 void FilterInstance::fadeFilterParameter(size_t aAttributeId,
@@ -108,4 +109,10 @@ void FilterInstance::filterChannel(float* /*aBuffer*/,
 {
 }
 
+time_t FilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    // Unknown filters may ring forever
+    return std::numeric_limits<time_t>::infinity();
+}
+
 }; // namespace SoLoud
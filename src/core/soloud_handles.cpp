@@ -0,0 +1,169 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_handles.hpp"
+#include <cassert>
+#include <utility>
+
+namespace SoLoud
+{
+handle VoiceGroups::create()
+{
+    size_t slot;
+    if (mFreeSlot.empty())
+    {
+        slot = mSlot.size();
+        mSlot.emplace_back();
+    }
+    else
+    {
+        slot = mFreeSlot.back();
+        mFreeSlot.pop_back();
+    }
+
+    mSlot[slot].mGroup = std::make_unique<VoiceGroup>();
+
+    return makeHandle(slot, mSlot[slot].mGeneration) | HANDLE_GROUP_BIT;
+}
+
+bool VoiceGroups::destroy(handle aGroupHandle)
+{
+    const auto* group = find(aGroupHandle);
+    if (group == nullptr)
+    {
+        return false;
+    }
+
+    for (const handle member : group->members())
+    {
+        dropMembership(handleSlot(member), *group);
+    }
+
+    auto& slot = mSlot[handleSlot(aGroupHandle)];
+    slot.mGroup.reset();
+    slot.mGeneration = (slot.mGeneration + 1) & HANDLE_GENERATION_MASK;
+    mFreeSlot.push_back(handleSlot(aGroupHandle));
+
+    return true;
+}
+
+VoiceGroup* VoiceGroups::find(handle aGroupHandle)
+{
+    return const_cast<VoiceGroup*>(std::as_const(*this).find(aGroupHandle));
+}
+
+const VoiceGroup* VoiceGroups::find(handle aGroupHandle) const
+{
+    if (!isGroupHandle(aGroupHandle))
+    {
+        return nullptr;
+    }
+
+    const size_t slot = handleSlot(aGroupHandle);
+    if (slot >= mSlot.size() || mSlot[slot].mGeneration != handleGeneration(aGroupHandle))
+    {
+        return nullptr;
+    }
+
+    return mSlot[slot].mGroup.get();
+}
+
+bool VoiceGroups::add(VoiceGroup& aGroup, handle aVoiceHandle)
+{
+    const size_t voice = handleSlot(aVoiceHandle);
+    assert(voice < VOICE_COUNT);
+
+    if (const auto* membership = findMembership(voice, aGroup); membership != nullptr)
+    {
+        aGroup.mMembers[membership->mPosition] = aVoiceHandle;
+        return false;
+    }
+
+    mMembership[voice].push_back({&aGroup, uint32_t(aGroup.mMembers.size())});
+    aGroup.mMembers.push_back(aVoiceHandle);
+    return true;
+}
+
+bool VoiceGroups::remove(VoiceGroup& aGroup, size_t aVoice)
+{
+    assert(aVoice < VOICE_COUNT);
+
+    const auto* membership = findMembership(aVoice, aGroup);
+    if (membership == nullptr)
+    {
+        return false;
+    }
+
+    eraseMember(aGroup, membership->mPosition);
+    dropMembership(aVoice, aGroup);
+    return true;
+}
+
+void VoiceGroups::removeFromAll(size_t aVoice)
+{
+    assert(aVoice < VOICE_COUNT);
+
+    for (const auto& membership : mMembership[aVoice])
+    {
+        eraseMember(*membership.mGroup, membership.mPosition);
+    }
+
+    mMembership[aVoice].clear();
+}
+
+VoiceGroups::Membership* VoiceGroups::findMembership(size_t aVoice, const VoiceGroup& aGroup)
+{
+    for (auto& membership : mMembership[aVoice])
+    {
+        if (membership.mGroup == &aGroup)
+        {
+            return &membership;
+        }
+    }
+
+    return nullptr;
+}
+
+void VoiceGroups::dropMembership(size_t aVoice, const VoiceGroup& aGroup)
+{
+    auto* membership = findMembership(aVoice, aGroup);
+    assert(membership != nullptr);
+
+    *membership = mMembership[aVoice].back();
+    mMembership[aVoice].pop_back();
+}
+
+void VoiceGroups::eraseMember(VoiceGroup& aGroup, uint32_t aPosition)
+{
+    const handle last = aGroup.mMembers.back();
+    aGroup.mMembers.pop_back();
+
+    if (aPosition < aGroup.mMembers.size())
+    {
+        aGroup.mMembers[aPosition]                          = last;
+        findMembership(handleSlot(last), aGroup)->mPosition = aPosition;
+    }
+}
+}; // namespace SoLoud
@@ -0,0 +1,148 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include "soloud.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace SoLoud
+{
+// Handles are 64 bits: the slot + 1 in the low 32 bits, the generation of the slot in the next
+// 31, and the top bit for voice groups. A slot gets a new generation whenever it's reused, so the
+// handle of a stopped voice or a destroyed group never matches what took its place.
+static constexpr handle   HANDLE_GROUP_BIT       = handle(1) << 63;
+static constexpr uint32_t HANDLE_GENERATION_MASK = 0x7fffffff;
+
+inline handle makeHandle(size_t aSlot, uint32_t aGeneration)
+{
+    return handle(aSlot + 1) | (handle(aGeneration & HANDLE_GENERATION_MASK) << 32);
+}
+
+// Slot of a handle; out of any range for the 0 handle
+inline size_t handleSlot(handle aHandle)
+{
+    return size_t(aHandle & 0xffffffff) - 1;
+}
+
+inline uint32_t handleGeneration(handle aHandle)
+{
+    return uint32_t(aHandle >> 32) & HANDLE_GENERATION_MASK;
+}
+
+inline bool isGroupHandle(handle aHandle)
+{
+    return (aHandle & HANDLE_GROUP_BIT) != 0;
+}
+
+// Members of a voice group, kept dense for iteration. VoiceGroups keeps the position of each
+// member, so that adding and removing a voice are O(1).
+class VoiceGroup
+{
+  public:
+    bool empty() const
+    {
+        return mMembers.empty();
+    }
+
+    size_t size() const
+    {
+        return mMembers.size();
+    }
+
+    handle operator[](size_t aIndex) const
+    {
+        return mMembers[aIndex];
+    }
+
+    std::span<const handle> members() const
+    {
+        return mMembers;
+    }
+
+  private:
+    friend class VoiceGroups;
+
+    std::vector<handle> mMembers;
+};
+
+// Slot map of the voice groups, growing as needed
+class VoiceGroups
+{
+  public:
+    handle create();
+
+    // Returns false if the handle isn't a live group
+    bool destroy(handle aGroupHandle);
+
+    // Returns nullptr if the handle isn't a live group
+    VoiceGroup*       find(handle aGroupHandle);
+    const VoiceGroup* find(handle aGroupHandle) const;
+
+    // Add a voice handle to a group. Returns false if its voice is a member already, replacing
+    // the handle in case it was stale.
+    bool add(VoiceGroup& aGroup, handle aVoiceHandle);
+
+    // Remove a voice (not handle) from a group. Returns false if it wasn't a member.
+    bool remove(VoiceGroup& aGroup, size_t aVoice);
+
+    // Remove a stopped voice (not handle) from every group it is in. Only visits those groups
+    // and doesn't allocate, so it is fine on the audio thread.
+    void removeFromAll(size_t aVoice);
+
+  private:
+    struct Slot
+    {
+        uint32_t                    mGeneration = 0;
+        std::unique_ptr<VoiceGroup> mGroup;
+    };
+
+    // A group a voice is in, and the position of the voice in its members
+    struct Membership
+    {
+        VoiceGroup* mGroup;
+        uint32_t    mPosition;
+    };
+
+    // Membership of a voice in a group, nullptr if it isn't a member
+    Membership* findMembership(size_t aVoice, const VoiceGroup& aGroup);
+
+    // Remove a voice's membership in a group from its list
+    void dropMembership(size_t aVoice, const VoiceGroup& aGroup);
+
+    // Remove the member at aPosition, moving the last member into the gap
+    void eraseMember(VoiceGroup& aGroup, uint32_t aPosition);
+
+    std::vector<Slot>   mSlot;
+    std::vector<size_t> mFreeSlot;
+
+    // Groups each voice is in. Voices are in a few groups at most, so the lists are scanned.
+    std::array<std::vector<Membership>, VOICE_COUNT> mMembership;
+};
+}; // namespace SoLoud
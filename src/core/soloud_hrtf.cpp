@@ -0,0 +1,723 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_hrtf.hpp"
+#include "soloud_file.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <stdexcept>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+namespace
+{
+constexpr float DEGREES = std::numbers::pi_v<float> / 180.0f;
+
+// Sub-block length over which the kernels of a direct voice stay fixed
+constexpr size_t KERNEL_STEP = 32;
+
+float dot(const float* aA, const float* aB, size_t aCount)
+{
+    size_t i   = 0;
+    float  sum = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= aCount; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(aA + i), _mm_loadu_ps(aB + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(aA + i + 4), _mm_loadu_ps(aB + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    for (; i < aCount; ++i)
+    {
+        sum += aA[i] * aB[i];
+    }
+
+    return sum;
+}
+
+// Reverse a kernel for dot(), delaying it by a fraction of a sample
+void reverseKernel(const float* aKernel, float aFraction, float* aOut, size_t aTaps)
+{
+    for (size_t j = 0; j < aTaps; ++j)
+    {
+        const size_t i    = aTaps - 1 - j;
+        const float  prev = i > 0 ? aKernel[i - 1] : 0.0f;
+        aOut[j]           = aKernel[i] + aFraction * (prev - aKernel[i]);
+    }
+}
+
+// Add aInput, delayed by aDelay and convolved with a reversed kernel, to aOutput. aInput needs
+// aDelay + aTaps - 1 samples of history.
+void convolve(const float* aInput,
+              const float* aKernel,
+              size_t       aTaps,
+              size_t       aDelay,
+              float*       aOutput,
+              size_t       aSamples,
+              float        aVolume0,
+              float        aVolume1)
+{
+    const float* x     = aInput + 1 - aDelay - aTaps;
+    const float  delta = (aVolume1 - aVolume0) / aSamples;
+    size_t       i     = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    // Eight outputs at a time, sharing the tap broadcasts
+    const __m128 step = _mm_set1_ps(delta * 4);
+    __m128       gain = _mm_setr_ps(
+        aVolume0, aVolume0 + delta, aVolume0 + delta * 2, aVolume0 + delta * 3);
+    for (; i + 8 <= aSamples; i += 8)
+    {
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        for (size_t j = 0; j < aTaps; ++j)
+        {
+            const __m128 tap = _mm_set1_ps(aKernel[j]);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(tap, _mm_loadu_ps(x + i + j)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(tap, _mm_loadu_ps(x + i + j + 4)));
+        }
+        _mm_storeu_ps(aOutput + i, _mm_add_ps(_mm_loadu_ps(aOutput + i), _mm_mul_ps(acc0, gain)));
+        gain = _mm_add_ps(gain, step);
+        _mm_storeu_ps(aOutput + i + 4,
+                      _mm_add_ps(_mm_loadu_ps(aOutput + i + 4), _mm_mul_ps(acc1, gain)));
+        gain = _mm_add_ps(gain, step);
+    }
+#endif
+
+    for (; i < aSamples; ++i)
+    {
+        aOutput[i] += (aVolume0 + delta * i) * dot(aKernel, x + i, aTaps);
+    }
+}
+
+// Add a fraction of a sample delayed copy of aSource to aTarget
+void addDelayed(const float* aSource, float* aTarget, size_t aTaps, float aDelay, float aGain)
+{
+    const auto  whole    = size_t(aDelay);
+    const float fraction = aDelay - whole;
+    for (size_t i = 0; i + whole < aTaps; ++i)
+    {
+        aTarget[i + whole] += aGain * (1 - fraction) * aSource[i];
+        if (i + whole + 1 < aTaps)
+        {
+            aTarget[i + whole + 1] += aGain * fraction * aSource[i];
+        }
+    }
+}
+} // namespace
+
+HrirTable loadHrirTable(std::span<const std::byte> aData)
+{
+    auto fp = MemoryFile{aData};
+
+    const auto read32 = [&fp] {
+        uint32_t d = 0;
+        if (fp.read(reinterpret_cast<unsigned char*>(&d), sizeof(d)) != sizeof(d))
+        {
+            throw std::runtime_error{"Failed to load HRTF table"};
+        }
+        return d;
+    };
+
+    // "SLHR"
+    if (read32() != 0x52484c53 || read32() != 1)
+    {
+        throw std::runtime_error{"Failed to load HRTF table"};
+    }
+
+    auto table        = HrirTable{};
+    table.mSamplerate = float(read32());
+    table.mTaps       = read32();
+
+    const size_t rings = read32();
+    if (table.mSamplerate < 8000 || table.mTaps == 0 || table.mTaps > 4096 || rings == 0 ||
+        rings > 180)
+    {
+        throw std::runtime_error{"Failed to load HRTF table"};
+    }
+
+    size_t entries = 0;
+    for (size_t i = 0; i < rings; ++i)
+    {
+        const float    elevation = std::bit_cast<float>(read32());
+        const uint32_t azimuths  = read32();
+        if (!(elevation >= -90 && elevation <= 90) || azimuths == 0 || azimuths > 720 ||
+            (i > 0 && elevation <= table.mElevation.back()))
+        {
+            throw std::runtime_error{"Failed to load HRTF table"};
+        }
+        table.mElevation.push_back(elevation);
+        table.mAzimuthCount.push_back(azimuths);
+        entries += azimuths;
+    }
+
+    // Two delays and two responses per entry; checked before sizing anything from the header
+    const size_t entryBytes = 2 * sizeof(float) + 2 * table.mTaps * sizeof(float);
+    if (entries * entryBytes > aData.size() - fp.pos())
+    {
+        throw std::runtime_error{"Failed to load HRTF table"};
+    }
+
+    table.mDelay.reserve(entries * 2);
+    table.mResponse.resize(entries * 2 * table.mTaps);
+    for (size_t i = 0; i < entries; ++i)
+    {
+        for (size_t ear = 0; ear < 2; ++ear)
+        {
+            const float delay = std::bit_cast<float>(read32());
+            if (!(delay >= 0 && delay < 4096))
+            {
+                throw std::runtime_error{"Failed to load HRTF table"};
+            }
+            table.mDelay.push_back(delay);
+        }
+
+        const size_t bytes = 2 * table.mTaps * sizeof(float);
+        if (fp.read(reinterpret_cast<unsigned char*>(&table.mResponse[i * 2 * table.mTaps]),
+                    bytes) != bytes)
+        {
+            throw std::runtime_error{"Failed to load HRTF table"};
+        }
+    }
+
+    for (const float v : table.mResponse)
+    {
+        if (!std::isfinite(v))
+        {
+            throw std::runtime_error{"Failed to load HRTF table"};
+        }
+    }
+
+    return table;
+}
+
+HrirTable createDefaultHrirTable(float aSamplerate)
+{
+    // Spherical head model after Brown and Duda, "A structural model for binaural sound
+    // synthesis" (1998): a shelving filter for the head shadow, Woodworth's onset delays and a
+    // few pinna echoes.
+    constexpr float radius = 0.0875f;
+    constexpr float speed  = 343.0f;
+    constexpr float pi     = std::numbers::pi_v<float>;
+
+    constexpr float echo_gain[]       = {0.5f, -1.0f, 0.5f, -0.25f, 0.25f};
+    constexpr float echo_amplitude[]  = {1, 5, 5, 5, 5};
+    constexpr float echo_offset[]     = {2, 4, 7, 11, 13};
+    constexpr float echo_elevation[] = {1, 0.5f, 0.5f, 0.5f, 0.5f};
+
+    auto table        = HrirTable{};
+    table.mSamplerate = aSamplerate;
+    table.mTaps       = (size_t(ceilf(0.00075f * aSamplerate)) + 3) & ~size_t(3);
+
+    for (int elevation = -40; elevation <= 90; elevation += 10)
+    {
+        table.mElevation.push_back(float(elevation));
+        table.mAzimuthCount.push_back(
+            uint32_t(std::max(1L, lroundf(36 * cosf(float(elevation) * DEGREES)))));
+    }
+
+    // The pinna echo delays are given in samples at 44.1kHz
+    const float echo_scale = aSamplerate / 44100.0f;
+
+    const float beta = 2 * speed / radius;
+    const float k    = 2 * aSamplerate;
+
+    auto shadow = std::vector<float>(table.mTaps);
+
+    for (size_t ring = 0; ring < table.mElevation.size(); ++ring)
+    {
+        const float elevation = table.mElevation[ring] * DEGREES;
+        const auto  azimuths  = table.mAzimuthCount[ring];
+
+        for (uint32_t a = 0; a < azimuths; ++a)
+        {
+            const float azimuth = 2 * pi * a / azimuths;
+            const auto  dir     = vec3{sinf(azimuth) * cosf(elevation),
+                                  sinf(elevation),
+                                  cosf(azimuth) * cosf(elevation)};
+
+            const size_t offset = table.mResponse.size();
+            table.mResponse.resize(offset + 2 * table.mTaps);
+
+            for (size_t ear = 0; ear < 2; ++ear)
+            {
+                // Angle between the source and the ear axis
+                const float lateral = std::clamp(ear == 0 ? dir.mX : -dir.mX, -1.0f, 1.0f);
+                const float theta   = acosf(lateral);
+
+                const float delay = theta < pi / 2 ? radius / speed * (1 - lateral)
+                                                   : radius / speed * (1 + theta - pi / 2);
+                table.mDelay.push_back(delay * aSamplerate);
+
+                // Head shadow: one pole, one zero shelf, bilinear transformed
+                const float alpha = 1.05f + 0.95f * cosf(theta * 180.0f / 150.0f);
+                const float b0    = (alpha * k + beta) / (k + beta);
+                const float b1    = (beta - alpha * k) / (k + beta);
+                const float a1    = (beta - k) / (k + beta);
+
+                float prev = 0;
+                for (size_t i = 0; i < table.mTaps; ++i)
+                {
+                    shadow[i] = (i == 0 ? b0 : 0) + (i == 1 ? b1 : 0) - a1 * prev;
+                    prev      = shadow[i];
+                }
+
+                // Pinna echoes, from the angle to the median plane and the angle around the ear
+                // axis, folded to the front
+                float polar = atan2f(dir.mY, dir.mZ);
+                if (polar > pi / 2)
+                {
+                    polar = pi - polar;
+                }
+                else if (polar < -pi / 2)
+                {
+                    polar = -pi - polar;
+                }
+
+                float* response = &table.mResponse[offset + ear * table.mTaps];
+                addDelayed(shadow.data(), response, table.mTaps, 0, 1);
+                for (size_t e = 0; e < std::size(echo_gain); ++e)
+                {
+                    const float echo = echo_amplitude[e] * cosf(asinf(lateral) / 2) *
+                                           sinf(echo_elevation[e] * (pi / 2 - polar)) +
+                                       echo_offset[e];
+                    addDelayed(shadow.data(),
+                               response,
+                               table.mTaps,
+                               std::max(echo, 0.0f) * echo_scale,
+                               echo_gain[e]);
+                }
+            }
+        }
+    }
+
+    return table;
+}
+
+Hrtf::Hrtf(const HrirTable& aTable, float aSamplerate, size_t aMaxSamples)
+    : mMaxSamples(aMaxSamples)
+    , mElevation(aTable.mElevation)
+    , mAzimuthCount(aTable.mAzimuthCount)
+{
+    for (const auto count : mAzimuthCount)
+    {
+        mRingStart.push_back(uint32_t(mEntryCount));
+        mEntryCount += count;
+    }
+
+    // Table samples per output sample
+    const float  ratio = aTable.mSamplerate / aSamplerate;
+    const size_t taps  = size_t(ceilf(float(aTable.mTaps) / ratio));
+
+    mTaps = (taps + 1 + 3) & ~size_t(3);
+    mKernel.resize(mEntryCount * 2 * mTaps);
+    mDelay.resize(mEntryCount * 2);
+
+    float max_delay = 0;
+    for (size_t i = 0; i < mEntryCount * 2; ++i)
+    {
+        const float* src    = &aTable.mResponse[i * aTable.mTaps];
+        float*       kernel = &mKernel[i * mTaps];
+        for (size_t j = 0; j < taps; ++j)
+        {
+            const float  pos = j * ratio;
+            const auto   i0  = size_t(pos);
+            const float  f   = pos - i0;
+            const float  s0  = i0 < aTable.mTaps ? src[i0] : 0.0f;
+            const float  s1  = i0 + 1 < aTable.mTaps ? src[i0 + 1] : 0.0f;
+            kernel[j]        = (s0 + f * (s1 - s0)) * ratio;
+        }
+
+        mDelay[i] = aTable.mDelay[i] / ratio;
+        max_delay = std::max(max_delay, mDelay[i]);
+    }
+
+    mHistory = size_t(max_delay) + mTaps;
+
+    mShared.resize(mKernel.size());
+    mSharedDelay.resize(mDelay.size());
+    for (size_t i = 0; i < mEntryCount * 2; ++i)
+    {
+        mSharedDelay[i] = uint32_t(mDelay[i]);
+        reverseKernel(&mKernel[i * mTaps], mDelay[i] - mSharedDelay[i], &mShared[i * mTaps], mTaps);
+    }
+
+    mInput.resize(mEntryCount);
+    mInputData.resize(mEntryCount * (mHistory + mMaxSamples));
+    for (size_t i = 0; i < mEntryCount; ++i)
+    {
+        mInput[i].mBuffer = mInputData.data() + i * (mHistory + mMaxSamples);
+    }
+    mActive.reserve(mEntryCount);
+    mMono.resize(aMaxSamples);
+    mTarget.resize(2 * mTaps);
+    mWork.resize(2 * mTaps);
+}
+
+void Hrtf::initVoice(HrtfVoiceState& aState) const
+{
+    aState.mKernel.assign(2 * mTaps, 0.0f);
+    aState.mHistory.assign(mHistory + mMaxSamples, 0.0f);
+    aState.mSynced = false;
+}
+
+bool Hrtf::fits(const HrtfVoiceState& aState) const
+{
+    return aState.mKernel.size() == 2 * mTaps && aState.mHistory.size() == mHistory + mMaxSamples;
+}
+
+HrtfPosition Hrtf::locate(const vec3& aDirection) const
+{
+    const auto dir = aDirection.isNull() ? vec3{0, 0, 1} : normalize(aDirection);
+
+    float azimuth = atan2f(dir.mX, dir.mZ) / DEGREES;
+    if (azimuth < 0)
+    {
+        azimuth += 360;
+    }
+    const float elevation = asinf(std::clamp(dir.mY, -1.0f, 1.0f)) / DEGREES;
+
+    const size_t upper =
+        std::upper_bound(mElevation.begin(), mElevation.end(), elevation) - mElevation.begin();
+    const size_t ring0 = upper > 0 ? upper - 1 : 0;
+    const size_t ring1 = std::min(upper, mElevation.size() - 1);
+    const float  t     = ring0 == ring1 ? 0.0f
+                                        : (elevation - mElevation[ring0]) /
+                                              (mElevation[ring1] - mElevation[ring0]);
+
+    auto pos = HrtfPosition{};
+
+    // Two neighbouring azimuths on each ring
+    const auto place = [&](size_t aRing, float aWeight, size_t aSlot) {
+        const auto  count = mAzimuthCount[aRing];
+        const float step  = azimuth * count / 360.0f;
+        const auto  a0    = uint32_t(step);
+        const float f     = step - a0;
+
+        pos.mEntry[aSlot]      = mRingStart[aRing] + a0 % count;
+        pos.mEntry[aSlot + 1]  = mRingStart[aRing] + (a0 + 1) % count;
+        pos.mWeight[aSlot]     = aWeight * (1 - f);
+        pos.mWeight[aSlot + 1] = aWeight * f;
+    };
+
+    place(ring0, 1 - t, 0);
+    place(ring1, t, 2);
+
+    return pos;
+}
+
+uint32_t Hrtf::nearest(const vec3& aDirection) const
+{
+    const auto pos = locate(aDirection);
+    return pos.mEntry[std::max_element(pos.mWeight.begin(), pos.mWeight.end()) -
+                      pos.mWeight.begin()];
+}
+
+bool Hrtf::interpolate(const HrtfPosition& aPosition, float* aKernel, float* aDelay) const
+{
+    std::fill(aKernel, aKernel + 2 * mTaps, 0.0f);
+    aDelay[0] = 0;
+    aDelay[1] = 0;
+
+    float total = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        const float w = aPosition.mWeight[i];
+        const auto  e = aPosition.mEntry[i];
+        if (w <= 0 || e >= mEntryCount)
+        {
+            continue;
+        }
+
+        total += w;
+        for (size_t ear = 0; ear < 2; ++ear)
+        {
+            const float* kernel = &mKernel[(e * 2 + ear) * mTaps];
+            for (size_t j = 0; j < mTaps; ++j)
+            {
+                aKernel[ear * mTaps + j] += w * kernel[j];
+            }
+            aDelay[ear] += w * mDelay[e * 2 + ear];
+        }
+    }
+
+    if (total <= 0)
+    {
+        return false;
+    }
+
+    // Only entries dropped above need renormalizing
+    if (fabsf(total - 1) > 1e-6f)
+    {
+        for (size_t j = 0; j < 2 * mTaps; ++j)
+        {
+            aKernel[j] /= total;
+        }
+        aDelay[0] /= total;
+        aDelay[1] /= total;
+    }
+
+    return true;
+}
+
+float* Hrtf::input(uint32_t aEntry, size_t aSamples)
+{
+    auto& in = mInput[aEntry];
+    if (!in.mActive)
+    {
+        in.mActive = true;
+        mActive.push_back(aEntry);
+    }
+
+    float* x = in.mBuffer + mHistory;
+    if (!in.mTouched)
+    {
+        in.mTouched = true;
+        std::fill(x, x + aSamples, 0.0f);
+    }
+
+    return x;
+}
+
+void Hrtf::addShared(
+    const float* aInput, size_t aSamples, uint32_t aEntry, float aVolume0, float aVolume1)
+{
+    float*      x     = input(aEntry, aSamples);
+    const float delta = (aVolume1 - aVolume0) / aSamples;
+    for (size_t i = 0; i < aSamples; ++i)
+    {
+        x[i] += (aVolume0 + delta * i) * aInput[i];
+    }
+}
+
+void Hrtf::renderDirect(const float*    aInput,
+                        size_t          aSamples,
+                        HrtfVoiceState& aState,
+                        float           aVolume0,
+                        float           aVolume1,
+                        bool            aReset,
+                        float*          aOutput,
+                        size_t          aStride)
+{
+    auto target_delay = std::array<float, 2>{};
+    if (!interpolate(aState.mTarget, mTarget.data(), target_delay.data()))
+    {
+        return;
+    }
+
+    if (aReset)
+    {
+        std::copy(mTarget.begin(), mTarget.end(), aState.mKernel.begin());
+        aState.mDelay = target_delay;
+        std::fill(aState.mHistory.begin(), aState.mHistory.end(), 0.0f);
+    }
+
+    float* x = aState.mHistory.data() + mHistory;
+    std::copy(aInput, aInput + aSamples, x);
+
+    const float delta = (aVolume1 - aVolume0) / aSamples;
+
+    for (size_t ofs = 0; ofs < aSamples; ofs += KERNEL_STEP)
+    {
+        const size_t count = std::min(KERNEL_STEP, aSamples - ofs);
+        const float  t     = (ofs + count * 0.5f) / aSamples;
+        const float  v0    = aVolume0 + delta * ofs;
+        const float  v1    = aVolume0 + delta * (ofs + count);
+
+        for (size_t ear = 0; ear < 2; ++ear)
+        {
+            const float* k0     = &aState.mKernel[ear * mTaps];
+            const float* k1     = &mTarget[ear * mTaps];
+            float*       kernel = &mWork[0];
+            for (size_t j = 0; j < mTaps; ++j)
+            {
+                kernel[j] = k0[j] + t * (k1[j] - k0[j]);
+            }
+
+            const float delay =
+                aState.mDelay[ear] + t * (target_delay[ear] - aState.mDelay[ear]);
+            const auto whole = size_t(delay);
+
+            reverseKernel(kernel, delay - whole, &mWork[mTaps], mTaps);
+            convolve(x + ofs,
+                     &mWork[mTaps],
+                     mTaps,
+                     whole,
+                     aOutput + ear * aStride + ofs,
+                     count,
+                     v0,
+                     v1);
+        }
+    }
+
+    std::memmove(aState.mHistory.data(),
+                 aState.mHistory.data() + aSamples,
+                 mHistory * sizeof(float));
+    std::copy(mTarget.begin(), mTarget.end(), aState.mKernel.begin());
+    aState.mDelay = target_delay;
+}
+
+void Hrtf::addVoice(const float*    aBuffer,
+                    size_t          aChannels,
+                    size_t          aStride,
+                    size_t          aSamples,
+                    HrtfVoiceState& aState,
+                    float           aVolume0,
+                    float           aVolume1,
+                    float*          aOutput,
+                    size_t          aOutputStride)
+{
+    const float* mono = aBuffer;
+    if (aChannels > 1)
+    {
+        const float scale = 1.0f / aChannels;
+        for (size_t i = 0; i < aSamples; ++i)
+        {
+            float sum = 0;
+            for (size_t ch = 0; ch < aChannels; ++ch)
+            {
+                sum += aBuffer[i + ch * aStride];
+            }
+            mMono[i] = sum * scale;
+        }
+        mono = mMono.data();
+    }
+
+    // Nearest grid direction, for shared rendering
+    auto  nearest = uint32_t(0);
+    float best    = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        if (aState.mTarget.mWeight[i] > best && aState.mTarget.mEntry[i] < mEntryCount)
+        {
+            best    = aState.mTarget.mWeight[i];
+            nearest = aState.mTarget.mEntry[i];
+        }
+    }
+
+    if (best == 0)
+    {
+        aState.mSynced = false;
+        return;
+    }
+
+    // A state sized for another table can only share
+    const bool direct = aState.mDirect && fits(aState);
+
+    if (aState.mSynced && aState.mWasDirect != direct)
+    {
+        // Fade out the old way of rendering over this block
+        if (aState.mWasDirect)
+        {
+            renderDirect(mono, aSamples, aState, aVolume0, 0, false, aOutput, aOutputStride);
+        }
+        else
+        {
+            addShared(mono, aSamples, aState.mEntry, aVolume0, 0);
+        }
+        aVolume0 = 0;
+    }
+    else if (aState.mSynced && !direct && aState.mEntry != nearest)
+    {
+        // Crossfade to the new grid direction
+        addShared(mono, aSamples, aState.mEntry, aVolume0, 0);
+        aVolume0 = 0;
+    }
+
+    if (direct)
+    {
+        const bool reset = !aState.mSynced || !aState.mWasDirect;
+        renderDirect(mono, aSamples, aState, aVolume0, aVolume1, reset, aOutput, aOutputStride);
+    }
+    else
+    {
+        addShared(mono, aSamples, nearest, aVolume0, aVolume1);
+    }
+
+    aState.mEntry     = nearest;
+    aState.mWasDirect = direct;
+    aState.mSynced    = true;
+}
+
+void Hrtf::render(float* aOutput, size_t aSamples, size_t aStride)
+{
+    size_t kept = 0;
+    for (const auto entry : mActive)
+    {
+        auto&  in = mInput[entry];
+        float* x  = in.mBuffer + mHistory;
+
+        if (in.mTouched)
+        {
+            in.mSilent = 0;
+        }
+        else
+        {
+            std::fill(x, x + aSamples, 0.0f);
+            in.mSilent += aSamples;
+        }
+
+        for (size_t ear = 0; ear < 2; ++ear)
+        {
+            convolve(x,
+                     &mShared[(entry * 2 + ear) * mTaps],
+                     mTaps,
+                     mSharedDelay[entry * 2 + ear],
+                     aOutput + ear * aStride,
+                     aSamples,
+                     1,
+                     1);
+        }
+
+        std::memmove(in.mBuffer, in.mBuffer + aSamples, mHistory * sizeof(float));
+        in.mTouched = false;
+
+        // Once the whole history is silent, nothing is left ringing
+        if (in.mSilent >= mHistory)
+        {
+            in.mActive = false;
+        }
+        else
+        {
+            mActive[kept++] = entry;
+        }
+    }
+    mActive.resize(kept);
+}
+}; // namespace SoLoud
@@ -0,0 +1,162 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include "soloud_engine.hpp"
+#include <span>
+#include <vector>
+
+namespace SoLoud
+{
+// Head related impulse responses measured on a grid of directions. The grid is a set of rings of
+// constant elevation, lowest first, each with evenly spaced azimuths. Azimuth 0 is straight ahead
+// and 90 degrees is to the left.
+struct HrirTable
+{
+    float  mSamplerate = 0.0f;
+    size_t mTaps       = 0;
+
+    // Per ring: elevation in degrees and number of azimuths
+    std::vector<float>    mElevation;
+    std::vector<uint32_t> mAzimuthCount;
+
+    // Per direction, ring by ring: left and right onset delays in samples, and left and right
+    // impulse responses of mTaps samples each
+    std::vector<float> mDelay;
+    std::vector<float> mResponse;
+};
+
+// Parse a table in the format described at Engine::setHrtfTable. Throws std::runtime_error if the
+// data is malformed.
+HrirTable loadHrirTable(std::span<const std::byte> aData);
+
+// Built-in table from a spherical head model with a simple pinna model.
+HrirTable createDefaultHrirTable(float aSamplerate);
+
+// Binaural renderer for 3d voices on the master bus.
+//
+// Direct voices are convolved with a kernel interpolated between their four nearest grid
+// directions, with the onset delays interpolated separately. The other voices are added to the
+// input of their nearest grid direction, which is convolved once per block however many voices
+// share it.
+class Hrtf
+{
+  public:
+    // The table is resampled to aSamplerate if needed. aMaxSamples is the largest block size.
+    Hrtf(const HrirTable& aTable, float aSamplerate, size_t aMaxSamples);
+
+    // Grid directions around a listener space direction, with bilinear weights.
+    HrtfPosition locate(const vec3& aDirection) const;
+
+    // Size the state of a voice for direct rendering, outside the mixer. Voices whose state was
+    // sized for another table share their nearest grid direction instead.
+    void initVoice(HrtfVoiceState& aState) const;
+
+    // Mix a block of a voice, ramping its volume from aVolume0 to aVolume1. Direct voices are
+    // added to the first two channels of aOutput right away, the others on render().
+    void addVoice(const float*    aBuffer,
+                  size_t          aChannels,
+                  size_t          aStride,
+                  size_t          aSamples,
+                  HrtfVoiceState& aState,
+                  float           aVolume0,
+                  float           aVolume1,
+                  float*          aOutput,
+                  size_t          aOutputStride);
+
+    // Convolve the grid directions that have input or are still ringing, adding the result to the
+    // first two channels of aOutput.
+    void render(float* aOutput, size_t aSamples, size_t aStride);
+
+    // Grid direction nearest to a listener space direction
+    uint32_t nearest(const vec3& aDirection) const;
+
+    // Current block of the input of a grid direction, cleared on first use in a block. Anything
+    // added to it is convolved on render().
+    float* input(uint32_t aEntry, size_t aSamples);
+
+  private:
+    // Input of a grid direction: mHistory samples of history followed by the current block
+    struct Input
+    {
+        float* mBuffer  = nullptr;
+        size_t mSilent  = 0;
+        bool   mTouched = false;
+        bool   mActive  = false;
+    };
+
+    // Whether a voice state was sized by initVoice for this table
+    bool fits(const HrtfVoiceState& aState) const;
+
+    // Interpolate the kernels and delays of a position; returns false if it has no valid entries
+    bool interpolate(const HrtfPosition& aPosition, float* aKernel, float* aDelay) const;
+
+    // Convolve a direct voice, moving from the kernels of the last block to the ones of the
+    // target position. aReset starts over from the target with an empty history.
+    void renderDirect(const float*    aInput,
+                      size_t          aSamples,
+                      HrtfVoiceState& aState,
+                      float           aVolume0,
+                      float           aVolume1,
+                      bool            aReset,
+                      float*          aOutput,
+                      size_t          aStride);
+
+    // Add a shared voice to the input of a grid direction
+    void addShared(
+        const float* aInput, size_t aSamples, uint32_t aEntry, float aVolume0, float aVolume1);
+
+    // Kernel length, a multiple of 4 with room for the fractional delay
+    size_t mTaps = 0;
+
+    // Input samples kept between blocks
+    size_t mHistory    = 0;
+    size_t mMaxSamples = 0;
+    size_t mEntryCount = 0;
+
+    std::vector<float>    mElevation;
+    std::vector<uint32_t> mAzimuthCount;
+    std::vector<uint32_t> mRingStart;
+
+    // Per entry and ear: kernel without the delay, and the delay in samples
+    std::vector<float> mKernel;
+    std::vector<float> mDelay;
+
+    // Per entry and ear: reversed kernel with the fractional delay applied, and the whole delay
+    std::vector<float>    mShared;
+    std::vector<uint32_t> mSharedDelay;
+
+    // Inputs of the grid directions, and their buffers, mHistory + mMaxSamples per entry
+    std::vector<Input>    mInput;
+    std::vector<float>    mInputData;
+    std::vector<uint32_t> mActive;
+
+    // Scratch for the mono input and the interpolated kernels
+    std::vector<float> mMono;
+    std::vector<float> mTarget;
+    std::vector<float> mWork;
+};
+}; // namespace SoLoud
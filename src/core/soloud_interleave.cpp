@@ -0,0 +1,425 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include "soloud_interleave.hpp"
+#include "soloud.hpp"
+#include "soloud_engine.hpp"
+#include <cmath>
+#include <cstring>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+// The kernels are written once against small loader/storer types, so each sample format only
+// has to describe how four consecutive interleaved samples are read or written. Channel counts
+// with a dedicated shuffle (1, 2, 4 and 8) run four frames at a time; the rest and all tails go
+// through the scalar loop.
+
+namespace SoLoud
+{
+namespace
+{
+constexpr float S16_TO_FLOAT = 1.0f / 32768.0f;
+constexpr float S24_TO_FLOAT = 1.0f / 8388608.0f;
+
+// Largest float below 2^31, so that full scale does not wrap around
+constexpr float FLOAT_TO_S32 = 2147483520.0f;
+
+inline float clampUnit(float aSample)
+{
+    return aSample <= -1 ? -1 : aSample >= 1 ? 1 : aSample;
+}
+
+inline int32_t readSigned24(const unsigned char* aSource)
+{
+    // Shift into the top bits first so the sign is extended
+    const auto u = uint32_t(aSource[0]) << 8 | uint32_t(aSource[1]) << 16 |
+                   uint32_t(aSource[2]) << 24;
+    return int32_t(u) >> 8;
+}
+
+struct FloatSource
+{
+    const float* mData;
+
+    float get(size_t aIndex) const
+    {
+        return mData[aIndex];
+    }
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128 get4(size_t aIndex) const
+    {
+        return _mm_loadu_ps(mData + aIndex);
+    }
+#endif
+};
+
+struct Signed16Source
+{
+    const int16_t* mData;
+
+    float get(size_t aIndex) const
+    {
+        return mData[aIndex] * S16_TO_FLOAT;
+    }
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128 get4(size_t aIndex) const
+    {
+        const __m128i s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mData + aIndex));
+        const __m128i i = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        return _mm_mul_ps(_mm_cvtepi32_ps(i), _mm_set1_ps(S16_TO_FLOAT));
+    }
+#endif
+};
+
+struct Signed24Source
+{
+    const unsigned char* mData;
+
+    float get(size_t aIndex) const
+    {
+        return readSigned24(mData + aIndex * 3) * S24_TO_FLOAT;
+    }
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128 get4(size_t aIndex) const
+    {
+        const unsigned char* p = mData + aIndex * 3;
+        const __m128i        i = _mm_setr_epi32(
+            readSigned24(p), readSigned24(p + 3), readSigned24(p + 6), readSigned24(p + 9));
+        return _mm_mul_ps(_mm_cvtepi32_ps(i), _mm_set1_ps(S24_TO_FLOAT));
+    }
+#endif
+};
+
+struct FloatDest
+{
+    float* mData;
+
+    void set(size_t aIndex, float aSample) const
+    {
+        mData[aIndex] = aSample;
+    }
+#ifdef SOLOUD_SSE_INTRINSICS
+    void set4(size_t aIndex, __m128 aSamples) const
+    {
+        _mm_storeu_ps(mData + aIndex, aSamples);
+    }
+#endif
+};
+
+struct Signed16Dest
+{
+    int16_t* mData;
+
+    void set(size_t aIndex, float aSample) const
+    {
+        mData[aIndex] = int16_t(lrintf(clampUnit(aSample) * 32767.0f));
+    }
+#ifdef SOLOUD_SSE_INTRINSICS
+    void set4(size_t aIndex, __m128 aSamples) const
+    {
+        aSamples        = _mm_max_ps(_mm_min_ps(aSamples, _mm_set1_ps(1.0f)), _mm_set1_ps(-1.0f));
+        const __m128i i = _mm_cvtps_epi32(_mm_mul_ps(aSamples, _mm_set1_ps(32767.0f)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(mData + aIndex), _mm_packs_epi32(i, i));
+    }
+#endif
+};
+
+struct Signed24Dest
+{
+    unsigned char* mData;
+
+    void set(size_t aIndex, float aSample) const
+    {
+        const auto     s = int32_t(lrintf(clampUnit(aSample) * 8388607.0f));
+        unsigned char* p = mData + aIndex * 3;
+        p[0]             = static_cast<unsigned char>(s);
+        p[1]             = static_cast<unsigned char>(s >> 8);
+        p[2]             = static_cast<unsigned char>(s >> 16);
+    }
+#ifdef SOLOUD_SSE_INTRINSICS
+    void set4(size_t aIndex, __m128 aSamples) const
+    {
+        alignas(16) float tmp[4];
+        _mm_store_ps(tmp, aSamples);
+        for (size_t i = 0; i < 4; ++i)
+        {
+            set(aIndex + i, tmp[i]);
+        }
+    }
+#endif
+};
+
+struct Signed32Dest
+{
+    int32_t* mData;
+
+    void set(size_t aIndex, float aSample) const
+    {
+        mData[aIndex] = int32_t(lrintf(clampUnit(aSample) * FLOAT_TO_S32));
+    }
+#ifdef SOLOUD_SSE_INTRINSICS
+    void set4(size_t aIndex, __m128 aSamples) const
+    {
+        aSamples        = _mm_max_ps(_mm_min_ps(aSamples, _mm_set1_ps(1.0f)), _mm_set1_ps(-1.0f));
+        const __m128i i = _mm_cvtps_epi32(_mm_mul_ps(aSamples, _mm_set1_ps(FLOAT_TO_S32)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mData + aIndex), i);
+    }
+#endif
+};
+
+template <typename Source>
+void deinterleave(const Source& aSource,
+                  size_t        aSourceChannels,
+                  float*        aDest,
+                  size_t        aDestChannels,
+                  size_t        aDestStride,
+                  size_t        aFrames)
+{
+    size_t i = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    const size_t quads = aFrames & ~size_t(3);
+
+    if (aSourceChannels == 1)
+    {
+        for (; i < quads; i += 4)
+        {
+            _mm_storeu_ps(aDest + i, aSource.get4(i));
+        }
+    }
+    else if (aSourceChannels == 2)
+    {
+        for (; i < quads; i += 4)
+        {
+            const __m128 a = aSource.get4(i * 2);
+            const __m128 b = aSource.get4(i * 2 + 4);
+            _mm_storeu_ps(aDest + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            if (aDestChannels > 1)
+            {
+                _mm_storeu_ps(aDest + aDestStride + i,
+                              _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            }
+        }
+    }
+    else if (aSourceChannels == 4 || aSourceChannels == 8)
+    {
+        // Each group of four channels is one 4x4 transpose
+        for (; i < quads; i += 4)
+        {
+            for (size_t g = 0; g < aSourceChannels && g < aDestChannels; g += 4)
+            {
+                __m128 r0 = aSource.get4(i * aSourceChannels + g);
+                __m128 r1 = aSource.get4((i + 1) * aSourceChannels + g);
+                __m128 r2 = aSource.get4((i + 2) * aSourceChannels + g);
+                __m128 r3 = aSource.get4((i + 3) * aSourceChannels + g);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+                const __m128 rows[4] = {r0, r1, r2, r3};
+                for (size_t c = g; c < g + 4 && c < aDestChannels; ++c)
+                {
+                    _mm_storeu_ps(aDest + c * aDestStride + i, rows[c - g]);
+                }
+            }
+        }
+    }
+#endif
+
+    for (; i < aFrames; ++i)
+    {
+        for (size_t c = 0; c < aDestChannels; ++c)
+        {
+            aDest[c * aDestStride + i] = aSource.get(i * aSourceChannels + c);
+        }
+    }
+}
+
+template <typename Dest>
+void interleave(
+    const float* aSource, size_t aSourceStride, size_t aChannels, const Dest& aDest, size_t aFrames)
+{
+    size_t i = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    const size_t quads = aFrames & ~size_t(3);
+
+    if (aChannels == 1)
+    {
+        for (; i < quads; i += 4)
+        {
+            aDest.set4(i, _mm_loadu_ps(aSource + i));
+        }
+    }
+    else if (aChannels == 2)
+    {
+        for (; i < quads; i += 4)
+        {
+            const __m128 l = _mm_loadu_ps(aSource + i);
+            const __m128 r = _mm_loadu_ps(aSource + aSourceStride + i);
+            aDest.set4(i * 2, _mm_unpacklo_ps(l, r));
+            aDest.set4(i * 2 + 4, _mm_unpackhi_ps(l, r));
+        }
+    }
+    else if (aChannels == 4 || aChannels == 8)
+    {
+        for (; i < quads; i += 4)
+        {
+            for (size_t g = 0; g < aChannels; g += 4)
+            {
+                __m128 r0 = _mm_loadu_ps(aSource + g * aSourceStride + i);
+                __m128 r1 = _mm_loadu_ps(aSource + (g + 1) * aSourceStride + i);
+                __m128 r2 = _mm_loadu_ps(aSource + (g + 2) * aSourceStride + i);
+                __m128 r3 = _mm_loadu_ps(aSource + (g + 3) * aSourceStride + i);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+                aDest.set4(i * aChannels + g, r0);
+                aDest.set4((i + 1) * aChannels + g, r1);
+                aDest.set4((i + 2) * aChannels + g, r2);
+                aDest.set4((i + 3) * aChannels + g, r3);
+            }
+        }
+    }
+#endif
+
+    for (; i < aFrames; ++i)
+    {
+        for (size_t c = 0; c < aChannels; ++c)
+        {
+            aDest.set(i * aChannels + c, aSource[c * aSourceStride + i]);
+        }
+    }
+}
+} // namespace
+
+void deinterleaveFloat(const float* aSource,
+                       size_t       aSourceChannels,
+                       float*       aDest,
+                       size_t       aDestChannels,
+                       size_t       aDestStride,
+                       size_t       aFrames)
+{
+    if (aSourceChannels == 1)
+    {
+        memcpy(aDest, aSource, sizeof(float) * aFrames);
+        return;
+    }
+    deinterleave(FloatSource{aSource}, aSourceChannels, aDest, aDestChannels, aDestStride, aFrames);
+}
+
+void deinterleaveSigned16(const int16_t* aSource,
+                          size_t         aSourceChannels,
+                          float*         aDest,
+                          size_t         aDestChannels,
+                          size_t         aDestStride,
+                          size_t         aFrames)
+{
+    deinterleave(
+        Signed16Source{aSource}, aSourceChannels, aDest, aDestChannels, aDestStride, aFrames);
+}
+
+void deinterleaveSigned24(const unsigned char* aSource,
+                          size_t               aSourceChannels,
+                          float*               aDest,
+                          size_t               aDestChannels,
+                          size_t               aDestStride,
+                          size_t               aFrames)
+{
+    deinterleave(
+        Signed24Source{aSource}, aSourceChannels, aDest, aDestChannels, aDestStride, aFrames);
+}
+
+size_t sampleSize(SampleFormat aFormat)
+{
+    switch (aFormat)
+    {
+        case SampleFormat::Float32: return 4;
+        case SampleFormat::Signed16: return 2;
+        case SampleFormat::Signed24: return 3;
+        case SampleFormat::Signed32: return 4;
+    }
+    return 4;
+}
+
+void interleaveSamples(const float* aSource,
+                       size_t       aSourceStride,
+                       size_t       aChannels,
+                       void*        aDest,
+                       SampleFormat aFormat,
+                       size_t       aFrames)
+{
+    const auto run = [&](const auto& aDestination) {
+        interleave(aSource, aSourceStride, aChannels, aDestination, aFrames);
+    };
+
+    switch (aFormat)
+    {
+        case SampleFormat::Float32: run(FloatDest{static_cast<float*>(aDest)}); break;
+        case SampleFormat::Signed16: run(Signed16Dest{static_cast<int16_t*>(aDest)}); break;
+        case SampleFormat::Signed24: run(Signed24Dest{static_cast<unsigned char*>(aDest)}); break;
+        case SampleFormat::Signed32: run(Signed32Dest{static_cast<int32_t*>(aDest)}); break;
+    }
+}
+
+void storeSamples(
+    const float* aSource, void* aDest, size_t aStep, SampleFormat aFormat, size_t aFrames)
+{
+    // Densely packed samples are a single interleaved channel
+    if (aStep == sampleSize(aFormat))
+    {
+        interleaveSamples(aSource, 0, 1, aDest, aFormat, aFrames);
+        return;
+    }
+
+    // Otherwise each sample goes through a one-sample destination of its own
+    auto* dest = static_cast<unsigned char*>(aDest);
+    for (size_t i = 0; i < aFrames; ++i, dest += aStep)
+    {
+        switch (aFormat)
+        {
+            case SampleFormat::Float32:
+                memcpy(dest, aSource + i, sizeof(float));
+                break;
+            case SampleFormat::Signed16:
+            {
+                int16_t s;
+                Signed16Dest{&s}.set(0, aSource[i]);
+                memcpy(dest, &s, sizeof(s));
+                break;
+            }
+            case SampleFormat::Signed24:
+                Signed24Dest{dest}.set(0, aSource[i]);
+                break;
+            case SampleFormat::Signed32:
+            {
+                int32_t s;
+                Signed32Dest{&s}.set(0, aSource[i]);
+                memcpy(dest, &s, sizeof(s));
+                break;
+            }
+        }
+    }
+}
+}; // namespace SoLoud
@@ -0,0 +1,75 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Conversion between interleaved device/codec frames and SoLoud's planar channel buffers.
+// Planar buffers keep each channel aStride floats apart, like everywhere else in SoLoud.
+// Integer samples map full scale to [-1, 1]; converting back clamps to full scale.
+namespace SoLoud
+{
+enum class SampleFormat;
+
+// Size of a single sample in the given format, in bytes
+size_t sampleSize(SampleFormat aFormat);
+
+// Deinterleave float frames. Source channels beyond aDestChannels are skipped.
+void deinterleaveFloat(const float* aSource,
+                       size_t       aSourceChannels,
+                       float*       aDest,
+                       size_t       aDestChannels,
+                       size_t       aDestStride,
+                       size_t       aFrames);
+
+// Deinterleave and convert 16-bit frames.
+void deinterleaveSigned16(const int16_t* aSource,
+                          size_t         aSourceChannels,
+                          float*         aDest,
+                          size_t         aDestChannels,
+                          size_t         aDestStride,
+                          size_t         aFrames);
+
+// Deinterleave and convert packed 3-byte little-endian frames.
+void deinterleaveSigned24(const unsigned char* aSource,
+                          size_t               aSourceChannels,
+                          float*               aDest,
+                          size_t               aDestChannels,
+                          size_t               aDestStride,
+                          size_t               aFrames);
+
+// Interleave planar channels into frames of the given format.
+void interleaveSamples(const float* aSource,
+                       size_t       aSourceStride,
+                       size_t       aChannels,
+                       void*        aDest,
+                       SampleFormat aFormat,
+                       size_t       aFrames);
+
+// Convert a single planar channel into samples of the given format, aStep bytes apart.
+void storeSamples(
+    const float* aSource, void* aDest, size_t aStep, SampleFormat aFormat, size_t aFrames);
+}; // namespace SoLoud
@@ -25,6 +25,7 @@ freely, subject to the following restrictions:
 #pragma once
 
 #include "soloud_engine.hpp"
+#include "soloud_handles.hpp"
 
 namespace SoLoud
 {
@@ -84,89 +85,85 @@ void alsa_init(Engine*     engine,
                size_t      aBuffer     = 2048,
                size_t      aChannels   = 2);
 
-// Interlace samples in a buffer. From 11112222 to 12121212
-void interlace_samples_float(const float* aSourceBuffer,
-                             float*       aDestBuffer,
-                             size_t       aSamples,
-                             size_t       aChannels,
-                             size_t       aStride);
-
-// Convert to 16-bit and interlace samples in a buffer. From 11112222 to 12121212
-void interlace_samples_s16(const float* aSourceBuffer,
-                           short*       aDestBuffer,
-                           size_t       aSamples,
-                           size_t       aChannels,
-                           size_t       aStride);
+// Set the channel volumes of the constant-power pan law for aChannels channels. Channels the
+// pan law does not cover keep their volume.
+void panChannelVolumes(float aPan, size_t aChannels, std::array<float, MAX_CHANNELS>& aVolume);
 }; // namespace SoLoud
 
+// The FOR_ALL_VOICES loops visit a single voice, or every member of a voice group. They walk the
+// group backwards, so the body may stop the current voice, which removes it from the group.
 #define FOR_ALL_VOICES_PRE                                                                         \
-    handle* h_     = nullptr;                                                                      \
-    handle  th_[2] = {aVoiceHandle, 0};                                                            \
     lockAudioMutex_internal();                                                                     \
-    h_ = voiceGroupHandleToArray_internal(aVoiceHandle);                                           \
-    if (h_ == nullptr)                                                                             \
-        h_ = th_;                                                                                  \
-    while (*h_)                                                                                    \
+    const VoiceGroup* g_ = findVoiceGroup_internal(aVoiceHandle);                                  \
+    for (size_t i_ = g_ ? g_->size() : 1; i_-- > 0;)                                               \
     {                                                                                              \
-        int ch = getVoiceFromHandle_internal(*h_);                                                 \
+        if (g_ && i_ >= g_->size())                                                                \
+            continue;                                                                              \
+        const handle h_ = g_ ? (*g_)[i_] : aVoiceHandle;                                           \
+        int          ch = getVoiceFromHandle_internal(h_);                                         \
         if (ch != -1)                                                                              \
         {
 
 #define FOR_ALL_VOICES_POST                                                                        \
     }                                                                                              \
-    h_++;                                                                                          \
     }                                                                                              \
     unlockAudioMutex_internal();
 
+// As FOR_ALL_VOICES_PRE/POST, for callers that hold the audio mutex already
+#define FOR_ALL_VOICES_PRE_LOCKED                                                                  \
+    const VoiceGroup* g_ = findVoiceGroup_internal(aVoiceHandle);                                  \
+    for (size_t i_ = g_ ? g_->size() : 1; i_-- > 0;)                                               \
+    {                                                                                              \
+        if (g_ && i_ >= g_->size())                                                                \
+            continue;                                                                              \
+        const handle h_ = g_ ? (*g_)[i_] : aVoiceHandle;                                           \
+        int          ch = getVoiceFromHandle_internal(h_);                                         \
+        if (ch != -1)                                                                              \
+        {
+
+#define FOR_ALL_VOICES_POST_LOCKED                                                                 \
+    }                                                                                              \
+    }
+
+// The 3d loops only touch game thread state and run without the audio mutex, over a copy of the
+// group's members
 #define FOR_ALL_VOICES_PRE_3D                                                                      \
-    handle* h_     = nullptr;                                                                      \
-    handle  th_[2] = {aVoiceHandle, 0};                                                            \
-    h_             = voiceGroupHandleToArray_internal(aVoiceHandle);                               \
-    if (h_ == nullptr)                                                                             \
-        h_ = th_;                                                                                  \
-    while (*h_)                                                                                    \
+    for (const handle h_ : get3dVoiceHandles_internal(aVoiceHandle))                               \
     {                                                                                              \
-        int ch = (*h_ & 0xfff) - 1;                                                                \
-        if (ch != -1 && m3dData[ch].mHandle == *h_)                                                \
+        const size_t s_ = handleSlot(h_);                                                          \
+        int          ch = s_ < VOICE_COUNT ? int(s_) : -1;                                         \
+        if (ch != -1 && m3dData[ch].mHandle == h_)                                                 \
         {
 
 #define FOR_ALL_VOICES_POST_3D                                                                     \
     }                                                                                              \
-    h_++;                                                                                          \
     }
 
 #define FOR_ALL_VOICES_PRE_EXT                                                                     \
-    handle* h_     = nullptr;                                                                      \
-    handle  th_[2] = {aVoiceHandle, 0};                                                            \
     engine->lockAudioMutex_internal();                                                             \
-    h_ = engine->voiceGroupHandleToArray_internal(aVoiceHandle);                                   \
-    if (h_ == nullptr)                                                                             \
-        h_ = th_;                                                                                  \
-    while (*h_)                                                                                    \
+    const VoiceGroup* g_ = engine->findVoiceGroup_internal(aVoiceHandle);                          \
+    for (size_t i_ = g_ ? g_->size() : 1; i_-- > 0;)                                               \
     {                                                                                              \
-        int ch = engine->getVoiceFromHandle_internal(*h_);                                         \
+        if (g_ && i_ >= g_->size())                                                                \
+            continue;                                                                              \
+        const handle h_ = g_ ? (*g_)[i_] : aVoiceHandle;                                           \
+        int          ch = engine->getVoiceFromHandle_internal(h_);                                 \
         if (ch != -1)                                                                              \
         {
 
 #define FOR_ALL_VOICES_POST_EXT                                                                    \
     }                                                                                              \
-    h_++;                                                                                          \
     }                                                                                              \
     engine->unlockAudioMutex_internal();
 
 #define FOR_ALL_VOICES_PRE_3D_EXT                                                                  \
-    handle* h_     = nullptr;                                                                      \
-    handle  th_[2] = {aVoiceHandle, 0};                                                            \
-    h_             = engine->voiceGroupHandleToArray(aVoiceHandle);                                \
-    if (h_ == nullptr)                                                                             \
-        h_ = th_;                                                                                  \
-    while (*h_)                                                                                    \
+    for (const handle h_ : engine->get3dVoiceHandles_internal(aVoiceHandle))                       \
     {                                                                                              \
-        int ch = (*h_ & 0xfff) - 1;                                                                \
-        if (ch != -1 && mEngine->m3dData[ch].mHandle == *h_)                                       \
+        const size_t s_ = handleSlot(h_);                                                          \
+        int          ch = s_ < VOICE_COUNT ? int(s_) : -1;                                         \
+        if (ch != -1 && engine->m3dData[ch].mHandle == h_)                                         \
         {
 
 #define FOR_ALL_VOICES_POST_3D_EXT                                                                 \
     }                                                                                              \
-    h_++;                                                                                          \
     }
@@ -0,0 +1,349 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_limiter.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+namespace
+{
+// Catmull-Rom weights for the points a quarter, half and three quarters between two samples.
+// Used to estimate peaks between samples without oversampling the whole block.
+constexpr float INTERSAMPLE_WEIGHTS[3][4] = {
+    {-0.0703125f, 0.8671875f, 0.2265625f, -0.0234375f},
+    {-0.0625f, 0.5625f, 0.5625f, -0.0625f},
+    {-0.0234375f, 0.2265625f, 0.8671875f, -0.0703125f},
+};
+
+// Highest absolute value on the segment between p1 and p2
+inline float truePeak(float p0, float p1, float p2, float p3)
+{
+    float peak = std::max(fabsf(p1), fabsf(p2));
+    for (const auto& w : INTERSAMPLE_WEIGHTS)
+    {
+        peak = std::max(peak, fabsf(w[0] * p0 + w[1] * p1 + w[2] * p2 + w[3] * p3));
+    }
+    return peak;
+}
+
+#ifdef SOLOUD_SSE_INTRINSICS
+inline __m128 absQuad(__m128 aValue)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), aValue);
+}
+
+inline __m128 truePeakQuad(__m128 p0, __m128 p1, __m128 p2, __m128 p3)
+{
+    __m128 peak = _mm_max_ps(absQuad(p1), absQuad(p2));
+    for (const auto& w : INTERSAMPLE_WEIGHTS)
+    {
+        __m128 v = _mm_mul_ps(p0, _mm_set1_ps(w[0]));
+        v        = _mm_add_ps(v, _mm_mul_ps(p1, _mm_set1_ps(w[1])));
+        v        = _mm_add_ps(v, _mm_mul_ps(p2, _mm_set1_ps(w[2])));
+        v        = _mm_add_ps(v, _mm_mul_ps(p3, _mm_set1_ps(w[3])));
+        peak     = _mm_max_ps(peak, absQuad(v));
+    }
+    return peak;
+}
+
+inline float horizontalMax(__m128 aValue)
+{
+    aValue = _mm_max_ps(aValue, _mm_movehl_ps(aValue, aValue));
+    aValue = _mm_max_ss(aValue, _mm_shuffle_ps(aValue, aValue, 1));
+    return _mm_cvtss_f32(aValue);
+}
+#endif
+} // namespace
+
+Limiter::Limiter(float aSamplerate, size_t aChannels, size_t aMaxSamples)
+    : mSamplerate(aSamplerate)
+    , mChannels(aChannels)
+    , mMaxSamples(aMaxSamples)
+{
+    setSettings(mSettings);
+}
+
+void Limiter::setSettings(const LimiterSettings& aSettings)
+{
+    const bool truePeakChanged = aSettings.mTruePeak != mSettings.mTruePeak;
+
+    mSettings            = aSettings;
+    mSettings.mThreshold = std::max(mSettings.mThreshold, 1.0e-6f);
+    // Zero, negative or NaN attacks get the shortest one; a second of lookahead is plenty.
+    mSettings.mAttack = std::min(std::max(0.0f, mSettings.mAttack), 1.0f);
+    mReleaseCoeff =
+        mSettings.mRelease > 0 ? expf(-1.0f / (mSettings.mRelease * mSamplerate)) : 0.0f;
+
+    // The moving average needs at least two samples to ramp at all
+    const auto attack = std::max(size_t(2), size_t(lrintf(mSettings.mAttack * mSamplerate)));
+
+    if (attack == mAttack && !truePeakChanged)
+    {
+        return;
+    }
+
+    // True peak detection looks at the segment between the two samples before the newest one, so
+    // the detector lags by two samples and each level covers two output samples.
+    mAttack = attack;
+    mHold   = mSettings.mTruePeak ? mAttack + 1 : mAttack;
+    mDelay  = mSettings.mTruePeak ? mAttack + 1 : mAttack - 1;
+
+    mLineStride = mDelay + mMaxSamples;
+    mLine.assign(mLineStride * mChannels, 0.0f);
+    mGain.assign(mMaxSamples, 0.0f);
+
+    mMinFrame.assign(mHold, 0);
+    mMinGain.assign(mHold, 1.0f);
+    mMinHead  = 0;
+    mMinCount = 0;
+    mFrame    = 0;
+
+    mRelease = 1.0f;
+
+    mAverage.assign(mAttack, 1.0f);
+    mAveragePos     = 0;
+    mAverageSum     = double(mAttack);
+    mAverageReduced = 0;
+}
+
+float Limiter::getGainReduction() const
+{
+    return mGainReduction;
+}
+
+float Limiter::detect(size_t aSamples)
+{
+    std::fill_n(mGain.data(), aSamples, 0.0f);
+
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        const float* src = mLine.data() + c * mLineStride + mDelay;
+        size_t       i   = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+        if (mSettings.mTruePeak)
+        {
+            for (; i + 4 <= aSamples; i += 4)
+            {
+                const __m128 peak = truePeakQuad(_mm_loadu_ps(src + i - 3),
+                                                 _mm_loadu_ps(src + i - 2),
+                                                 _mm_loadu_ps(src + i - 1),
+                                                 _mm_loadu_ps(src + i));
+                _mm_storeu_ps(mGain.data() + i, _mm_max_ps(_mm_loadu_ps(mGain.data() + i), peak));
+            }
+        }
+        else
+        {
+            for (; i + 4 <= aSamples; i += 4)
+            {
+                const __m128 peak = absQuad(_mm_loadu_ps(src + i));
+                _mm_storeu_ps(mGain.data() + i, _mm_max_ps(_mm_loadu_ps(mGain.data() + i), peak));
+            }
+        }
+#endif
+
+        for (; i < aSamples; ++i)
+        {
+            const float peak = mSettings.mTruePeak
+                                   ? truePeak(src[i - 3], src[i - 2], src[i - 1], src[i])
+                                   : fabsf(src[i]);
+            mGain[i] = std::max(mGain[i], peak);
+        }
+    }
+
+    size_t i    = 0;
+    float  peak = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128 quad = _mm_setzero_ps();
+    for (; i + 4 <= aSamples; i += 4)
+    {
+        quad = _mm_max_ps(quad, _mm_loadu_ps(mGain.data() + i));
+    }
+    peak = horizontalMax(quad);
+#endif
+
+    for (; i < aSamples; ++i)
+    {
+        peak = std::max(peak, mGain[i]);
+    }
+
+    return peak;
+}
+
+float Limiter::computeGains(size_t aSamples)
+{
+    const float threshold = mSettings.mThreshold;
+    const float slope     = mSettings.mRatio > 1 ? 1 - 1 / mSettings.mRatio : 0.0f;
+    float       lowest    = 1;
+
+    for (size_t i = 0; i < aSamples; ++i, ++mFrame)
+    {
+        auto target = 1.0f;
+        if (mGain[i] > threshold)
+        {
+            target = slope == 1 ? threshold / mGain[i] : powf(threshold / mGain[i], slope);
+        }
+
+        // Sliding minimum over the hold window
+        if (mMinCount > 0 && mMinFrame[mMinHead] + mHold <= mFrame)
+        {
+            mMinHead = (mMinHead + 1) % mHold;
+            --mMinCount;
+        }
+
+        if (target < 1)
+        {
+            while (mMinCount > 0 && mMinGain[(mMinHead + mMinCount - 1) % mHold] >= target)
+            {
+                --mMinCount;
+            }
+
+            const size_t tail = (mMinHead + mMinCount) % mHold;
+            mMinFrame[tail]   = mFrame;
+            mMinGain[tail]    = target;
+            ++mMinCount;
+        }
+
+        const float held = mMinCount > 0 ? mMinGain[mMinHead] : 1.0f;
+
+        // Instant attack, exponential release
+        if (held <= mRelease)
+        {
+            mRelease = held;
+        }
+        else
+        {
+            mRelease = held - (held - mRelease) * mReleaseCoeff;
+            if (mRelease > 0.999999f && held == 1)
+            {
+                mRelease = 1;
+            }
+        }
+
+        // Moving average over the attack window
+        const float old        = mAverage[mAveragePos];
+        mAverage[mAveragePos]  = mRelease;
+        mAveragePos            = (mAveragePos + 1) % mAttack;
+        mAverageSum           += double(mRelease) - double(old);
+        mAverageReduced       += (mRelease < 1 ? 1 : 0) - (old < 1 ? 1 : 0);
+
+        if (mAverageReduced == 0)
+        {
+            // Drop any accumulated rounding once the window is clean
+            mAverageSum = double(mAttack);
+            mGain[i]    = 1;
+        }
+        else
+        {
+            mGain[i] = std::min(float(mAverageSum / double(mAttack)), 1.0f);
+        }
+
+        lowest = std::min(lowest, mGain[i]);
+    }
+
+    return lowest;
+}
+
+void Limiter::process(
+    float* aBuffer, size_t aSamples, size_t aStride, float aVolume0, float aVolume1)
+{
+    assert(aSamples <= mMaxSamples);
+
+    if (aSamples == 0)
+    {
+        return;
+    }
+
+    const float vd = (aVolume1 - aVolume0) / aSamples;
+
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        const float* src  = aBuffer + c * aStride;
+        float*       line = mLine.data() + c * mLineStride + mDelay;
+
+        for (size_t i = 0; i < aSamples; ++i)
+        {
+            line[i] = src[i] * (aVolume0 + vd * i);
+        }
+    }
+
+    const float peak   = detect(aSamples);
+    auto        lowest = 1.0f;
+
+    const bool idle = mMinCount == 0 && mRelease == 1 && mAverageReduced == 0;
+    if (idle && peak <= mSettings.mThreshold)
+    {
+        // Nothing to limit in this block or the window behind it; just delay the signal
+        mFrame      += aSamples;
+        mAveragePos  = (mAveragePos + aSamples) % mAttack;
+
+        for (size_t c = 0; c < mChannels; ++c)
+        {
+            memcpy(aBuffer + c * aStride, mLine.data() + c * mLineStride, aSamples * sizeof(float));
+        }
+    }
+    else
+    {
+        lowest = computeGains(aSamples);
+
+        for (size_t c = 0; c < mChannels; ++c)
+        {
+            const float* line = mLine.data() + c * mLineStride;
+            float*       dst  = aBuffer + c * aStride;
+            size_t       i    = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+            for (; i + 4 <= aSamples; i += 4)
+            {
+                _mm_storeu_ps(dst + i,
+                              _mm_mul_ps(_mm_loadu_ps(line + i), _mm_loadu_ps(mGain.data() + i)));
+            }
+#endif
+
+            for (; i < aSamples; ++i)
+            {
+                dst[i] = line[i] * mGain[i];
+            }
+        }
+    }
+
+    for (size_t c = 0; c < mChannels; ++c)
+    {
+        float* line = mLine.data() + c * mLineStride;
+        memmove(line, line + aSamples, mDelay * sizeof(float));
+    }
+
+    mGainReduction = lowest < 1 ? -20.0f * log10f(lowest) : 0.0f;
+}
+}; // namespace SoLoud
@@ -0,0 +1,97 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include "soloud_engine.hpp"
+#include <vector>
+
+namespace SoLoud
+{
+// Lookahead peak limiter / compressor for the master bus.
+//
+// The detector feeds a sliding minimum of the target gains over the attack window, followed by
+// a release smoother and a moving average of the same length. The moving average turns the
+// gain step into a ramp that reaches the target exactly when the peak leaves the delay line,
+// so the output never exceeds the threshold (for sample peaks) without any clipping.
+class Limiter
+{
+  public:
+    Limiter(float aSamplerate, size_t aChannels, size_t aMaxSamples);
+
+    // Apply new settings. Changing the attack time or true peak mode resets the limiter state.
+    void setSettings(const LimiterSettings& aSettings);
+
+    // Apply the volume ramp and the gain reduction to the planar buffer in place. The output is
+    // delayed by the attack time.
+    void process(float* aBuffer, size_t aSamples, size_t aStride, float aVolume0, float aVolume1);
+
+    // Highest gain reduction of the last processed block, in decibels.
+    float getGainReduction() const;
+
+  private:
+    // Per-frame detector level for aSamples frames; returns the highest level.
+    float detect(size_t aSamples);
+
+    // Turn detector levels in mGain into smoothed gains; returns the lowest gain.
+    float computeGains(size_t aSamples);
+
+    LimiterSettings mSettings;
+    float           mSamplerate;
+    size_t          mChannels;
+    size_t          mMaxSamples;
+
+    // Attack window, hold window and delay line length, in samples
+    size_t mAttack = 0;
+    size_t mHold   = 0;
+    size_t mDelay  = 0;
+
+    float mReleaseCoeff  = 0.0f;
+    float mGainReduction = 0.0f;
+
+    // Per channel delay line: mDelay samples of history followed by the current block
+    std::vector<float> mLine;
+    size_t             mLineStride = 0;
+
+    // Detector levels, then gains, of the current block
+    std::vector<float> mGain;
+
+    // Sliding minimum of target gains; only gains below 1 are queued
+    std::vector<size_t> mMinFrame;
+    std::vector<float>  mMinGain;
+    size_t              mMinHead  = 0;
+    size_t              mMinCount = 0;
+    size_t              mFrame    = 0;
+
+    // Release smoother state
+    float mRelease = 1.0f;
+
+    // Moving average over the attack window
+    std::vector<float> mAverage;
+    size_t             mAveragePos     = 0;
+    double             mAverageSum     = 0;
+    size_t             mAverageReduced = 0;
+};
+}; // namespace SoLoud
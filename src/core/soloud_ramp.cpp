@@ -0,0 +1,157 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_ramp.hpp"
+#include "soloud.hpp"
+#include <algorithm>
+#include <cstring>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+#ifdef SOLOUD_SSE_INTRINSICS
+namespace
+{
+// Gains of the first four samples of a ramp
+inline __m128 firstQuad(float aGain0, float aStep)
+{
+    return _mm_add_ps(_mm_set1_ps(aGain0), _mm_mul_ps(_mm_set1_ps(aStep), _mm_setr_ps(1, 2, 3, 4)));
+}
+} // namespace
+#endif
+
+void scaleRamp(float* aBuffer, size_t aSamples, float aGain0, float aGain1)
+{
+    const float step = (aGain1 - aGain0) / float(aSamples);
+    size_t      i    = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128       gain  = firstQuad(aGain0, step);
+    const __m128 step4 = _mm_set1_ps(4 * step);
+    for (; i + 4 <= aSamples; i += 4)
+    {
+        _mm_storeu_ps(aBuffer + i, _mm_mul_ps(_mm_loadu_ps(aBuffer + i), gain));
+        gain = _mm_add_ps(gain, step4);
+    }
+#endif
+
+    for (; i < aSamples; ++i)
+    {
+        aBuffer[i] *= aGain0 + step * float(i + 1);
+    }
+}
+
+void mixRamp(const float* aInput, float* aOutput, size_t aSamples, float aGain0, float aGain1)
+{
+    const float step = (aGain1 - aGain0) / float(aSamples);
+    size_t      i    = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128       gain  = firstQuad(aGain0, step);
+    const __m128 step4 = _mm_set1_ps(4 * step);
+    for (; i + 4 <= aSamples; i += 4)
+    {
+        _mm_storeu_ps(aOutput + i,
+                      _mm_add_ps(_mm_loadu_ps(aOutput + i),
+                                 _mm_mul_ps(_mm_loadu_ps(aInput + i), gain)));
+        gain = _mm_add_ps(gain, step4);
+    }
+#endif
+
+    for (; i < aSamples; ++i)
+    {
+        aOutput[i] += aInput[i] * (aGain0 + step * float(i + 1));
+    }
+}
+
+void crossfadeRamp(const float* aDry, float* aBuffer, size_t aSamples, float aGain0, float aGain1)
+{
+    const float step = (aGain1 - aGain0) / float(aSamples);
+    size_t      i    = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128       gain  = firstQuad(aGain0, step);
+    const __m128 step4 = _mm_set1_ps(4 * step);
+    for (; i + 4 <= aSamples; i += 4)
+    {
+        const __m128 dry = _mm_loadu_ps(aDry + i);
+        const __m128 wet = _mm_loadu_ps(aBuffer + i);
+        _mm_storeu_ps(aBuffer + i, _mm_add_ps(dry, _mm_mul_ps(_mm_sub_ps(wet, dry), gain)));
+        gain = _mm_add_ps(gain, step4);
+    }
+#endif
+
+    for (; i < aSamples; ++i)
+    {
+        aBuffer[i] = aDry[i] + (aBuffer[i] - aDry[i]) * (aGain0 + step * float(i + 1));
+    }
+}
+
+void applyGainRamp(
+    float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels, float aGain0, float aGain1)
+{
+    if (aSamples == 0)
+    {
+        return;
+    }
+
+    for (size_t c = 0; c < aChannels; ++c)
+    {
+        scaleRamp(aBuffer + c * aStride, aSamples, aGain0, aGain1);
+    }
+}
+
+void DryMix::save(
+    const float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels, float aWet)
+{
+    mWet0 = mWet1;
+    mWet1 = aWet;
+
+    if (mWet0 < 1.0f || mWet1 < 1.0f)
+    {
+        mDry.resize(std::max(mDry.size(), aSamples * aChannels));
+        for (size_t c = 0; c < aChannels; ++c)
+        {
+            memcpy(mDry.data() + c * aSamples, aBuffer + c * aStride, aSamples * sizeof(float));
+        }
+    }
+}
+
+void DryMix::mix(float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels) const
+{
+    if (aSamples == 0 || (mWet0 >= 1.0f && mWet1 >= 1.0f))
+    {
+        return;
+    }
+
+    for (size_t c = 0; c < aChannels; ++c)
+    {
+        crossfadeRamp(mDry.data() + c * aSamples, aBuffer + c * aStride, aSamples, mWet0, mWet1);
+    }
+}
+} // namespace SoLoud
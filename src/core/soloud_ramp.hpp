@@ -0,0 +1,65 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace SoLoud
+{
+// Gain ramps over a block. The gain moves linearly from aGain0 to aGain1, reaching aGain1 on the
+// last sample, so that consecutive blocks ramping from where the last one ended join up.
+
+// Scale aSamples samples by the ramp.
+void scaleRamp(float* aBuffer, size_t aSamples, float aGain0, float aGain1);
+
+// Add aInput scaled by the ramp to aOutput.
+void mixRamp(const float* aInput, float* aOutput, size_t aSamples, float aGain0, float aGain1);
+
+// Crossfade from aDry to aBuffer in place, with the ramp as the level of aBuffer.
+void crossfadeRamp(const float* aDry, float* aBuffer, size_t aSamples, float aGain0, float aGain1);
+
+// Scale all channels of a planar block by the ramp.
+void applyGainRamp(
+    float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels, float aGain0, float aGain1);
+
+// Dry input of a block processed in place, crossfaded back in at a wet level that ramps from
+// block to block. Nothing is copied while the level stays at 1.
+class DryMix
+{
+  public:
+    // Keep the input of a block to be mixed at aWet.
+    void save(const float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels, float aWet);
+
+    // Mix the kept input back into the processed block.
+    void mix(float* aBuffer, size_t aSamples, size_t aStride, size_t aChannels) const;
+
+  private:
+    std::vector<float> mDry;
+    float              mWet0 = 1.0f;
+    float              mWet1 = 1.0f;
+};
+} // namespace SoLoud
@@ -0,0 +1,102 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_sidechain.hpp"
+#include <algorithm>
+#include <cmath>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+SidechainLevel measureLevel(const float* aBuffer,
+                            size_t       aSamples,
+                            size_t       aStride,
+                            size_t       aChannels)
+{
+    if (aSamples == 0 || aChannels == 0)
+    {
+        return {};
+    }
+
+    float peak = 0.0f;
+    float sum  = 0.0f;
+
+    for (size_t c = 0; c < aChannels; ++c)
+    {
+        const float* x = aBuffer + c * aStride;
+        size_t       i = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+        const __m128 sign  = _mm_set1_ps(-0.0f);
+        __m128       peak4 = _mm_setzero_ps();
+        __m128       sum4  = _mm_setzero_ps();
+        for (; i + 4 <= aSamples; i += 4)
+        {
+            const __m128 v = _mm_loadu_ps(x + i);
+            peak4          = _mm_max_ps(peak4, _mm_andnot_ps(sign, v));
+            sum4           = _mm_add_ps(sum4, _mm_mul_ps(v, v));
+        }
+
+        alignas(16) float p[4];
+        alignas(16) float s[4];
+        _mm_store_ps(p, peak4);
+        _mm_store_ps(s, sum4);
+        peak = std::max({peak, p[0], p[1], p[2], p[3]});
+        sum += (s[0] + s[1]) + (s[2] + s[3]);
+#endif
+
+        for (; i < aSamples; ++i)
+        {
+            peak = std::max(peak, fabsf(x[i]));
+            sum += x[i] * x[i];
+        }
+    }
+
+    return {
+        .mPeak = peak,
+        .mRms  = sqrtf(sum / float(aSamples * aChannels)),
+    };
+}
+
+std::optional<SidechainLevel> getSidechainLevel(const Engine& aEngine, handle aBus)
+{
+    const int voice = aEngine.getVoiceFromHandle_internal(aBus);
+    if (voice == -1)
+    {
+        return {};
+    }
+
+    const auto* bus = dynamic_cast<const BusInstance*>(aEngine.mVoice[voice].get());
+    if (bus == nullptr)
+    {
+        return {};
+    }
+
+    return bus->getSidechainLevel_internal();
+}
+}; // namespace SoLoud
@@ -0,0 +1,87 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_snapshot.hpp"
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+
+namespace SoLoud
+{
+static_assert(std::is_trivially_copyable_v<VoiceInfo>);
+
+void VoiceSnapshots::publish(size_t aVoice, const VoiceInfo& aInfo)
+{
+    assert(aVoice < VOICE_COUNT);
+
+    auto words = std::array<uint64_t, WORDS>{};
+    memcpy(words.data(), &aInfo, sizeof(VoiceInfo));
+
+    auto&          slot     = mSlot[aVoice];
+    const uint32_t sequence = slot.mSequence.load(std::memory_order_relaxed);
+
+    slot.mSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < WORDS; ++i)
+    {
+        slot.mWords[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    slot.mSequence.store(sequence + 2, std::memory_order_release);
+}
+
+VoiceInfo VoiceSnapshots::read(size_t aVoice) const
+{
+    assert(aVoice < VOICE_COUNT);
+
+    const auto& slot  = mSlot[aVoice];
+    auto        words = std::array<uint64_t, WORDS>{};
+
+    while (true)
+    {
+        const uint32_t before = slot.mSequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            words[i] = slot.mWords[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.mSequence.load(std::memory_order_relaxed) == before)
+        {
+            break;
+        }
+    }
+
+    auto info = VoiceInfo{};
+    memcpy(static_cast<void*>(&info), words.data(), sizeof(VoiceInfo));
+    return info;
+}
+}; // namespace SoLoud
@@ -0,0 +1,58 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include "soloud_engine.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace SoLoud
+{
+// Voice state published for getters on other threads. Each voice has a seqlock: the writer (who
+// holds the audio mutex) makes the sequence odd while it writes, and readers retry until they
+// saw the same even sequence before and after copying. Readers never block the writer.
+class VoiceSnapshots
+{
+  public:
+    // Publish the state of a voice; aInfo.mHandle is 0 for a free voice
+    void publish(size_t aVoice, const VoiceInfo& aInfo);
+
+    // Read the state of a voice
+    VoiceInfo read(size_t aVoice) const;
+
+  private:
+    static constexpr size_t WORDS = (sizeof(VoiceInfo) + 7) / 8;
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint32_t>                    mSequence{0};
+        std::array<std::atomic<uint64_t>, WORDS> mWords{};
+    };
+
+    std::array<Slot, VOICE_COUNT> mSlot;
+};
+}; // namespace SoLoud
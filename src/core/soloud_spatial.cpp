@@ -0,0 +1,625 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_spatial.hpp"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+namespace
+{
+#ifdef SOLOUD_SSE_INTRINSICS
+// Four lanes, so that the update below runs for four voices at once
+struct Quad
+{
+    __m128 mValue;
+
+    Quad(__m128 aValue)
+        : mValue(aValue)
+    {
+    }
+
+    Quad(float aValue)
+        : mValue(_mm_set1_ps(aValue))
+    {
+    }
+};
+
+inline Quad operator+(Quad a, Quad b)
+{
+    return _mm_add_ps(a.mValue, b.mValue);
+}
+
+inline Quad operator-(Quad a, Quad b)
+{
+    return _mm_sub_ps(a.mValue, b.mValue);
+}
+
+inline Quad operator*(Quad a, Quad b)
+{
+    return _mm_mul_ps(a.mValue, b.mValue);
+}
+
+inline Quad operator/(Quad a, Quad b)
+{
+    return _mm_div_ps(a.mValue, b.mValue);
+}
+
+inline Quad min(Quad a, Quad b)
+{
+    return _mm_min_ps(a.mValue, b.mValue);
+}
+
+inline Quad max(Quad a, Quad b)
+{
+    return _mm_max_ps(a.mValue, b.mValue);
+}
+
+inline Quad sqrt(Quad a)
+{
+    return _mm_sqrt_ps(a.mValue);
+}
+
+// All bits set in the lanes where a == b
+inline Quad equal(Quad a, Quad b)
+{
+    return _mm_cmpeq_ps(a.mValue, b.mValue);
+}
+
+inline Quad greater(Quad a, Quad b)
+{
+    return _mm_cmpgt_ps(a.mValue, b.mValue);
+}
+
+inline Quad select(Quad aMask, Quad a, Quad b)
+{
+    return _mm_or_ps(_mm_and_ps(aMask.mValue, a.mValue), _mm_andnot_ps(aMask.mValue, b.mValue));
+}
+
+template <typename T>
+T load(const float* aSource);
+
+template <>
+Quad load<Quad>(const float* aSource)
+{
+    return _mm_loadu_ps(aSource);
+}
+
+inline void store(float* aDest, Quad a)
+{
+    _mm_storeu_ps(aDest, a.mValue);
+}
+#else
+template <typename T>
+T load(const float* aSource);
+#endif
+
+template <>
+float load<float>(const float* aSource)
+{
+    return *aSource;
+}
+
+inline void store(float* aDest, float a)
+{
+    *aDest = a;
+}
+
+inline float min(float a, float b)
+{
+    return std::min(a, b);
+}
+
+inline float max(float a, float b)
+{
+    return std::max(a, b);
+}
+
+inline float sqrt(float a)
+{
+    return std::sqrt(a);
+}
+
+inline bool equal(float a, float b)
+{
+    return a == b;
+}
+
+inline bool greater(float a, float b)
+{
+    return a > b;
+}
+
+inline float select(bool aMask, float a, float b)
+{
+    return aMask ? a : b;
+}
+
+constexpr float SQRT2 = 1.41421356f;
+constexpr float LN2   = 0.69314718f;
+
+// log2 of a mantissa in [sqrt(1/2), sqrt(2)), from the series of atanh((m - 1) / (m + 1))
+template <typename T>
+T log2Mantissa(T m)
+{
+    const T s  = (m - T(1.0f)) / (m + T(1.0f));
+    const T s2 = s * s;
+    const T p  = T(1.0f) + s2 * (T(1.0f / 3) + s2 * (T(1.0f / 5) + s2 * T(1.0f / 7)));
+    return T(2.0f / LN2) * s * p;
+}
+
+// 2^f for f in [-1/2, 1/2], from the series of exp(f ln 2)
+template <typename T>
+T exp2Fraction(T f)
+{
+    const T t = f * T(LN2);
+    return T(1.0f) +
+           t * (T(1.0f) +
+                t * (T(1.0f / 2) +
+                     t * (T(1.0f / 6) +
+                          t * (T(1.0f / 24) + t * (T(1.0f / 120) + t * T(1.0f / 720))))));
+}
+
+// log2 of positive normal numbers, to about 1e-7
+float approxLog2(float x)
+{
+    const auto bits     = std::bit_cast<uint32_t>(x);
+    float      exponent = float(int(bits >> 23) - 127);
+    float      m        = std::bit_cast<float>((bits & 0x007fffff) | 0x3f800000);
+    if (m > SQRT2)
+    {
+        m *= 0.5f;
+        exponent += 1.0f;
+    }
+    return exponent + log2Mantissa(m);
+}
+
+// 2^x, to a relative error of about 1e-7
+float approxExp2(float x)
+{
+    x             = std::clamp(x, -126.0f, 126.0f);
+    const float n = std::nearbyint(x);
+    return exp2Fraction(x - n) * std::bit_cast<float>(uint32_t(int(n) + 127) << 23);
+}
+
+#ifdef SOLOUD_SSE_INTRINSICS
+Quad approxLog2(Quad x)
+{
+    const __m128i bits     = _mm_castps_si128(x.mValue);
+    const __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+    const __m128i mantissa = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                                          _mm_set1_epi32(0x3f800000));
+
+    const Quad m     = _mm_castsi128_ps(mantissa);
+    const Quad large = greater(m, SQRT2);
+    return Quad(_mm_cvtepi32_ps(exponent)) + select(large, 1.0f, 0.0f) +
+           log2Mantissa(select(large, m * 0.5f, m));
+}
+
+Quad approxExp2(Quad x)
+{
+    x                = min(max(x, -126.0f), 126.0f);
+    const __m128i n  = _mm_cvtps_epi32(x.mValue);
+    const Quad    p2 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+    return exp2Fraction(x - Quad(_mm_cvtepi32_ps(n))) * p2;
+}
+#endif
+
+template <typename T, AttenuationModel Model>
+void updateVoices(SpatialBatch& b, const SpatialListener& aListener, size_t i)
+{
+    const T px = load<T>(&b.mPositionX[i]);
+    const T py = load<T>(&b.mPositionY[i]);
+    const T pz = load<T>(&b.mPositionZ[i]);
+
+    const T vx = load<T>(&b.mVelocityX[i]);
+    const T vy = load<T>(&b.mVelocityY[i]);
+    const T vz = load<T>(&b.mVelocityZ[i]);
+
+    const T    distance = sqrt(px * px + py * py + pz * pz);
+    const auto atSource = equal(distance, 0.0f);
+    const T    inverse  = T(1.0f) / distance;
+    store(&b.mDistance[i], distance);
+
+    // Travel time of the sound heard now, which left the source at p - v t: |p - v t| = c t
+    // solves to t = d^2 / (sqrt(b^2 + a d^2) + b), with b = p.v and a = c^2 - v^2. The source
+    // speed is capped just below the speed of sound, where the time would grow without bound.
+    {
+        const float speed2 = aListener.mSoundSpeed * aListener.mSoundSpeed;
+
+        const T distance2 = distance * distance;
+        const T along     = px * vx + py * vy + pz * vz;
+        const T a         = max(T(speed2) - (vx * vx + vy * vy + vz * vz), T(0.01f * speed2));
+        const T delay     = distance2 / (sqrt(along * along + a * distance2) + along);
+        store(&b.mDelay[i], select(atSource, 0.0f, delay));
+    }
+
+    // Attenuation
+    T volume = load<T>(&b.mVolume[i]);
+    if constexpr (Model != AttenuationModel::NoAttenuation)
+    {
+        const T minDistance = load<T>(&b.mMinDistance[i]);
+        const T maxDistance = load<T>(&b.mMaxDistance[i]);
+        const T rolloff     = load<T>(&b.mRolloff[i]);
+        const T d           = min(max(distance, minDistance), maxDistance);
+
+        if constexpr (Model == AttenuationModel::InverseDistance)
+        {
+            volume = volume * (minDistance / (minDistance + rolloff * (d - minDistance)));
+        }
+        else if constexpr (Model == AttenuationModel::LinearDistance)
+        {
+            volume =
+                volume * (T(1.0f) - rolloff * (d - minDistance) / (maxDistance - minDistance));
+        }
+        else
+        {
+            // (d / min) ^ -rolloff
+            volume = volume * approxExp2(T(0.0f) - rolloff * approxLog2(d / minDistance));
+        }
+    }
+    store(&b.mVolume[i], volume);
+
+    // Doppler, with the speeds along the line of sight capped at the speed of sound
+    {
+        const auto& lv = aListener.mVelocity;
+
+        const T factor = load<T>(&b.mDopplerFactor[i]);
+        const T speed  = aListener.mSoundSpeed;
+
+        const T sourceSpeed   = (px * vx + py * vy + pz * vz) * inverse;
+        const T listenerSpeed = (px * T(lv.mX) + py * T(lv.mY) + pz * T(lv.mZ)) * inverse;
+
+        const T doppler = (speed - min(factor * listenerSpeed, speed)) /
+                          (speed - min(factor * sourceSpeed, speed));
+        store(&b.mDoppler[i], select(atSource, 1.0f, doppler));
+    }
+
+    // Directions
+    const T wx = select(atSource, 0.0f, px * inverse);
+    const T wy = select(atSource, 0.0f, py * inverse);
+    const T wz = select(atSource, 0.0f, pz * inverse);
+    store(&b.mWorldDirectionX[i], wx);
+    store(&b.mWorldDirectionY[i], wy);
+    store(&b.mWorldDirectionZ[i], wz);
+
+    const auto& a  = aListener.mAxes;
+    const T     lx = T(a[0].mX) * px + T(a[0].mY) * py + T(a[0].mZ) * pz;
+    const T     ly = T(a[1].mX) * px + T(a[1].mY) * py + T(a[1].mZ) * pz;
+    const T     lz = T(a[2].mX) * px + T(a[2].mY) * py + T(a[2].mZ) * pz;
+
+    const T    length = sqrt(lx * lx + ly * ly + lz * lz);
+    const auto none   = equal(length, 0.0f);
+    const T    scale  = T(1.0f) / length;
+    const T    dx     = select(none, 0.0f, lx * scale);
+    const T    dy     = select(none, 0.0f, ly * scale);
+    const T    dz     = select(none, 0.0f, lz * scale);
+    store(&b.mDirectionX[i], dx);
+    store(&b.mDirectionY[i], dy);
+    store(&b.mDirectionZ[i], dz);
+
+    // Panning
+    for (size_t j = 0; j < aListener.mChannels; ++j)
+    {
+        const auto& s = aListener.mSpeakers[j];
+        if (s.isNull())
+        {
+            store(&b.mPan[j][i], T(1.0f));
+        }
+        else
+        {
+            const T dot = T(s.mX) * dx + T(s.mY) * dy + T(s.mZ) * dz;
+            store(&b.mPan[j][i], (dot + T(1.0f)) * T(0.5f));
+        }
+    }
+}
+
+template <AttenuationModel Model>
+void updateGroup(SpatialBatch& b, const SpatialListener& aListener)
+{
+    const size_t end = b.mGroup[size_t(Model) + 1];
+    size_t       i   = b.mGroup[size_t(Model)];
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    for (; i + 4 <= end; i += 4)
+    {
+        updateVoices<Quad, Model>(b, aListener, i);
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        updateVoices<float, Model>(b, aListener, i);
+    }
+}
+} // namespace
+
+void SpatialBatch::gather(std::span<const size_t>          aVoices,
+                          const AudioSourceInstance3dData* aData,
+                          const SpatialListener&           aListener)
+{
+    assert(aVoices.size() <= CAPACITY);
+
+    const auto model = [&](size_t aVoice) {
+        const auto& v = aData[aVoice];
+        return v.mAttenuator != nullptr ? size_t(0) : size_t(v.m3dAttenuationModel);
+    };
+
+    auto next = std::array<size_t, 4>{};
+    for (const size_t voice : aVoices)
+    {
+        ++next[model(voice)];
+    }
+
+    mGroup[0] = 0;
+    for (size_t k = 0; k < 4; ++k)
+    {
+        mGroup[k + 1] = mGroup[k] + next[k];
+        next[k]       = mGroup[k];
+    }
+    mCount = aVoices.size();
+
+    for (const size_t voice : aVoices)
+    {
+        const auto&  v = aData[voice];
+        const size_t i = next[model(voice)]++;
+
+        auto pos = v.m3dPosition;
+        if (!v.mFlags.ListenerRelative)
+        {
+            pos = pos - aListener.mPosition;
+        }
+
+        mVoice[i]         = voice;
+        mPositionX[i]     = pos.mX;
+        mPositionY[i]     = pos.mY;
+        mPositionZ[i]     = pos.mZ;
+        mVelocityX[i]     = v.m3dVelocity.mX;
+        mVelocityY[i]     = v.m3dVelocity.mY;
+        mVelocityZ[i]     = v.m3dVelocity.mZ;
+        mMinDistance[i]   = v.m3dMinDistance;
+        mMaxDistance[i]   = v.m3dMaxDistance;
+        mRolloff[i]       = v.m3dAttenuationRolloff;
+        mDopplerFactor[i] = v.m3dDopplerFactor;
+        mVolume[i]        = 1.0f;
+    }
+}
+
+void SpatialBatch::update(const SpatialListener& aListener)
+{
+    updateGroup<AttenuationModel::NoAttenuation>(*this, aListener);
+    updateGroup<AttenuationModel::InverseDistance>(*this, aListener);
+    updateGroup<AttenuationModel::LinearDistance>(*this, aListener);
+    updateGroup<AttenuationModel::ExponentialDistance>(*this, aListener);
+}
+
+SpatialListenerMix::SpatialListenerMix(size_t aScratchSize)
+    : mOutput(aScratchSize * MAX_CHANNELS)
+{
+}
+
+namespace
+{
+// Cell coordinates are clamped to 21 bits each, so that a key holds all three
+constexpr int64_t CELL_RANGE = int64_t(1) << 20;
+
+int64_t cellCoordinate(float aValue, float aCellSize)
+{
+    const float cell = std::floor(aValue / aCellSize);
+    return int64_t(std::clamp(cell, -float(CELL_RANGE), float(CELL_RANGE - 1)));
+}
+
+uint64_t cellKey(int64_t aX, int64_t aY, int64_t aZ)
+{
+    return (uint64_t(aX + CELL_RANGE) << 42) | (uint64_t(aY + CELL_RANGE) << 21) |
+           uint64_t(aZ + CELL_RANGE);
+}
+} // namespace
+
+SpatialGrid::SpatialGrid(float aCellSize)
+    : mCellSize(aCellSize)
+{
+    assert(aCellSize > 0.0f);
+}
+
+void SpatialGrid::setCellSize(float aCellSize)
+{
+    assert(aCellSize > 0.0f);
+
+    const auto lock = std::lock_guard{mMutex};
+    if (aCellSize == mCellSize)
+    {
+        return;
+    }
+
+    mCellSize = aCellSize;
+    mCells.clear();
+    for (size_t i = 0; i < VOICE_COUNT; ++i)
+    {
+        if (mWhere[i] == Where::Cell)
+        {
+            link(i);
+        }
+    }
+}
+
+void SpatialGrid::insert(size_t aVoice, const vec3& aPosition, bool aListenerRelative)
+{
+    assert(aVoice < VOICE_COUNT);
+
+    const auto lock = std::lock_guard{mMutex};
+    unlink(aVoice);
+    mPosition[aVoice] = aPosition;
+
+    if (aListenerRelative)
+    {
+        mWhere[aVoice] = Where::Relative;
+        mIndex[aVoice] = mRelative.size();
+        mRelative.push_back(aVoice);
+    }
+    else
+    {
+        link(aVoice);
+    }
+}
+
+void SpatialGrid::move(size_t aVoice, const vec3& aPosition)
+{
+    assert(aVoice < VOICE_COUNT);
+
+    const auto lock = std::lock_guard{mMutex};
+    relocate(aVoice, aPosition);
+}
+
+void SpatialGrid::move(std::span<const size_t> aVoices, std::span<const vec3> aPositions)
+{
+    assert(aVoices.size() == aPositions.size());
+
+    const auto lock = std::lock_guard{mMutex};
+    for (size_t i = 0; i < aVoices.size(); ++i)
+    {
+        assert(aVoices[i] < VOICE_COUNT);
+        relocate(aVoices[i], aPositions[i]);
+    }
+}
+
+void SpatialGrid::remove(size_t aVoice)
+{
+    assert(aVoice < VOICE_COUNT);
+
+    const auto lock = std::lock_guard{mMutex};
+    unlink(aVoice);
+}
+
+void SpatialGrid::query(const vec3& aListener, float aRadius, std::vector<size_t>& aVoices)
+{
+    const auto lock = std::lock_guard{mMutex};
+
+    const float radius2 = aRadius * aRadius;
+
+    for (const size_t voice : mRelative)
+    {
+        if (mPosition[voice].dot(mPosition[voice]) <= radius2)
+        {
+            aVoices.push_back(voice);
+        }
+    }
+
+    const auto lo = [&](float aValue) { return cellCoordinate(aValue - aRadius, mCellSize); };
+    const auto hi = [&](float aValue) { return cellCoordinate(aValue + aRadius, mCellSize); };
+
+    const int64_t x1 = hi(aListener.mX);
+    const int64_t y1 = hi(aListener.mY);
+    const int64_t z1 = hi(aListener.mZ);
+
+    for (int64_t x = lo(aListener.mX); x <= x1; ++x)
+    {
+        for (int64_t y = lo(aListener.mY); y <= y1; ++y)
+        {
+            for (int64_t z = lo(aListener.mZ); z <= z1; ++z)
+            {
+                const auto cell = mCells.find(cellKey(x, y, z));
+                if (cell == mCells.end())
+                {
+                    continue;
+                }
+
+                for (const size_t voice : cell->second)
+                {
+                    const vec3 d = mPosition[voice] - aListener;
+                    if (d.dot(d) <= radius2)
+                    {
+                        aVoices.push_back(voice);
+                    }
+                }
+            }
+        }
+    }
+}
+
+SpatialGrid::Key SpatialGrid::keyOf(const vec3& aPosition) const
+{
+    return cellKey(cellCoordinate(aPosition.mX, mCellSize),
+                   cellCoordinate(aPosition.mY, mCellSize),
+                   cellCoordinate(aPosition.mZ, mCellSize));
+}
+
+void SpatialGrid::unlink(size_t aVoice)
+{
+    if (mWhere[aVoice] == Where::Nowhere)
+    {
+        return;
+    }
+
+    // Swap with the last voice of the list, and drop that
+    auto& list = mWhere[aVoice] == Where::Cell ? mCells[mKey[aVoice]] : mRelative;
+
+    const size_t last    = list.back();
+    list[mIndex[aVoice]] = last;
+    mIndex[last]         = mIndex[aVoice];
+    list.pop_back();
+
+    if (list.empty() && mWhere[aVoice] == Where::Cell)
+    {
+        mCells.erase(mKey[aVoice]);
+    }
+
+    mWhere[aVoice] = Where::Nowhere;
+}
+
+void SpatialGrid::relocate(size_t aVoice, const vec3& aPosition)
+{
+    if (mWhere[aVoice] == Where::Nowhere)
+    {
+        return;
+    }
+
+    mPosition[aVoice] = aPosition;
+    if (mWhere[aVoice] == Where::Cell && keyOf(aPosition) != mKey[aVoice])
+    {
+        unlink(aVoice);
+        link(aVoice);
+    }
+}
+
+void SpatialGrid::link(size_t aVoice)
+{
+    mKey[aVoice] = keyOf(mPosition[aVoice]);
+
+    auto& cell     = mCells[mKey[aVoice]];
+    mWhere[aVoice] = Where::Cell;
+    mIndex[aVoice] = cell.size();
+    cell.push_back(aVoice);
+}
+}; // namespace SoLoud
@@ -0,0 +1,181 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include "soloud_audiosource.hpp"
+#include "soloud_misc.hpp"
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace SoLoud
+{
+// Listener state the 3d update of a batch depends on
+struct SpatialListener
+{
+    vec3 mPosition;
+    vec3 mVelocity;
+
+    // Left, up and forward axes of the listener in world space
+    std::array<vec3, 3> mAxes;
+
+    // Unit speaker directions; a null speaker hears every direction
+    std::array<vec3, MAX_CHANNELS> mSpeakers;
+    size_t                         mChannels = 0;
+
+    float mSoundSpeed = 343.3f;
+};
+
+// Listener mixed besides listener 0, see Engine::setListenerCount
+struct SpatialListenerMix
+{
+    explicit SpatialListenerMix(size_t aScratchSize);
+
+    vec3 mPosition;
+    vec3 mAt{0, 0, -1};
+    vec3 mUp{0, 1, 0};
+    vec3 mVelocity;
+
+    // 3d volume and channel volumes of each voice for this listener, as the 3d update computes
+    // them outside the audio mutex
+    std::array<float, VOICE_COUNT>                           mTarget3dVolume{};
+    std::array<std::array<float, MAX_CHANNELS>, VOICE_COUNT> mTargetChannelVolume{};
+
+    // The same as the mixer uses them, copied over by Engine::apply3dVoice_internal
+    std::array<float, VOICE_COUNT>                           m3dVolume{};
+    std::array<std::array<float, MAX_CHANNELS>, VOICE_COUNT> mChannelVolume{};
+
+    // Channel volumes each voice was mixed with in the last block, and whether they are set
+    std::array<std::array<float, MAX_CHANNELS>, VOICE_COUNT> mCurrentVolume{};
+    std::array<bool, VOICE_COUNT>                            mSynced{};
+
+    // Mix of the block, channel after channel
+    AlignedFloatBuffer mOutput;
+};
+
+// 3d state of up to CAPACITY voices as a structure of arrays, so that four voices are updated at
+// a time. Voices are grouped by attenuation model, so that each group runs without branches.
+struct SpatialBatch
+{
+    static constexpr size_t CAPACITY = 64;
+
+    // Gather voices from aData, indexed by voice. Voices with a custom attenuator go with the
+    // unattenuated ones; the attenuator is up to the caller, with mDistance.
+    void gather(std::span<const size_t>          aVoices,
+                const AudioSourceInstance3dData* aData,
+                const SpatialListener&           aListener);
+
+    // Update all voices gathered
+    void update(const SpatialListener& aListener);
+
+    size_t mCount = 0;
+
+    // Voice of each entry, and the first entry of each attenuation model
+    std::array<size_t, CAPACITY> mVoice;
+    std::array<size_t, 5>        mGroup;
+
+    // Position relative to the listener and velocity, in world space
+    std::array<float, CAPACITY> mPositionX, mPositionY, mPositionZ;
+    std::array<float, CAPACITY> mVelocityX, mVelocityY, mVelocityZ;
+
+    std::array<float, CAPACITY> mMinDistance;
+    std::array<float, CAPACITY> mMaxDistance;
+    std::array<float, CAPACITY> mRolloff;
+    std::array<float, CAPACITY> mDopplerFactor;
+
+    // Collider volume going in, attenuated volume coming out
+    std::array<float, CAPACITY> mVolume;
+
+    std::array<float, CAPACITY> mDistance;
+    std::array<float, CAPACITY> mDoppler;
+
+    // Travel time of the sound to the listener, in seconds
+    std::array<float, CAPACITY> mDelay;
+
+    // Unit direction relative to the listener, in world space and in listener space
+    std::array<float, CAPACITY> mWorldDirectionX, mWorldDirectionY, mWorldDirectionZ;
+    std::array<float, CAPACITY> mDirectionX, mDirectionY, mDirectionZ;
+
+    // Panning gain of each speaker, without the volume
+    std::array<std::array<float, CAPACITY>, MAX_CHANNELS> mPan;
+};
+
+// Uniform grid over the positions of 3d voices, so that culling only visits the voices near the
+// listener. Positions are set from the game thread while the 3d update queries, so the grid has a
+// lock of its own. Stopped voices are not removed by the engine; the 3d update removes the
+// voices a query finds stale.
+class SpatialGrid
+{
+  public:
+    explicit SpatialGrid(float aCellSize);
+
+    // Change the cell size, moving all voices to their new cells
+    void setCellSize(float aCellSize);
+
+    // Add a voice, or replace it. Listener relative voices are kept outside of the grid, and
+    // every query checks them against their distance from the listener.
+    void insert(size_t aVoice, const vec3& aPosition, bool aListenerRelative);
+
+    // Move a voice in the grid; voices not in it are ignored
+    void move(size_t aVoice, const vec3& aPosition);
+    void move(std::span<const size_t> aVoices, std::span<const vec3> aPositions);
+
+    void remove(size_t aVoice);
+
+    // Append the voices within aRadius of aListener to aVoices
+    void query(const vec3& aListener, float aRadius, std::vector<size_t>& aVoices);
+
+  private:
+    using Key = uint64_t;
+
+    Key  keyOf(const vec3& aPosition) const;
+    void relocate(size_t aVoice, const vec3& aPosition);
+    void unlink(size_t aVoice);
+    void link(size_t aVoice);
+
+    std::mutex mMutex;
+    float      mCellSize;
+
+    std::unordered_map<Key, std::vector<size_t>> mCells;
+    std::vector<size_t>                          mRelative;
+
+    enum class Where : uint8_t
+    {
+        Nowhere,
+        Cell,
+        Relative,
+    };
+
+    // Per voice: where it is, its position, its cell and its index in the cell or relative list
+    std::array<Where, VOICE_COUNT>  mWhere{};
+    std::array<vec3, VOICE_COUNT>   mPosition{};
+    std::array<Key, VOICE_COUNT>    mKey{};
+    std::array<size_t, VOICE_COUNT> mIndex{};
+};
+}; // namespace SoLoud
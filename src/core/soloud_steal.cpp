@@ -0,0 +1,166 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_steal.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace SoLoud
+{
+void StealCandidates::insert(size_t aVoice, size_t aCategory, int aPriority, size_t aPlayIndex)
+{
+    assert(aVoice < VOICE_COUNT && !mEntry[aVoice].mLinked);
+
+    mEntry[aVoice] = {aPriority, aPlayIndex, aCategory, true};
+    link(mAll, mAllLink, aVoice);
+
+    const size_t index = categoryIndex(aCategory);
+    if (index == mCategoryCount || mCategory[index].mCategory != aCategory)
+    {
+        std::move_backward(mCategory.begin() + index,
+                           mCategory.begin() + mCategoryCount,
+                           mCategory.begin() + mCategoryCount + 1);
+        mCategory[index] = {aCategory, {}};
+        ++mCategoryCount;
+    }
+    link(mCategory[index].mList, mCategoryLink, aVoice);
+}
+
+void StealCandidates::erase(size_t aVoice)
+{
+    if (!mEntry[aVoice].mLinked)
+    {
+        return;
+    }
+
+    mEntry[aVoice].mLinked = false;
+    unlink(mAll, mAllLink, aVoice);
+
+    const size_t index = categoryIndex(mEntry[aVoice].mCategory);
+    auto&        list  = mCategory[index].mList;
+    unlink(list, mCategoryLink, aVoice);
+
+    if (list.mHead == NONE)
+    {
+        std::move(mCategory.begin() + index + 1,
+                  mCategory.begin() + mCategoryCount,
+                  mCategory.begin() + index);
+        --mCategoryCount;
+    }
+}
+
+size_t StealCandidates::first(std::optional<size_t> aCategory) const
+{
+    if (!aCategory)
+    {
+        return mAll.mHead;
+    }
+
+    const size_t index = categoryIndex(*aCategory);
+    if (index == mCategoryCount || mCategory[index].mCategory != *aCategory)
+    {
+        return NONE;
+    }
+
+    return mCategory[index].mList.mHead;
+}
+
+size_t StealCandidates::next(size_t aVoice, bool aInCategory) const
+{
+    return aInCategory ? mCategoryLink[aVoice].mNext : mAllLink[aVoice].mNext;
+}
+
+bool StealCandidates::after(size_t aVoice, size_t aOther) const
+{
+    const auto& a = mEntry[aVoice];
+    const auto& b = mEntry[aOther];
+    return a.mPriority != b.mPriority ? a.mPriority > b.mPriority : a.mPlayIndex > b.mPlayIndex;
+}
+
+void StealCandidates::link(List& aList, Links& aLinks, size_t aVoice)
+{
+    // Walk back from the tail to the last voice aVoice goes after
+    size_t prev = aList.mTail;
+    while (prev != NONE && !after(aVoice, prev))
+    {
+        prev = aLinks[prev].mPrev;
+    }
+
+    const size_t next = prev == NONE ? aList.mHead : aLinks[prev].mNext;
+    aLinks[aVoice]    = {prev, next};
+
+    if (prev == NONE)
+    {
+        aList.mHead = aVoice;
+    }
+    else
+    {
+        aLinks[prev].mNext = aVoice;
+    }
+
+    if (next == NONE)
+    {
+        aList.mTail = aVoice;
+    }
+    else
+    {
+        aLinks[next].mPrev = aVoice;
+    }
+}
+
+void StealCandidates::unlink(List& aList, Links& aLinks, size_t aVoice)
+{
+    const Link link = aLinks[aVoice];
+    aLinks[aVoice]  = {};
+
+    if (link.mPrev == NONE)
+    {
+        aList.mHead = link.mNext;
+    }
+    else
+    {
+        aLinks[link.mPrev].mNext = link.mNext;
+    }
+
+    if (link.mNext == NONE)
+    {
+        aList.mTail = link.mPrev;
+    }
+    else
+    {
+        aLinks[link.mNext].mPrev = link.mPrev;
+    }
+}
+
+size_t StealCandidates::categoryIndex(size_t aCategory) const
+{
+    const auto less = [](const CategoryList& aList, size_t aValue) {
+        return aList.mCategory < aValue;
+    };
+
+    const auto begin = mCategory.begin();
+    return size_t(std::lower_bound(begin, begin + mCategoryCount, aCategory, less) - begin);
+}
+} // namespace SoLoud
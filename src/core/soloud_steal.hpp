@@ -0,0 +1,114 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#pragma once
+
+#include "soloud.hpp"
+#include <array>
+#include <cstddef>
+#include <optional>
+
+namespace SoLoud
+{
+// Voices that may be stolen, ordered by priority and then by age, over all voices and within each
+// category. Protected voices are left out. The engine keeps it up to date as voices are played
+// and stopped, and as their priority or protection changes, so picking a victim only looks at the
+// lowest priority voices, and for the oldest one not even that.
+//
+// The orders are doubly linked lists through arrays indexed by voice, and the categories with
+// candidates are a sorted array of their lists, so nothing is allocated after construction. A
+// played voice is the newest, so inserting it walks back only over voices of higher priority;
+// erasing is O(1) unless it empties a category. Scoring the lowest priority voices for the
+// Quietest and Farthest policies still visits each of them, so with the default priority for
+// all voices it is O(n) in the unprotected voices.
+class StealCandidates
+{
+  public:
+    static constexpr size_t NONE = VOICE_COUNT;
+
+    void insert(size_t aVoice, size_t aCategory, int aPriority, size_t aPlayIndex);
+
+    // Does nothing if the voice isn't a candidate
+    void erase(size_t aVoice);
+
+    // First candidate over all voices, or of a category, NONE if there are none
+    size_t first(std::optional<size_t> aCategory) const;
+
+    // Candidate after aVoice over all voices, or in its category, NONE if it is the last
+    size_t next(size_t aVoice, bool aInCategory) const;
+
+    int priority(size_t aVoice) const
+    {
+        return mEntry[aVoice].mPriority;
+    }
+
+  private:
+    struct Entry
+    {
+        int    mPriority  = 0;
+        size_t mPlayIndex = 0;
+        size_t mCategory  = 0;
+        bool   mLinked    = false;
+    };
+
+    struct Link
+    {
+        size_t mPrev = NONE;
+        size_t mNext = NONE;
+    };
+
+    struct List
+    {
+        size_t mHead = NONE;
+        size_t mTail = NONE;
+    };
+
+    struct CategoryList
+    {
+        size_t mCategory = 0;
+        List   mList;
+    };
+
+    using Links = std::array<Link, VOICE_COUNT>;
+
+    // Whether aVoice goes after aOther
+    bool after(size_t aVoice, size_t aOther) const;
+
+    void link(List& aList, Links& aLinks, size_t aVoice);
+    void unlink(List& aList, Links& aLinks, size_t aVoice);
+
+    // Categories with candidates before aCategory
+    size_t categoryIndex(size_t aCategory) const;
+
+    std::array<Entry, VOICE_COUNT> mEntry;
+    List                           mAll;
+    Links                          mAllLink;
+    Links                          mCategoryLink;
+
+    // One list per category with candidates, sorted by category
+    std::array<CategoryList, VOICE_COUNT> mCategory;
+    size_t                                mCategoryCount = 0;
+};
+} // namespace SoLoud
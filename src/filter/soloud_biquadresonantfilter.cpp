@@ -27,6 +27,7 @@ Based on "Using the Biquad Resonant Filter",
 Phil Burk, Game Programming Gems 3, p. 606
 */
 
+#include "soloud_biquad.hpp"
 #include "soloud_filter.hpp"
 #include <cmath>
 
@@ -34,113 +35,94 @@ namespace SoLoud
 {
 void BiquadResonantFilterInstance::calcBQRParams()
 {
-    mDirty = 0;
+    const auto frequency = mParam[Frequency];
+    const auto resonance = mParam[Resonance];
+    const auto gain      = mParam[Gain];
 
-    const auto omega     = float(2.0f * M_PI * mParam[Frequency] / mSamplerate);
-    const auto sin_omega = sin(omega);
-    const auto cos_omega = cos(omega);
-    const auto alpha     = sin_omega / (2.0f * mParam[Resonance]);
-    const auto scalar    = 1.0f / (1.0f + alpha);
+    // Second order Butterworth, cascaded twice for Linkwitz-Riley
+    constexpr auto butterworth = float(M_SQRT1_2);
+
+    auto shape  = Biquad::Shape::Lowpass;
+    auto q      = resonance;
+    auto stages = size_t(1);
 
     switch (int(mParam[Type]))
     {
-        case BiquadResonantFilter::LOWPASS: {
-            mA0 = 0.5f * (1.0f - cos_omega) * scalar;
-            mA1 = (1.0f - cos_omega) * scalar;
-            mA2 = mA0;
-            mB1 = -2.0f * cos_omega * scalar;
-            mB2 = (1.0f - alpha) * scalar;
-            break;
-        }
-        case BiquadResonantFilter::HIGHPASS: {
-            mA0 = 0.5f * (1.0f + cos_omega) * scalar;
-            mA1 = -(1.0f + cos_omega) * scalar;
-            mA2 = mA0;
-            mB1 = -2.0f * cos_omega * scalar;
-            mB2 = (1.0f - alpha) * scalar;
+        case BiquadResonantFilter::HIGHPASS: shape = Biquad::Shape::Highpass; break;
+        case BiquadResonantFilter::BANDPASS: shape = Biquad::Shape::Bandpass; break;
+        case BiquadResonantFilter::NOTCH: shape = Biquad::Shape::Notch; break;
+        case BiquadResonantFilter::PEAK: shape = Biquad::Shape::Peak; break;
+        case BiquadResonantFilter::LOWSHELF: shape = Biquad::Shape::LowShelf; break;
+        case BiquadResonantFilter::HIGHSHELF: shape = Biquad::Shape::HighShelf; break;
+        case BiquadResonantFilter::LINKWITZ_RILEY_LOWPASS:
+            q      = butterworth;
+            stages = 2;
             break;
-        }
-        case BiquadResonantFilter::BANDPASS: {
-            mA0 = alpha * scalar;
-            mA1 = 0;
-            mA2 = -mA0;
-            mB1 = -2.0f * cos_omega * scalar;
-            mB2 = (1.0f - alpha) * scalar;
+        case BiquadResonantFilter::LINKWITZ_RILEY_HIGHPASS:
+            shape  = Biquad::Shape::Highpass;
+            q      = butterworth;
+            stages = 2;
             break;
-        }
         default: break;
     }
+
+    const auto coefficients = Biquad::design(shape, frequency, q, gain, mSamplerate);
+
+    mCascade->setStageCount(stages);
+    for (size_t s = 0; s < stages; ++s)
+    {
+        mCascade->setStage(s, coefficients);
+    }
 }
 
 
 BiquadResonantFilterInstance::BiquadResonantFilterInstance(BiquadResonantFilter* aParent)
-    : mParent(aParent)
+    : mCascade(std::make_unique<Biquad::Cascade>())
+    , mParent(aParent)
 {
-    FilterInstance::initParams(4);
+    FilterInstance::initParams(5);
 
     mParam[Resonance] = aParent->mResonance;
     mParam[Frequency] = aParent->mFrequency;
     mParam[Type]      = float(aParent->mFilterType);
+    mParam[Gain]      = aParent->mGain;
 
     mSamplerate = 44'100.0f;
 
     calcBQRParams();
+    mCascade->reset();
 }
 
-void BiquadResonantFilterInstance::filterChannel(float* aBuffer,
-                                                 size_t aSamples,
-                                                 float  aSamplerate,
-                                                 double aTime,
-                                                 size_t aChannel,
-                                                 size_t /*aChannels*/)
+BiquadResonantFilterInstance::~BiquadResonantFilterInstance() = default;
+
+void BiquadResonantFilterInstance::filter(float* aBuffer,
+                                          size_t aSamples,
+                                          size_t aBufferSize,
+                                          size_t aChannels,
+                                          float  aSamplerate,
+                                          double aTime)
 {
-    const auto osamples = aSamples;
+    updateParams(aTime);
 
-    if (aChannel == 0)
+    if (aSamplerate != mSamplerate)
     {
-        updateParams(aTime);
-
-        if (mParamChanged & ((1 << Frequency) | (1 << Resonance) | (1 << Type)) ||
-            aSamplerate != mSamplerate)
-        {
-            mSamplerate = aSamplerate;
-            calcBQRParams();
-        }
-        mParamChanged = 0;
+        // Nothing to glide from at a new rate
+        mSamplerate = aSamplerate;
+        calcBQRParams();
+        mCascade->reset();
     }
-
-    auto& s = mState[aChannel];
-
-    // make sure we access pairs of samples (one sample may be skipped)
-    aSamples = aSamples & ~1;
-
-    int c = 0;
-
-    for (size_t i = 0; i < aSamples; i += 2, ++c)
+    else if (mParamChanged & ((1 << Frequency) | (1 << Resonance) | (1 << Type) | (1 << Gain)))
     {
-        // Generate outputs by filtering inputs.
-        const float x = aBuffer[c];
-        s.mY2         = (mA0 * x) + (mA1 * s.mX1) + (mA2 * s.mX2) - (mB1 * s.mY1) - (mB2 * s.mY2);
-        aBuffer[c] += (s.mY2 - aBuffer[c]) * mParam[Wet];
-
-        ++c;
-
-        // Permute filter operations to reduce data movement.
-        // Just substitute variables instead of doing mX1=x, etc.
-        s.mX2 = aBuffer[c];
-        s.mY1 = (mA0 * s.mX2) + (mA1 * x) + (mA2 * s.mX1) - (mB1 * s.mY2) - (mB2 * s.mY1);
-        aBuffer[c] += (s.mY1 - aBuffer[c]) * mParam[Wet];
-
-        // Only move a little data.
-        s.mX1 = s.mX2;
-        s.mX2 = x;
+        calcBQRParams();
     }
+    mParamChanged = 0;
 
-    // If we skipped a sample earlier, patch it by just copying the previous.
-    if (osamples != aSamples)
-    {
-        aBuffer[c] = aBuffer[c - 1];
-    }
+    mCascade->process(aBuffer, aSamples, aBufferSize, aChannels, mParam[Wet]);
+}
+
+time_t BiquadResonantFilterInstance::getTailLength(float aSamplerate)
+{
+    return mCascade->getTailLength(aSamplerate);
 }
 
 std::shared_ptr<FilterInstance> BiquadResonantFilter::createInstance()
@@ -0,0 +1,110 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_filter.hpp"
+#include "soloud_ramp.hpp"
+#include "soloud_sidechain.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace SoLoud
+{
+CompressorFilterInstance::CompressorFilterInstance(CompressorFilter* aParent)
+{
+    initParams(7);
+    mParam[CompressorFilter::THRESHOLD] = aParent->mThreshold;
+    mParam[CompressorFilter::RATIO]     = aParent->mRatio;
+    mParam[CompressorFilter::ATTACK]    = aParent->mAttack;
+    mParam[CompressorFilter::RELEASE]   = aParent->mRelease;
+    mParam[CompressorFilter::MAKEUP]    = aParent->mMakeup;
+    mParam[CompressorFilter::DETECTOR]  = float(aParent->mDetector);
+    mListenTo                           = aParent->mListenTo;
+    mEngine                             = aParent->mEngine;
+}
+
+void CompressorFilterInstance::filter(float* aBuffer,
+                                      size_t aSamples,
+                                      size_t aBufferSize,
+                                      size_t aChannels,
+                                      float  aSamplerate,
+                                      double aTime)
+{
+    updateParams(aTime);
+
+    if (aSamples == 0)
+    {
+        return;
+    }
+
+    // A sidechain that isn't playing is silent
+    auto level = SidechainLevel{};
+    if (mEngine && mListenTo)
+    {
+        level = getSidechainLevel(*mEngine, mListenTo).value_or(SidechainLevel{});
+    }
+    else
+    {
+        level = measureLevel(aBuffer, aSamples, aBufferSize, aChannels);
+    }
+
+    const bool  peak     = int(mParam[CompressorFilter::DETECTOR]) == CompressorFilter::PEAK;
+    const float detected = peak ? level.mPeak : level.mRms;
+    const float levelDb = 20.0f * log10f(std::max(detected, 1.0e-6f));
+
+    // Above the threshold, the output only rises by 1 / ratio of the input
+    const float ratio  = std::max(mParam[CompressorFilter::RATIO], 1.0f);
+    const float over   = levelDb - mParam[CompressorFilter::THRESHOLD];
+    const float target = over > 0 ? -over * (1.0f - 1.0f / ratio) : 0.0f;
+
+    // One pole smoothing of the reduction, stepped once per block
+    const float time = target < mReduction ? mParam[CompressorFilter::ATTACK]
+                                           : mParam[CompressorFilter::RELEASE];
+    const float coeff = time > 0 ? 1.0f - expf(-float(aSamples) / (time * aSamplerate)) : 1.0f;
+    mReduction += (target - mReduction) * coeff;
+
+    const float gain0 = mGain;
+    const float gain1 = powf(10.0f, (mReduction + mParam[CompressorFilter::MAKEUP]) / 20.0f);
+    mGain = gain1;
+
+    const float wet = mParam[CompressorFilter::WET];
+    applyGainRamp(aBuffer,
+                  aSamples,
+                  aBufferSize,
+                  aChannels,
+                  1.0f + (gain0 - 1.0f) * wet,
+                  1.0f + (gain1 - 1.0f) * wet);
+}
+
+time_t CompressorFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    // Only scales the input
+    return 0;
+}
+
+std::shared_ptr<FilterInstance> CompressorFilter::createInstance()
+{
+    return std::make_shared<CompressorFilterInstance>(this);
+}
+} // namespace SoLoud
@@ -0,0 +1,340 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud.hpp"
+#include "soloud_fft.hpp"
+#include "soloud_filter.hpp"
+#include "soloud_wav.hpp"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
+
+namespace SoLoud
+{
+namespace
+{
+float dot(const float* aA, const float* aB, size_t aCount)
+{
+    size_t i   = 0;
+    float  sum = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= aCount; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(aA + i), _mm_loadu_ps(aB + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(aA + i + 4), _mm_loadu_ps(aB + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    for (; i < aCount; ++i)
+    {
+        sum += aA[i] * aB[i];
+    }
+
+    return sum;
+}
+
+// Prepare the impulse for convolution at aSamplerate, resampling it linearly if its rate differs.
+// Resampled responses are scaled by the rate ratio, so that they keep the same gain.
+std::shared_ptr<const ConvolutionResponse> makeResponse(
+    const std::vector<float>& aImpulse,
+    size_t                    aChannels,
+    float                     aImpulseSamplerate,
+    float                     aSamplerate,
+    size_t                    aPartitionSize)
+{
+    auto         response = std::make_shared<ConvolutionResponse>();
+    const size_t size     = aPartitionSize;
+    const size_t source   = aImpulse.size() / aChannels;
+    const float  ratio    = aImpulseSamplerate / aSamplerate;
+    const size_t length   = ratio == 1.0f ? source : size_t(ceilf(float(source) / ratio));
+
+    response->mPartitionSize     = size;
+    response->mPartitions        = length > size ? (length - 1) / size : 0;
+    response->mChannels          = aChannels;
+    response->mLength            = length;
+    response->mSamplerate        = aSamplerate;
+    response->mHead.assign(size * aChannels, 0.0f);
+    response->mSpectra.assign(size * 2 * response->mPartitions * aChannels, 0.0f);
+
+    const auto& plan  = FFT::getPlan(size * 2);
+    auto        frame = std::vector<float>(size * 2);
+    auto        ir    = std::vector<float>(length);
+
+    for (size_t j = 0; j < aChannels; ++j)
+    {
+        const float* src  = aImpulse.data() + j * source;
+        float*       head = response->mHead.data() + j * size;
+
+        if (ratio == 1.0f)
+        {
+            std::copy(src, src + source, ir.begin());
+        }
+        else
+        {
+            for (size_t i = 0; i < length; ++i)
+            {
+                const float  pos = float(i) * ratio;
+                const auto   i0  = size_t(pos);
+                const float  f   = pos - float(i0);
+                const float  s0  = i0 < source ? src[i0] : 0.0f;
+                const float  s1  = i0 + 1 < source ? src[i0 + 1] : 0.0f;
+                ir[i]            = (s0 + f * (s1 - s0)) * ratio;
+            }
+        }
+
+        for (size_t i = 0; i < size && i < length; ++i)
+        {
+            head[size - 1 - i] = ir[i];
+        }
+
+        // Zero padded to twice the partition size for overlap-save
+        for (size_t p = 0; p < response->mPartitions; ++p)
+        {
+            const size_t start = (p + 1) * size;
+            const size_t count = std::min(size, length - start);
+
+            std::fill(frame.begin(), frame.end(), 0.0f);
+            std::copy(ir.begin() + start, ir.begin() + start + count, frame.begin());
+
+            float* spectrum =
+                response->mSpectra.data() + (j * response->mPartitions + p) * size * 2;
+            plan.forward(frame.data(), spectrum, spectrum + size);
+        }
+    }
+
+    return response;
+}
+} // namespace
+
+ConvolutionFilterInstance::ConvolutionFilterInstance(ConvolutionFilter* aParent)
+    : mResponses(aParent->mResponses)
+    , mResponse(mResponses->front())
+{
+    FilterInstance::initParams(1);
+
+    // Reserved for the longest prepared response, so that changing rates or the first block of up
+    // to stereo, or the impulse response's channels, don't allocate in the mixer
+    size_t partitions = 0;
+    for (const auto& response : *mResponses)
+    {
+        partitions = std::max(partitions, response->mPartitions);
+    }
+
+    const size_t size     = mResponse->mPartitionSize;
+    const size_t channels = std::max<size_t>(mResponse->mChannels, 2);
+    mHistory.reserve(size * 2 * channels);
+    mTail.reserve(size * channels);
+    mDelayLine.reserve(size * 2 * partitions * channels);
+    mScratch.reserve(size * 4);
+}
+
+void ConvolutionFilterInstance::initBuffers(size_t aChannels)
+{
+    const size_t size = mResponse->mPartitionSize;
+
+    mChannels = aChannels;
+    mFill     = 0;
+    mSlot     = 0;
+    mHistory.assign(size * 2 * aChannels, 0.0f);
+    mTail.assign(size * aChannels, 0.0f);
+    mDelayLine.assign(size * 2 * mResponse->mPartitions * aChannels, 0.0f);
+    mScratch.assign(size * 4, 0.0f);
+}
+
+void ConvolutionFilterInstance::filter(float* aBuffer,
+                                       size_t aSamples,
+                                       size_t aBufferSize,
+                                       size_t aChannels,
+                                       float  aSamplerate,
+                                       time_t aTime)
+{
+    updateParams(aTime);
+
+    // The responses were prepared by the filter; pick the one closest to the rate
+    if (mResponse->mSamplerate != aSamplerate)
+    {
+        const auto& closest = *std::ranges::min_element(*mResponses, {}, [&](const auto& r) {
+            return std::fabs(r->mSamplerate - aSamplerate);
+        });
+
+        if (closest != mResponse)
+        {
+            mResponse = closest;
+            initBuffers(aChannels);
+        }
+    }
+
+    if (mChannels != aChannels)
+    {
+        initBuffers(aChannels);
+    }
+
+    const auto&  response   = *mResponse;
+    const size_t size       = response.mPartitionSize;
+    const size_t partitions = response.mPartitions;
+    const float  wet        = mParam[ConvolutionFilter::WET];
+
+    size_t ofs = 0;
+    while (ofs < aSamples)
+    {
+        const size_t samples = std::min(size - mFill, aSamples - ofs);
+
+        for (size_t j = 0; j < aChannels; ++j)
+        {
+            float*       buf     = aBuffer + j * aBufferSize + ofs;
+            float*       history = mHistory.data() + j * size * 2;
+            const float* tail    = mTail.data() + j * size + mFill;
+            const float* head =
+                response.mHead.data() + std::min(j, response.mChannels - 1) * size;
+
+            memcpy(history + size + mFill, buf, sizeof(float) * samples);
+
+            for (size_t i = 0; i < samples; ++i)
+            {
+                const float y = dot(head, history + mFill + i + 1, size) + tail[i];
+                buf[i] += (y - buf[i]) * wet;
+            }
+        }
+
+        ofs += samples;
+        mFill += samples;
+
+        if (mFill < size)
+        {
+            break;
+        }
+
+        mFill = 0;
+
+        for (size_t j = 0; j < aChannels; ++j)
+        {
+            float* history = mHistory.data() + j * size * 2;
+
+            if (partitions)
+            {
+                const auto& plan  = FFT::getPlan(size * 2);
+                float*      line  = mDelayLine.data() + j * partitions * size * 2;
+                float*      real  = mScratch.data();
+                float*      imag  = real + size;
+                float*      frame = imag + size;
+                float*      slot  = line + mSlot * size * 2;
+                const float* spectra =
+                    response.mSpectra.data() +
+                    std::min(j, response.mChannels - 1) * partitions * size * 2;
+
+                plan.forward(history, slot, slot + size);
+
+                // The newest input goes through the second partition of the response, the one
+                // before through the third, and so on
+                memset(real, 0, sizeof(float) * size * 2);
+                for (size_t s = 0; s < partitions; ++s)
+                {
+                    const size_t age   = (mSlot + partitions - s) % partitions;
+                    const float* input = line + s * size * 2;
+                    const float* ir    = spectra + age * size * 2;
+                    FFT::multiplyAccumulate(
+                        real, imag, input, input + size, ir, ir + size, size);
+                }
+
+                plan.inverse(real, imag, frame);
+                memcpy(mTail.data() + j * size, frame + size, sizeof(float) * size);
+            }
+
+            memmove(history, history + size, sizeof(float) * size);
+        }
+
+        if (partitions)
+        {
+            mSlot = (mSlot + 1) % partitions;
+        }
+    }
+}
+
+time_t ConvolutionFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    return double(mResponse->mLength) / mResponse->mSamplerate;
+}
+
+ConvolutionFilter::ConvolutionFilter(const Wav& aImpulse,
+                                     size_t     aPartitionSize,
+                                     float      aSamplerate)
+{
+    assert(std::has_single_bit(aPartitionSize) && aPartitionSize >= 32 &&
+           aPartitionSize <= 32768);
+
+    const size_t length = aImpulse.getSampleCount();
+    const float* data   = aImpulse.getData();
+
+    mChannels          = std::max<size_t>(aImpulse.channel_count, 1);
+    mImpulseSamplerate = aImpulse.base_sample_rate;
+    mPartitionSize     = aPartitionSize;
+    mImpulse.assign(length * mChannels, 0.0f);
+
+    if (data != nullptr)
+    {
+        std::copy(data, data + length * mChannels, mImpulse.begin());
+    }
+
+    const float samplerate = aSamplerate > 0.0f ? aSamplerate : mImpulseSamplerate;
+
+    mResponses = std::make_shared<std::vector<std::shared_ptr<const ConvolutionResponse>>>(
+        1, makeResponse(mImpulse, mChannels, mImpulseSamplerate, samplerate, mPartitionSize));
+}
+
+void ConvolutionFilter::prepare(float aSamplerate)
+{
+    for (const auto& response : *mResponses)
+    {
+        if (response->mSamplerate == aSamplerate)
+        {
+            return;
+        }
+    }
+
+    auto responses = std::make_shared<std::vector<std::shared_ptr<const ConvolutionResponse>>>(
+        *mResponses);
+    responses->push_back(
+        makeResponse(mImpulse, mChannels, mImpulseSamplerate, aSamplerate, mPartitionSize));
+
+    mResponses = std::move(responses);
+}
+
+std::shared_ptr<FilterInstance> ConvolutionFilter::createInstance()
+{
+    return std::make_shared<ConvolutionFilterInstance>(this);
+}
+} // namespace SoLoud
@@ -22,9 +22,10 @@ freely, subject to the following restrictions:
    distribution.
 */
 
-#include "soloud_bus.hpp"
-#include "soloud_engine.hpp"
 #include "soloud_filter.hpp"
+#include "soloud_ramp.hpp"
+#include "soloud_sidechain.hpp"
+#include <algorithm>
 
 namespace SoLoud
 {
@@ -48,75 +49,49 @@ void DuckFilterInstance::filter(float* aBuffer,
 {
     updateParams(aTime);
 
+    const float duckLevel = mParam[DuckFilter::LEVEL];
+
     auto onramp_step = 1.0f;
     if (mParam[DuckFilter::ONRAMP] > 0.01f)
     {
-        onramp_step =
-            (1.0f - mParam[DuckFilter::LEVEL]) / (mParam[DuckFilter::ONRAMP] * aSamplerate);
+        onramp_step = (1.0f - duckLevel) / (mParam[DuckFilter::ONRAMP] * aSamplerate);
     }
 
     auto offramp_step = 1.0f;
     if (mParam[DuckFilter::OFFRAMP] > 0.01f)
     {
-        offramp_step =
-            (1.0f - mParam[DuckFilter::LEVEL]) / (mParam[DuckFilter::OFFRAMP] * aSamplerate);
+        offramp_step = (1.0f - duckLevel) / (mParam[DuckFilter::OFFRAMP] * aSamplerate);
     }
 
     auto soundOn = false;
     if (mEngine)
     {
-        const auto voice_num = mEngine->getVoiceFromHandle_internal(mListenTo);
-        if (voice_num != -1)
-        {
-            const auto bi = std::static_pointer_cast<BusInstance>(mEngine->mVoice[voice_num]);
-
-            auto v = 0.0f;
-            for (size_t i = 0; i < bi->mChannels; ++i)
-            {
-                v += bi->mVisualizationChannelVolume[i];
-            }
-
-            if (v > 0.01f)
-            {
-                soundOn = true;
-            }
-        }
+        const auto level = getSidechainLevel(*mEngine, mListenTo);
+        soundOn          = level && level->mPeak > 0.01f;
     }
 
-    auto level = mCurrentLevel;
-    for (size_t j = 0; j < aChannels; ++j)
-    {
-        level             = mCurrentLevel;
-        const auto bchofs = j * aBufferSize;
-
-        for (size_t i = 0; i < aSamples; ++i)
-        {
-            if (soundOn && level > mParam[DuckFilter::LEVEL])
-            {
-                level -= onramp_step;
-            }
-
-            if (!soundOn && level < 1)
-            {
-                level += offramp_step;
-            }
-
-            if (level < mParam[DuckFilter::LEVEL])
-            {
-                level = mParam[DuckFilter::LEVEL];
-            }
-
-            if (level > 1)
-            {
-                level = 1;
-            }
-
-            aBuffer[i + bchofs] +=
-                (-aBuffer[i + bchofs] + aBuffer[i + bchofs] * level) * mParam[DuckFilter::WET];
-        }
-    }
+    // The level moves by a fixed step per sample towards the ducked level or back to 1; a linear
+    // ramp between its values at the ends of the block follows it
+    const float start = mCurrentLevel;
+    const float end   = std::clamp(soundOn ? start - onramp_step * float(aSamples)
+                                           : start + offramp_step * float(aSamples),
+                                 std::min(duckLevel, 1.0f),
+                                 1.0f);
+    mCurrentLevel     = end;
+
+    const float wet = mParam[DuckFilter::WET];
+    applyGainRamp(aBuffer,
+                  aSamples,
+                  aBufferSize,
+                  aChannels,
+                  1.0f + (start - 1.0f) * wet,
+                  1.0f + (end - 1.0f) * wet);
+}
 
-    mCurrentLevel = level;
+time_t DuckFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    // Only scales the input
+    return 0;
 }
 
 std::shared_ptr<FilterInstance> DuckFilter::createInstance()
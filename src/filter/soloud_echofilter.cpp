@@ -22,21 +22,28 @@ freely, subject to the following restrictions:
    distribution.
 */
 
+#include "soloud_delayline.hpp"
 #include "soloud_filter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace SoLoud
 {
+// Longest run of samples processed at once
+static constexpr size_t MAX_RUN = 256;
+
 EchoFilterInstance::EchoFilterInstance(EchoFilter* aParent)
+    : mLine(std::make_unique<DelayLine>())
 {
-    mBufferLength    = 0;
-    mBufferMaxLength = 0;
-    mOffset          = 0;
     FilterInstance::initParams(4);
     mParam[EchoFilter::DELAY]  = aParent->mDelay;
     mParam[EchoFilter::DECAY]  = aParent->mDecay;
     mParam[EchoFilter::FILTER] = aParent->mFilter;
 }
 
+EchoFilterInstance::~EchoFilterInstance() = default;
+
 void EchoFilterInstance::filter(float* aBuffer,
                                 size_t aSamples,
                                 size_t aBufferSize,
@@ -45,41 +52,56 @@ void EchoFilterInstance::filter(float* aBuffer,
                                 double aTime)
 {
     updateParams(aTime);
-    if (mBuffer == nullptr)
-    {
-        // We only know channels and sample rate at this point.. not really optimal
-        mBufferMaxLength = int(ceil(mParam[EchoFilter::DELAY] * aSamplerate));
-        mBuffer          = std::make_unique<float[]>(mBufferMaxLength * aChannels);
-    }
 
-    mBufferLength = int(ceil(mParam[EchoFilter::DELAY] * aSamplerate));
-    if (mBufferLength > mBufferMaxLength)
-    {
-        mBufferLength = mBufferMaxLength;
-    }
+    // The line grows when the delay does, keeping the echoes already in it
+    const auto delay = std::max(size_t(ceil(mParam[EchoFilter::DELAY] * aSamplerate)), size_t(1));
+    mLine->reserve(aChannels, delay);
+    mRun.resize(std::max(mRun.size(), MAX_RUN * aChannels));
 
-    int prevofs = (mOffset + mBufferLength - 1) % mBufferLength;
+    const float filter = mParam[EchoFilter::FILTER];
+    const float decay  = mParam[EchoFilter::DECAY];
+    const float wet    = mParam[EchoFilter::WET];
 
-    for (size_t i = 0; i < aSamples; ++i)
+    // Runs no longer than the delay only read echoes of earlier runs
+    for (size_t i = 0; i < aSamples;)
     {
-        for (size_t j = 0; j < aChannels; ++j)
-        {
-            const auto chofs  = j * mBufferLength;
-            const auto bchofs = j * aBufferSize;
+        const size_t run = std::min({aSamples - i, delay, MAX_RUN});
 
-            mBuffer[mOffset + chofs] = mParam[EchoFilter::FILTER] * mBuffer[prevofs + chofs] +
-                                       (1 - mParam[EchoFilter::FILTER]) * mBuffer[mOffset + chofs];
+        mLine->read(mRun.data(), run, run, delay);
 
-            const auto n =
-                aBuffer[i + bchofs] + mBuffer[mOffset + chofs] * mParam[EchoFilter::DECAY];
-            mBuffer[mOffset + chofs] = n;
+        for (size_t c = 0; c < aChannels; ++c)
+        {
+            float* x    = aBuffer + c * aBufferSize + i;
+            float* line = mRun.data() + c * run;
 
-            aBuffer[i + bchofs] += (n - aBuffer[i + bchofs]) * mParam[EchoFilter::WET];
+            // The filter blends the echo with the last sample written to the line
+            float previous = mLine->at(c, 1);
+            for (size_t j = 0; j < run; ++j)
+            {
+                const float echo = line[j] + (previous - line[j]) * filter;
+                const float n    = x[j] + echo * decay;
+                previous         = n;
+                line[j]          = n;
+                x[j] += (n - x[j]) * wet;
+            }
         }
-        prevofs = mOffset;
-        mOffset = (mOffset + 1) % mBufferLength;
+
+        mLine->write(mRun.data(), run, run);
+        i += run;
     }
 }
+time_t EchoFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    // Each round trip through the delay line scales the echo by the decay
+    const double decay = fabs(mParam[EchoFilter::DECAY]);
+    if (decay >= 1)
+    {
+        return std::numeric_limits<time_t>::infinity();
+    }
+
+    const double repeats = decay > 0 ? ceil(log(SILENCE_THRESHOLD) / log(decay)) : 0;
+    return mParam[EchoFilter::DELAY] * (repeats + 1);
+}
 
 std::shared_ptr<FilterInstance> EchoFilter::createInstance()
 {
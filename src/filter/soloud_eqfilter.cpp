@@ -25,11 +25,16 @@ freely, subject to the following restrictions:
 #include "soloud.hpp"
 #include "soloud_filter.hpp"
 #include <algorithm>
-#include <cstring>
+#include <cmath>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
 
 namespace SoLoud
 {
 EqFilterInstance::EqFilterInstance(EqFilter* aParent)
+    : FFTFilterInstance(aParent)
 {
     mParent = aParent;
     FilterInstance::initParams(9);
@@ -41,6 +46,9 @@ EqFilterInstance::EqFilterInstance(EqFilter* aParent)
     mParam[BAND6] = aParent->mVolume[BAND6 - BAND1];
     mParam[BAND7] = aParent->mVolume[BAND7 - BAND1];
     mParam[BAND8] = aParent->mVolume[BAND8 - BAND1];
+
+    mGain         = std::make_unique<float[]>(mWindowSize / 2);
+    mParamChanged = ~size_t(0);
 }
 
 static float catmullrom(float t, float p0, float p1, float p2, float p3)
@@ -49,38 +57,64 @@ static float catmullrom(float t, float p0, float p1, float p2, float p3)
                    (-p0 + 3 * p1 - 3 * p2 + p3) * t * t * t);
 }
 
-void EqFilterInstance::fftFilterChannel(float* aFFTBuffer,
-                                        size_t aSamples,
-                                        float /*aSamplerate*/,
-                                        time_t /*aTime*/,
-                                        size_t /*aChannel*/,
-                                        size_t /*aChannels*/)
+void EqFilterInstance::fftFilter(float* aReal,
+                                 float* aImag,
+                                 size_t aBins,
+                                 size_t aStride,
+                                 size_t aChannels,
+                                 float /*aSamplerate*/,
+                                 time_t /*aTime*/)
 {
-    comp2MagPhase(aFFTBuffer, aSamples / 2);
-
-    for (size_t p = 0; p < aSamples / 2; p++)
+    // The bands only scale the bins, so there's no need to go through magnitude and phase
+    if (mParamChanged)
     {
-        int i  = int(floor(sqrt(p / float(aSamples / 2)) * (aSamples / 2)));
-        int p2 = (i / (aSamples / 16));
-        int p1 = p2 - 1;
-        int p0 = p1 - 1;
-        int p3 = p2 + 1;
-
-        if (p1 < 0)
-            p1 = 0;
-        if (p0 < 0)
-            p0 = 0;
-        if (p3 > 7)
-            p3 = 7;
-
-        const auto v = float(i % (aSamples / 16)) / float(aSamples / 16);
-
-        aFFTBuffer[p * 2] *=
-            catmullrom(v, mParam[p0 + 1], mParam[p1 + 1], mParam[p2 + 1], mParam[p3 + 1]);
+        for (size_t p = 0; p < aBins; p++)
+        {
+            int i  = int(floor(sqrt(p / float(aBins)) * aBins));
+            int p2 = (i / (aBins / 8));
+            int p1 = p2 - 1;
+            int p0 = p1 - 1;
+            int p3 = p2 + 1;
+
+            if (p1 < 0)
+                p1 = 0;
+            if (p0 < 0)
+                p0 = 0;
+            if (p3 > 7)
+                p3 = 7;
+
+            const auto v = float(i % (aBins / 8)) / float(aBins / 8);
+
+            mGain[p] = catmullrom(v, mParam[p0 + 1], mParam[p1 + 1], mParam[p2 + 1], mParam[p3 + 1]);
+        }
+
+        mParamChanged = 0;
     }
 
-    memset(aFFTBuffer + aSamples, 0, sizeof(float) * aSamples);
-    magPhase2Comp(aFFTBuffer, aSamples / 2);
+    for (size_t j = 0; j < aChannels; ++j)
+    {
+        float*      re      = aReal + j * aStride;
+        float*      im      = aImag + j * aStride;
+        const float nyquist = im[0] * mParam[BAND8];
+        size_t      i       = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+        for (; i + 4 <= aBins; i += 4)
+        {
+            const __m128 gain = _mm_loadu_ps(mGain.get() + i);
+            _mm_storeu_ps(re + i, _mm_mul_ps(_mm_loadu_ps(re + i), gain));
+            _mm_storeu_ps(im + i, _mm_mul_ps(_mm_loadu_ps(im + i), gain));
+        }
+#endif
+
+        for (; i < aBins; ++i)
+        {
+            re[i] *= mGain[i];
+            im[i] *= mGain[i];
+        }
+
+        im[0] = nyquist;
+    }
 }
 
 EqFilter::EqFilter()
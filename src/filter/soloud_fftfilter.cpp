@@ -38,246 +38,373 @@ freely, subject to the following restrictions:
 #include "soloud.hpp"
 #include "soloud_fft.hpp"
 #include "soloud_filter.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include <cstring>
 
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
 namespace SoLoud
 {
-static constexpr auto STFT_WINDOW_SIZE  = 256; // must be power of two
-static constexpr auto STFT_WINDOW_HALF  = STFT_WINDOW_SIZE / 2;
-static constexpr auto STFT_WINDOW_TWICE = STFT_WINDOW_SIZE * 2;
+namespace
+{
+constexpr float TWO_PI     = 2.0f * float(M_PI);
+constexpr float INV_TWO_PI = 1.0f / TWO_PI;
+constexpr float HALF_PI    = 0.5f * float(M_PI);
 
-// Needed for subclasses
-FFTFilterInstance::FFTFilterInstance()
+// Wrap a phase into [-pi, pi]
+inline float wrapPhase(float aPhase)
 {
-    for (size_t i = 0; i < MAX_CHANNELS; ++i)
-    {
-        mInputOffset[i] = STFT_WINDOW_SIZE;
-        mMixOffset[i]   = STFT_WINDOW_HALF;
-        mReadOffset[i]  = 0;
-    }
+    return aPhase - TWO_PI * floorf(aPhase * INV_TWO_PI + 0.5f);
 }
 
-FFTFilterInstance::FFTFilterInstance(FFTFilter* aParent)
-    : FFTFilterInstance()
+// atan2 within 1e-5 radians (Abramowitz & Stegun 4.4.49 on the octant)
+inline float fastAtan2(float aY, float aX)
 {
-    mParent = aParent;
-    FilterInstance::initParams(1);
+    const float ax = fabsf(aX);
+    const float ay = fabsf(aY);
+    const float a  = std::min(ax, ay) / std::max(std::max(ax, ay), 1.0e-30f);
+    const float s  = a * a;
+    float       r =
+        a * (0.9998660f +
+             s * (-0.3302995f + s * (0.1801410f + s * (-0.0851330f + s * 0.0208351f))));
+
+    if (ay > ax)
+        r = HALF_PI - r;
+    if (aX < 0)
+        r = float(M_PI) - r;
+    return aY < 0 ? -r : r;
+}
+
+// sin of a phase in [-pi, pi], within 4e-6
+inline float fastSin(float aPhase)
+{
+    if (aPhase > HALF_PI)
+        aPhase = float(M_PI) - aPhase;
+    else if (aPhase < -HALF_PI)
+        aPhase = -float(M_PI) - aPhase;
+
+    const float s = aPhase * aPhase;
+    return aPhase *
+           (1.0f + s * (-1.0f / 6 + s * (1.0f / 120 + s * (-1.0f / 5040 + s * (1.0f / 362880)))));
+}
+
+#ifdef SOLOUD_SSE_INTRINSICS
+inline __m128 selectQuad(__m128 aMask, __m128 aTrue, __m128 aFalse)
+{
+    return _mm_or_ps(_mm_and_ps(aMask, aTrue), _mm_andnot_ps(aMask, aFalse));
 }
 
-void FFTFilterInstance::filterChannel(float* aBuffer,
-                                      size_t aSamples,
-                                      float  aSamplerate,
-                                      double aTime,
-                                      size_t aChannel,
-                                      size_t aChannels)
+inline __m128 wrapPhaseQuad(__m128 aPhase)
 {
-    if (aChannel == 0)
+    const __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(aPhase, _mm_set1_ps(INV_TWO_PI))));
+    return _mm_sub_ps(aPhase, _mm_mul_ps(turns, _mm_set1_ps(TWO_PI)));
+}
+
+inline __m128 fastAtan2Quad(__m128 aY, __m128 aX)
+{
+    const __m128 signmask = _mm_set1_ps(-0.0f);
+    const __m128 ax       = _mm_andnot_ps(signmask, aX);
+    const __m128 ay       = _mm_andnot_ps(signmask, aY);
+    const __m128 a        = _mm_div_ps(_mm_min_ps(ax, ay),
+                                _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1.0e-30f)));
+    const __m128 s        = _mm_mul_ps(a, a);
+
+    __m128 r = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(0.0208351f)), _mm_set1_ps(-0.0851330f));
+    r        = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(0.1801410f));
+    r        = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(-0.3302995f));
+    r        = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(0.9998660f));
+    r        = _mm_mul_ps(a, r);
+
+    r = selectQuad(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(HALF_PI), r), r);
+    r = selectQuad(_mm_cmplt_ps(aX, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(float(M_PI)), r), r);
+    return _mm_or_ps(r, _mm_and_ps(aY, signmask));
+}
+
+inline __m128 fastSinQuad(__m128 aPhase)
+{
+    const __m128 pi = _mm_set1_ps(float(M_PI));
+    aPhase          = selectQuad(
+        _mm_cmpgt_ps(aPhase, _mm_set1_ps(HALF_PI)), _mm_sub_ps(pi, aPhase), aPhase);
+    aPhase = selectQuad(_mm_cmplt_ps(aPhase, _mm_set1_ps(-HALF_PI)),
+                        _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(pi, aPhase)),
+                        aPhase);
+
+    const __m128 s = _mm_mul_ps(aPhase, aPhase);
+    __m128       r = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(1.0f / 362880)), _mm_set1_ps(-1.0f / 5040));
+    r              = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(1.0f / 120));
+    r              = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(-1.0f / 6));
+    r              = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(1.0f));
+    return _mm_mul_ps(aPhase, r);
+}
+#endif
+
+// Round the window down to a power of two the FFT supports, and the hop to one that overlaps
+// windows at least by half
+void clampSizes(size_t& aWindowSize, size_t& aHopSize)
+{
+    aWindowSize = std::bit_floor(std::clamp(aWindowSize, FFT::MIN_SIZE, FFT::MAX_SIZE));
+    aHopSize    = std::bit_floor(std::clamp(aHopSize, size_t(1), aWindowSize / 2));
+}
+} // namespace
+
+FFTFilterInstance::FFTFilterInstance(FFTFilter* aParent)
+    : mWindowSize(aParent->mWindowSize)
+    , mHopSize(aParent->mHopSize)
+    , mParent(aParent)
+{
+    // The sizes are public, so they're checked here too and not only in setParams
+    clampSizes(mWindowSize, mHopSize);
+
+    mPlan = &FFT::getPlan(mWindowSize);
+
+    // Square root of a Hann window, applied before and after the transform
+    mWindow = std::make_unique<float[]>(mWindowSize);
+    for (size_t i = 0; i < mWindowSize; ++i)
     {
-        updateParams(aTime);
+        mWindow[i] = sqrtf(0.5f - 0.5f * cosf(TWO_PI * float(i) / float(mWindowSize)));
     }
 
-    // Chicken-egg problem: we don't know channel count before this.
-    // Could allocate max_channels but that would potentially waste a lot of memory.
-    if (mInputBuffer == 0)
+    FilterInstance::initParams(1);
+}
+
+void FFTFilterInstance::initBuffers(size_t aChannels)
+{
+    const size_t bins = mWindowSize / 2;
+
+    mChannels    = aChannels;
+    mFill        = 0;
+    mInputBuffer = std::make_unique<float[]>(mWindowSize * aChannels);
+    mMixBuffer   = std::make_unique<float[]>(mWindowSize * aChannels);
+    mSpectrum    = std::make_unique<float[]>(mWindowSize * (aChannels + 1));
+    mLastPhase   = std::make_unique<float[]>(bins * aChannels);
+    mSumPhase    = std::make_unique<float[]>(bins * aChannels);
+}
+
+void FFTFilterInstance::filter(float* aBuffer,
+                               size_t aSamples,
+                               size_t aBufferSize,
+                               size_t aChannels,
+                               float  aSamplerate,
+                               time_t aTime)
+{
+    updateParams(aTime);
+
+    if (mChannels != aChannels)
     {
-        mInputBuffer = std::make_unique<float[]>(STFT_WINDOW_TWICE * aChannels);
-        mMixBuffer   = std::make_unique<float[]>(STFT_WINDOW_TWICE * aChannels);
-        mTemp        = std::make_unique<float[]>(STFT_WINDOW_SIZE);
-        mLastPhase   = std::make_unique<float[]>(STFT_WINDOW_SIZE * aChannels);
-        mSumPhase    = std::make_unique<float[]>(STFT_WINDOW_SIZE * aChannels);
+        initBuffers(aChannels);
     }
 
-    int    i;
-    size_t ofs      = 0;
-    size_t chofs    = STFT_WINDOW_TWICE * aChannel;
-    size_t inputofs = mInputOffset[aChannel];
-    size_t mixofs   = mMixOffset[aChannel];
-    size_t readofs  = mReadOffset[aChannel];
+    const size_t window = mWindowSize;
+    const size_t hop    = mHopSize;
+    const size_t bins   = window / 2;
+
+    // All channels' real parts, then all imaginary parts, then a time domain frame
+    float* real  = mSpectrum.get();
+    float* imag  = real + bins * aChannels;
+    float* frame = imag + bins * aChannels;
+
+    // Both windows together overlap-add to window / (2 * hop)
+    const float scale = 2.0f * float(hop) / float(window);
+    const float wet   = mParam[0];
 
+    size_t ofs = 0;
     while (ofs < aSamples)
     {
-        int samples = STFT_WINDOW_HALF - (inputofs & (STFT_WINDOW_HALF - 1));
+        const size_t samples = std::min(hop - mFill, aSamples - ofs);
 
-        if (ofs + samples > aSamples)
-            samples = aSamples - ofs;
-
-        for (i = 0; i < samples; ++i)
+        for (size_t j = 0; j < aChannels; ++j)
         {
-            mInputBuffer[chofs + ((inputofs + STFT_WINDOW_HALF) & (STFT_WINDOW_TWICE - 1))] =
-                aBuffer[ofs + i];
-            mMixBuffer[chofs + ((inputofs + STFT_WINDOW_HALF) & (STFT_WINDOW_TWICE - 1))] = 0;
-            inputofs++;
-        }
+            float*       buf = aBuffer + j * aBufferSize + ofs;
+            float*       in  = mInputBuffer.get() + j * window + window - hop + mFill;
+            const float* mix = mMixBuffer.get() + j * window + mFill;
 
-        if ((inputofs & (STFT_WINDOW_HALF - 1)) == 0)
-        {
-            for (i = 0; i < STFT_WINDOW_SIZE; ++i)
+            for (size_t i = 0; i < samples; ++i)
             {
-                mTemp[i] =
-                    mInputBuffer[chofs + ((inputofs + STFT_WINDOW_TWICE - STFT_WINDOW_HALF + i) &
-                                          (STFT_WINDOW_TWICE - 1))];
+                in[i] = buf[i];
+                buf[i] += (mix[i] - buf[i]) * wet;
             }
+        }
 
-            FFT::fft(mTemp.get(), STFT_WINDOW_SIZE);
+        ofs += samples;
+        mFill += samples;
 
-            // do magic
-            fftFilterChannel(mTemp.get(),
-                             STFT_WINDOW_HALF,
-                             aSamplerate,
-                             aTime,
-                             aChannel,
-                             aChannels);
+        if (mFill < hop)
+        {
+            break;
+        }
 
-            FFT::ifft(mTemp.get(), STFT_WINDOW_SIZE);
+        mFill = 0;
 
-            for (i = 0; i < STFT_WINDOW_SIZE; ++i)
-            {
-                // mMixBuffer[chofs + (mixofs & (STFT_WINDOW_TWICE - 1))] = mTemp[i];
-                mMixBuffer[chofs + (mixofs & (STFT_WINDOW_TWICE - 1))] +=
-                    mTemp[i] * ((float)STFT_WINDOW_HALF - abs(STFT_WINDOW_HALF - i)) *
-                    (1.0f / (float)STFT_WINDOW_HALF);
+        for (size_t j = 0; j < aChannels; ++j)
+        {
+            float* in  = mInputBuffer.get() + j * window;
+            float* mix = mMixBuffer.get() + j * window;
 
-                mixofs++;
+            for (size_t i = 0; i < window; ++i)
+            {
+                frame[i] = in[i] * mWindow[i];
             }
 
-            mixofs -= STFT_WINDOW_HALF;
+            mPlan->forward(frame, real + j * bins, imag + j * bins);
+
+            memmove(in, in + hop, sizeof(float) * (window - hop));
+            memmove(mix, mix + hop, sizeof(float) * (window - hop));
+            memset(mix + window - hop, 0, sizeof(float) * hop);
         }
 
-        for (i = 0; i < samples; ++i)
+        fftFilter(real, imag, bins, bins, aChannels, aSamplerate, aTime);
+
+        for (size_t j = 0; j < aChannels; ++j)
         {
-            aBuffer[ofs + i] +=
-                (mMixBuffer[chofs + (readofs & (STFT_WINDOW_TWICE - 1))] - aBuffer[ofs + i]) *
-                mParam[0];
-            readofs++;
-        }
+            float* mix = mMixBuffer.get() + j * window;
 
-        ofs += samples;
+            mPlan->inverse(real + j * bins, imag + j * bins, frame);
+
+            for (size_t i = 0; i < window; ++i)
+            {
+                mix[i] += frame[i] * mWindow[i] * scale;
+            }
+        }
     }
-    mInputOffset[aChannel] = inputofs;
-    mReadOffset[aChannel]  = readofs;
-    mMixOffset[aChannel]   = mixofs;
 }
 
-void FFTFilterInstance::comp2MagPhase(float* aFFTBuffer, size_t aSamples)
+void FFTFilterInstance::comp2MagPhase(float* aReal, float* aImag, size_t aBins)
 {
-    for (size_t i = 0; i < aSamples; ++i)
+    size_t i = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    for (; i + 4 <= aBins; i += 4)
     {
-        float re              = aFFTBuffer[i * 2];
-        float im              = aFFTBuffer[i * 2 + 1];
-        aFFTBuffer[i * 2]     = sqrt(re * re + im * im) * 2;
-        aFFTBuffer[i * 2 + 1] = atan2(im, re);
+        const __m128 re = _mm_loadu_ps(aReal + i);
+        const __m128 im = _mm_loadu_ps(aImag + i);
+        _mm_storeu_ps(aReal + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))));
+        _mm_storeu_ps(aImag + i, fastAtan2Quad(im, re));
     }
-}
+#endif
 
-void FFTFilterInstance::magPhase2MagFreq(float* aFFTBuffer,
-                                         size_t aSamples,
-                                         float  aSamplerate,
-                                         size_t aChannel)
-{
-    float stepsize   = aSamples / aSamplerate;
-    float expct      = (stepsize / aSamples) * 2.0f * (float)M_PI;
-    float freqPerBin = aSamplerate / aSamples;
-    for (size_t i = 0; i < aSamples; ++i)
+    for (; i < aBins; ++i)
     {
-        float       mag = aFFTBuffer[i * 2];
-        const float pha = aFFTBuffer[i * 2 + 1];
-
-        /* compute phase difference */
-        float freq = pha - mLastPhase[i + aChannel * STFT_WINDOW_SIZE];
-        mLastPhase[i + aChannel * STFT_WINDOW_SIZE] = pha;
-
-        /* subtract expected phase difference */
-        freq -= float(i) * expct;
-
-        /* map delta phase into +/- Pi interval */
-        int qpd = int(floor(freq / M_PI));
-        if (qpd >= 0)
-            qpd += qpd & 1;
-        else
-            qpd -= qpd & 1;
-        freq -= float(M_PI) * float(qpd);
+        const float re = aReal[i];
+        const float im = aImag[i];
+        aReal[i]       = sqrtf(re * re + im * im);
+        aImag[i]       = fastAtan2(im, re);
+    }
+}
 
-        /* get deviation from bin frequency from the +/- Pi interval */
-        freq = aSamples * freq / (2.0f * float(M_PI));
+void FFTFilterInstance::magPhase2Comp(float* aMagnitude, float* aPhase, size_t aBins)
+{
+    size_t i = 0;
 
-        /* compute the k-th partials' true frequency */
-        freq = float(i) * freqPerBin + freq * freqPerBin;
+#ifdef SOLOUD_SSE_INTRINSICS
+    const __m128 halfpi = _mm_set1_ps(HALF_PI);
+    for (; i + 4 <= aBins; i += 4)
+    {
+        const __m128 mag = _mm_loadu_ps(aMagnitude + i);
+        const __m128 pha = wrapPhaseQuad(_mm_loadu_ps(aPhase + i));
+        const __m128 cos = fastSinQuad(wrapPhaseQuad(_mm_add_ps(pha, halfpi)));
+        _mm_storeu_ps(aMagnitude + i, _mm_mul_ps(mag, cos));
+        _mm_storeu_ps(aPhase + i, _mm_mul_ps(mag, fastSinQuad(pha)));
+    }
+#endif
 
-        /* store magnitude and true frequency in analysis arrays */
-        aFFTBuffer[i * 2 + 1] = freq;
+    for (; i < aBins; ++i)
+    {
+        const float mag = aMagnitude[i];
+        const float pha = wrapPhase(aPhase[i]);
+        aMagnitude[i]   = mag * fastSin(wrapPhase(pha + HALF_PI));
+        aPhase[i]       = mag * fastSin(pha);
     }
 }
 
-void FFTFilterInstance::magFreq2MagPhase(float* aFFTBuffer,
-                                         size_t aSamples,
+void FFTFilterInstance::magPhase2MagFreq(float* aPhase,
+                                         size_t aBins,
                                          float  aSamplerate,
                                          size_t aChannel)
 {
-    const float stepsize   = aSamples / aSamplerate;
-    const float expct      = (stepsize / aSamples) * 2.0f * float(M_PI);
-    const float freqPerBin = aSamplerate / aSamples;
+    // Phase advance of bin i over one hop is i * expct
+    const float osamp      = float(mWindowSize) / float(mHopSize);
+    const float expct      = TWO_PI / osamp;
+    const float freqPerBin = aSamplerate / float(mWindowSize);
+    float*      lastPhase  = mLastPhase.get() + aChannel * (mWindowSize / 2);
 
-    for (size_t i = 0; i < aSamples; ++i)
+    for (size_t i = 0; i < aBins; ++i)
     {
-        /* get magnitude and true frequency from synthesis arrays */
-        float mag  = aFFTBuffer[i * 2];
-        float freq = aFFTBuffer[i * 2 + 1];
-
-        /* subtract bin mid frequency */
-        freq -= float(i) * freqPerBin;
-
-        /* get bin deviation from freq deviation */
-        freq /= freqPerBin;
-
-        /* take osamp into account */
-        freq = (freq / aSamples) * (float)M_PI * 2.0f;
-
-        /* add the overlap phase advance back in */
-        freq += float(i) * expct;
-
-        /* accumulate delta phase to get bin phase */
-
-        mSumPhase[i + aChannel * STFT_WINDOW_SIZE] += freq;
-        aFFTBuffer[i * 2 + 1] = mSumPhase[i + aChannel * STFT_WINDOW_SIZE];
+        // The deviation from the expected phase advance gives the true frequency
+        const float delta = wrapPhase(aPhase[i] - lastPhase[i] - float(i) * expct);
+        lastPhase[i]      = aPhase[i];
+        aPhase[i]         = (float(i) + delta * osamp * INV_TWO_PI) * freqPerBin;
     }
 }
 
-void FFTFilterInstance::magPhase2Comp(float* aFFTBuffer, size_t aSamples)
+void FFTFilterInstance::magFreq2MagPhase(float* aFrequency,
+                                         size_t aBins,
+                                         float  aSamplerate,
+                                         size_t aChannel)
 {
-    for (size_t i = 0; i < aSamples; ++i)
+    const float phasePerHz = TWO_PI * float(mHopSize) / aSamplerate;
+    float*      sumPhase   = mSumPhase.get() + aChannel * (mWindowSize / 2);
+
+    for (size_t i = 0; i < aBins; ++i)
     {
-        float mag             = aFFTBuffer[i * 2];
-        float pha             = aFFTBuffer[i * 2 + 1];
-        aFFTBuffer[i * 2]     = cos(pha) * mag;
-        aFFTBuffer[i * 2 + 1] = sin(pha) * mag;
+        sumPhase[i]   = wrapPhase(sumPhase[i] + aFrequency[i] * phasePerHz);
+        aFrequency[i] = sumPhase[i];
     }
 }
 
-void FFTFilterInstance::fftFilterChannel(float* aFFTBuffer,
-                                         size_t aSamples,
-                                         float  aSamplerate,
-                                         time_t /*aTime*/,
-                                         size_t aChannel,
-                                         size_t /*aChannels*/)
+void FFTFilterInstance::fftFilter(float* aReal,
+                                  float* aImag,
+                                  size_t aBins,
+                                  size_t aStride,
+                                  size_t aChannels,
+                                  float  aSamplerate,
+                                  time_t /*aTime*/)
 {
-    comp2MagPhase(aFFTBuffer, aSamples);
-    magPhase2MagFreq(aFFTBuffer, aSamples, aSamplerate, aChannel);
+    // The time domain frame isn't needed until the inverse transforms
+    float* t = mSpectrum.get() + mWindowSize * aChannels;
 
-    float t[STFT_WINDOW_TWICE];
-    memcpy(t, aFFTBuffer, sizeof(float) * aSamples);
-    memset(aFFTBuffer, 0, sizeof(float) * aSamples * 2);
-
-    for (size_t i = 0; i < aSamples / 4; ++i)
+    for (size_t j = 0; j < aChannels; ++j)
     {
-        if (const size_t d = i * 2; d < aSamples / 4)
+        float* mag = aReal + j * aStride;
+        float* pha = aImag + j * aStride;
+
+        // No phase for the Nyquist bin, which is left out
+        pha[0] = 0;
+
+        comp2MagPhase(mag, pha, aBins);
+        magPhase2MagFreq(pha, aBins, aSamplerate, j);
+
+        memcpy(t, mag, sizeof(float) * aBins);
+        memcpy(t + aBins, pha, sizeof(float) * aBins);
+        memset(mag, 0, sizeof(float) * aBins);
+        memset(pha, 0, sizeof(float) * aBins);
+
+        for (size_t i = 0; i < aBins / 8; ++i)
         {
-            aFFTBuffer[d * 2] += t[i * 2];
-            aFFTBuffer[d * 2 + 1] = t[i * 2 + 1] * 2;
+            mag[i * 2] += t[i];
+            pha[i * 2] = t[aBins + i] * 2;
         }
+
+        magFreq2MagPhase(pha, aBins, aSamplerate, j);
+        magPhase2Comp(mag, pha, aBins);
     }
+}
 
-    magFreq2MagPhase(aFFTBuffer, aSamples, aSamplerate, aChannel);
-    magPhase2Comp(aFFTBuffer, aSamples);
+time_t FFTFilterInstance::getTailLength(float aSamplerate)
+{
+    // Samples still in flight in the input and overlap-add buffers
+    return double(mWindowSize * 2) / aSamplerate;
+}
+
+void FFTFilter::setParams(size_t aWindowSize, size_t aHopSize)
+{
+    clampSizes(aWindowSize, aHopSize);
+    mWindowSize = aWindowSize;
+    mHopSize    = aHopSize;
 }
 
 std::shared_ptr<FilterInstance> FFTFilter::createInstance()
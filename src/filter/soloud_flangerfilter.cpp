@@ -21,24 +21,26 @@ freely, subject to the following restrictions:
    3. This notice may not be removed or altered from any source
    distribution.
 */
+#include "soloud_delayline.hpp"
 #include "soloud_filter.hpp"
-#include <cstring>
+#include <algorithm>
+#include <cmath>
 
 namespace SoLoud
 {
 FlangerFilterInstance::FlangerFilterInstance(FlangerFilter* aParent)
+    : mLine(std::make_unique<DelayLine>())
+    , mLfo(std::make_unique<Lfo>())
 {
-    mParent       = aParent;
-    mBuffer       = 0;
-    mBufferLength = 0;
-    mOffset       = 0;
-    mIndex        = 0;
+    mParent = aParent;
     FilterInstance::initParams(3);
     mParam[FlangerFilter::WET]   = 1;
     mParam[FlangerFilter::FREQ]  = mParent->mFreq;
     mParam[FlangerFilter::DELAY] = mParent->mDelay;
 }
 
+FlangerFilterInstance::~FlangerFilterInstance() = default;
+
 void FlangerFilterInstance::filter(float* aBuffer,
                                    size_t aSamples,
                                    size_t aBufferSize,
@@ -48,33 +50,42 @@ void FlangerFilterInstance::filter(float* aBuffer,
 {
     updateParams(aTime);
 
-    if (mBufferLength < mParam[FlangerFilter::DELAY] * aSamplerate)
+    // The block is written before it's read back delayed. The interpolator looks two samples past
+    // the delayed position, so the delay never goes below two samples.
+    const float maxdelay = std::max(mParam[FlangerFilter::DELAY] * aSamplerate, 2.0f);
+    mLine->reserve(aChannels, aSamples + size_t(ceil(maxdelay)));
+    mLine->write(aBuffer, aSamples, aBufferSize);
+
+    mDelay.resize(std::max(mDelay.size(), aSamples));
+    mDelayed.resize(std::max(mDelayed.size(), aSamples * aChannels));
+
+    // The delay sweeps between 0 and the maximum, following a cosine
+    mLfo->setFrequency(mParam[FlangerFilter::FREQ], aSamplerate);
+    mLfo->generate(mDelay.data(), aSamples);
+    for (size_t i = 0; i < aSamples; ++i)
     {
-        mBufferLength = int(ceil(mParam[FlangerFilter::DELAY] * aSamplerate));
-        mBuffer       = std::make_unique<float[]>(mBufferLength * aChannels);
+        const float delay = std::max(0.5f * maxdelay * (1.0f + mDelay[i]), 2.0f);
+        mDelay[i]         = float(aSamples) + delay;
     }
 
-    const int    maxsamples = int(ceil(mParam[FlangerFilter::DELAY] * aSamplerate));
-    const double inc        = mParam[FlangerFilter::FREQ] * M_PI * 2 / aSamplerate;
-    for (size_t i = 0; i < aChannels; ++i)
+    mLine->readInterpolated(mDelayed.data(), aSamples, aSamples, mDelay.data());
+
+    const float wet = mParam[FlangerFilter::WET];
+    for (size_t c = 0; c < aChannels; ++c)
     {
-        const auto mbofs = i * mBufferLength;
-        auto       abofs = i * aBufferSize;
-        for (size_t j = 0; j < aSamples; ++j, ++abofs)
+        float*       x       = aBuffer + c * aBufferSize;
+        const float* delayed = mDelayed.data() + c * aSamples;
+        for (size_t i = 0; i < aSamples; ++i)
         {
-            const auto delay = int(floor(maxsamples * (1 + cos(mIndex)))) / 2;
-            mIndex += inc;
-            mBuffer[mbofs + mOffset % mBufferLength] = aBuffer[abofs];
-            const auto n =
-                0.5f * (aBuffer[abofs] +
-                        mBuffer[mbofs + (mBufferLength - delay + mOffset) % mBufferLength]);
-            mOffset++;
-            aBuffer[abofs] += (n - aBuffer[abofs]) * mParam[FlangerFilter::WET];
+            const float n = 0.5f * (x[i] + delayed[i]);
+            x[i] += (n - x[i]) * wet;
         }
-        mOffset -= aSamples;
     }
-    mOffset += aSamples;
-    mOffset %= mBufferLength;
+}
+time_t FlangerFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    // No feedback; the delay line just has to run empty
+    return mParam[FlangerFilter::DELAY];
 }
 
 FlangerFilter::FlangerFilter()
@@ -23,6 +23,16 @@ freely, subject to the following restrictions:
 */
 
 #include "soloud_filter.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#ifdef SOLOUD_SSE_INTRINSICS
+#include <xmmintrin.h>
+#endif
 
 namespace SoLoud
 {
@@ -32,59 +42,25 @@ namespace FreeverbImpl
 // which was placed in public domain. The code was massaged quite a bit by
 // Jari Komppa, result in the license listed at top of this file.
 
-class Comb
-{
-  public:
-    void  setbuffer(float* aBuf, int aSize);
-    float process(float aInp);
-    void  mute();
-    void  setdamp(float val);
-    void  setfeedback(float val);
-
-    float  mFeedback    = 0.0f;
-    float  mFilterstore = 0.0f;
-    float  mDamp1       = 0.0f;
-    float  mDamp2       = 0.0f;
-    float* mBuffer      = nullptr;
-    int    mBufsize     = 0;
-    int    mBufidx      = 0;
-};
-
-class Allpass
-{
-  public:
-    Allpass();
-    void   setbuffer(float* aBuf, int aSize);
-    float  process(float aInp);
-    void   mute();
-    void   setfeedback(float aVal);
-    float  mFeedback;
-    float* mBuffer;
-    int    mBufsize;
-    int    mBufidx;
-};
-
-static constexpr int   gNumcombs     = 8;
-static constexpr int   gNumallpasses = 4;
-static constexpr float gMuted        = 0;
-static constexpr float gFixedgain    = 0.015f;
-static constexpr float gScalewet     = 3;
-static constexpr float gScaledry     = 2;
-static constexpr float gScaledamp    = 0.4f;
-static constexpr float gScaleroom    = 0.28f;
-static constexpr float gOffsetroom   = 0.7f;
-static constexpr float gInitialroom  = 0.5f;
-static constexpr float gInitialdamp  = 0.5f;
-static constexpr float gInitialwet   = 1 / gScalewet;
-static constexpr float gInitialdry   = 0;
-static constexpr float gInitialwidth = 1;
-static constexpr float gInitialmode  = 0;
-static constexpr float gFreezemode   = 0.5f;
-static constexpr int   gStereospread = 23;
-
-// These values assume 44.1KHz sample rate
-// they will probably be OK for 48KHz sample rate
-// but would need scaling for 96KHz (or other) sample rates.
+static constexpr size_t gNumcombs     = 8;
+static constexpr size_t gNumallpasses = 4;
+static constexpr float  gMuted        = 0;
+static constexpr float  gFixedgain    = 0.015f;
+static constexpr float  gScalewet     = 3;
+static constexpr float  gScaledry     = 2;
+static constexpr float  gScaledamp    = 0.4f;
+static constexpr float  gScaleroom    = 0.28f;
+static constexpr float  gOffsetroom   = 0.7f;
+static constexpr float  gInitialroom  = 0.5f;
+static constexpr float  gInitialdamp  = 0.5f;
+static constexpr float  gInitialwet   = 1 / gScalewet;
+static constexpr float  gInitialdry   = 0;
+static constexpr float  gInitialwidth = 1;
+static constexpr float  gInitialmode  = 0;
+static constexpr float  gFreezemode   = 0.5f;
+static constexpr int    gStereospread = 23;
+
+// These values assume 44.1KHz sample rate and are scaled to the actual one.
 // The values were obtained by listening tests.
 static constexpr int gCombtuningL1    = 1116;
 static constexpr int gCombtuningR1    = 1116 + gStereospread;
@@ -111,13 +87,70 @@ static constexpr int gAllpasstuningR3 = 341 + gStereospread;
 static constexpr int gAllpasstuningL4 = 225;
 static constexpr int gAllpasstuningR4 = 225 + gStereospread;
 
+static constexpr int gCombtuning[2][gNumcombs] = {
+    {gCombtuningL1,
+     gCombtuningL2,
+     gCombtuningL3,
+     gCombtuningL4,
+     gCombtuningL5,
+     gCombtuningL6,
+     gCombtuningL7,
+     gCombtuningL8},
+    {gCombtuningR1,
+     gCombtuningR2,
+     gCombtuningR3,
+     gCombtuningR4,
+     gCombtuningR5,
+     gCombtuningR6,
+     gCombtuningR7,
+     gCombtuningR8},
+};
+
+static constexpr int gAllpasstuning[2][gNumallpasses] = {
+    {gAllpasstuningL1, gAllpasstuningL2, gAllpasstuningL3, gAllpasstuningL4},
+    {gAllpasstuningR1, gAllpasstuningR2, gAllpasstuningR3, gAllpasstuningR4},
+};
+
+// Longest run of samples processed at once. Every delay is at least as long as a run, so within a
+// run the delay lines are only read where they were written by earlier runs.
+static constexpr size_t gMaxRun = 128;
+
+// Circular delay line in the shared memory of a model
+struct Line
+{
+    float* mBuffer = nullptr;
+    size_t mSize   = 0;
+    size_t mIndex  = 0;
+
+    // Samples until the index wraps
+    size_t remaining() const
+    {
+        return mSize - mIndex;
+    }
+
+    void advance(size_t aSamples)
+    {
+        mIndex += aSamples;
+        if (mIndex == mSize)
+        {
+            mIndex = 0;
+        }
+    }
+};
+
+// The model works on runs of samples rather than single ones. The combs and the allpasses only
+// read samples older than the run, so apart from the damping lowpass of each comb their work has
+// no dependency between samples of a run. The combs of both sides are processed four at a time
+// in SIMD lanes, and the allpasses a run at a time.
 class Revmodel
 {
   public:
     Revmodel();
 
+    // Size the delay lines for the sample rate, in one allocation, and clear them.
+    void setSamplerate(float aSamplerate);
     void mute();
-    void process(float* aSampleData, long aNumSamples, long aStride);
+    void process(float* aSampleData, size_t aNumSamples, size_t aStride);
     void setroomsize(float aValue);
     void setdamp(float aValue);
     void setwet(float aValue);
@@ -126,217 +159,271 @@ class Revmodel
     void setmode(float aValue);
     void update();
 
-    float mGain;
-    float mRoomsize, mRoomsize1;
-    float mDamp, mDamp1;
-    float mWet, mWet1, mWet2;
-    float mDry;
-    float mWidth;
-    float mMode;
-
-    int mDirty;
-
-    // The following are all declared inline
-    // to remove the need for dynamic allocation
-    // with its subsequent error-checking messiness
-
-    // Comb filters
-    Comb mCombL[gNumcombs];
-    Comb mCombR[gNumcombs];
-
-    // Allpass filters
-    Allpass mAllpassL[gNumallpasses];
-    Allpass mAllpassR[gNumallpasses];
-
-    // Buffers for the combs
-    float mBufcombL1[gCombtuningL1];
-    float mBufcombR1[gCombtuningR1];
-    float mBufcombL2[gCombtuningL2];
-    float mBufcombR2[gCombtuningR2];
-    float mBufcombL3[gCombtuningL3];
-    float mBufcombR3[gCombtuningR3];
-    float mBufcombL4[gCombtuningL4];
-    float mBufcombR4[gCombtuningR4];
-    float mBufcombL5[gCombtuningL5];
-    float mBufcombR5[gCombtuningR5];
-    float mBufcombL6[gCombtuningL6];
-    float mBufcombR6[gCombtuningR6];
-    float mBufcombL7[gCombtuningL7];
-    float mBufcombR7[gCombtuningR7];
-    float mBufcombL8[gCombtuningL8];
-    float mBufcombR8[gCombtuningR8];
-
-    // Buffers for the allpasses
-    float mBufallpassL1[gAllpasstuningL1];
-    float mBufallpassR1[gAllpasstuningR1];
-    float mBufallpassL2[gAllpasstuningL2];
-    float mBufallpassR2[gAllpasstuningR2];
-    float mBufallpassL3[gAllpasstuningL3];
-    float mBufallpassR3[gAllpasstuningR3];
-    float mBufallpassL4[gAllpasstuningL4];
-    float mBufallpassR4[gAllpasstuningR4];
+    // Length of the longest comb and the sum of the allpass lengths of one side, in samples
+    size_t longestComb() const;
+    size_t allpassLength() const;
+
+    float mSamplerate = 0.0f;
+    float mGain       = 0.0f;
+    float mRoomsize   = 0.0f;
+    float mRoomsize1  = 0.0f;
+    float mDamp       = 0.0f;
+    float mDamp1      = 0.0f;
+    float mWet        = 0.0f;
+    float mWet1       = 0.0f;
+    float mWet2       = 0.0f;
+    float mDry        = 0.0f;
+    float mWidth      = 0.0f;
+    float mMode       = 0.0f;
+
+    int mDirty = 1;
+
+  private:
+    void processCombs(size_t aFirst, const float* aInput, float* aOutput, size_t aSamples);
+    void processAllpass(Line& aLine, float* aData, size_t aSamples);
+
+    // Combs of the left side followed by the ones of the right side, and their lowpass states
+    std::array<Line, 2 * gNumcombs>  mComb;
+    std::array<float, 2 * gNumcombs> mFilterstore{};
+
+    std::array<Line, 2 * gNumallpasses> mAllpass;
+
+    std::vector<float> mMemory;
+    size_t             mRun = 0;
+
+    // Comb input and the outputs of the two sides for the current run
+    std::array<float, gMaxRun> mInput{};
+    std::array<float, gMaxRun> mOutL{};
+    std::array<float, gMaxRun> mOutR{};
 };
 
-Allpass::Allpass()
+static constexpr float gAllpassfeedback = 0.5f;
+
+Revmodel::Revmodel()
 {
-    mBufidx   = 0;
-    mFeedback = 0;
-    mBuffer   = 0;
-    mBufsize  = 0;
+    setwet(gInitialwet);
+    setroomsize(gInitialroom);
+    setdry(gInitialdry);
+    setdamp(gInitialdamp);
+    setwidth(gInitialwidth);
+    setmode(gInitialmode);
 }
 
-float Allpass::process(float aInput)
+void Revmodel::setSamplerate(float aSamplerate)
 {
-    float output;
-    float bufout;
+    mSamplerate = aSamplerate;
 
-    bufout = mBuffer[mBufidx];
+    const double scale = aSamplerate / 44'100.0;
+    const auto   tuned = [scale](int aTuning) {
+        return std::max(size_t(lround(aTuning * scale)), size_t(1));
+    };
 
-    output           = -aInput + bufout;
-    mBuffer[mBufidx] = aInput + (bufout * mFeedback);
+    size_t total = 0;
+    for (size_t side = 0; side < 2; ++side)
+    {
+        for (size_t i = 0; i < gNumcombs; ++i)
+        {
+            total += tuned(gCombtuning[side][i]);
+        }
+        for (size_t i = 0; i < gNumallpasses; ++i)
+        {
+            total += tuned(gAllpasstuning[side][i]);
+        }
+    }
 
-    if (++mBufidx >= mBufsize)
-        mBufidx = 0;
+    mMemory.assign(total, 0.0f);
+    mRun = gMaxRun;
 
-    return output;
-}
+    float* memory = mMemory.data();
+    for (size_t side = 0; side < 2; ++side)
+    {
+        for (size_t i = 0; i < gNumcombs; ++i)
+        {
+            auto& line = mComb[side * gNumcombs + i];
+            line       = {memory, tuned(gCombtuning[side][i]), 0};
+            memory += line.mSize;
+            mRun = std::min(mRun, line.mSize);
+        }
+        for (size_t i = 0; i < gNumallpasses; ++i)
+        {
+            auto& line = mAllpass[side * gNumallpasses + i];
+            line       = {memory, tuned(gAllpasstuning[side][i]), 0};
+            memory += line.mSize;
+            mRun = std::min(mRun, line.mSize);
+        }
+    }
 
-void Allpass::setbuffer(float* aBuf, int aSize)
-{
-    mBuffer  = aBuf;
-    mBufsize = aSize;
+    mFilterstore = {};
 }
 
-void Allpass::mute()
+void Revmodel::mute()
 {
-    for (int i = 0; i < mBufsize; ++i)
-        mBuffer[i] = 0;
-}
+    if (mMode >= gFreezemode)
+        return;
 
-void Allpass::setfeedback(float aVal)
-{
-    mFeedback = aVal;
+    std::ranges::fill(mMemory, 0.0f);
+    mFilterstore = {};
 }
 
-float Comb::process(float aInput)
+size_t Revmodel::longestComb() const
 {
-    float output;
-
-    output = mBuffer[mBufidx];
-
-    mFilterstore = (output * mDamp2) + (mFilterstore * mDamp1);
-
-    mBuffer[mBufidx] = aInput + (mFilterstore * mFeedback);
-
-    if (++mBufidx >= mBufsize)
-        mBufidx = 0;
-
-    return output;
+    return mComb[2 * gNumcombs - 1].mSize;
 }
 
-void Comb::setbuffer(float* aBuf, int aSize)
+size_t Revmodel::allpassLength() const
 {
-    mBuffer  = aBuf;
-    mBufsize = aSize;
+    size_t length = 0;
+    for (size_t i = 0; i < gNumallpasses; ++i)
+    {
+        length += mAllpass[gNumallpasses + i].mSize;
+    }
+    return length;
 }
 
-void Comb::mute()
+void Revmodel::processCombs(size_t aFirst, const float* aInput, float* aOutput, size_t aSamples)
 {
-    for (int i = 0; i < mBufsize; ++i)
-        mBuffer[i] = 0;
-}
+    // Each comb outputs its delayed sample, feeds it through a one pole lowpass and writes the
+    // input plus the scaled lowpass output back
+    Line* line = mComb.data() + aFirst;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+    const __m128 damp1    = _mm_set1_ps(mDamp1);
+    const __m128 damp2    = _mm_set1_ps(1 - mDamp1);
+    const __m128 feedback = _mm_set1_ps(mRoomsize1);
+    __m128       store    = _mm_loadu_ps(mFilterstore.data() + aFirst);
+
+    size_t i = 0;
+    while (i < aSamples)
+    {
+        size_t run = aSamples - i;
+        for (size_t k = 0; k < 4; ++k)
+        {
+            run = std::min(run, line[k].remaining());
+        }
 
-void Comb::setdamp(float aVal)
-{
-    mDamp1 = aVal;
-    mDamp2 = 1 - aVal;
-}
+        float* p[4];
+        for (size_t k = 0; k < 4; ++k)
+        {
+            p[k] = line[k].mBuffer + line[k].mIndex;
+        }
 
-void Comb::setfeedback(float aVal)
-{
-    mFeedback = aVal;
-}
+        size_t j = 0;
+        for (; j + 4 <= run; j += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(p[0] + j);
+            __m128 r1 = _mm_loadu_ps(p[1] + j);
+            __m128 r2 = _mm_loadu_ps(p[2] + j);
+            __m128 r3 = _mm_loadu_ps(p[3] + j);
+
+            const __m128 sum = _mm_add_ps(_mm_add_ps(r0, r1), _mm_add_ps(r2, r3));
+            _mm_storeu_ps(aOutput + i + j, _mm_add_ps(_mm_loadu_ps(aOutput + i + j), sum));
+
+            // One vector per sample, with a lane per comb
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            __m128* rows[4] = {&r0, &r1, &r2, &r3};
+            for (size_t t = 0; t < 4; ++t)
+            {
+                store = _mm_add_ps(_mm_mul_ps(*rows[t], damp2), _mm_mul_ps(store, damp1));
+                *rows[t] =
+                    _mm_add_ps(_mm_set1_ps(aInput[i + j + t]), _mm_mul_ps(store, feedback));
+            }
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            _mm_storeu_ps(p[0] + j, r0);
+            _mm_storeu_ps(p[1] + j, r1);
+            _mm_storeu_ps(p[2] + j, r2);
+            _mm_storeu_ps(p[3] + j, r3);
+        }
 
-Revmodel::Revmodel()
-{
-    mGain      = 0;
-    mRoomsize  = 0;
-    mRoomsize1 = 0;
-    mDamp      = 0;
-    mDamp1     = 0;
-    mWet       = 0;
-    mWet1      = 0;
-    mWet2      = 0;
-    mDry       = 0;
-    mWidth     = 0;
-    mMode      = 0;
+        for (; j < run; ++j)
+        {
+            const __m128 out = _mm_setr_ps(p[0][j], p[1][j], p[2][j], p[3][j]);
+            store            = _mm_add_ps(_mm_mul_ps(out, damp2), _mm_mul_ps(store, damp1));
+
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, out);
+            aOutput[i + j] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+            const __m128 in = _mm_set1_ps(aInput[i + j]);
+            _mm_store_ps(lanes, _mm_add_ps(in, _mm_mul_ps(store, feedback)));
+            for (size_t k = 0; k < 4; ++k)
+            {
+                p[k][j] = lanes[k];
+            }
+        }
 
-    mDirty = 1;
+        for (size_t k = 0; k < 4; ++k)
+        {
+            line[k].advance(run);
+        }
+        i += run;
+    }
 
-    // Tie the components to their buffers
-    mCombL[0].setbuffer(mBufcombL1, gCombtuningL1);
-    mCombR[0].setbuffer(mBufcombR1, gCombtuningR1);
-    mCombL[1].setbuffer(mBufcombL2, gCombtuningL2);
-    mCombR[1].setbuffer(mBufcombR2, gCombtuningR2);
-    mCombL[2].setbuffer(mBufcombL3, gCombtuningL3);
-    mCombR[2].setbuffer(mBufcombR3, gCombtuningR3);
-    mCombL[3].setbuffer(mBufcombL4, gCombtuningL4);
-    mCombR[3].setbuffer(mBufcombR4, gCombtuningR4);
-    mCombL[4].setbuffer(mBufcombL5, gCombtuningL5);
-    mCombR[4].setbuffer(mBufcombR5, gCombtuningR5);
-    mCombL[5].setbuffer(mBufcombL6, gCombtuningL6);
-    mCombR[5].setbuffer(mBufcombR6, gCombtuningR6);
-    mCombL[6].setbuffer(mBufcombL7, gCombtuningL7);
-    mCombR[6].setbuffer(mBufcombR7, gCombtuningR7);
-    mCombL[7].setbuffer(mBufcombL8, gCombtuningL8);
-    mCombR[7].setbuffer(mBufcombR8, gCombtuningR8);
-    mAllpassL[0].setbuffer(mBufallpassL1, gAllpasstuningL1);
-    mAllpassR[0].setbuffer(mBufallpassR1, gAllpasstuningR1);
-    mAllpassL[1].setbuffer(mBufallpassL2, gAllpasstuningL2);
-    mAllpassR[1].setbuffer(mBufallpassR2, gAllpasstuningR2);
-    mAllpassL[2].setbuffer(mBufallpassL3, gAllpasstuningL3);
-    mAllpassR[2].setbuffer(mBufallpassR3, gAllpasstuningR3);
-    mAllpassL[3].setbuffer(mBufallpassL4, gAllpasstuningL4);
-    mAllpassR[3].setbuffer(mBufallpassR4, gAllpasstuningR4);
-
-    // Set default values
-    mAllpassL[0].setfeedback(0.5f);
-    mAllpassR[0].setfeedback(0.5f);
-    mAllpassL[1].setfeedback(0.5f);
-    mAllpassR[1].setfeedback(0.5f);
-    mAllpassL[2].setfeedback(0.5f);
-    mAllpassR[2].setfeedback(0.5f);
-    mAllpassL[3].setfeedback(0.5f);
-    mAllpassR[3].setfeedback(0.5f);
-    setwet(gInitialwet);
-    setroomsize(gInitialroom);
-    setdry(gInitialdry);
-    setdamp(gInitialdamp);
-    setwidth(gInitialwidth);
-    setmode(gInitialmode);
+    _mm_storeu_ps(mFilterstore.data() + aFirst, store);
+#else
+    const float damp1 = mDamp1;
+    const float damp2 = 1 - mDamp1;
 
-    // Buffer will be full of rubbish - so we MUST mute them
-    mute();
+    for (size_t k = 0; k < 4; ++k)
+    {
+        float store = mFilterstore[aFirst + k];
+        size_t i     = 0;
+        while (i < aSamples)
+        {
+            const size_t run = std::min(aSamples - i, line[k].remaining());
+            float*       p   = line[k].mBuffer + line[k].mIndex;
+
+            for (size_t j = 0; j < run; ++j)
+            {
+                const float out = p[j];
+                store           = out * damp2 + store * damp1;
+                p[j]            = aInput[i + j] + store * mRoomsize1;
+                aOutput[i + j] += out;
+            }
+
+            line[k].advance(run);
+            i += run;
+        }
+        mFilterstore[aFirst + k] = store;
+    }
+#endif
 }
 
-void Revmodel::mute()
+void Revmodel::processAllpass(Line& aLine, float* aData, size_t aSamples)
 {
-    if (mMode >= gFreezemode)
-        return;
-
-    for (int i = 0; i < gNumcombs; ++i)
-    {
-        mCombL[i].mute();
-        mCombR[i].mute();
-    }
-    for (int i = 0; i < gNumallpasses; ++i)
+    size_t i = 0;
+    while (i < aSamples)
     {
-        mAllpassL[i].mute();
-        mAllpassR[i].mute();
+        const size_t run = std::min(aSamples - i, aLine.remaining());
+        float*       p   = aLine.mBuffer + aLine.mIndex;
+        float*       x   = aData + i;
+        size_t       j   = 0;
+
+#ifdef SOLOUD_SSE_INTRINSICS
+        const __m128 feedback = _mm_set1_ps(gAllpassfeedback);
+        for (; j + 4 <= run; j += 4)
+        {
+            const __m128 in     = _mm_loadu_ps(x + j);
+            const __m128 bufout = _mm_loadu_ps(p + j);
+            _mm_storeu_ps(x + j, _mm_sub_ps(bufout, in));
+            _mm_storeu_ps(p + j, _mm_add_ps(in, _mm_mul_ps(bufout, feedback)));
+        }
+#endif
+
+        for (; j < run; ++j)
+        {
+            const float in     = x[j];
+            const float bufout = p[j];
+            x[j]               = bufout - in;
+            p[j]               = in + bufout * gAllpassfeedback;
+        }
+
+        aLine.advance(run);
+        i += run;
     }
 }
 
-void Revmodel::process(float* aSampleData, long aNumSamples, long aStride)
+void Revmodel::process(float* aSampleData, size_t aNumSamples, size_t aStride)
 {
     float* inputL = aSampleData;
     float* inputR = aSampleData + aStride;
@@ -348,33 +435,42 @@ void Revmodel::process(float* aSampleData, long aNumSamples, long aStride)
 
     mDirty = 0;
 
-    while (aNumSamples-- > 0)
+    while (aNumSamples > 0)
     {
-        auto outR  = 0.0f;
-        auto outL  = 0.0f;
-        auto input = (*inputL + *inputR) * mGain;
+        const size_t run = std::min(aNumSamples, mRun);
 
-        // Accumulate comb filters in parallel
-        for (int i = 0; i < gNumcombs; ++i)
+        for (size_t i = 0; i < run; ++i)
         {
-            outL += mCombL[i].process(input);
-            outR += mCombR[i].process(input);
+            mInput[i] = (inputL[i] + inputR[i]) * mGain;
         }
 
+        // Accumulate comb filters in parallel
+        std::fill_n(mOutL.data(), run, 0.0f);
+        std::fill_n(mOutR.data(), run, 0.0f);
+        processCombs(0, mInput.data(), mOutL.data(), run);
+        processCombs(4, mInput.data(), mOutL.data(), run);
+        processCombs(8, mInput.data(), mOutR.data(), run);
+        processCombs(12, mInput.data(), mOutR.data(), run);
+
         // Feed through allpasses in series
-        for (int i = 0; i < gNumallpasses; ++i)
+        for (size_t i = 0; i < gNumallpasses; ++i)
         {
-            outL = mAllpassL[i].process(outL);
-            outR = mAllpassR[i].process(outR);
+            processAllpass(mAllpass[i], mOutL.data(), run);
+            processAllpass(mAllpass[gNumallpasses + i], mOutR.data(), run);
         }
 
         // Calculate output REPLACING anything already there
-        *inputL = outL * mWet1 + outR * mWet2 + *inputL * mDry;
-        *inputR = outR * mWet1 + outL * mWet2 + *inputR * mDry;
+        for (size_t i = 0; i < run; ++i)
+        {
+            const float outL = mOutL[i];
+            const float outR = mOutR[i];
+            inputL[i]        = outL * mWet1 + outR * mWet2 + inputL[i] * mDry;
+            inputR[i]        = outR * mWet1 + outL * mWet2 + inputR[i] * mDry;
+        }
 
-        // Increment sample pointers, allowing for interleave (if any)
-        inputL++;
-        inputR++;
+        inputL += run;
+        inputR += run;
+        aNumSamples -= run;
     }
 }
 
@@ -397,18 +493,6 @@ void Revmodel::update()
         mDamp1     = mDamp;
         mGain      = gFixedgain;
     }
-
-    for (int i = 0; i < gNumcombs; ++i)
-    {
-        mCombL[i].setfeedback(mRoomsize1);
-        mCombR[i].setfeedback(mRoomsize1);
-    }
-
-    for (int i = 0; i < gNumcombs; ++i)
-    {
-        mCombL[i].setdamp(mDamp1);
-        mCombR[i].setdamp(mDamp1);
-    }
 }
 
 void Revmodel::setroomsize(float aValue)
@@ -471,6 +555,14 @@ void FreeverbFilterInstance::filter(float* aBuffer,
 {
     assert(aChannels == 2); // Only stereo supported at this time
 
+    // The delay memory is only allocated once the instance plays, at the rate it plays at
+    if (aSamplerate != mModel->mSamplerate)
+    {
+        mModel->setSamplerate(aSamplerate);
+    }
+
+    updateParams(aTime);
+
     if (mParamChanged)
     {
         mModel->setdamp(mParam[DAMP]);
@@ -485,6 +577,37 @@ void FreeverbFilterInstance::filter(float* aBuffer,
     mModel->process(aBuffer, aSamples, aBufferSize);
 }
 
+time_t FreeverbFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    using namespace FreeverbImpl;
+
+    if (mParam[FREEZE] >= gFreezemode)
+    {
+        return std::numeric_limits<time_t>::infinity();
+    }
+
+    // The longest comb decays by its feedback once per loop, then the allpasses smear the result.
+    // Damping only makes the decay faster.
+    const double feedback = mParam[ROOMSIZE] * gScaleroom + gOffsetroom;
+    if (feedback >= 1)
+    {
+        return std::numeric_limits<time_t>::infinity();
+    }
+
+    const double loops = feedback > 0 ? ceil(log(SILENCE_THRESHOLD) / log(feedback)) : 1;
+    const double allpassLoops = ceil(log(SILENCE_THRESHOLD) / log(0.5));
+
+    // The delays scale with the sample rate, so the tail is about the same length at any rate.
+    // Until the model has been sized, go by the tuning at 44.1 kHz.
+    const bool   sized = mModel->mSamplerate > 0;
+    const double comb  = sized ? double(mModel->longestComb()) : gCombtuningR8;
+    const double allpass =
+        sized ? double(mModel->allpassLength())
+              : gAllpasstuningR1 + gAllpasstuningR2 + gAllpasstuningR3 + gAllpasstuningR4;
+
+    return (loops * comb + allpassLoops * allpass) / (sized ? mModel->mSamplerate : 44'100.0);
+}
+
 std::shared_ptr<FilterInstance> FreeverbFilter::createInstance()
 {
     return std::make_shared<FreeverbFilterInstance>(this);
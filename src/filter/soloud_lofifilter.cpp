@@ -63,6 +63,12 @@ void LofiFilterInstance::filterChannel(float* aBuffer,
     }
 }
 
+time_t LofiFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    // A held sample lasts one period of the reduced sample rate
+    return mParam[SAMPLERATE] > 0 ? 1.0 / mParam[SAMPLERATE] : 0.0;
+}
+
 std::shared_ptr<FilterInstance> LofiFilter::createInstance()
 {
     return std::make_shared<LofiFilterInstance>(this);
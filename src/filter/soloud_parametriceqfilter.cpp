@@ -0,0 +1,144 @@
+/*
+SoLoud audio engine
+Copyright (c) 2013-2020 Jari Komppa
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include "soloud_biquad.hpp"
+#include "soloud_filter.hpp"
+#include <cassert>
+#include <cmath>
+
+namespace SoLoud
+{
+ParametricEqFilterInstance::ParametricEqFilterInstance(ParametricEqFilter* aParent)
+    : mParent(aParent)
+    , mBandCount(aParent->mBandCount)
+    , mCascade(std::make_unique<Biquad::Cascade>(aParent->mBandCount))
+{
+    FilterInstance::initParams(int(ParametricEqFilter::bandAttribute(mBandCount, 0)));
+
+    for (size_t b = 0; b < mBandCount; ++b)
+    {
+        const auto& band = aParent->mBand[b];
+
+        mParam[ParametricEqFilter::bandAttribute(b, ParametricEqFilter::TYPE)] = float(band.mType);
+        mParam[ParametricEqFilter::bandAttribute(b, ParametricEqFilter::FREQUENCY)] =
+            band.mFrequency;
+        mParam[ParametricEqFilter::bandAttribute(b, ParametricEqFilter::GAIN)] = band.mGain;
+        mParam[ParametricEqFilter::bandAttribute(b, ParametricEqFilter::Q)]    = band.mQ;
+    }
+}
+
+ParametricEqFilterInstance::~ParametricEqFilterInstance() = default;
+
+void ParametricEqFilterInstance::calcBands()
+{
+    for (size_t b = 0; b < mBandCount; ++b)
+    {
+        const float* band = mParam.get() + ParametricEqFilter::bandAttribute(b, 0);
+
+        auto shape = Biquad::Shape::Peak;
+        switch (int(band[ParametricEqFilter::TYPE]))
+        {
+            case ParametricEqFilter::LOWSHELF: shape = Biquad::Shape::LowShelf; break;
+            case ParametricEqFilter::HIGHSHELF: shape = Biquad::Shape::HighShelf; break;
+            case ParametricEqFilter::LOWPASS: shape = Biquad::Shape::Lowpass; break;
+            case ParametricEqFilter::HIGHPASS: shape = Biquad::Shape::Highpass; break;
+            case ParametricEqFilter::BANDPASS: shape = Biquad::Shape::Bandpass; break;
+            case ParametricEqFilter::NOTCH: shape = Biquad::Shape::Notch; break;
+            default: break;
+        }
+
+        mCascade->setStage(b,
+                           Biquad::design(shape,
+                                          band[ParametricEqFilter::FREQUENCY],
+                                          band[ParametricEqFilter::Q],
+                                          band[ParametricEqFilter::GAIN],
+                                          mSamplerate));
+    }
+}
+
+void ParametricEqFilterInstance::filter(float* aBuffer,
+                                        size_t aSamples,
+                                        size_t aBufferSize,
+                                        size_t aChannels,
+                                        float  aSamplerate,
+                                        time_t aTime)
+{
+    updateParams(aTime);
+
+    if (aSamplerate != mSamplerate)
+    {
+        // Nothing to glide from at a new rate
+        mSamplerate = aSamplerate;
+        calcBands();
+        mCascade->reset();
+    }
+    else if (mParamChanged & ~size_t(1 << ParametricEqFilter::WET))
+    {
+        calcBands();
+    }
+    mParamChanged = 0;
+
+    mCascade->process(aBuffer, aSamples, aBufferSize, aChannels, mParam[ParametricEqFilter::WET]);
+}
+
+time_t ParametricEqFilterInstance::getTailLength(float aSamplerate)
+{
+    return mCascade->getTailLength(aSamplerate);
+}
+
+ParametricEqFilter::ParametricEqFilter(size_t aBands)
+    : mBandCount(aBands)
+{
+    assert(aBands > 0 && aBands <= MAX_BANDS);
+
+    for (size_t b = 0; b < mBandCount; ++b)
+    {
+        auto& band = mBand[b];
+
+        band.mFrequency = mBandCount > 1 ? float(100.0 * pow(80.0, b / double(mBandCount - 1)))
+                                         : 1000.0f;
+        band.mQ         = float(M_SQRT1_2);
+
+        if (mBandCount > 1 && b == 0)
+        {
+            band.mType = LOWSHELF;
+        }
+        else if (mBandCount > 1 && b == mBandCount - 1)
+        {
+            band.mType = HIGHSHELF;
+        }
+        else
+        {
+            band.mType = PEAK;
+            band.mQ    = 1.0f;
+        }
+    }
+}
+
+std::shared_ptr<FilterInstance> ParametricEqFilter::createInstance()
+{
+    return std::make_shared<ParametricEqFilterInstance>(this);
+}
+} // namespace SoLoud
@@ -55,6 +55,11 @@ void RobotizeFilterInstance::filterChannel(float* aBuffer,
     }
 }
 
+time_t RobotizeFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    return 0;
+}
+
 std::shared_ptr<FilterInstance> RobotizeFilter::createInstance()
 {
     return std::make_shared<RobotizeFilterInstance>(this);
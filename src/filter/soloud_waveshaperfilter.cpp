@@ -63,6 +63,11 @@ void WaveShaperFilterInstance::filterChannel(float* aBuffer,
     }
 }
 
+time_t WaveShaperFilterInstance::getTailLength(float /*aSamplerate*/)
+{
+    return 0;
+}
+
 std::shared_ptr<FilterInstance> WaveShaperFilter::createInstance()
 {
     return std::make_shared<WaveShaperFilterInstance>(this);